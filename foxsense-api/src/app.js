@@ -109,6 +109,13 @@ const server = app.listen(PORT, () => {
   console.log(`Environment: ${config.nodeEnv}`);
 });
 
+// 親機は1起床の設定取得と送信を同じ接続で行い、その間に子機の受信窓を挟む（窓150秒を時計の
+// 不確かさで前後に最大30秒ずつ広げ、窓が開くまでの待ちも入れて最大約240秒）。
+// Node の既定（keep-alive 5秒）ではその間に切れて張り直し（TLSハンドシェイク）になるので、それより長く保つ。
+// headersTimeout は keepAliveTimeout より長く、requestTimeout（既定300秒）より短くする
+server.keepAliveTimeout = 270 * 1000;
+server.headersTimeout = 275 * 1000;
+
 // グレースフルシャットダウン
 const gracefulShutdown = async (signal) => {
   console.log(`[Server] ${signal} received, shutting down gracefully`);
@@ -72,6 +72,10 @@ const config = {
     pass: process.env.SMTP_PASS,
     from: process.env.SMTP_FROM || 'noreply@foxsense.jp',
   },
+
+  // UDP送信(ingest)の受信側。保存まで行う本番のリスナーを置いた環境だけ true にする
+  // （false の間は親機を udp へ切り替えられず、設定応答も http を返す）
+  udpIngestEnabled: process.env.UDP_INGEST_ENABLED === 'true',
 };
 
 export default config;
@@ -1,4 +1,5 @@
 import * as adminService from './admin.service.js';
+import config from '../../config/index.js';
 import { asyncHandler } from '../../middleware/errorHandler.js';
 import { getAvailableSimsForAdmin } from '../soracom/soracom.service.js';
 
@@ -115,6 +116,21 @@ export const setAcEnabled = asyncHandler(async (req, res) => {
   res.json({ success: true, data: result });
 });
 
+// 送信経路 (http/udp) の個体別切替。親機は次の設定取得で反映
+export const setIngestTransport = asyncHandler(async (req, res) => {
+  const { deviceId } = req.params;
+  const { transport } = req.body;
+  if (transport !== 'http' && transport !== 'udp') {
+    return res.status(400).json({ success: false, message: 'transport must be "http" or "udp"' });
+  }
+  // 保存まで行うUDPリスナーが無い環境では切り替えない（ACKを受けた親機は送信済みとしてラウンドを捨てる）
+  if (transport === 'udp' && !config.udpIngestEnabled) {
+    return res.status(409).json({ success: false, message: 'UDP ingest listener is not configured (UDP_INGEST_ENABLED)' });
+  }
+  const result = await adminService.setIngestTransport(deviceId, transport);
+  res.json({ success: true, data: result });
+});
+
 export const createAcCommand = asyncHandler(async (req, res) => {
   const { deviceId } = req.params;
   const { mode, tempC } = req.body;
@@ -15,6 +15,7 @@ router.post('/users/:userId/coins', adminController.adjustUserCoins);
 // Devices
 router.get('/devices', adminController.getAllDevices);
 router.put('/devices/:deviceId/ac-enabled', adminController.setAcEnabled);
+router.put('/devices/:deviceId/transport', adminController.setIngestTransport);
 router.post('/devices/:deviceId/ac', adminController.createAcCommand);
 
 // Stats
@@ -317,6 +317,17 @@ export const setAcEnabled = async (deviceId, enabled) => {
   });
 };
 
+export const setIngestTransport = async (deviceId, transport) => {
+  const device = await prisma.parentDevice.findUnique({ where: { deviceId } });
+  if (!device) throw new AppError('Device not found', 404);
+
+  return prisma.parentDevice.update({
+    where: { deviceId },
+    data: { ingestTransport: transport },
+    select: { id: true, deviceId: true, name: true, ingestTransport: true },
+  });
+};
+
 export const createAcCommand = async (deviceId, mode, tempC) => {
   const VALID_MODES = ['COOL', 'HEAT', 'DRY', 'FAN', 'OFF'];
   if (!VALID_MODES.includes(mode)) throw new AppError('Invalid mode. Use COOL/HEAT/DRY/FAN', 400);
@@ -88,7 +88,12 @@ export const getDeviceConfig = asyncHandler(async (req, res) => {
     return res.status(400).json({ success: false, message: 'Secret is required' });
   }
 
-  const config = await devicesService.getDeviceConfig(deviceId, secret, fw);
+  const { config, etag } = await devicesService.getDeviceConfig(deviceId, secret, fw);
+  // 条件付き取得: 親機が保持するETagと一致すればボディ無しの304（fw申告の記録は上で済んでいる）
+  res.set('ETag', etag);
+  if (req.get('If-None-Match') === etag) {
+    return res.status(304).end();
+  }
   res.json({ success: true, data: config });
 });
 
@@ -1,4 +1,6 @@
+import crypto from 'crypto';
 import prisma from '../../config/db.js';
+import appConfig from '../../config/index.js';
 import { AppError } from '../../middleware/errorHandler.js';
 import { computeParentIdHash, hashToHex } from '../../utils/deviceHash.js';
 import { getSimByImsi, setSimName } from '../soracom/soracom.service.js';
@@ -285,6 +287,10 @@ export const deleteChildDevice = async (id, userId) => {
 
 // ===== Assignments (紐付け管理) =====
 
+// 親機1台あたりの子機（アクティブな紐付け）の上限。親機ファームの子機表 MAX_CHILD_DEVICES（src/config.h）と同じ値。
+// 親機は超過分を保持できないので、紐付けの時点で断る
+export const MAX_CHILDREN_PER_PARENT = 32;
+
 export const assignChildToParent = async (parentId, childId, userId) => {
   // 親機の所有確認
   const parent = await prisma.parentDevice.findFirst({ where: { id: parentId, userId } });
@@ -306,6 +312,12 @@ export const assignChildToParent = async (parentId, childId, userId) => {
     );
   }
 
+  // 親機の子機数の上限
+  const activeCount = await prisma.deviceAssignment.count({ where: { parentId, unassignedAt: null } });
+  if (activeCount >= MAX_CHILDREN_PER_PARENT) {
+    throw new AppError(`この親機に紐付けられる子機は${MAX_CHILDREN_PER_PARENT}台までです`, 409);
+  }
+
   return prisma.deviceAssignment.create({
     data: { parentId, childId },
     include: { parent: true, child: true },
@@ -342,25 +354,23 @@ export const getAssignmentHistory = async (childId, userId) => {
 
 // ===== Device Config (ファームウェア認証) =====
 
-export const getDeviceConfig = async (deviceId, secret, fwCode) => {
-  const device = await prisma.parentDevice.findUnique({
-    where: { deviceId },
-    include: {
-      assignments: {
-        where: { unassignedAt: null },
-        include: { child: true },
-        orderBy: { assignedAt: 'asc' },
-      },
+const findDeviceWithAssignments = (deviceId) => prisma.parentDevice.findUnique({
+  where: { deviceId },
+  include: {
+    assignments: {
+      where: { unassignedAt: null },
+      include: { child: true },
+      orderBy: { assignedAt: 'asc' },
     },
-  });
+  },
+});
+
+export const getDeviceConfig = async (deviceId, secret, fwCode) => {
+  const device = await findDeviceWithAssignments(deviceId);
 
   if (!device) throw new AppError('Device not found', 404);
   if (device.deviceSecret !== secret) throw new AppError('Invalid device secret', 401);
 
-  const parentIdHash = computeParentIdHash(deviceId);
-
-  // ===== LTE OTA: 稼働中バージョンの記録＋新版判定 =====
-  let firmware = null;
   const reported = fwCode != null ? Number(fwCode) : null;
   if (reported != null && !Number.isNaN(reported)) {
     // 稼働中バージョンを記録（可視化用）。列が無い旧DBでも落ちないようtry握り
@@ -370,7 +380,19 @@ export const getDeviceConfig = async (deviceId, secret, fwCode) => {
         data: { fwVersionCode: reported, fwReportedAt: new Date() },
       });
     } catch (e) { /* migration前などは無視 */ }
+  }
+
+  const config = await buildDeviceConfig(device, reported);
+  return { config, etag: `"${configEtag(config)}"` };
+};
 
+// 親機へ返す設定本体（子機リスト＋OTA新版判定）
+const buildDeviceConfig = async (device, reported) => {
+  const parentIdHash = computeParentIdHash(device.deviceId);
+
+  // ===== LTE OTA: 新版判定 =====
+  let firmware = null;
+  if (reported != null && !Number.isNaN(reported)) {
     // 配信対象の最新版（個体ピン留め targetFwCode があれば優先）
     try {
       const latest = await prisma.firmware.findFirst({
@@ -402,7 +424,8 @@ export const getDeviceConfig = async (deviceId, secret, fwCode) => {
     deviceId: device.deviceId,
     parentIdHash,
     parentIdHashHex: hashToHex(parentIdHash),
-    children: device.assignments.map((a, index) => ({
+    // 上限の導入前に紐付けた分があっても、親機が保持できる台数（古い紐付けから）だけ返す
+    children: device.assignments.slice(0, MAX_CHILDREN_PER_PARENT).map((a, index) => ({
       id: a.child.id,
       assignmentId: a.id,
       deviceId: a.child.deviceId,
@@ -412,6 +435,57 @@ export const getDeviceConfig = async (deviceId, secret, fwCode) => {
       name: a.child.name,
     })),
     firmware, // null=最新（デバイスは何もしない）
+    // 送信経路（親機 device_config.h）。UDPリスナーの無い環境では udp の親機にも http を返す
+    transport: device.ingestTransport === 'udp' && appConfig.udpIngestEnabled ? 'udp' : 'http',
+  };
+};
+
+// 設定のETag: 親機ファームが使う項目だけから算出（子機名の変更などでは変わらない）。
+// 親機は If-None-Match で送り、一致すれば304で解析を省く
+const configEtag = (config) => {
+  const used = [
+    config.parentIdHash,
+    config.children.map((c) => [c.deviceIdNum, c.logicalId, c.pairingStatus, c.deviceId]),
+    config.firmware && [config.firmware.versionCode, config.firmware.url, config.firmware.size, config.firmware.md5],
+  ];
+  // 既定(http)の親機のETagは従来から変えない
+  if (config.transport !== 'http') used.push(config.transport);
+  return crypto.createHash('sha1').update(JSON.stringify(used)).digest('hex').slice(0, 16);
+};
+
+/**
+ * 前回のヒントで実行したACコマンドの完了通知（送信ボディの ac_ack。実行時刻は親機時計のJST壁時計）。
+ * 失敗は呼び出し側へ投げる（取込ごと失敗させ、親機に通知を再送させる。握りつぶすと次のヒントで
+ * 同じコマンドが PENDING のまま返り、親機が再実行してしまう）
+ */
+export const recordAcAcks = async (parentDevice, acks) => {
+  for (const ack of acks) {
+    const executedAt = ack.at ? new Date(ack.at) : new Date();
+    await prisma.acCommand.updateMany({
+      where: { id: Number(ack.id), parentId: parentDevice.id, status: 'PENDING' },
+      data: { status: 'DONE', executedAt: isNaN(executedAt.getTime()) ? new Date() : executedAt },
+    });
+  }
+};
+
+/**
+ * 送信(ingest)応答に載せるヒント。親機はこれを見て設定取得/OTA/ACコマンドの個別要求を省く。
+ * meta: { fw, cfg } は送信ボディの付帯情報（cfg=親機が保持する設定ETag、引用符なし）。
+ * ac_ack は先に recordAcAcks で処理しておくこと（完了したコマンドを ac で返さない）
+ * 戻り値: { config: 設定が変わった(またはETag未保持), ota: 新版あり, ac?: 未実行ACコマンド }
+ */
+export const getIngestHints = async (parentDevice, meta) => {
+  const device = await findDeviceWithAssignments(parentDevice.deviceId);
+  const config = await buildDeviceConfig(device, Number(meta.fw));
+  const cmd = await prisma.acCommand.findFirst({
+    where: { parentId: parentDevice.id, status: 'PENDING' },
+    orderBy: { createdAt: 'asc' },
+  });
+
+  return {
+    config: meta.cfg !== configEtag(config),
+    ota: !!config.firmware,
+    ...(cmd ? { ac: { id: cmd.id, mode: cmd.mode, tempC: cmd.tempC } } : {}),
   };
 };
 
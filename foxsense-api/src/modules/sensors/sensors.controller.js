@@ -1,5 +1,6 @@
 import * as sensorsService from './sensors.service.js';
 import { asyncHandler } from '../../middleware/errorHandler.js';
+import { decodeRoundBatch } from '../../utils/roundCbor.js';
 
 export const getLatestData = asyncHandler(async (req, res) => {
   const data = await sensorsService.getLatestData(req.params.parentId, req.user.id);
@@ -21,8 +22,13 @@ export const recordSensorData = asyncHandler(async (req, res) => {
 
 // ファームウェアからのバルク受信（親機+子機を一括で受け取る）
 export const ingestSensorData = asyncHandler(async (req, res) => {
-  const data = await sensorsService.recordBulkSensorData(req.body);
-  res.status(201).json({ success: true, data });
+  // CBOR(application/cbor) は express.raw で Buffer になっているのでJSON形式へ変換
+  const body = Buffer.isBuffer(req.body) ? decodeRoundBatch(req.body) : req.body;
+  const { ack_seq: ackSeq, hints, ...data } = await sensorsService.recordBulkSensorData(body);
+  // ack_seq / hints は親機が先頭だけ読むので data より前に置く
+  res.status(201).json({
+    success: true, ...(ackSeq != null ? { ack_seq: ackSeq } : {}), ...(hints ? { hints } : {}), data,
+  });
 });
 
 export const getDeviceStats = asyncHandler(async (req, res) => {
@@ -1,4 +1,4 @@
-import { Router } from 'express';
+import express, { Router } from 'express';
 import * as sensorsController from './sensors.controller.js';
 import { authenticate } from '../../middleware/auth.js';
 
@@ -8,7 +8,8 @@ const router = Router();
 router.post('/callback', sensorsController.recordSensorData);
 
 // ファームウェアからのバルク受信（親機+子機を1リクエストで送信、デバイスシークレット認証必須）
-router.post('/ingest', sensorsController.ingestSensorData);
+// JSON と CBOR(application/cbor, 親機 src/round_cbor.h のスキーマ) の両方を受け付ける
+router.post('/ingest', express.raw({ type: 'application/cbor', limit: '256kb' }), sensorsController.ingestSensorData);
 
 // Protected endpoints
 router.use(authenticate);
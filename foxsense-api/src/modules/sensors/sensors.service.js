@@ -1,5 +1,6 @@
 import prisma from '../../config/db.js';
 import { AppError } from '../../middleware/errorHandler.js';
+import { getIngestHints, recordAcAcks } from '../devices/devices.service.js';
 
 export const getLatestData = async (parentId, userId) => {
   const parent = await prisma.parentDevice.findFirst({
@@ -180,6 +181,19 @@ export const recordSensorData = async (data) => {
  *   parent: { temperature, humidity, battery, signal },
  *   children: [{ device_id, temperature, humidity, rssi, battery, received }, ...]
  * }
+ * バッチ形式（蓄積した複数ラウンドを1リクエストで送信）:
+ * {
+ *   parent_id, secret, boot_count,
+ *   link: { resumed, attaches, resumes, prep_ms, ttfb_ms, reg_ms, band, band_scope, rat, tls, opens, open_ms,
+ *           up_transport, up_bytes, up_ms, up_retx, rsrp, rsrq, verdict, defers, defer_rsrp },   // 任意: LTE接続計測
+ *   fw, cfg, ac_ack: [{ id, at }],   // 任意: 応答ヒント用（稼働中ファーム/保持中の設定ETag/前回ヒントのAC完了通知）
+ *   cycle: { wake, start_ms, total_ms, phases: { sensors: [planned_ms, actual_ms, status], ... } },   // 任意: 工程記録
+ *   energy: { tier: "normal"|"save"|"critical", changes, charging },   // 任意: 電池残量による動作段階
+ *   seq_epoch, have_from,   // 任意: ラウンド通番の系列（親機の電源投入毎）と親機が保持する最古の seq
+ *   rounds: [{ seq, timestamp, parent: {...}, children: [...] }, ...]
+ * }
+ * seq 付きラウンドは (親機, seq_epoch, seq) の受取記録で重複を判定し、再送は記録せず duplicate を返す。
+ * 応答の ack_seq は have_from から連続して受け取り済みの最大 seq（親機はそこまでを手元から消す）。
  */
 export const recordBulkSensorData = async (data) => {
   // 親機検索・シークレット認証
@@ -191,6 +205,107 @@ export const recordBulkSensorData = async (data) => {
     throw new AppError('Invalid device secret', 401);
   }
 
+  // LTE接続計測（PSM復帰/フルアタッチの回数・TTFB）と起床サイクルの工程記録（予定/実績）を
+  // 最新値として保持（可視化用）。列が無い旧DBでも取込自体は失敗させない
+  if (data.link && typeof data.link === 'object') {
+    try {
+      await prisma.parentDevice.update({
+        where: { id: parentDevice.id },
+        data: { linkStats: data.link, linkReportedAt: new Date() },
+      });
+    } catch (e) { /* migration前などは無視 */ }
+  }
+  if (data.energy && typeof data.energy === 'object') {
+    try {
+      await prisma.parentDevice.update({
+        where: { id: parentDevice.id },
+        data: { energyStats: data.energy, energyReportedAt: new Date() },
+      });
+    } catch (e) { /* migration前などは無視 */ }
+  }
+  if (data.cycle && typeof data.cycle === 'object') {
+    try {
+      await prisma.parentDevice.update({
+        where: { id: parentDevice.id },
+        data: { cycleStats: data.cycle, cycleReportedAt: new Date() },
+      });
+    } catch (e) { /* migration前などは無視 */ }
+  }
+
+  // ACコマンドの完了通知（ヒントより先に。失敗はヒントと違い握りつぶさず、取込ごとエラーにする）
+  if (Array.isArray(data.ac_ack)) await recordAcAcks(parentDevice, data.ac_ack);
+
+  if (!Array.isArray(data.rounds)) {
+    return recordRound(parentDevice, data);
+  }
+
+  // バッチ: 1ラウンドの値異常でバッチ全体を400にすると親機が同じバッファを再送し続けるため、
+  // 異常ラウンドはスキップして残りを記録する。
+  // 異常ラウンドも受取記録は残す（ack_seq を進めないと親機が手放せない）。受取記録とラウンドは
+  // 同じトランザクションで書くので、DB障害時はどちらも残らずエラーのまま返る（親機は再送する）。
+  const epoch = Number.isInteger(data.seq_epoch) && data.seq_epoch > 0 ? data.seq_epoch : null;
+  const rounds = [];
+  for (const round of data.rounds) {
+    const receipt = epoch && Number.isInteger(round.seq) && round.seq > 0
+      ? { parentId: parentDevice.id, epoch, seq: round.seq }
+      : null;
+    try {
+      rounds.push(receipt
+        ? await prisma.$transaction(async (tx) => {
+          await tx.roundReceipt.create({ data: receipt });
+          return recordRoundOrReject(parentDevice, round, tx);
+        })
+        : await recordRoundOrReject(parentDevice, round));
+    } catch (err) {
+      if (err.code !== 'P2002') throw err;
+      rounds.push({ parent: null, children: [], duplicate: true });
+    }
+  }
+
+  const ackSeq = epoch && Number.isInteger(data.have_from)
+    ? await getContiguousAck(parentDevice.id, epoch, data.have_from)
+    : null;
+
+  // 応答ヒント（fw を申告する親機のみ）。失敗しても取込は成功扱い（親機は個別要求に戻る）
+  let hints;
+  if (data.fw != null) {
+    try {
+      hints = await getIngestHints(parentDevice, data);
+    } catch (e) { /* ヒント無しで応答 */ }
+  }
+  return { rounds, ...(ackSeq != null ? { ack_seq: ackSeq } : {}), ...(hints ? { hints } : {}) };
+};
+
+// haveFrom から連続して受取記録のある最大の seq（haveFrom 自体が無ければ null）
+const getContiguousAck = async (parentId, epoch, haveFrom) => {
+  const receipts = await prisma.roundReceipt.findMany({
+    where: { parentId, epoch, seq: { gte: haveFrom } },
+    select: { seq: true },
+    orderBy: { seq: 'asc' },
+    take: 512,
+  });
+  let ack = haveFrom - 1;
+  for (const r of receipts) {
+    if (r.seq !== ack + 1) break;
+    ack = r.seq;
+  }
+  return ack >= haveFrom ? ack : null;
+};
+
+// バッチの1ラウンド: 値異常(400)は記録せず理由を返す。recordRound は書込みの前に検証するので、
+// トランザクション内なら受取記録だけが残る
+const recordRoundOrReject = async (parentDevice, round, db) => {
+  try {
+    return await recordRound(parentDevice, round, db);
+  } catch (err) {
+    if (!(err instanceof AppError) || err.statusCode !== 400) throw err;
+    return { parent: null, children: [], error: err.message };
+  }
+};
+
+// 1ラウンド分（親機+子機）を記録（db: 受取記録と同じトランザクションで書く時は tx）。
+// 値の検証（400）はどの書込みよりも前に行う
+const recordRound = async (parentDevice, data, db = prisma) => {
   const results = { parent: null, children: [] };
 
   // ペイロードの timestamp(ISO8601) を採用（蓄積バッチ送信で各ラウンドの実測時刻を保持）。
@@ -207,7 +322,7 @@ export const recordBulkSensorData = async (data) => {
     if (typeof p.humidity !== 'number' || p.humidity < 0 || p.humidity > 100) {
       throw new AppError('Invalid parent humidity value', 400);
     }
-    const parentRecord = await prisma.sensorData.create({
+    const parentRecord = await db.sensorData.create({
       data: {
         parentId: parentDevice.id,
         deviceType: 'PARENT',
@@ -230,12 +345,12 @@ export const recordBulkSensorData = async (data) => {
       if (typeof c.temperature !== 'number' || c.temperature < -50 || c.temperature > 80) continue;
       if (typeof c.humidity !== 'number' || c.humidity < 0 || c.humidity > 100) continue;
 
-      const childDevice = await prisma.childDevice.findUnique({
+      const childDevice = await db.childDevice.findUnique({
         where: { deviceId: c.device_id.toUpperCase() },
       });
       if (!childDevice) continue; // 未登録子機はスキップ
 
-      const childRecord = await prisma.sensorData.create({
+      const childRecord = await db.sensorData.create({
         data: {
           childId: childDevice.id,
           deviceType: 'CHILD',
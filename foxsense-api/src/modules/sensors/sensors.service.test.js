@@ -0,0 +1,182 @@
+// recordBulkSensorData の受取記録（seq_epoch/seq）と ack_seq の確認。
+// DB はメモリ上の代用（@prisma/client を差し替え。$transaction は失敗時に巻き戻す）で、
+// DB や npm 依存なしに `node --test` で動く。
+import { test, beforeEach } from 'node:test';
+import assert from 'node:assert/strict';
+import { register } from 'node:module';
+
+// ---- 外部依存の差し替え（DB と Soracom API の HTTP クライアント） ----
+const fakeModule = (src) => `data:text/javascript,${encodeURIComponent(src)}`;
+const stubs = {
+  '@prisma/client': fakeModule('export class PrismaClient { constructor() { return globalThis.fakePrisma; } }'),
+  axios: fakeModule('export default {};'),
+};
+register(fakeModule(`
+  const stubs = ${JSON.stringify(stubs)};
+  export async function resolve(specifier, context, next) {
+    if (stubs[specifier]) return { url: stubs[specifier], shortCircuit: true };
+    return next(specifier, context);
+  }
+`));
+
+const PARENT = { id: 'p1', deviceId: 'FOX00001', deviceSecret: 's3cret' };
+const CHILD = { id: 'c1', deviceId: 'A0000001' };
+
+const uniqueViolation = () => Object.assign(new Error('Unique constraint failed'), { code: 'P2002' });
+
+// 使う分だけのモデル。rows は { receipts, sensorData }、acCommands は親機宛てのACコマンド
+const createFakePrisma = () => {
+  const db = {
+    rows: { receipts: [], sensorData: [] },
+    failSensorWrite: false,   // true で sensorData.create を DB障害として失敗させる
+    failAcAck: false,         // true で acCommand.updateMany を DB障害として失敗させる
+    acCommands: [],
+    parentDevice: {
+      findUnique: async ({ where }) => (where.deviceId === PARENT.deviceId ? PARENT : null),
+      update: async () => PARENT,
+    },
+    childDevice: {
+      findUnique: async ({ where }) => (where.deviceId === CHILD.deviceId ? CHILD : null),
+    },
+    roundReceipt: {
+      create: async ({ data }) => {
+        const r = db.rows.receipts;
+        if (r.some(x => x.parentId === data.parentId && x.epoch === data.epoch && x.seq === data.seq)) {
+          throw uniqueViolation();
+        }
+        r.push({ ...data });
+        return data;
+      },
+      findMany: async ({ where, take }) => db.rows.receipts
+        .filter(x => x.parentId === where.parentId && x.epoch === where.epoch && x.seq >= where.seq.gte)
+        .sort((a, b) => a.seq - b.seq)
+        .slice(0, take)
+        .map(x => ({ seq: x.seq })),
+    },
+    sensorData: {
+      create: async ({ data }) => {
+        if (db.failSensorWrite) throw new Error('connection reset');
+        const row = { id: db.rows.sensorData.length + 1, ...data };
+        db.rows.sensorData.push(row);
+        return row;
+      },
+    },
+    acCommand: {
+      updateMany: async ({ where, data }) => {
+        if (db.failAcAck) throw new Error('connection reset');
+        const hit = db.acCommands.filter(c => c.id === where.id && c.parentId === where.parentId && c.status === where.status);
+        hit.forEach(c => Object.assign(c, data));
+        return { count: hit.length };
+      },
+    },
+    $transaction: async (fn) => {
+      const saved = { receipts: [...db.rows.receipts], sensorData: [...db.rows.sensorData] };
+      try {
+        return await fn(db);
+      } catch (err) {
+        db.rows = saved;
+        throw err;
+      }
+    },
+  };
+  return db;
+};
+
+globalThis.fakePrisma = createFakePrisma();
+const { recordBulkSensorData } = await import('./sensors.service.js');
+const db = globalThis.fakePrisma;
+
+const round = (seq, temperature = 21.5) => ({
+  seq,
+  timestamp: '2026-10-01T12:00:00+09:00',
+  parent: { temperature, humidity: 55, pressure: 1008, battery: 80, vbus_mv: 0, signal: 18 },
+  children: [{ device_id: 'a0000001', received: true, temperature: 19.2, humidity: 60, rssi: -80, battery: 95 }],
+});
+
+const batch = (seqs, { epoch = 7, haveFrom = seqs[0], rounds } = {}) => ({
+  parent_id: PARENT.deviceId,
+  secret: PARENT.deviceSecret,
+  seq_epoch: epoch,
+  have_from: haveFrom,
+  rounds: rounds ?? seqs.map(s => round(s)),
+});
+
+const receiptSeqs = (epoch = 7) => db.rows.receipts.filter(r => r.epoch === epoch).map(r => r.seq).sort((a, b) => a - b);
+
+beforeEach(() => {
+  db.rows = { receipts: [], sensorData: [] };
+  db.failSensorWrite = false;
+  db.failAcAck = false;
+  db.acCommands = [{ id: 5, parentId: PARENT.id, status: 'PENDING' }];
+});
+
+test('受け取ったラウンドまで連続して ack する', async () => {
+  const res = await recordBulkSensorData(batch([1, 2, 3]));
+  assert.equal(res.ack_seq, 3);
+  assert.deepEqual(receiptSeqs(), [1, 2, 3]);
+  assert.equal(db.rows.sensorData.length, 6);   // 親機＋子機 ×3
+});
+
+test('抜けがあればその手前までしか ack せず、埋まれば先まで進む', async () => {
+  let res = await recordBulkSensorData(batch([1, 2, 4], { haveFrom: 1 }));
+  assert.equal(res.ack_seq, 2);
+  res = await recordBulkSensorData(batch([3], { haveFrom: 1 }));
+  assert.equal(res.ack_seq, 4);
+});
+
+test('have_from 自体を受け取っていなければ ack_seq を返さない', async () => {
+  const res = await recordBulkSensorData(batch([5, 6], { haveFrom: 4 }));
+  assert.equal(res.ack_seq, undefined);
+  assert.deepEqual(receiptSeqs(), [5, 6]);
+});
+
+test('再送された重複ラウンドは記録し直さず、ack は変わらない', async () => {
+  await recordBulkSensorData(batch([1, 2]));
+  const rows = db.rows.sensorData.length;
+  const res = await recordBulkSensorData(batch([1, 2, 3], { haveFrom: 1 }));
+  assert.deepEqual(res.rounds.map(r => !!r.duplicate), [true, true, false]);
+  assert.equal(db.rows.sensorData.length, rows + 2);   // seq 3 の分だけ
+  assert.equal(res.ack_seq, 3);
+});
+
+test('値異常のラウンドは記録しないが受取記録は残し、ack を進める', async () => {
+  const res = await recordBulkSensorData(batch([1, 2, 3], { rounds: [round(1), round(2, 200), round(3)] }));
+  assert.match(res.rounds[1].error, /temperature/);
+  assert.equal(res.ack_seq, 3);
+  assert.deepEqual(receiptSeqs(), [1, 2, 3]);
+  assert.equal(db.rows.sensorData.length, 4);   // seq 1 と 3 のみ
+
+  const again = await recordBulkSensorData(batch([2], { haveFrom: 1, rounds: [round(2, 200)] }));
+  assert.equal(again.rounds[0].duplicate, true);
+});
+
+test('DB障害ではラウンドも受取記録も残さずエラーを返す（親機は再送する）', async () => {
+  await recordBulkSensorData(batch([1]));
+  db.failSensorWrite = true;
+  await assert.rejects(recordBulkSensorData(batch([2], { haveFrom: 1 })), /connection reset/);
+  assert.deepEqual(receiptSeqs(), [1]);
+
+  db.failSensorWrite = false;
+  const res = await recordBulkSensorData(batch([2], { haveFrom: 1 }));
+  assert.equal(res.rounds[0].duplicate, undefined);
+  assert.equal(res.ack_seq, 2);
+});
+
+test('通番系列が違えば同じ seq も別のラウンド', async () => {
+  await recordBulkSensorData(batch([1, 2], { epoch: 7 }));
+  const res = await recordBulkSensorData(batch([1], { epoch: 8 }));
+  assert.equal(res.rounds[0].duplicate, undefined);
+  assert.equal(res.ack_seq, 1);
+});
+
+test('ac_ack で実行済みのACコマンドを DONE にする', async () => {
+  await recordBulkSensorData({ ...batch([1]), ac_ack: [{ id: 5, at: '2026-10-01T12:00:00+09:00' }] });
+  assert.equal(db.acCommands[0].status, 'DONE');
+});
+
+test('ac_ack の記録に失敗したら取込ごとエラー（成功を返すと親機が通知を捨てて再実行する）', async () => {
+  db.failAcAck = true;
+  await assert.rejects(recordBulkSensorData({ ...batch([1]), ac_ack: [{ id: 5 }] }), /connection reset/);
+  assert.equal(db.acCommands[0].status, 'PENDING');
+  assert.deepEqual(receiptSeqs(), []);   // ラウンドも書かない（再送で二重にならない）
+});
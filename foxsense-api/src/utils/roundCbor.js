@@ -0,0 +1,173 @@
+import { AppError } from '../middleware/errorHandler.js';
+
+// 親機ファームの蓄積ラウンドCBORバッチ（スキーマは親機 src/round_cbor.h と同一）
+// batch = { 0: version, 1: parent_id, 2: secret, 3: boot_count, 4: [round, ...], 5?: link, 6?: cycle,
+//          7?: fw, 8?: cfg, 9?: ac_ack, 10?: [seq_epoch, have_from], 11?: energy }
+// round = [ts, pTemp×100, pHumid×100, pPres×10, pBat, pVbus, pSignal, [child, ...], seq?]
+// child = [id, 1, temp×100, humid×100, pres×10, rssi, bat] | [id, 0]
+// link  = [resumed, attaches, resumes, prep_ms, ttfb_ms, reg_ms, band, band_scope, rat, tls, opens, open_ms,
+//          up_transport, up_bytes, up_ms, up_retx, rsrp, rsrq, verdict, defers, defer_rsrp]   LTE接続計測（任意）
+// cycle = [wake, start_ms, total_ms, [[planned_ds, actual_ds, status], ...]]           直近LTE起床の工程記録（任意）
+// ac_ack = [[ac_id, ts], ...]   前回の応答ヒントで実行したACコマンドの完了通知（任意）
+// energy = [tier, changes, charging]   電池残量による動作段階（任意）
+// 配列の位置で読むフィールドが増えるたびに親機側で版を上げる（src/round_cbor.h の ROUND_CBOR_SCHEMA_VERSION）
+//   v1: キー0-4、round は seq なしの8要素
+//   v2: キー5-11、round の9要素目 seq、link は21要素
+const SCHEMA_VERSIONS = [1, 2];
+
+// 親機の ts は JST壁時計を UTC として数えた unix 秒（JSON版の "+09:00" 表記と同じ基準）
+const JST_OFFSET_SEC = 9 * 60 * 60;
+
+// cycle の工程順（親機 src/wake_schedule.h の WakePhase と同一）
+const WAKE_PHASES = ['sensors', 'attach', 'ntp', 'config', 'window', 'upload', 'ac', 'ota'];
+
+// link.up_transport（親機 LinkStats.upTransport）
+const UP_TRANSPORTS = ['http', 'udp', 'udp+http'];
+
+// link.verdict（親機 src/upload_policy.h の UploadVerdict）
+const UPLOAD_VERDICTS = ['send', 'defer', 'forced', 'no-metric'];
+
+// energy.tier（親機 src/energy_governor.h の EnergyTier）
+const ENERGY_TIERS = ['normal', 'save', 'critical'];
+
+/**
+ * 最小限のCBORデコーダ（整数/文字列/配列/マップのみ。浮動小数・不定長は非対応）
+ */
+const decodeItem = (buf, pos) => {
+  if (pos.i >= buf.length) throw new AppError('Truncated CBOR', 400);
+  const ib = buf[pos.i++];
+  const major = ib >> 5;
+  const ai = ib & 0x1f;
+  let v;
+  if (ai < 24) {
+    v = ai;
+  } else {
+    const n = { 24: 1, 25: 2, 26: 4, 27: 8 }[ai];
+    if (!n || pos.i + n > buf.length) throw new AppError('Unsupported CBOR item', 400);
+    v = 0;
+    for (let k = 0; k < n; k++) v = v * 256 + buf[pos.i++];
+  }
+
+  switch (major) {
+    case 0: return v;
+    case 1: return -1 - v;
+    case 2:
+    case 3: {
+      if (pos.i + v > buf.length) throw new AppError('Truncated CBOR', 400);
+      const s = buf.subarray(pos.i, pos.i + v);
+      pos.i += v;
+      return major === 3 ? s.toString('utf8') : s;
+    }
+    case 4: {
+      const arr = [];
+      for (let k = 0; k < v; k++) arr.push(decodeItem(buf, pos));
+      return arr;
+    }
+    case 5: {
+      const map = new Map();
+      for (let k = 0; k < v; k++) {
+        const key = decodeItem(buf, pos);
+        map.set(key, decodeItem(buf, pos));
+      }
+      return map;
+    }
+    default:
+      throw new AppError('Unsupported CBOR item', 400);
+  }
+};
+
+/**
+ * CBORバッチ → JSONバッチ形式（recordBulkSensorData の入力）へ変換
+ */
+export const decodeRoundBatch = (buf) => {
+  const pos = { i: 0 };
+  const batch = decodeItem(buf, pos);
+  if (!(batch instanceof Map) || pos.i !== buf.length) {
+    throw new AppError('Invalid CBOR batch', 400);
+  }
+  const version = batch.get(0);
+  if (!SCHEMA_VERSIONS.includes(version)) {
+    throw new AppError('Unsupported CBOR schema version', 400);
+  }
+  // v1 のバッチにはキー5以降・round の seq が無い（あっても位置の意味が違うので読まない）
+  const v2 = version >= 2;
+
+  const rounds = (batch.get(4) || []).map((r) => ({
+    ...(v2 && r.length >= 9 ? { seq: r[8] } : {}),
+    timestamp: new Date((r[0] - JST_OFFSET_SEC) * 1000).toISOString(),
+    parent: {
+      temperature: r[1] / 100,
+      humidity: r[2] / 100,
+      pressure: r[3] / 10,
+      battery: r[4],
+      vbus_mv: r[5],
+      signal: r[6],
+    },
+    children: (r[7] || []).map((c) => (c[1]
+      ? {
+        device_id: (c[0] >>> 0).toString(16).padStart(8, '0'),
+        received: true,
+        temperature: c[2] / 100,
+        humidity: c[3] / 100,
+        pressure: c[4] / 10,
+        rssi: c[5],
+        battery: c[6],
+      }
+      : { device_id: (c[0] >>> 0).toString(16).padStart(8, '0'), received: false })),
+  }));
+
+  const l = v2 ? batch.get(5) : undefined;
+  const link = Array.isArray(l) && l.length >= 5
+    ? {
+      resumed: !!l[0],
+      attaches: l[1],
+      resumes: l[2],
+      prep_ms: l[3],
+      ttfb_ms: l[4],
+      ...(l.length >= 8 ? { reg_ms: l[5], band: l[6], band_scope: l[7] } : {}),
+      ...(l.length >= 9 ? { rat: l[8] } : {}),
+      ...(l.length >= 12 ? { tls: !!l[9], opens: l[10], open_ms: l[11] } : {}),
+      ...(l.length >= 16 ? { up_transport: UP_TRANSPORTS[l[12]] ?? l[12], up_bytes: l[13], up_ms: l[14], up_retx: l[15] } : {}),
+      ...(l.length >= 21 ? { rsrp: l[16], rsrq: l[17], verdict: UPLOAD_VERDICTS[l[18]] ?? l[18], defers: l[19], defer_rsrp: l[20] } : {}),
+    }
+    : undefined;
+
+  // 工程記録はJSON版と同じ形 { wake, start_ms, total_ms, phases: { name: [planned_ms, actual_ms, status] } }
+  const cy = v2 ? batch.get(6) : undefined;
+  const cycle = Array.isArray(cy) && cy.length >= 4 && Array.isArray(cy[3])
+    ? {
+      wake: cy[0],
+      start_ms: cy[1],
+      total_ms: cy[2],
+      phases: Object.fromEntries(cy[3].slice(0, WAKE_PHASES.length)
+        .map((p, i) => [WAKE_PHASES[i], [p[0] * 100, p[1] * 100, p[2]]])),
+    }
+    : undefined;
+
+  const acks = v2 ? batch.get(9) : undefined;
+  const acAck = Array.isArray(acks)
+    ? acks.map((a) => ({ id: a[0], at: new Date((a[1] - JST_OFFSET_SEC) * 1000).toISOString() }))
+    : undefined;
+
+  const en = v2 ? batch.get(11) : undefined;
+  const energy = Array.isArray(en) && en.length >= 3
+    ? { tier: ENERGY_TIERS[en[0]] ?? en[0], changes: en[1], charging: !!en[2] }
+    : undefined;
+
+  const sq = v2 ? batch.get(10) : undefined;
+  const seq = Array.isArray(sq) && sq.length >= 2 ? { seq_epoch: sq[0], have_from: sq[1] } : undefined;
+
+  return {
+    parent_id: batch.get(1),
+    secret: batch.get(2),
+    boot_count: batch.get(3),
+    rounds,
+    ...(link ? { link } : {}),
+    ...(cycle ? { cycle } : {}),
+    ...(v2 && batch.has(7) ? { fw: batch.get(7) } : {}),
+    ...(v2 && batch.has(8) ? { cfg: batch.get(8) } : {}),
+    ...(acAck ? { ac_ack: acAck } : {}),
+    ...(energy ? { energy } : {}),
+    ...(seq || {}),
+  };
+};
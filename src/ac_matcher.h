@@ -0,0 +1,131 @@
+#ifndef AC_MATCHER_H
+#define AC_MATCHER_H
+
+// =====================================================================
+// Aho–Corasick 多パターン照合（DFA化・固定長テーブル）  ※親機ファーム/ホスト共用
+// ---------------------------------------------------------------------
+// モデム応答の終端(OK/ERROR/">")とURCプレフィクス群を、受信バイト1個につき
+// テーブル参照1回で同時に照合する。行頭アンカー付きパターンは先頭に仮想の
+// '\n' を付けて登録するので、ストリームを行に切らずに行頭一致を検出できる。
+// 文字はパターンに現れる文字だけをクラス化（その他は全てクラス0）して表を小さく保つ。
+// パターン文字列は静的寿命であること（ポインタのみ保持し、追加毎に表を再構築）。
+// =====================================================================
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+template <int MAX_STATES, int MAX_PATTERNS, int MAX_CLASSES = 48>
+class AcMatcher {
+    static_assert(MAX_STATES <= 255, "state index is uint8_t");
+public:
+    AcMatcher() : _count(0), _states(1) { build(); }
+
+    /**
+     * パターン追加。lineStart=true で行頭のみ一致。戻り値=パターンID（-1=容量不足）
+     * 既に同じパターンがあればそのIDを返す。
+     */
+    int add(const char* pattern, bool lineStart = true) {
+        int id = find(pattern, lineStart);
+        if (id >= 0) return id;
+        if (_count >= MAX_PATTERNS) return -1;
+        _pat[_count] = pattern;
+        _anchored[_count] = lineStart;
+        _count++;
+        if (!build()) { _count--; build(); return -1; }
+        return _count - 1;
+    }
+
+    int find(const char* pattern, bool lineStart = true) const {
+        for (int i = 0; i < _count; i++)
+            if (_anchored[i] == lineStart && strcmp(_pat[i], pattern) == 0) return i;
+        return -1;
+    }
+
+    // 状態遷移（1バイト）
+    uint8_t step(uint8_t state, uint8_t c) const { return _delta[state][_cls[c]]; }
+
+    // state で終わるパターンID（無ければ -1。複数なら最長）
+    int8_t match(uint8_t state) const { return _out[state]; }
+
+    // 行頭（'\n' 直後）に相当する状態
+    uint8_t lineStartState() const { return step(0, '\n'); }
+
+    int states() const { return _states; }
+
+private:
+    const char* _pat[MAX_PATTERNS];
+    bool _anchored[MAX_PATTERNS];
+    int _count;
+    int _states;
+    uint8_t _cls[256];
+    uint8_t _delta[MAX_STATES][MAX_CLASSES];
+    int8_t _out[MAX_STATES];
+
+    bool classify() {
+        memset(_cls, 0, sizeof(_cls));
+        int next = 1;
+        for (int i = 0; i < _count; i++) {
+            if (_anchored[i] && !_cls[(uint8_t)'\n']) {
+                if (next >= MAX_CLASSES) return false;
+                _cls[(uint8_t)'\n'] = next++;
+            }
+            for (const char* p = _pat[i]; *p; p++) {
+                if (_cls[(uint8_t)*p]) continue;
+                if (next >= MAX_CLASSES) return false;
+                _cls[(uint8_t)*p] = next++;
+            }
+        }
+        return true;
+    }
+
+    bool insert(int id) {
+        uint8_t s = 0;
+        const char* p = _pat[id];
+        bool lead = _anchored[id];
+        while (lead || *p) {
+            uint8_t c = _cls[(uint8_t)(lead ? '\n' : *p)];
+            if (lead) lead = false; else p++;
+            if (_delta[s][c] == 0xFF) {
+                if (_states >= MAX_STATES) return false;
+                _delta[s][c] = (uint8_t)_states++;
+            }
+            s = _delta[s][c];
+        }
+        if (_out[s] < 0) _out[s] = (int8_t)id;
+        return true;
+    }
+
+    // トライ構築 → 幅優先で失敗遷移を埋めて完全DFAにする
+    bool build() {
+        if (!classify()) return false;
+        memset(_delta, 0xFF, sizeof(_delta));
+        memset(_out, -1, sizeof(_out));
+        _states = 1;
+        for (int i = 0; i < _count; i++) if (!insert(i)) return false;
+
+        uint8_t fail[MAX_STATES];
+        uint8_t queue[MAX_STATES];
+        int qh = 0, qt = 0;
+        fail[0] = 0;
+        for (int c = 0; c < MAX_CLASSES; c++) {
+            uint8_t u = _delta[0][c];
+            if (u == 0xFF) { _delta[0][c] = 0; continue; }
+            fail[u] = 0;
+            queue[qt++] = u;
+        }
+        while (qh < qt) {
+            uint8_t s = queue[qh++];
+            for (int c = 0; c < MAX_CLASSES; c++) {
+                uint8_t u = _delta[s][c];
+                if (u == 0xFF) { _delta[s][c] = _delta[fail[s]][c]; continue; }
+                fail[u] = _delta[fail[s]][c];
+                if (_out[u] < 0) _out[u] = _out[fail[u]];
+                queue[qt++] = u;
+            }
+        }
+        return true;
+    }
+};
+
+#endif // AC_MATCHER_H
@@ -0,0 +1,378 @@
+#ifndef AT_ENGINE_H
+#define AT_ENGINE_H
+
+// =====================================================================
+// SIM7080G 用 非ブロッキングATコマンドエンジン + URCディスパッチャ
+// ---------------------------------------------------------------------
+// 旧 sendATCommand() は「UART排出→送信→Stringに溜めて OK/ERROR/URC文字列を
+// indexOf」だったため、
+//   - 非同期の +CADATAIND / +APP PDP / +CAURC で別コマンドが途中終了する
+//   - 次のコマンドの排出で URC が捨てられる
+// 問題があった。本エンジンは受信を行単位で処理し、
+//   - 応答行 → 実行中コマンドの応答バッファ（完了判定: OK/ERROR/">" または述語）
+//   - URC行  → 購読者のハンドラ（+CADATAIND/+CASTATE/+CEREG/+CAURC 等）
+// に振り分ける。コマンドはキューに積み poll() で順次送信する。
+// 応答待ちの間は AtPort::idle（実機は delay(2)）で他タスクへ譲る（LoRa受信はここでは扱わない:
+// 並列起床では本エンジンが core 0 のモデムタスク、E220 の受信は core 1 の受信窓が専有するため）。
+// UART の読み書きと時計は AtPort で受け取る（実機の結線は main.cpp。ホストでは擬似モデムと
+// 仮想時計を渡して同じコードを動かす）。
+//
+// 応答かURCかの判定: 実行中コマンド "AT+XXX..." に対する "+XXX:" 行は応答、
+// それ以外で購読プレフィクスに一致する行はURC。
+//
+// 受信は UartRing に一括で取り込み、終端(OK/ERROR/">")・URCプレフィクス・
+// 生データ長ヘッダを AcMatcher で1パス照合する（行を String に溜めて indexOf
+// しない）。行はリングバッファ内を直接指して渡す（折り返した行のみコピー）。
+// 別タスクから cancel() すると、待ち中・以後の exec()/service() は即座に AT_TIMEOUT で戻る
+// （並列起床の締切でメインがモデムタスクを打ち切る。resume() まで有効）。
+// ※ハンドラ/完了コールバック内から exec() を呼ばないこと（再入不可）
+// ※ハンドラに渡す line は呼出し中のみ有効
+// =====================================================================
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include "uart_ring.h"
+#include "ac_matcher.h"
+
+#define AT_QUEUE_LEN      8
+#define AT_CMD_MAX        192
+#define AT_LINE_MAX       256
+#define AT_RESP_MAX       768
+#define AT_MAX_URC_SUBS   8
+#define AT_RX_RING        2048    // 受信リング（2のべき乗。CARECV 1460B + 応答行が収まる）
+#define AT_AC_STATES      192
+#define AT_AC_PATTERNS    24
+
+enum AtStatus : uint8_t {
+    AT_PENDING = 0,
+    AT_OK,          // "OK"
+    AT_ERROR,       // "ERROR" / "+CME ERROR" / "+CMS ERROR"
+    AT_PROMPT,      // ">"（CASEND等のデータ入力待ち）
+    AT_MATCH,       // 述語が成立
+    AT_TIMEOUT
+};
+
+// 完了述語: 応答バッファ全体（行を'\n'区切り）を見て true で完了
+typedef bool (*AtPredicate)(const char* resp, void* ctx);
+typedef void (*AtDoneHandler)(AtStatus status, const char* resp, void* ctx);
+typedef void (*AtUrcHandler)(const char* line, void* ctx);
+
+// UART と時計の差し替え口
+struct AtPort {
+    UartReadFn read;                                          // 受信済みを待たずに読む
+    void (*write)(const uint8_t* p, size_t n, void* ctx);     // 送信
+    uint32_t (*now)();                                        // ミリ秒時計（millis 相当）
+    void (*idle)();                                           // 応答待ちの間に他タスクへ譲る
+    void* ctx;                                                // read/write に渡す
+};
+
+class AtEngine {
+public:
+    explicit AtEngine(const AtPort& port)
+        : _port(port), _head(0), _count(0), _active(false), _subCount(0),
+          _scan(0), _lineStart(0), _lineTag(-1), _binHdr(false), _binLen(0),
+          _respLen(0), _binRemain(0), _cancel(false) {
+        _resp[0] = '\0';
+        memset(_patSub, -1, sizeof(_patSub));
+        // 固定パターン（IDは PAT_* の順）
+        _ac.add("OK\r"); _ac.add("ERROR\r"); _ac.add("+CME ERROR"); _ac.add("+CMS ERROR"); _ac.add(">");
+        _st = _ac.lineStartState();
+    }
+
+    // URC購読（prefix 例: "+CADATAIND:"。静的寿命の文字列）
+    bool subscribe(const char* prefix, AtUrcHandler handler, void* ctx = nullptr) {
+        if (_subCount >= AT_MAX_URC_SUBS) return false;
+        int id = addPattern(prefix);
+        if (id < 0) return false;
+        _subs[_subCount] = { handler, ctx };
+        _patSub[id] = (int8_t)_subCount++;
+        return true;
+    }
+
+    /**
+     * コマンドをキューに積む（非ブロッキング）。キュー満杯なら false。
+     * cmd=nullptr は送信せず結果行だけ待つ（">"後の生データ送信に続く OK 等）。
+     * done: 完了述語（nullptr なら OK/ERROR/">" で完了）
+     * onDone: 完了時コールバック（resp は次の poll() まで有効）
+     */
+    bool submit(const char* cmd, uint32_t timeoutMs, AtPredicate done = nullptr, void* doneCtx = nullptr,
+                AtDoneHandler onDone = nullptr, void* ctx = nullptr) {
+        return enqueue(cmd, timeoutMs, done, doneCtx, onDone, ctx) != nullptr;
+    }
+
+    /**
+     * 受信処理・タイムアウト判定・次コマンド送信を1回分進める（非ブロッキング）
+     */
+    void poll() {
+        // 結果行だけ待つ（送信なし）ものは受信より先に開始する（既に届いた OK を不要行として捨てない）
+        if (!_active && _count > 0 && !_q[_head].send) start();
+        _rx.fill(_port.read, _port.ctx);
+        while (_scan != _rx.end()) {
+            if (_binRemain > 0) { binCopy(); continue; }
+            uint8_t c = _rx.at(_scan);
+            _st = _ac.step(_st, c);
+            int m = _ac.match(_st);
+            _scan++;
+            if (m >= 0 && onPattern(m)) continue;
+            if (_binHdr) {
+                // "+CARECV: <len>," の <len> を読み、',' の直後から生データ
+                if (c >= '0' && c <= '9') { _binLen = _binLen * 10 + (c - '0'); continue; }
+                _binHdr = false;
+                if (c == ',') {
+                    _binRemain = _binLen;
+                    _lineStart = _scan; _rx.release(_scan);
+                    _st = 0;
+                    continue;
+                }
+            }
+            if (c == '\n') {
+                endLine(_lineStart, _scan - 1);
+                _lineStart = _scan; _rx.release(_scan);
+                _lineTag = -1;
+            }
+        }
+        // 改行の来ない行でリングが埋まったら行を捨てる
+        if (_rx.space() == 0) { _lineStart = _scan; _rx.release(_scan); _lineTag = -1; }
+
+        if (_active && _port.now() - _q[_head].sentAt > _q[_head].timeoutMs) finish(AT_TIMEOUT);
+        if (!_active && _count > 0) start();
+    }
+
+    // ms の間 poll() を回す（delay() の代わり。待ち中も URC を処理する）
+    void service(uint32_t ms) {
+        uint32_t t = _port.now();
+        while (!_cancel) {
+            poll(); idle();
+            if (_port.now() - t >= ms) break;
+        }
+    }
+
+    /**
+     * 打ち切り（他タスクから呼べる）。実行中・キュー中のコマンドは待っている側で AT_TIMEOUT に
+     * なり、以後のコマンドも送らずに失敗する。resume() は使う側のタスクが止まってから呼ぶこと
+     */
+    void cancel() { _cancel = true; }
+    void resume() { _cancel = false; }
+    bool cancelled() const { return _cancel; }
+
+    bool busy() const { return _active || _count > 0; }
+
+    /**
+     * 1コマンドを実行して完了まで待つ（先行キューがあればその後）
+     */
+    AtStatus exec(const char* cmd, uint32_t timeoutMs, AtPredicate done = nullptr, void* doneCtx = nullptr) {
+        AtStatus st = AT_PENDING;
+        if (!submit(cmd, timeoutMs, done, doneCtx, execDone, &st)) return AT_ERROR;
+        return wait(st);
+    }
+
+    // 生データ送信後の結果行(OK/ERROR)を待つ
+    AtStatus waitResult(uint32_t timeoutMs) { return exec(nullptr, timeoutMs); }
+
+    /**
+     * 応答に生バイト列を含むコマンド（AT+CARECV 等）を実行。
+     * "<prefix><len>," の後の len バイトを out に最大 maxOut 格納（超過分は捨てる）。
+     */
+    AtStatus execBinary(const char* cmd, const char* prefix, uint8_t* out, size_t maxOut,
+                        size_t& got, uint32_t timeoutMs) {
+        AtStatus st = AT_PENDING;
+        got = 0;
+        int pat = addPattern(prefix);
+        if (pat < 0) return AT_ERROR;
+        Slot* s = enqueue(cmd, timeoutMs, nullptr, nullptr, execDone, &st);
+        if (!s) return AT_ERROR;
+        s->binPattern = (int8_t)pat; s->binOut = out; s->binCap = maxOut; s->binGot = &got;
+        return wait(st);
+    }
+
+    // ">" プロンプト後の生データ送信
+    void write(const uint8_t* p, size_t n) { _port.write(p, n, _port.ctx); }
+
+    // 直近に完了したコマンドの応答（次のコマンド開始まで有効）
+    const char* response() const { return _resp; }
+
+private:
+    struct Slot {
+        char cmd[AT_CMD_MAX];
+        bool send;
+        uint32_t timeoutMs;
+        uint32_t sentAt;
+        AtPredicate pred;
+        void* predCtx;
+        AtDoneHandler onDone;
+        void* ctx;
+        bool done;
+        int8_t binPattern;
+        uint8_t* binOut;
+        size_t binCap;
+        size_t* binGot;
+    };
+    struct Sub {
+        AtUrcHandler handler;
+        void* ctx;
+    };
+    enum { PAT_OK = 0, PAT_ERROR, PAT_CME, PAT_CMS, PAT_PROMPT };
+
+    AtPort _port;
+    Slot _q[AT_QUEUE_LEN];
+    uint8_t _head, _count;
+    bool _active;
+    Sub _subs[AT_MAX_URC_SUBS];
+    uint8_t _subCount;
+    UartRing<AT_RX_RING> _rx;
+    AcMatcher<AT_AC_STATES, AT_AC_PATTERNS> _ac;
+    int8_t _patSub[AT_AC_PATTERNS];   // パターンID → 購読インデックス
+    uint8_t _st;                      // 照合器の状態
+    uint32_t _scan;                   // 照合済みの受信位置
+    uint32_t _lineStart;              // 処理中の行の先頭位置
+    int _lineTag;                     // 処理中の行の行頭で一致したパターン
+    bool _binHdr;                     // 生データ長ヘッダ読取中
+    size_t _binLen;
+    char _line[AT_LINE_MAX];          // リング末尾で折り返した行の退避先
+    char _resp[AT_RESP_MAX];
+    size_t _respLen;
+    size_t _binRemain;
+    volatile bool _cancel;
+
+    static void execDone(AtStatus st, const char*, void* ctx) { *(AtStatus*)ctx = st; }
+
+    // 照合パターン追加（表が作り直されたら照合状態を行頭に戻す）
+    int addPattern(const char* prefix) {
+        int id = _ac.find(prefix);
+        if (id >= 0) return id;
+        id = _ac.add(prefix);
+        _st = _ac.lineStartState();
+        return id;
+    }
+
+    Slot* enqueue(const char* cmd, uint32_t timeoutMs, AtPredicate done, void* doneCtx,
+                  AtDoneHandler onDone, void* ctx) {
+        if (_count >= AT_QUEUE_LEN) return nullptr;
+        Slot& s = _q[(_head + _count) % AT_QUEUE_LEN];
+        s.send = cmd != nullptr;
+        if (cmd) { strncpy(s.cmd, cmd, AT_CMD_MAX - 1); s.cmd[AT_CMD_MAX - 1] = '\0'; }
+        else s.cmd[0] = '\0';
+        s.timeoutMs = timeoutMs;
+        s.pred = done; s.predCtx = doneCtx;
+        s.onDone = onDone; s.ctx = ctx;
+        s.done = false;
+        s.binPattern = -1; s.binOut = nullptr; s.binCap = 0; s.binGot = nullptr;
+        _count++;
+        return &s;
+    }
+
+    AtStatus wait(AtStatus& st) {
+        while (st == AT_PENDING) {
+            if (_cancel) { while (_count > 0) finish(AT_TIMEOUT); break; }
+            poll();
+            if (st == AT_PENDING) idle();
+        }
+        return st;
+    }
+
+    void idle() { _port.idle(); }
+
+    void start() {
+        Slot& s = _q[_head];
+        _respLen = 0; _resp[0] = '\0';
+        _active = true;
+        if (s.send) { write((const uint8_t*)s.cmd, strlen(s.cmd)); write((const uint8_t*)"\r\n", 2); }
+        s.sentAt = _port.now();
+    }
+
+    void finish(AtStatus st) {
+        Slot& s = _q[_head];
+        s.done = true;
+        _active = false;
+        _binRemain = 0;
+        _binHdr = false;
+        _head = (_head + 1) % AT_QUEUE_LEN;
+        _count--;
+        if (s.onDone) s.onDone(st, _resp, s.ctx);
+    }
+
+    void append(const char* str) {
+        size_t n = strlen(str);
+        if (_respLen + n > AT_RESP_MAX - 1) n = AT_RESP_MAX - 1 - _respLen;
+        memcpy(_resp + _respLen, str, n);
+        _respLen += n;
+        _resp[_respLen] = '\0';
+    }
+
+    // 生データをリングから出力先へまとめてコピー
+    void binCopy() {
+        Slot& s = _q[_head];
+        size_t n = _rx.end() - _scan;
+        if (n > _binRemain) n = _binRemain;
+        size_t room = (_active && s.binGot && *s.binGot < s.binCap) ? s.binCap - *s.binGot : 0;
+        size_t k = (n < room) ? n : room;
+        if (k > 0) { _rx.copy(_scan, s.binOut + *s.binGot, k); *s.binGot += k; }
+        _scan += n;
+        _binRemain -= n;
+        _lineStart = _scan; _rx.release(_scan);
+    }
+
+    /**
+     * パターン一致時の処理。戻り値 true=このバイトを消費した（通常の行処理をしない）
+     */
+    bool onPattern(int m) {
+        if (m == PAT_PROMPT) {
+            // ">" プロンプトは改行無しで届く
+            if (_active && !_q[_head].binOut) {
+                append(">");
+                _lineStart = _scan; _rx.release(_scan);
+                finish(AT_PROMPT);
+                return true;
+            }
+            return false;
+        }
+        if (_active && m == _q[_head].binPattern) { _binHdr = true; _binLen = 0; return true; }
+        _lineTag = m;
+        return false;
+    }
+
+    // 実行中コマンド "AT+XXX[=?]..." への応答行 "+XXX:" か
+    bool isResponseToActive(const char* line) const {
+        if (!_active || !_q[_head].send) return false;
+        const char* cmd = _q[_head].cmd;
+        if (strncmp(cmd, "AT+", 3) != 0 || line[0] != '+') return false;
+        const char* a = cmd + 3;
+        const char* b = line + 1;
+        while (*a && *a != '=' && *a != '?' && *b && *b != ':' && *a == *b) { a++; b++; }
+        return (*a == '\0' || *a == '=' || *a == '?') && *b == ':';
+    }
+
+    // [start, nl) の1行を処理（nl は '\n' の位置）
+    void endLine(uint32_t start, uint32_t nl) {
+        size_t len = nl - start;
+        if (len > 0 && _rx.at(nl - 1) == '\r') len--;
+        if (len == 0) return;
+        // 行末の '\r' / '\n' の位置を終端にして、リング内をそのまま指す
+        char* line = (char*)_rx.contiguous(start, len + 1);
+        if (!line) {
+            if (len > AT_LINE_MAX - 1) len = AT_LINE_MAX - 1;
+            _rx.copy(start, (uint8_t*)_line, len);
+            line = _line;
+        }
+        line[len] = '\0';
+
+        if (_lineTag >= 0 && _patSub[_lineTag] >= 0 && !isResponseToActive(line)) {
+            const Sub& sub = _subs[_patSub[_lineTag]];
+            sub.handler(line, sub.ctx);
+            return;
+        }
+        if (!_active) return;              // 応答待ち無し: 不要行(RDY等)は捨てる
+        append(line); append("\n");
+        const Slot& s = _q[_head];
+        if (_lineTag == PAT_ERROR || _lineTag == PAT_CME || _lineTag == PAT_CMS) {
+            finish(AT_ERROR);
+        } else if (s.pred) {
+            if (s.pred(_resp, s.predCtx)) finish(AT_MATCH);
+        } else if (_lineTag == PAT_OK) {
+            finish(AT_OK);
+        }
+    }
+};
+
+#endif // AT_ENGINE_H
@@ -71,7 +71,10 @@
 #define TWELITE_BAUD_RATE LORA_BAUD_RATE
 
 // 子機管理設定
-#define MAX_CHILD_DEVICES 8                // 最大子機数
+#define MAX_CHILD_DEVICES 32               // 最大子機数（親機1台あたりの上限。サーバも紐付けをこの数までに制限する:
+                                           // foxsense-api devices.service.js MAX_CHILDREN_PER_PARENT。変える時は両方）
+                                           // RTC: 圧縮蓄積 RTC_ROUND_ARENA_BYTES(2688B) + RoundPackState(544B。予測用に1台16B)
+                                           //      + 子機表160B ≒ 3.4KB。RTC低速メモリ8KBに収まる範囲
 #define CHILD_RESPONSE_TIMEOUT 150000      // 子機受信窓 (ms) 子機起点プッシュを待つ窓
                                            // 【明示同期】150sに拡幅。子機は窓中央(WINDOW_AIM=75s)を
                                            // 狙って起床するので±75sの自RCドリフトを吸収(日中は温度で±60s程度)。
@@ -83,6 +86,9 @@
 // サーバー設定取得間隔（ブート回数ベース）
 // 10分間隔 × 36回 = 約6時間ごとにサーバーから設定再取得
 #define CONFIG_FETCH_INTERVAL 36
+// 設定の条件付き取得: 前回応答のETagを If-None-Match で送り、変更なし(304)なら解析を省く。
+// ETag保持中は毎LTE起床で確認する（変更が無ければ応答はヘッダのみ）
+#define CONFIG_ETAG_ENABLE true
 
 // TWELITEプロトコルコマンド定義
 #define TWELITE_HEADER      0xA5           // パケットヘッダー
@@ -97,6 +103,15 @@
 // ===== バッテリー監視設定 (AXP2101 PMU) =====
 #define BATTERY_LOW_WARN_THRESHOLD 0       // 低バッテリー警告しきい値 (%) ※0=無効
 #define BATTERY_LOW_SHUTDOWN_THRESHOLD 3   // 低バッテリーシャットダウンしきい値 (%)
+// 電池残量による動作段階（energy_governor.h）。下がる時は ENTER 以下、戻る時は EXIT 以上で切替
+#define ENERGY_GOVERNOR_ENABLE true        // false=常に NORMAL（ROUNDS_PER_UPLOAD 固定）
+#define ENERGY_SAVE_ENTER_PCT 40           // これ以下で SAVE（送信間隔延長・AC/設定はヒントのみ・OTAは給電中のみ）
+#define ENERGY_SAVE_EXIT_PCT 55            // これ以上で NORMAL へ戻す
+#define ENERGY_CRITICAL_ENTER_PCT 20       // これ以下で CRITICAL（計測と送信のみ）
+#define ENERGY_CRITICAL_EXIT_PCT 30        // これ以上で SAVE へ戻す
+#define ENERGY_VBUS_PRESENT_MV 4000        // VBUS これ以上で外部給電あり（太陽光/USB）
+#define ENERGY_SAVE_ROUNDS_PER_UPLOAD 4    // SAVE の送信間隔（起床回数。フラッシュ退避なしなら MAX_RTC_ROUNDS で頭打ち）
+#define ENERGY_CRITICAL_ROUNDS_PER_UPLOAD 6  // CRITICAL の送信間隔（同上。最も長い間隔にする: PSM TAU の要求値の基準）
 
 // ===== LTE通信設定 (SIM7080G) =====
 #define MODEM_BAUD_RATE 115200             // SIM7080G通信速度
@@ -111,9 +126,28 @@
 
 // サーバー設定
 #define SERVER_HOST "foxsense.smart-agri-vision.net"  // データ送信先サーバー
-#define SERVER_PORT 443                               // HTTPSポート
+#define SERVER_PORT 443                               // HTTPSポート（SERVER_TLS_ENABLE 時）
+#define SERVER_HTTP_PORT 80                           // 平文HTTPポート
+#define SERVER_TLS_ENABLE false                       // true=起床中のセッションをTLS(ca.pemで検証)で張る。1起床1ハンドシェイク
 #define SERVER_PATH "/api/sensors/ingest"             // データ送信APIエンドポイント（バルク）
 #define SERVER_CONFIG_PATH "/api/devices/config/"     // デバイス設定取得APIパス
+#define INGEST_USE_CBOR false                         // true=バッチをCBOR(application/cbor)で送信, false=JSON
+#define INGEST_ENCODING_STATS true                    // 送信時にJSON/CBORのサイズ・エンコード時間を比較ログ出力
+#define INGEST_HINTS_ENABLE true                      // 送信応答の hints(設定変更/OTA/ACコマンド)で個別の問い合わせを省く
+// 送信順: 1リクエスト目に最新から新しい順に予算内で詰め、残り(停電/圏外明けの積み残し)は古い順に後追い送信(backfill)
+#define UPLOAD_BATCH_MAX_ROUNDS 6                     // 1リクエストあたりのラウンド数上限（ENERGY_CRITICAL_ROUNDS_PER_UPLOAD 以上）
+#define UPLOAD_BACKFILL_BUDGET_BYTES 16384            // 起床1回の送信バイト予算(超過分は次のLTE起床へ)
+#define UPLOAD_BACKFILL_BUDGET_MS 20000               // 同 時間予算
+// 蓄積のフラッシュ退避（round_log.h）: RTC蓄積が一杯になったらLittleFS("spiffs"領域)のログへ移し、後追い送信で古い順に送る
+#define ROUND_LOG_ENABLE true                         // false=従来通りRTCだけ（一杯なら最古を破棄）
+#define ROUND_LOG_SEG_BYTES 16384                     // セグメント1個の上限（LittleFSブロック4KBの倍数）
+#define ROUND_LOG_MAX_SEGS 64                         // 保持するセグメント数（64×16KB=1MB ≒ 子機8台で2か月分。超過で最古を破棄）
+// UDP送信（udp_ingest.h）: サーバ設定で "transport":"udp" の親機だけ。ACKの来ないラウンドはHTTPで送り直す
+#define UDP_INGEST_HOST SERVER_HOST
+#define UDP_INGEST_PORT 5683
+#define UDP_CLIENT_ID 1                               // CAOPEN の cid（HTTPセッション/OTAは0）
+#define UDP_ACK_TIMEOUT_MS 3000                       // 1巡送った後にACKを待つ時間
+#define UDP_SEND_PASSES 3                             // 送信巡回数(初回+再送)
 
 // ===== LTE自動復旧設定 =====
 #define LTE_MAX_RETRY_COUNT 3              // 最大リトライ回数
@@ -125,6 +159,72 @@
 // SIM7080GはCat-M1/NB-IoTのみ対応（2G/3G/4G非対応）
 // SIMカードは電源投入前に挿入必要
 #define MODEM_NETWORK_MODE 38              // 38=LTE only, 51=GSM+LTE
+#define MODEM_CASEND_MAX 1024              // AT+CASEND 1回あたりの最大送信バイト数(超過分は分割送信)
+#define MODEM_FAST_ATTACH true             // APN/RAT設定が残っていればCFUN=0/1の再設定を省く
+#define FAST_ATTACH_REG_TRIES 6            // 高速パスで未在圏時に登録を待つ回数(約5秒/回)。超過でフル初期化
+// バンド学習: 前回アタッチのサービングバンドに絞って探索し(AT+CBANDCFG)、見つからなければ
+// 国内Cat-M1バンド → 全バンド の順に広げる
+#define BAND_CACHE_ENABLE true
+#define CATM_BANDS_REGIONAL "1,3,8,18,19,26,28"                          // 国内キャリアのCat-M1バンド
+#define CATM_BANDS_ALL "1,2,3,4,5,8,12,13,14,18,19,20,25,26,27,28,66,85" // SIM7080G 対応全バンド
+#define BAND_SCAN_TRIES 8                  // 絞り込み探索1段あたりの登録待ち回数(約5秒/回)
+// RAT自動選択: Cat-M1/NB-IoT を送信1バイトあたりの推定エネルギーで選ぶ。
+// NB-IoT 対応のSIM/プランが前提(plan-D は Cat-M1 のみ)なので既定は無効=Cat-M1固定
+#define RAT_ADAPTIVE_ENABLE false
+#define RAT_CATM_ACTIVE_MA 100             // 接続中のモデム平均電流の見積り mA(Cat-M1)。実測で校正する
+#define RAT_NBIOT_ACTIVE_MA 70             // 同(NB-IoT)
+#define RAT_SUPPLY_V 3.8f                  // モデム電源電圧(エネルギー見積り用)
+#define RAT_REEVAL_ATTACHES 24             // 他方のRATを試して再評価する周期(フルアタッチ回数)
+#define RAT_MAX_FAILURES 3                 // 連続アタッチ失敗でそのRATを使わなくなる回数(再評価周期ごとに1回試し直す)
+#define RAT_BOTH_MARGIN 0.15f              // 両RATの差がこの比率以内なら両方許可(CMNB=3)
+// LTE初期化(モデムタスク, PRO_CPU)とLoRa受信窓/センサ(メイン, APP_CPU)を並行させる。
+// 初回起床とNTP同期期限の起床は従来通り直列(窓の前にLTE初期化)
+#define LTE_PARALLEL_ENABLE true
+#define MODEM_TASK_CORE 0
+#define MODEM_TASK_STACK 12288
+#define MODEM_TASK_PRIORITY 1
+#define MODEM_TASK_GRACE_MS 3000           // 締切(g_lteDeadlineMs)後にモデムタスクの完了報告を待つ猶予
+#define MODEM_TASK_ABORT_MS 5000           // 打ち切り(at.cancel)後にモデムタスクの終了報告を待つ上限(PWRKEY 1.1s＋余裕)
+// PSM: LTE送信後にCPSMS=1でPSMへ入れ、ESP32ディープスリープ中も登録を保持して次のLTE起床で
+// 再アタッチせず復帰する(実機での復帰検証が済むまで既定は無効)。T3412はアップロード周期から算出
+#define MODEM_PSM_ENABLE false
+#define PSM_ACTIVE_TIME_SEC 10             // T3324: RRC解放後にPSMへ入るまでの待ち(着信は使わないので短く)
+
+// ===== 電界に応じた送信見送り（upload_policy.h）=====
+// アタッチ直後の RSRP が普段より悪く、今送る余分なエネルギーが「次の起床でもう1回接続する」
+// 費用を上回れば送信を次の起床へ見送る。鮮度・蓄積の空き・連続回数の限度では電界が悪くても送る
+#define UPLOAD_DEFER_ENABLE true
+#define UPLOAD_RSRP_REF_DBM -105           // これ以上の RSRP はカバレッジ拡張なし(倍率1)とみなす
+#define UPLOAD_CE_DB_PER_DOUBLING 5.0f     // RSRP がこれだけ下がる毎に送信エネルギー2倍(繰り返し送信)
+#define UPLOAD_DEFAULT_UJ_PER_BYTE 250.0f  // 学習前の良好時 µJ/byte(100mA×3.8V、3KBを2秒程度)
+#define UPLOAD_FRESHNESS_MAX_SEC (90 * 60) // 最古ラウンドをこれ以上サーバへ届けずにおかない
+#define UPLOAD_MAX_DEFERRALS 2             // 連続見送りの上限
+#define UPLOAD_DEFER_MARGIN 1.5f           // 待つ費用の安全率(大きいほど見送りに慎重)
+#define UPLOAD_RECONNECT_EXTRA_MS 3000     // 見送りで増えるLTE起床の接続以外の通電(CAOPEN/応答待ち)
+#define UPLOAD_HTTP_OVERHEAD_BYTES 400     // 送信バイト見積りに足すHTTPヘッダ・応答分
+
+// ===== 起床サイクルの工程予算（wake_schedule.h）=====
+// 締切は20分グリッド境界からの秒。任意工程(NTP/設定/AC/OTA)は見積りが締切に収まらなければ
+// 次回へ見送り、アタッチの登録待ちは締切で打ち切る。サイクル全体を次グリッドより十分前に終える
+#define WAKE_CYCLE_DEADLINE_SEC 600        // 全工程の締切(これ以降は必須の送信のみ)
+#define WINDOW_LATE_MAX_SEC 40             // 直列起床: LTE初期化で窓openをここまで遅らせてよい(子機は窓中央を狙う)
+#define PHASE_EST_SENSORS_MS 3000          // 工程の見積り ms（予定値として記録し、任意工程の可否判定に使う）
+#define PHASE_EST_ATTACH_MS 60000
+#define PHASE_EST_NTP_MS 5000              // 通常のCNTP所要(応答待ちの上限は30s。NITZ/Dateが使えない時だけ)
+#define PHASE_EST_CONFIG_MS 8000
+#define PHASE_EST_UPLOAD_MS 20000
+#define PHASE_EST_AC_MS 10000
+#define PHASE_EST_OTA_MS 240000            // ダウンロード+書込(1.2MB程度)
+
+// ===== 時計合わせ（time_source.h）=====
+// モデム時計(NITZ/CNTP済み)→HTTP Date→CNTP の順。不確かさ(誤差+経過×ドリフト)だけ受信窓を前後に広げる
+#define TIME_CCLK_ERR_MS 1000              // CCLK読取りの誤差(秒単位)
+#define TIME_HTTP_DATE_ERR_MS 1500         // Date の誤差(秒切捨て+応答遅延)
+#define TIME_AGREE_MAX_MS 2000             // 時計と Date の差がこれ以内なら一致とみなす(超えて説明できなければCNTP)
+#define TIME_MODEM_DRIFT_PPM 20            // モデム時計(水晶)のドリフト
+#define TIME_RC_DRIFT_PPM 1000             // ESP32 RTC(スリープ中)の時計ドリフト見積り
+#define TIME_MODEM_CLOCK_MAX_AGE_SEC (7 * 24 * 3600)   // NITZ/CNTPからこれ以上経ったモデム時計は使わない
+#define WINDOW_TIME_MARGIN_MAX_SEC 30      // 受信窓の前後拡幅の上限(未同期時はこの値)
 
 // ===== ACコマンド設定 =====
 // ACコマンドは10分サイクルの通常起床時にチェック・実行される（最大10分遅延）
@@ -0,0 +1,202 @@
+#ifndef DEVICE_CONFIG_H
+#define DEVICE_CONFIG_H
+
+// =====================================================================
+// デバイス設定応答の解釈（GET /api/devices/config/:id）  ※親機ファーム/ホスト共用
+// ---------------------------------------------------------------------
+// {"success":true,"data":{"parentIdHash":N,"children":[{...},...],"firmware":{...}|null}}
+// を json_tok.h で1回だけ走査し、子機表・ペアリング待ち・OTA情報を呼び出し側の配列へ直接埋める。
+// 応答は受信チャンクのまま渡せる（DeviceConfigParser::feed。全体をバッファしない）。
+// 値は入れ子の位置で判定するので、子機オブジェクト内に将来オブジェクト/配列が増えても
+// 取り違えない（未知のキーは読み飛ばす）。子機が childCap を超えた分は数だけ数えて捨てる。
+// "transport" は送信(ingest)経路の個体別指定（"udp" 以外/無しは HTTP）。
+// =====================================================================
+
+#include <stdint.h>
+#include <stddef.h>
+#include "json_tok.h"
+
+enum IngestTransport : uint8_t { TRANSPORT_HTTP = 0, TRANSPORT_UDP = 1 };
+
+struct ConfigChild {
+    uint32_t id;          // deviceIdNum（0=不正で未格納）
+    uint8_t logicalId;
+    bool pending;         // pairingStatus == "PENDING"
+    char idHex[9];        // deviceId（ペアリング結果の報告用）
+};
+
+struct ConfigFirmware {
+    uint32_t versionCode;
+    uint32_t size;
+    char url[160];
+    char md5[33];
+};
+
+struct DeviceConfig {
+    uint32_t parentIdHash;    // 0=応答に無し
+    bool hasChildren;         // "children" があった（空配列を含む。無ければ子機表を変えない）
+    ConfigChild* children;    // 呼び出し側の配列（childCap 件）
+    uint16_t childCap;
+    uint16_t childCount;      // 格納した子機数
+    uint16_t childTotal;      // 応答中の子機数（childCap 超過・不正分を含む）
+    bool hasFirmware;         // "firmware" がオブジェクトだった（null=最新）
+    ConfigFirmware fw;
+    uint8_t transport;        // IngestTransport
+};
+
+#define DEVICE_CONFIG_WINDOW 384   // 分割入力の作業窓（途中で切れたトークンを次のチャンクとつなぐ）
+static_assert(DEVICE_CONFIG_WINDOW > JSON_TOK_MAX_STRING + 1, "window must hold the longest pending token");
+
+/**
+ * 設定応答を受信チャンクのまま解釈して cfg を埋める（応答全体をバッファしない）。
+ * cfg.children/childCap は呼び出し側で設定しておき、feed() を受信順に呼んで最後に finish()。
+ */
+class DeviceConfigParser {
+public:
+    explicit DeviceConfigParser(DeviceConfig& cfg)
+        : _cfg(cfg), _fill(0), _bytes(0), _state(PARSING), _childrenDepth(0), _fwDepth(0), _skipDepth(0),
+          _inChild(false), _hasKey(false) {
+        cfg.parentIdHash = 0;
+        cfg.hasChildren = false;
+        cfg.childCount = cfg.childTotal = 0;
+        cfg.hasFirmware = false;
+        memset(&cfg.fw, 0, sizeof(cfg.fw));
+        cfg.transport = TRANSPORT_HTTP;
+        _key[0] = '\0';
+    }
+
+    // 受信チャンクを渡す（不正なJSONと分かった後は読み捨てる）
+    void feed(const char* p, size_t n) {
+        _bytes += n;
+        while (n && _state == PARSING) {
+            size_t k = sizeof(_win) - _fill;
+            if (k > n) k = n;
+            memcpy(_win + _fill, p, k);
+            _fill += k; p += k; n -= k;
+            run(false);
+            size_t used = (size_t)(_jp.pos() - _win);   // 残り=途中で切れたトークン
+            memmove(_win, _win + used, _fill - used);
+            _fill -= used;
+        }
+    }
+
+    // 入力の終わり。戻り値: JSONとして最後まで読めた
+    bool finish() {
+        if (_state == PARSING) run(true);
+        return _state == DONE;
+    }
+
+    size_t bytes() const { return _bytes; }   // feed() で受けた総バイト数
+
+private:
+    enum : uint8_t { PARSING, DONE, FAILED };
+
+    DeviceConfig& _cfg;
+    JsonPull _jp;
+    char _win[DEVICE_CONFIG_WINDOW];
+    size_t _fill;
+    size_t _bytes;
+    uint8_t _state;
+    uint8_t _childrenDepth;   // "children" 配列の深さ（0=外）
+    uint8_t _fwDepth;         // "firmware" オブジェクトの深さ
+    uint8_t _skipDepth;       // 読み飛ばし中の入れ子の深さ（0=なし）
+    bool _inChild;
+    ConfigChild _cur;
+    bool _hasKey;             // 直前のトークンがキー（_key。収まらない長さなら空）
+    char _key[24];
+
+    void run(bool final) {
+        _jp.input(_win, _fill, final);
+        JsonToken t;
+        for (;;) {
+            JsonTokType ty = _jp.next(t);
+            if (ty == JT_MORE) return;
+            if (ty == JT_END) { _state = DONE; return; }
+            if (ty == JT_ERROR) { _state = FAILED; return; }
+            token(ty, t);
+        }
+    }
+
+    bool keyIs(const char* k) const { return strcmp(_key, k) == 0; }
+
+    void token(JsonTokType ty, const JsonToken& t) {
+        if (_skipDepth) {
+            if ((ty == JT_OBJ_END || ty == JT_ARR_END) && t.depth == _skipDepth) _skipDepth = 0;
+            return;
+        }
+        if (ty == JT_KEY) {
+            _hasKey = true;
+            if (!JsonPull::copy(t, _key, sizeof(_key))) _key[0] = '\0';
+            return;
+        }
+
+        if (ty == JT_OBJ_END || ty == JT_ARR_END) {
+            if (_inChild && t.depth == _childrenDepth + 1) {
+                _inChild = false;
+                _cfg.childTotal++;
+                if (_cur.id != 0 && _cfg.childCount < _cfg.childCap) _cfg.children[_cfg.childCount++] = _cur;
+            } else if (t.depth == _childrenDepth) {
+                _childrenDepth = 0;
+            } else if (t.depth == _fwDepth) {
+                _fwDepth = 0;
+            }
+            return;
+        }
+
+        bool container = ty == JT_OBJ_BEGIN || ty == JT_ARR_BEGIN;
+        uint8_t at = container ? t.depth - 1 : t.depth;   // 値が置かれている入れ子の深さ
+        bool skip = false;
+
+        if (_childrenDepth && at == _childrenDepth) {
+            // children 配列の要素（オブジェクト以外は無視）
+            if (ty == JT_OBJ_BEGIN) { memset(&_cur, 0, sizeof(_cur)); _inChild = true; }
+            else skip = container;
+        } else if (_inChild && at == _childrenDepth + 1) {
+            // 子機オブジェクトのメンバ（入れ子は読み飛ばす）
+            if (container) skip = true;
+            else if (keyIs("deviceIdNum")) _cur.id = JsonPull::toU32(t);
+            else if (keyIs("logicalId")) _cur.logicalId = (uint8_t)JsonPull::toU32(t);
+            else if (keyIs("pairingStatus")) _cur.pending = JsonPull::eq(t, "PENDING");
+            else if (keyIs("deviceId") && ty == JT_STRING) JsonPull::copy(t, _cur.idHex, sizeof(_cur.idHex));
+        } else if (_fwDepth && at == _fwDepth) {
+            if (container) skip = true;
+            else if (keyIs("versionCode")) _cfg.fw.versionCode = JsonPull::toU32(t);
+            else if (keyIs("size")) _cfg.fw.size = JsonPull::toU32(t);
+            else if (keyIs("url") && ty == JT_STRING) JsonPull::copy(t, _cfg.fw.url, sizeof(_cfg.fw.url));
+            else if (keyIs("md5") && ty == JT_STRING) JsonPull::copy(t, _cfg.fw.md5, sizeof(_cfg.fw.md5));
+        } else if (at <= 2 && _hasKey) {
+            // 設定本体（最上位、または "data" の中）のメンバ
+            if (ty == JT_ARR_BEGIN && keyIs("children")) {
+                _childrenDepth = t.depth;
+                _cfg.hasChildren = true;
+            } else if (ty == JT_OBJ_BEGIN && keyIs("firmware")) {
+                _fwDepth = t.depth;
+                _cfg.hasFirmware = true;
+            } else if (ty == JT_OBJ_BEGIN && at == 1 && keyIs("data")) {
+                // 中へ進む
+            } else if (container) {
+                skip = true;
+            } else if (keyIs("parentIdHash")) {
+                _cfg.parentIdHash = JsonPull::toU32(t);
+            } else if (keyIs("transport")) {
+                _cfg.transport = JsonPull::eq(t, "udp") ? TRANSPORT_UDP : TRANSPORT_HTTP;
+            }
+        } else if (container && at > 0) {
+            skip = true;
+        }
+        if (skip) _skipDepth = t.depth;
+        _hasKey = false;
+    }
+};
+
+/**
+ * 応答全体が手元にある時の版（cfg.children/childCap は呼び出し側で設定しておく）。
+ * 戻り値: JSONとして最後まで読めた
+ */
+inline bool parseDeviceConfig(const char* js, size_t len, DeviceConfig& cfg) {
+    DeviceConfigParser p(cfg);
+    p.feed(js, len);
+    return p.finish();
+}
+
+#endif // DEVICE_CONFIG_H
@@ -0,0 +1,112 @@
+#ifndef ENERGY_GOVERNOR_H
+#define ENERGY_GOVERNOR_H
+
+// =====================================================================
+// 電池残量に応じた動作段階（送信周期・設定/ACの問い合わせ・OTAの可否）  ※親機ファーム/ホスト共用
+// ---------------------------------------------------------------------
+// 太陽光+電池の親機は冬場に日照が足りず残量が落ちる。起床毎に PMU の残量%・VBUS・充電中を読み、
+//   NORMAL   : 通常（ROUNDS_PER_UPLOAD 毎に送信、設定はETagで毎LTE起床確認、ACも問い合わせ、OTA可）
+//   SAVE     : 送信間隔を延ばし、設定は取得周期/応答ヒントのみ、ACは応答ヒントで届いた分だけ、
+//              OTAは外部給電中のみ
+//   CRITICAL : さらに送信間隔を延ばし、設定/AC/OTAはしない（計測と送信だけ）
+// の段階を決める。境目でばたつかないよう、下がる時は enter、戻る時は exit（enter より高い）
+// を跨いだ時だけ変える。充電中は exit を待たず enter を上回れば1段戻す（日中に回復したら早めに戻す）。
+// 電池が無い/残量不明（PMU無し・外部電源のみ。ENERGY_NO_BATTERY）は NORMAL。
+// 電池があって残量0%は段階を飛ばしてでも CRITICAL にする（最も負荷を落とすべき時）。
+// 段階は送信ボディ（CBORキー11 / JSON "energy"）でサーバへ申告する。
+// 状態はRTCに置く前提のPOD（ゼロ初期化=NORMAL）。
+// =====================================================================
+
+#include <stdint.h>
+
+enum EnergyTier : uint8_t {
+    ENERGY_NORMAL = 0,
+    ENERGY_SAVE,
+    ENERGY_CRITICAL
+};
+
+static const char* const kEnergyTierName[] = { "normal", "save", "critical" };
+
+#define ENERGY_NO_BATTERY -1   // EnergyReading::batteryPct: 電池なし/残量不明
+
+// PMU の読み値
+struct EnergyReading {
+    int batteryPct;        // 0..100、電池なし/不明は ENERGY_NO_BATTERY
+    int vbusMv;            // 外部給電(太陽光/USB)の電圧
+    bool charging;
+};
+
+struct EnergyParams {
+    uint8_t saveEnterPct;       // これ以下で SAVE へ
+    uint8_t saveExitPct;        // これ以上で SAVE から NORMAL へ
+    uint8_t criticalEnterPct;   // これ以下で CRITICAL へ
+    uint8_t criticalExitPct;    // これ以上で CRITICAL から SAVE へ
+    int vbusPresentMv;          // これ以上で外部給電あり
+    uint8_t roundsPerUpload[3]; // 段階別の送信周期（起床回数。蓄積上限で頭打ち）
+    uint8_t queueCap;           // 蓄積上限（MAX_RTC_ROUNDS）
+};
+
+// RTC 状態
+struct EnergyState {
+    uint8_t tier;               // EnergyTier
+    uint8_t lastPct;            // 前回の残量（ログ用）
+    bool charging;              // 前回の読み値（送信ボディに載せる）
+    uint16_t changes;           // 段階が変わった回数
+};
+
+// 段階毎の動作
+struct EnergyPlan {
+    uint8_t roundsPerUpload;    // LTE送信の間隔（起床回数）
+    bool configFetch;           // 取得周期/応答ヒントで設定を取り直す
+    bool configPoll;            // ETag保持中に毎LTE起床で設定を確認する
+    bool acPoll;                // 応答ヒントが無くても ac-command を問い合わせる
+    bool acFromHints;           // 応答ヒントで届いたACコマンドを実行する
+    bool otaAllowed;            // OTA を実行してよい（電池残量の個別条件は別途）
+    bool externalPower;
+};
+
+inline bool energyExternal(const EnergyReading& r, const EnergyParams& p) {
+    return r.vbusMv >= p.vbusPresentMv;
+}
+
+/**
+ * 読み値から段階を更新して返す（1回の呼び出しで動くのは1段まで。残量0%だけは直ちに CRITICAL）
+ */
+inline uint8_t energyUpdate(EnergyState& s, const EnergyReading& r, const EnergyParams& p) {
+    uint8_t t = s.tier <= ENERGY_CRITICAL ? s.tier : (uint8_t)ENERGY_NORMAL;
+    int pct = r.batteryPct;
+    if (pct < 0) {
+        t = ENERGY_NORMAL;   // 電池なし/不明
+    } else if (pct == 0) {
+        t = ENERGY_CRITICAL;
+    } else if (t == ENERGY_NORMAL) {
+        if (pct <= p.saveEnterPct) t = ENERGY_SAVE;
+    } else if (t == ENERGY_SAVE) {
+        if (pct <= p.criticalEnterPct) t = ENERGY_CRITICAL;
+        else if (pct >= p.saveExitPct || (r.charging && pct > p.saveEnterPct)) t = ENERGY_NORMAL;
+    } else {
+        if (pct >= p.criticalExitPct || (r.charging && pct > p.criticalEnterPct)) t = ENERGY_SAVE;
+    }
+    if (t != s.tier && s.changes < 0xFFFF) s.changes++;
+    s.tier = t;
+    s.lastPct = pct > 0 ? (uint8_t)pct : 0;
+    s.charging = r.charging;
+    return t;
+}
+
+inline EnergyPlan energyPlan(uint8_t tier, const EnergyReading& r, const EnergyParams& p) {
+    EnergyPlan e;
+    if (tier > ENERGY_CRITICAL) tier = ENERGY_NORMAL;
+    e.roundsPerUpload = p.roundsPerUpload[tier];
+    if (e.roundsPerUpload < 1) e.roundsPerUpload = 1;
+    if (e.roundsPerUpload > p.queueCap) e.roundsPerUpload = p.queueCap;
+    e.externalPower = energyExternal(r, p);
+    e.configFetch = tier != ENERGY_CRITICAL;
+    e.configPoll = tier == ENERGY_NORMAL;
+    e.acPoll = tier == ENERGY_NORMAL;
+    e.acFromHints = tier != ENERGY_CRITICAL;
+    e.otaAllowed = tier == ENERGY_NORMAL || (tier == ENERGY_SAVE && e.externalPower);
+    return e;
+}
+
+#endif // ENERGY_GOVERNOR_H
@@ -0,0 +1,208 @@
+#ifndef HTTP_PARSER_H
+#define HTTP_PARSER_H
+
+// =====================================================================
+// インクリメンタルHTTP/1.1応答パーサ  ※親機ファーム/ホスト共用
+// ---------------------------------------------------------------------
+// CARECVは最大1460バイト単位で届き、ステータス行やヘッダがチャンク境界で
+// 分断されうる。応答全体をStringに溜めて indexOf を繰り返す代わりに、受信した
+// バイト列をそのまま feed() し、状態機械で
+//   ステータス行 → ヘッダ(Content-Length / Transfer-Encoding: chunked / Connection / Date)
+//   → ボディ(長さ指定 / chunked / 切断まで)
+// を追う。ボディはコールバックへ逐次渡すので呼び出し側はバッファ不要。
+// done() になった時点で受信ループを打ち切れる。
+// =====================================================================
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdlib.h>
+
+typedef void (*HttpBodySink)(const uint8_t* p, size_t n, void* ctx);
+typedef void (*HttpHeaderSink)(const char* name, const char* value, void* ctx);
+
+class HttpResponseParser {
+public:
+    HttpResponseParser(HttpBodySink onBody = nullptr, void* bodyCtx = nullptr,
+                       HttpHeaderSink onHeader = nullptr, void* headerCtx = nullptr)
+        : _onBody(onBody), _bodyCtx(bodyCtx), _onHeader(onHeader), _headerCtx(headerCtx) { reset(); }
+
+    // 次の応答に備えて状態を初期化（コールバックは保持）
+    void reset() {
+        _state = SEEK; _seek = 0; _lineLen = 0;
+        _status = 0; _contentLength = -1; _chunked = false; _close = false;
+        _remain = 0; _bodyBytes = 0;
+        _date[0] = '\0';
+    }
+
+    /**
+     * 受信バイト列を投入。戻り値=消費したバイト数
+     * (応答末尾で止まるので n 未満なら以降は次の応答/残滓)
+     */
+    size_t feed(const uint8_t* p, size_t n) {
+        size_t i = 0;
+        while (i < n && _state != DONE && _state != FAILED) {
+            switch (_state) {
+            case SEEK: {
+                // 古いモデムバッファの残滓を読み飛ばし "HTTP/" から開始
+                static const char kMagic[] = "HTTP/";
+                char c = (char)p[i++];
+                _seek = (c == kMagic[_seek]) ? _seek + 1 : (c == 'H' ? 1 : 0);
+                if (_seek == 5) { memcpy(_line, kMagic, 5); _lineLen = 5; _state = STATUS_LINE; }
+                break;
+            }
+            case STATUS_LINE:
+            case HEADER_LINE:
+            case CHUNK_SIZE:
+            case CHUNK_TRAILER:
+                if (readLine(p[i++])) onLine();
+                break;
+            case BODY: {
+                size_t c = n - i;
+                if (_contentLength >= 0 && c > _remain) c = _remain;
+                emit(p + i, c); i += c;
+                if (_contentLength >= 0 && (_remain -= c) == 0) _state = DONE;
+                break;
+            }
+            case CHUNK_DATA: {
+                size_t c = n - i;
+                if (c > _remain) c = _remain;
+                emit(p + i, c); i += c;
+                if ((_remain -= c) == 0) { _state = CHUNK_DATA_END; _lineLen = 0; }
+                break;
+            }
+            case CHUNK_DATA_END:
+                // チャンクデータ直後の CRLF
+                if (readLine(p[i++])) _state = CHUNK_SIZE;
+                break;
+            default:
+                i = n;
+                break;
+            }
+        }
+        return i;
+    }
+
+    /**
+     * 接続終了(受信が途切れた)を通知。長さ不明のボディはここで完了扱い
+     */
+    void finish() {
+        if (_state == BODY && _contentLength < 0) _state = DONE;
+    }
+
+    bool done() const           { return _state == DONE; }
+    bool failed() const         { return _state == FAILED; }
+    bool started() const        { return _state != SEEK || _seek > 0; }
+    bool headersDone() const    { return _state >= BODY && _state != FAILED; }
+    int status() const          { return _status; }
+    long contentLength() const  { return _contentLength; }
+    bool chunked() const        { return _chunked; }
+    bool connectionClose() const { return _close; }
+    size_t bodyBytes() const    { return _bodyBytes; }
+    const char* date() const    { return _date; }   // Date ヘッダの値（無ければ空。時計合わせ用）
+
+private:
+    enum State { SEEK, STATUS_LINE, HEADER_LINE, BODY, CHUNK_SIZE, CHUNK_DATA, CHUNK_DATA_END,
+                 CHUNK_TRAILER, DONE, FAILED };
+
+    HttpBodySink _onBody;
+    void* _bodyCtx;
+    HttpHeaderSink _onHeader;
+    void* _headerCtx;
+
+    State _state;
+    uint8_t _seek;
+    char _line[192];      // 1行分（超過分は切り捨て。ヘッダ名と値の先頭が読めれば十分）
+    size_t _lineLen;
+    int _status;
+    long _contentLength;
+    bool _chunked;
+    bool _close;
+    size_t _remain;
+    size_t _bodyBytes;
+    char _date[32];       // "Sun, 06 Nov 1994 08:49:37 GMT"
+
+    // 1バイト追加し、行末(LF)なら true（_line は CR/LF 除去済み・終端付き）
+    bool readLine(uint8_t c) {
+        if (c == '\n') {
+            if (_lineLen > 0 && _line[_lineLen - 1] == '\r') _lineLen--;
+            _line[_lineLen] = '\0';
+            return true;
+        }
+        if (_lineLen < sizeof(_line) - 1) _line[_lineLen++] = (char)c;
+        return false;
+    }
+
+    void emit(const uint8_t* p, size_t n) {
+        if (n == 0) return;
+        _bodyBytes += n;
+        if (_onBody) _onBody(p, n, _bodyCtx);
+    }
+
+    static bool startsWithNoCase(const char* s, const char* prefix) {
+        for (; *prefix; s++, prefix++) {
+            char a = *s, b = *prefix;
+            if (a >= 'A' && a <= 'Z') a += 'a' - 'A';
+            if (a != b) return false;
+        }
+        return true;
+    }
+
+    static bool containsNoCase(const char* s, const char* word) {
+        for (; *s; s++) if (startsWithNoCase(s, word)) return true;
+        return false;
+    }
+
+    void onLine() {
+        char* line = _line;
+        _lineLen = 0;
+        switch (_state) {
+        case STATUS_LINE: {
+            // "HTTP/1.1 200 OK"
+            const char* sp = strchr(line, ' ');
+            _status = sp ? atoi(sp + 1) : 0;
+            _state = (_status >= 100) ? HEADER_LINE : FAILED;
+            break;
+        }
+        case HEADER_LINE: {
+            if (*line == '\0') { headersEnd(); break; }
+            char* colon = strchr(line, ':');
+            if (!colon) break;
+            *colon = '\0';
+            const char* v = colon + 1;
+            while (*v == ' ' || *v == '\t') v++;
+            if (startsWithNoCase(line, "content-length") && line[14] == '\0') _contentLength = atol(v);
+            else if (startsWithNoCase(line, "transfer-encoding") && containsNoCase(v, "chunked")) _chunked = true;
+            else if (startsWithNoCase(line, "connection") && containsNoCase(v, "close")) _close = true;
+            else if (startsWithNoCase(line, "date") && line[4] == '\0') {
+                strncpy(_date, v, sizeof(_date) - 1);
+                _date[sizeof(_date) - 1] = '\0';
+            }
+            if (_onHeader) _onHeader(line, v, _headerCtx);
+            break;
+        }
+        case CHUNK_SIZE: {
+            // "1a2b[;ext]"。0 なら最終チャンク→トレーラ
+            _remain = strtoul(line, nullptr, 16);
+            _state = (_remain > 0) ? CHUNK_DATA : CHUNK_TRAILER;
+            break;
+        }
+        case CHUNK_TRAILER:
+            if (*line == '\0') _state = DONE;
+            break;
+        default:
+            break;
+        }
+    }
+
+    void headersEnd() {
+        if (_status < 200) { reset(); return; }   // 1xx 暫定応答: 本応答を待ち直す
+        if (_status == 204 || _status == 304) { _state = DONE; return; }
+        if (_chunked) { _state = CHUNK_SIZE; _contentLength = -1; return; }
+        _state = BODY;
+        if (_contentLength == 0) _state = DONE;
+        else if (_contentLength > 0) _remain = (size_t)_contentLength;
+    }
+};
+
+#endif // HTTP_PARSER_H
@@ -0,0 +1,185 @@
+#ifndef JSON_TOK_H
+#define JSON_TOK_H
+
+// =====================================================================
+// JSONプル型トークナイザ（jsmn方式・ゼロコピー）  ※親機ファーム/ホスト共用
+// ---------------------------------------------------------------------
+// 入力バッファを1回走査し、next() の呼び出し毎にトークンを1個返す。トークンは入力内の
+// 位置(p,len)を指すだけで文字列を複製しない（文字列はエスケープ未解除の生の中身）。
+// jsmn はトークン配列を事前確保するが、子機数に比例して配列が伸びる（64台で1000超）ため
+// 配列は持たず、呼び出し側が depth を見て必要な値だけ拾う。
+// 入れ子は JSON_TOK_MAX_DEPTH まで（超過・不正な構造は JT_ERROR）。
+//
+// 分割入力: 引数なしで作って input(js, len, false) で受信チャンクを順に渡すと、トークンの途中で
+// 入力が尽きたところで JT_MORE を返す（pos() 以降は未消費。呼び出し側が残りに次のチャンクを足して
+// 渡し直す）。最後は input(..., true) で終端を知らせる。JSON_TOK_MAX_STRING を超える文字列は
+// 先頭だけのトークンとして返し、残りは読み捨てる（子機名など使わない長い値で止まらないため）。
+// =====================================================================
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdlib.h>
+
+#define JSON_TOK_MAX_DEPTH 16
+#define JSON_TOK_MAX_STRING 192      // 分割入力で1トークンとして返す文字列の最大長（超過分は捨てる）
+#define JSON_TOK_MAX_PRIMITIVE 32    // 分割入力で待つ数値/true/false/null の最大長（超過は不正）
+
+enum JsonTokType : uint8_t {
+    JT_END = 0,        // 入力終端（最上位の値が閉じた）
+    JT_OBJ_BEGIN, JT_OBJ_END,
+    JT_ARR_BEGIN, JT_ARR_END,
+    JT_KEY,            // オブジェクトのキー（p,len = 引用符の内側）
+    JT_STRING,         // 文字列値（p,len = 引用符の内側）
+    JT_PRIMITIVE,      // 数値/true/false/null（p,len = 字句そのまま）
+    JT_ERROR,
+    JT_MORE            // 分割入力: 入力が尽きた（次のチャンクを足して input() し直す）
+};
+
+struct JsonToken {
+    JsonTokType type;
+    const char* p;
+    size_t len;
+    uint8_t depth;     // 入れ子の深さ（最上位のオブジェクトの中身=1。BEGIN/END はその入れ子自身の深さ）
+};
+
+class JsonPull {
+public:
+    // 入力全体を一度に渡す
+    JsonPull(const char* js, size_t len) : JsonPull() { input(js, len, true); }
+    // 分割入力（input() で渡す）
+    JsonPull() : _p(nullptr), _end(nullptr), _final(false), _depth(0), _objMask(0), _expectKey(false),
+                 _skipStr(false), _esc(false) {}
+
+    // 続きの入力を渡す（前回の pos() 以降の未消費分を先頭に含めること）。final=これで終わり
+    void input(const char* js, size_t len, bool final) { _p = js; _end = js + len; _final = final; }
+    const char* pos() const { return _p; }
+
+    JsonTokType next(JsonToken& t) {
+        for (;;) {
+            if (_skipStr && !skipStringTail()) return emit(t, _final ? JT_ERROR : JT_MORE, _p, 0);
+            while (_p < _end && (*_p == ' ' || *_p == '\t' || *_p == '\r' || *_p == '\n' || *_p == ':')) _p++;
+            if (_p >= _end) return emit(t, !_final ? JT_MORE : _depth == 0 ? JT_END : JT_ERROR, _p, 0);
+            char c = *_p;
+            if (c == ',') { _p++; if (inObject()) _expectKey = true; continue; }
+            if (c == '{' || c == '[') {
+                if (_depth >= JSON_TOK_MAX_DEPTH) return emit(t, JT_ERROR, _p, 0);
+                _p++;
+                bool obj = c == '{';
+                if (obj) _objMask |= (1u << _depth); else _objMask &= ~(1u << _depth);
+                _depth++;
+                _expectKey = obj;
+                return emit(t, obj ? JT_OBJ_BEGIN : JT_ARR_BEGIN, _p - 1, 1);
+            }
+            if (c == '}' || c == ']') {
+                if (_depth == 0 || (c == '}') != inObject()) return emit(t, JT_ERROR, _p, 0);
+                _p++;
+                emit(t, c == '}' ? JT_OBJ_END : JT_ARR_END, _p - 1, 1);
+                _depth--;
+                _expectKey = false;
+                return t.type;
+            }
+            if (c == '"') {
+                const char* s = _p + 1;
+                const char* q = s;
+                bool esc = false;   // 入力がエスケープの '\' で尽きた
+                while (q < _end && *q != '"') {
+                    if (*q == '\\' && ++q >= _end) { esc = true; break; }
+                    q++;
+                }
+                bool key = inObject() && _expectKey;
+                if (q >= _end) {
+                    if (_final) return emit(t, JT_ERROR, s, 0);
+                    if (_end - s < JSON_TOK_MAX_STRING) return emit(t, JT_MORE, _p, 0);   // 閉じ引用符を待つ
+                    // 長すぎる: 先頭だけ返して残りは読み捨てる
+                    _esc = esc;
+                    _skipStr = true;
+                    _p = _end;
+                    _expectKey = false;
+                    return emit(t, key ? JT_KEY : JT_STRING, s, JSON_TOK_MAX_STRING);
+                }
+                _expectKey = false;
+                emit(t, key ? JT_KEY : JT_STRING, s, (size_t)(q - s));
+                _p = q + 1;
+                return t.type;
+            }
+            const char* s = _p;
+            const char* q = _p;
+            while (q < _end && *q != ',' && *q != ']' && *q != '}' &&
+                   *q != ' ' && *q != '\t' && *q != '\r' && *q != '\n') q++;
+            if (q >= _end && !_final) {
+                return emit(t, q - s < JSON_TOK_MAX_PRIMITIVE ? JT_MORE : JT_ERROR, s, 0);   // 区切りを待つ
+            }
+            _p = q;
+            _expectKey = false;
+            return emit(t, JT_PRIMITIVE, s, (size_t)(_p - s));
+        }
+    }
+
+    /**
+     * 直前に返した OBJ_BEGIN/ARR_BEGIN の中身を読み飛ばして対応する END の直後へ進む
+     * （入力全体を渡した時のみ。分割入力では呼び出し側が END の depth を見て読み飛ばす）
+     */
+    bool skipContainer() {
+        uint8_t target = _depth - 1;
+        JsonToken t;
+        while (_depth > target) {
+            JsonTokType ty = next(t);
+            if (ty == JT_ERROR || ty == JT_END) return false;
+        }
+        return true;
+    }
+
+    uint8_t depth() const { return _depth; }
+
+    // ---- トークン値のヘルパ ----
+    static bool eq(const JsonToken& t, const char* s) {
+        size_t n = strlen(s);
+        return t.len == n && memcmp(t.p, s, n) == 0;
+    }
+
+    static uint32_t toU32(const JsonToken& t) {
+        char buf[24];
+        size_t n = t.len < sizeof(buf) - 1 ? t.len : sizeof(buf) - 1;
+        memcpy(buf, t.p, n); buf[n] = '\0';
+        return (uint32_t)strtoul(buf, nullptr, 10);
+    }
+
+    static bool isNull(const JsonToken& t) { return t.type == JT_PRIMITIVE && eq(t, "null"); }
+
+    // 文字列を終端付きでコピー（収まらなければ切り詰めて false）
+    static bool copy(const JsonToken& t, char* out, size_t cap) {
+        size_t n = t.len < cap - 1 ? t.len : cap - 1;
+        memcpy(out, t.p, n); out[n] = '\0';
+        return n == t.len;
+    }
+
+private:
+    const char* _p;
+    const char* _end;
+    bool _final;          // 入力はここで終わり（false=尽きたら JT_MORE）
+    uint8_t _depth;
+    uint32_t _objMask;    // bit d = 深さ d+1 の入れ子がオブジェクト
+    bool _expectKey;
+    bool _skipStr;        // 長すぎる文字列の残りを読み捨て中
+    bool _esc;            // 読み捨て中、直前の入力がエスケープの '\' で終わった
+
+    bool inObject() const { return _depth > 0 && (_objMask & (1u << (_depth - 1))); }
+
+    // 読み捨て中の文字列を閉じ引用符まで進める（false=入力が尽きた）
+    bool skipStringTail() {
+        for (; _p < _end; _p++) {
+            if (_esc) { _esc = false; continue; }
+            if (*_p == '\\') { _esc = true; continue; }
+            if (*_p == '"') { _p++; _skipStr = false; return true; }
+        }
+        return false;
+    }
+
+    JsonTokType emit(JsonToken& t, JsonTokType type, const char* p, size_t len) {
+        t.type = type; t.p = p; t.len = len; t.depth = _depth;
+        return type;
+    }
+};
+
+#endif // JSON_TOK_H
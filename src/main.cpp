@@ -34,6 +34,23 @@
 #include "ca_cert.h"
 #include "ir_control.h"
 #include "e220.h"
+#include "round_data.h"
+#include "round_cbor.h"
+#include "round_json.h"
+#include "payload_writer.h"
+#include "http_parser.h"
+#include "at_engine.h"
+#include "psm_timer.h"
+#include "rat_select.h"
+#include "wake_schedule.h"
+#include "device_config.h"
+#include "time_source.h"
+#include "udp_ingest.h"
+#include "upload_policy.h"
+#include "energy_governor.h"
+#include "round_log.h"
+#include "round_pack.h"
+#include <LittleFS.h>        // 蓄積のフラッシュ退避（round_log.h）
 #include <Update.h>          // LTE OTA: ota_1面への書込
 #include "esp_ota_ops.h"     // LTE OTA: ロールバック/確定
 
@@ -44,7 +61,18 @@
 #else
 #define ROUNDS_PER_UPLOAD 3          // LTE送信は3回に1回(20分×3≒1時間)。それまでRTCに蓄積
 #endif
-#define MAX_RTC_ROUNDS 4             // 蓄積上限(超過で最古を破棄)
+#define MAX_RTC_ROUNDS 48            // RTC蓄積の件数上限(圧縮表現 round_pack.h。超過分はフラッシュのログへ退避。退避できなければ最古を破棄)
+#define RTC_ROUND_ARENA_BYTES 2688   // 圧縮ラウンドの領域(状態と合わせて旧 RtcRound×4 の 3264 バイト以内。子機8台で約60ラウンド)
+// 最も長いLTE起床間隔（起床回数。電池残量の段階で延びる）
+#define MAX_ROUNDS_PER_UPLOAD ENERGY_CRITICAL_ROUNDS_PER_UPLOAD
+#if MAX_ROUNDS_PER_UPLOAD > MAX_RTC_ROUNDS
+#error "ENERGY_CRITICAL_ROUNDS_PER_UPLOAD exceeds MAX_RTC_ROUNDS"
+#endif
+#if MAX_ROUNDS_PER_UPLOAD > UPLOAD_BATCH_MAX_ROUNDS
+#error "UPLOAD_BATCH_MAX_ROUNDS must hold one upload interval (ENERGY_CRITICAL_ROUNDS_PER_UPLOAD)"
+#endif
+// PSM周期TAU(T3412)の要求値: 最も長いLTE起床間隔の2倍。次のLTE起床までに登録が切れない長さ
+#define PSM_TAU_SEC ((uint32_t)MAX_ROUNDS_PER_UPLOAD * MEASUREMENT_INTERVAL_MIN * 60 * 2)
 #define NTP_SYNC_INTERVAL_SEC (24 * 60 * 60)  // 24時間
 
 // 【明示同期+窓のNTP固定】親のDATA_ACKに「次の受信窓が開くまでの秒数」を載せ、子機が
@@ -54,6 +82,10 @@
 // 対策: 親は起床後NTPで grid境界+WINDOW_OPEN_OFFSET_SEC まで待ってから窓を開く=窓位置を
 // 絶対時刻に固定。OFFSETはLTEモデム初期化(実測~76s)を吸収できる値にする(窓はLTE初期化の後)。
 #define WINDOW_OPEN_OFFSET_SEC 100   // grid境界→受信窓openの固定オフセット(NTP絶対)。~76sのLTE初期化+余裕
+// LTE初期化を受信窓と並行させる起床(LTE_PARALLEL_ENABLE)と非LTE起床の窓オフセット。
+// 起床(RC早起き含む)→PMU/センサ/E220初期化を吸収できればよい。子機はACKの「次窓まで秒」に
+// 従うので、起床毎にオフセットが変わっても窓中央を狙える。
+#define WINDOW_OPEN_OFFSET_PARALLEL_SEC 20
 #define SKIP_BATTERY_CHECK true
 
 // 子機データ構造体
@@ -73,10 +105,81 @@ struct ChildData {
 
 // RTCメモリに保存するデータ（ディープスリープ後も保持）
 RTC_DATA_ATTR uint32_t bootCount = 0;
-RTC_DATA_ATTR time_t lastNtpSyncTime = 0;
-RTC_DATA_ATTR bool ntpSynced = false;
+RTC_DATA_ATTR time_t lastNtpSyncTime = 0;     // 最後に時計を合わせた時刻（NITZ/Date/CNTP のいずれか）
+RTC_DATA_ATTR bool ntpSynced = false;          // 時計を一度でも合わせた
+RTC_DATA_ATTR TimeQuality timeQuality = {};    // 時計の情報源と誤差（受信窓マージンの算出用）
+RTC_DATA_ATTR TimeQuality modemClock = {};     // モデム時計(CCLK)をNITZ/CNTPで合わせた記録（モデム再起動で無効）
+TimeSample httpDate = {};                      // 本起床で最後に受けた HTTP Date
+int g_windowMarginSec = 0;                     // 時計の不確かさ分だけ受信窓を前後に広げる秒
 RTC_DATA_ATTR int consecutiveFailures = 0;
 RTC_DATA_ATTR bool modemNeedsReset = false;  // SHCONN失敗時: 次回CFUN=1,1でHTTPモジュール再初期化
+RTC_DATA_ATTR char rtcImsi[16] = "";           // SIM情報キャッシュ（初回のみ CIMI/CCID を問い合わせ）
+RTC_DATA_ATTR char rtcIccid[24] = "";
+
+// LTEアタッチの工程別所要時間 ms（直近の initModem。高速パスの効果確認用）
+struct AttachTiming {
+    uint32_t powerOn;       // 電源確認〜ATE0/CMEE
+    uint32_t sim;           // CPIN〜SIM情報（CFUN=1,1 リセット含む）
+    uint32_t check;         // 高速パス判定（CPSI/CGDCONT/CNMP/CMNB 照会）
+    uint32_t provision;     // フル初期化（CFUN=0→設定→CFUN=1→COPS）
+    uint32_t registration;  // 登録待ち
+    uint32_t pdp;           // connectNetwork
+    uint32_t total;
+    bool fast;              // 高速パスで接続できた
+    uint8_t bandScope;      // 登録できた探索範囲（BandScope）
+};
+RTC_DATA_ATTR AttachTiming lastAttach = {};
+
+// 登録時のバンド探索範囲（学習バンド → 国内Cat-M1バンド → 全バンド の順に広げる）
+enum BandScope : uint8_t { BAND_SCOPE_CACHED = 0, BAND_SCOPE_REGIONAL = 1, BAND_SCOPE_ALL = 2, BAND_SCOPE_NONE = 3 };
+static const char* const kBandScopeName[] = { "cached", "regional", "all", "none" };
+
+// 前回アタッチ時のサービングセル（AT+CPSI? から学習）
+struct BandCache {
+    uint8_t band;           // EUTRAN-BANDn（0=未学習）
+    uint16_t earfcn;
+    char oper[8];           // MCC-MNC "440-10"
+};
+RTC_DATA_ATTR BandCache bandCache = {};
+
+// RAT選択（Cat-M1/NB-IoT の µJ/byte 計測。判定は rat_select.h）
+RTC_DATA_ATTR RatStats ratStats = {};
+uint8_t ratMode = RAT_CMNB_CATM;     // 本起床でアタッチに使う AT+CMNB 値
+uint8_t servingRat = RAT_UNKNOWN;    // 本起床で在圏したRAT（AT+CPSI? から）
+uint32_t wakeHttpMs = 0;             // 本起床のHTTP送受信に要した時間
+uint32_t wakeHttpBytes = 0;          // 本起床のHTTP送受信バイト（ヘッダ込み）
+uint8_t wakeOpens = 0;               // 本起床のセッション確立回数（送信後に linkStats へ移し、次回のバッチで報告）
+uint32_t wakeOpenMs = 0;             // その所要の合計
+
+// PSM: 前回スリープ前にPSMを設定しネットワークが十分なT3412を付与した（次回は復帰を試す）
+RTC_DATA_ATTR bool psmArmed = false;
+// LTE接続の累計計測（バッチのエンベロープ "link" で送信。構造体は round_data.h）
+RTC_DATA_ATTR LinkStats linkStats = {};
+static const char* const kUpTransportName[] = { "http", "udp", "udp+http" };   // linkStats.upTransport
+// 電界に応じた送信見送り（upload_policy.h）。見送った起床の次は LoRa 起床でもLTEで再判定する
+RTC_DATA_ATTR UploadPolicyState uploadPolicy = {};
+RTC_DATA_ATTR bool uploadDeferred = false;
+LinkQuality linkQuality = {};       // 本起床のアタッチ直後の電界
+// 電池残量による動作段階（energy_governor.h）。段階はRTC、動作は起床毎にPMUの読み値から決める
+RTC_DATA_ATTR EnergyState energyState = {};
+RTC_DATA_ATTR uint8_t wakesSinceLte = 0;   // 前回のLTE起床からの起床回数
+EnergyPlan energyPlanNow = { ROUNDS_PER_UPLOAD, true, true, true, true, true, false };
+int g_windowOffsetSec = WINDOW_OPEN_OFFSET_SEC;   // 本起床の受信窓オフセット（windowOffsetFor）
+bool g_lteWake = false;                           // 本起床はLTE起床（窓の後で送信を見送りうる）
+// 【明示同期】本起床で最後に送った DATA_ACK（送出時の millis と告げた次窓までの秒）
+bool g_ackSent = false;
+uint32_t g_ackSentMs = 0;
+uint16_t g_ackNextWin = 0;
+// 前回の起床が DATA_ACK で子機へ告げた次窓openの時刻（その起床の時計補正後の時計。0=告げていない）
+RTC_DATA_ATTR time_t promisedWindowAt = 0;
+unsigned long ttfbStartMs = 0;      // 本起床で最初のHTTP要求の開始時刻（0=未開始）
+bool ttfbMeasured = false;          // 本起床のTTFB計測済み
+
+// 起床サイクルの工程スケジューラ（締切はグリッド境界基準。判定/記録は wake_schedule.h）
+WakeScheduler schedule;
+int32_t g_lteDeadlineMs = 0;        // アタッチ/NTP/設定の締切（直列=窓open+遅延許容, 並列=送信に間に合う時刻）
+// 直近に完了したLTE起床の工程記録（次のLTE起床でエンベロープ "cycle" として送信）
+RTC_DATA_ATTR WakeCycleLog lastCycle = {};
 
 // v2: RTCキャッシュ変数（サーバー設定）
 RTC_DATA_ATTR uint32_t cachedParentIdHash = 0;
@@ -85,7 +188,10 @@ RTC_DATA_ATTR uint8_t cachedChildLogicalIds[MAX_CHILD_DEVICES] = {0};
 RTC_DATA_ATTR uint8_t cachedChildCount = 0;
 RTC_DATA_ATTR uint32_t lastConfigFetch = 0;       // 最後に設定取得したブート回数
 RTC_DATA_ATTR bool configFetched = false;          // 設定取得済みフラグ
-RTC_DATA_ATTR bool caCertUploaded = false;         // CA証明書アップロード済みフラグ
+RTC_DATA_ATTR char configEtag[40] = "";            // 設定応答のETag（引用符なし。If-None-Match で送り、304なら解析省略）
+RTC_DATA_ATTR uint8_t ingestTransport = TRANSPORT_HTTP;   // 送信経路（設定の "transport"。device_config.h）
+RTC_DATA_ATTR uint16_t udpMsgId = 0;               // UDP送信の通番（起床をまたいで一意。サーバの重複判定用）
+RTC_DATA_ATTR uint32_t caCertOnModem = 0;         // モデムFSの ca.pem のハッシュ（0=未確認。一致すれば書込を省く）
 
 // 起床回数（LTE送信タイミング判定用）
 RTC_DATA_ATTR uint32_t wakeCounter = 0;
@@ -102,19 +208,24 @@ RTC_DATA_ATTR bool    g_otaProbation      = false;  // OTA直後で未確定
 RTC_DATA_ATTR uint8_t g_otaProbationBoots = 0;      // 未確定のまま起動した回数
 bool g_serverReachedThisBoot = false;               // 本ブートでサーバ到達したか(確定判定用)
 
-// データ蓄積バッファ（20分毎の計測を貯め、1時間毎にまとめて送信）
-struct RtcChild {
-    uint32_t id; bool received;
-    float temp, humid, pres; int8_t rssi; uint8_t bat; uint8_t lid;
-};
-struct RtcRound {
-    time_t ts;
-    float pTemp, pHumid, pPres; int pBat; int pVbus; int pSignal;
-    uint8_t childCount;
-    RtcChild child[MAX_CHILD_DEVICES];
-};
-RTC_DATA_ATTR RtcRound rtcRounds[MAX_RTC_ROUNDS];
-RTC_DATA_ATTR uint8_t rtcRoundCount = 0;
+// データ蓄積バッファ（20分毎の計測を貯め、1時間毎にまとめて送信。構造体は round_data.h）
+// RTCには前ラウンドとの差分で詰めた圧縮表現（round_pack.h）で置く。LTE起床の送信時も全件は展開せず、
+// 送る分だけを rtcRoundBuf へ読む。届いた分には印を付け、送信後に印の無い分だけで詰め直す
+RTC_DATA_ATTR uint8_t rtcRoundArena[RTC_ROUND_ARENA_BYTES];
+RTC_DATA_ATTR RoundPackState rtcPack = {};
+RtcRound rtcRoundBuf[UPLOAD_BATCH_MAX_ROUNDS];   // 送る分の作業域（RTC蓄積・退避ログ共用。1件 800 バイト超）
+uint32_t rtcRoundSeq[MAX_RTC_ROUNDS];    // 蓄積の通番（添字=古い順の位置。openRtcRounds で控える）
+bool rtcRoundGone[MAX_RTC_ROUNDS];       // 外す印（届いた/退避した/捨てた。repackRtcRounds で詰め直す）
+uint8_t rtcRoundTotal = 0;               // 位置の数（openRtcRounds 時点の蓄積数）
+uint8_t rtcRoundCount = 0;               // うち印の無い（未達の）数
+RoundPackReader rtcReader(rtcRoundArena, rtcPack);   // readRtcRound の読み進めた位置
+int rtcReaderPos = MAX_RTC_ROUNDS;       // 次に読む位置（MAX_RTC_ROUNDS=先頭から読み直す）
+RTC_DATA_ATTR uint32_t roundEpoch = 0;   // ラウンド通番の系列（電源投入で作り直す。round_data.h BatchSeq）
+RTC_DATA_ATTR uint32_t roundSeq = 0;     // 最後に蓄積したラウンドの通番
+// フラッシュ退避ログ（round_log.h）の位置/件数。RTCが消えたら記憶域から読み直す
+RTC_DATA_ATTR RoundLogState roundLog = {};
+bool roundLogMounted = false;            // 本起床で LittleFS をマウントした
+bool roundLogMountFailed = false;
 
 // 子機データ配列
 ChildData childDataList[MAX_CHILD_DEVICES];
@@ -136,6 +247,17 @@ Adafruit_SHT31 shtParent = Adafruit_SHT31();  // FS304-SHT3x（温湿度・防
 bool shtParentOk = false;
 XPowersPMU PMU;
 HardwareSerial modemSerial(1);   // SIM7080G
+
+// ATエンジンの UART/時計（at_engine.h の AtPort）
+static size_t modemRead(uint8_t* buf, size_t cap, void*) {
+    int avail = modemSerial.available();
+    if (avail <= 0) return 0;
+    return modemSerial.readBytes(buf, (size_t)avail < cap ? (size_t)avail : cap);
+}
+static void modemWrite(const uint8_t* p, size_t n, void*) { modemSerial.write(p, n); }
+static uint32_t modemClockMs() { return millis(); }
+static void modemIdle() { delay(2); }
+AtEngine at({ modemRead, modemWrite, modemClockMs, modemIdle, nullptr });   // SIM7080G ATコマンドエンジン（応答/URC振分け）
 HardwareSerial tweliteSerial(2); // E220 LoRa (旧TWELITE UART配線を流用)
 E220 lora(tweliteSerial, LORA_M0_PIN, LORA_M1_PIN, LORA_AUX_PIN);
 int16_t g_lastRssi = 0;          // 直近のLoRa受信RSSI(dBm)。parseChildPacketV2で使用
@@ -149,6 +271,39 @@ struct AcCommandPending {
     float tempC;
 };
 
+// 送信バッチのエンベロープ（fw/cfg/ac_ack/link/energy/cycle）の写し。送る前に1回だけ取り、
+// 長さを数える書出しと送信時の書出しは写しだけを読む（途中で計測値が変わっても長さがずれない）
+struct BatchEnvelope {
+    LinkStats link;
+    EnergyReport energy;
+    WakeCycleLog cycle;   // wake=0 なら載せない
+    char etag[40];
+    BatchMeta meta;       // meta.configEtag は etag を指す（写しは作り直さずに使う）
+};
+
+// writeBatchJson の対象（HttpBody.ctx で渡す）
+struct BatchRange {
+    const RtcRound* rounds;   // RTC蓄積、またはフラッシュのログから読んだ分
+    int count;
+    const BatchEnvelope* env;   // nullptr=エンベロープを載せない
+    BatchSeq seq;      // seq_epoch / have_from
+    uint32_t bootCount;
+};
+
+// 送信応答の "hints"（設定変更/OTA新版/未実行ACコマンド）。valid=false は旧サーバか送信失敗で、
+// その場合は従来通り設定/ACを個別に問い合わせる
+struct IngestHints {
+    bool valid;
+    bool configChanged;
+    bool ota;
+    AcCommandPending ac;
+};
+IngestHints ingestHints = {};
+bool configFetchedThisWake = false;   // 本起床で設定取得を試みた（ヒントで二重に取らない）
+// 応答ヒントで実行したACコマンドの完了通知（次の送信ボディ "ac_ack" に載せる。0=なし）
+RTC_DATA_ATTR uint32_t acAckId = 0;
+RTC_DATA_ATTR time_t acAckAt = 0;
+
 // モデム状態
 struct ModemState {
     bool isInitialized = false;
@@ -157,6 +312,60 @@ struct ModemState {
     String ipAddress = "";
 } modemState;
 
+// HTTPセッション（1回のLTE起床で1本のkeep-alive TCP接続を使い回す）
+struct HttpSession {
+    bool open = false;           // CAOPEN済み
+    bool slotsCleared = false;   // 起床後の全スロットクローズ済み
+    bool tlsReady = false;       // 起床後のTLS設定(CSSLCFG/CASSLCFG)済み
+    int  clientID = 0;           // +CAOPEN: で割当てられたclientID
+    int  requests = 0;           // 処理したリクエスト数
+    int  reconnects = 0;         // サーバ切断による再接続回数
+} httpSession;
+
+// URCで更新されるモデム状態（AtEngine の購読ハンドラが更新。ビットは clientID 0..12）
+struct UrcState {
+    uint16_t dataReady = 0;   // +CADATAIND: <cid> 受信済み（未読データあり）
+    uint16_t closed = 0;      // +CASTATE: <cid>,0 受信済み（相手側切断）
+    int cereg = -1;           // 直近の +CEREG: <stat>（-1=未受信）
+    bool pdpActive = false;   // +APP PDP: 0,ACTIVE / DEACTIVE
+} urcState;
+
+// HTTPリクエストボディ: 生バイト、または長さを先に確定した書出し関数
+// (write は1回目=長さ計測、2回目=CASENDチャンクへ直接 の2回呼ばれるので同じ出力を返すこと。
+//  出力の元になる値は ctx で渡し、2回の間で変えない)
+struct HttpBody {
+    const char* contentType;
+    size_t length;
+    const uint8_t* bytes;                 // write==nullptr の時に送る生バイト
+    void (*write)(PayloadWriter& w, void* ctx);
+    void* ctx;                            // write に渡す
+};
+const HttpBody HTTP_NO_BODY = { nullptr, 0, nullptr, nullptr, nullptr };
+
+// 応答ボディを固定長バッファに受ける（超過分は捨てる。終端'\0'付き）
+struct BodyBuffer {
+    char* data;
+    size_t cap;
+    size_t len;
+};
+
+static void bodyBufferSink(const uint8_t* p, size_t n, void* ctx) {
+    BodyBuffer& b = *(BodyBuffer*)ctx;
+    size_t c = b.cap - 1 - b.len;
+    if (c > n) c = n;
+    memcpy(b.data + b.len, p, c);
+    b.len += c;
+    b.data[b.len] = '\0';
+}
+
+// CASEND送信ストリーム（MODEM_CASEND_MAX分たまったら1チャンク送る。ヒープ不使用）
+struct CasendStream {
+    int clientID;
+    size_t fill;      // チャンクバッファ内の未送信バイト
+    size_t sent;      // 送信済みバイト
+    bool ok;
+};
+
 // 親機センサーデータ
 struct ParentData {
     float temperature;
@@ -166,15 +375,53 @@ struct ParentData {
     int vbusMv = 0;    // VBUS電圧 mV (USB/安定化電源給電時)
 } parentData;
 
+// モデムを使える状態にした結果（bringUpModem）。並列起床ではモデムタスク（別コア）が埋めてキューで渡し、
+// linkStats/uploadPolicy/schedule などメイン側の状態へは applyModemBringup() がメインタスクで反映する
+struct ModemBringup {
+    bool ok;
+    bool resumed;            // PSM復帰（再アタッチなし）
+    uint32_t startMs;        // 準備開始の millis()（PH_ATTACH の記録用）
+    uint32_t endMs;          // 工程の終了（CA証明書まで。失敗含む）の millis()
+    uint32_t prepMs;         // アタッチ or 復帰の所要
+    uint32_t regMs;          // 登録待ち（復帰なら0）
+    uint8_t bandScope;
+    uint8_t band;
+    uint8_t rat;
+    LinkQuality quality;     // アタッチ直後の電界（AT+CESQ）
+};
+
 // 関数プロトタイプ
 bool readParentSensors();
 bool initModem();
+bool resumeModem();
+bool armModemPsm();
+void recordRatSample();
+bool bringUpModem(ModemBringup& b);
+bool applyModemBringup(const ModemBringup& b);
+void syncTimeAndConfig();
+bool refreshConfig(int32_t deadlineMs);
+void runPendingPairing();
+bool lteNeedsSequential(time_t at);
+int gridOffsetSec(time_t at);
+void logWakeCycle(const WakeCycleLog& c);
+int windowOffsetFor(bool lteWake, time_t at);
+bool startModemTask();
+bool waitModemTask(ModemBringup& b);
 bool powerOnModem();
 void powerOffModem();
 bool connectNetwork();
 bool syncNTP();
-bool sendAllDataToServer();
+bool syncTimeFromModem();
+bool refineTimeFromHttpDate(bool required);
+void applyTime(time_t t, uint16_t fracMs, uint8_t source, uint16_t errMs);
+void applyHttpDate();
+bool readModemClock(time_t& t);
+int windowMarginSec(time_t at);
+UploadPolicyParams uploadPolicyParams();
+void updateEnergyTier(bool batteryPresent, bool charging);
+bool shouldDeferUpload();
 String sendATCommand(const String& cmd, unsigned long timeout = 10000);
+void initAtEngine();
 void goToDeepSleep(uint64_t sleepTimeSec);
 bool initPMU();
 int getSignalStrength();
@@ -191,29 +438,54 @@ void parseChildPacketV2(uint8_t* buffer, int length);
 bool isAllChildDataReceived();
 
 // v2新規関数
-bool sendRawHTTPTCP(const String& method, const String& path, const String& host, const String& body);
+bool sendRawHTTPTCP(const String& method, const String& path, const String& body);
+bool httpSessionOpen();
+void httpSessionClose();
+bool httpSessionAlive();
+int  httpReadResponse(int clientID, HttpResponseParser& resp, bool& serverClose);
+int  httpRequest(const String& method, const String& path, const HttpBody& body, HttpResponseParser& resp,
+                 const char* extraHeaders = nullptr);
+int  httpRequest(const String& method, const String& path, const HttpBody& body, String& respBody);
+int  httpRequest(const String& method, const String& path, const String& body, String& respBody);
+void casendWrite(const char* p, size_t n, void* ctx);
+bool casendFinish(CasendStream& s);
 uint8_t computeChecksum(uint8_t* buffer, int length);
 bool uploadCACert();
+uint32_t caCertHash();
 bool fetchConfigFromServer();
+bool configCheckDue();
 void sendPairingCommand(uint32_t parentIdHash, uint32_t targetChildId, uint8_t logicalId);
 bool waitForPairingResponse(uint32_t targetChildId, unsigned long timeoutMs = PAIRING_RESPONSE_TIMEOUT);
 void sendDataAck(uint32_t parentIdHash, uint32_t childId);
 uint16_t secondsToNextWindow();
+void commitWindowPromise();
 void waitUntilWindowOpen();
 void storeRoundToRtc();
+void openRtcRounds();
+bool readRtcRound(int idx, RtcRound& r);
+void repackRtcRounds();
 // LTE OTA
 void markOtaValidIfPending();
-int  carecvRaw(uint8_t* out, int maxOut, uint32_t timeoutMs);
+int  carecvRaw(uint8_t* out, int maxOut, uint32_t timeoutMs, int clientID = 0);
 bool performOta();
-String buildRoundPayload(const RtcRound& r);
+void writeBatchJson(PayloadWriter& w, void* ctx);
 bool uploadAllRounds();
+bool uploadRoundsHttp(bool envelope);
+bool postRoundsHttp(const RtcRound* rounds, int count, bool envelope, const BatchSeq& seq, uint32_t& ackSeq);
+bool roundLogReady();
+bool roundLogPending();
+void spillRoundsToLog();
+int  uploadRoundsUdp(uint8_t& retx);
 bool reportPairingResult(const char* childDeviceIdHex, const char* status);
 void executePairingMode();
 uint32_t computeParentIdHashLocal(const char* deviceId);
 
 // ACプロトタイプモード用関数
 AcCommandPending fetchPendingAcCommand();
+AcCommandPending parseAcCommand(const char* text);
 bool ackAcCommand(int cmdId);
+void parseIngestHints(char* text);
+void runAcCommand();
 
 /**
  * parentIdHashをローカルで計算（SHA-256の先頭4バイト相当）
@@ -371,8 +643,13 @@ void setup() {
             Serial.println("Wakeup: Power on / Reset");
             ntpSynced = false;
             lastNtpSyncTime = 0;
+            timeQuality = {};
+            modemClock = {};         // モデムも起動し直している可能性がある（Date/CNTPで確かめる）
             configFetched = false;   // 電源オン時は設定を再取得
-            caCertUploaded = false;  // 電源オン時はCA証明書を再アップロード
+            configEtag[0] = '\0';   // （条件なしで全文を受ける）
+            caCertOnModem = 0;       // 電源オン時はモデムFSの ca.id で照合し直す
+            roundLog.open = false;   // 退避ログは記憶域から読み直す（追記中のリセットを含む）
+            promisedWindowAt = 0;    // 子機へ告げた窓は無効（窓は既定のオフセットで開く）
             break;
     }
 
@@ -398,15 +675,19 @@ void setup() {
                                : "[WARN] SHT3x not found (fallback to BME280)");
 
     // バッテリー電圧確認 (AXP2101 PMU)
+    bool charging = false, batteryPresent = false;
     if (initPMU()) {
-        parentData.batteryLevel = PMU.isBatteryConnect() ? PMU.getBatteryPercent() : 0;
+        batteryPresent = PMU.isBatteryConnect();
+        parentData.batteryLevel = batteryPresent ? PMU.getBatteryPercent() : 0;
         parentData.vbusMv = (int)PMU.getVbusVoltage();
+        charging = PMU.isCharging();
         Serial.printf("[INFO] Battery: %dmV (%d%%) charging=%d VBUS=%dmV\n",
-                      PMU.getBattVoltage(), parentData.batteryLevel, PMU.isCharging(), parentData.vbusMv);
+                      PMU.getBattVoltage(), parentData.batteryLevel, charging, parentData.vbusMv);
     } else {
         Serial.println("[WARN] PMU (AXP2101) not found, battery unknown");
         parentData.batteryLevel = 0;
     }
+    updateEnergyTier(batteryPresent, charging);
 
     // 低バッテリー時は長めにスリープ
     if (parentData.batteryLevel > 0 && parentData.batteryLevel < BATTERY_LOW_WARN_THRESHOLD) {
@@ -418,48 +699,49 @@ void setup() {
     // TWELITE初期化
     initTwelite();
 
-    // 起床回数++。LTE送信は ROUNDS_PER_UPLOAD 回に1回(≒1時間)。初回/設定未取得時は必ずLTE。
+    // 起床回数++。LTE送信は動作段階の送信間隔(NORMAL は ROUNDS_PER_UPLOAD 回≒1時間)に1回。
+    // 初回/設定未取得時は必ずLTE。前回LTE起床で電界が悪く送信を見送った場合も、次の起床でLTE（再判定）
     wakeCounter++;
-    bool lteWake = (!configFetched) || (wakeCounter % ROUNDS_PER_UPLOAD == 0);
+    wakesSinceLte++;
+    bool lteWake = (!configFetched) || (wakesSinceLte >= energyPlanNow.roundsPerUpload) || uploadDeferred;
+    if (lteWake) wakesSinceLte = 0;
+    g_lteWake = lteWake;
+    uploadDeferred = false;   // 本起床で再判定（モデム不調でLTEに至らなければ通常周期へ戻る）
     bool modemOk = false;
 
-    if (lteWake) {
-        modemSerial.begin(MODEM_BAUD_RATE, SERIAL_8N1, MODEM_RX_PIN, MODEM_TX_PIN);
-        delay(100);
-        Serial.println("\n[MODEM] LTE wake: initializing...");
-        if (initModem()) {
-            modemOk = true;
-            modemState.isInitialized = true;
-
-            if (!uploadCACert()) {
-                Serial.println("[SSL] CA cert upload failed, no-verify mode");
-            }
+    // LTE初期化を受信窓と並行させるか（設定取得済み・NTP同期不要=窓位置がRTC時計だけで決まる起床）。
+    // 直列で初期化する起床だけ窓を grid+WINDOW_OPEN_OFFSET_SEC まで後ろへずらす。
+    time_t wakeTime; time(&wakeTime);
+    bool lteParallel = lteWake && !lteNeedsSequential(wakeTime);
+    g_windowOffsetSec = windowOffsetFor(lteWake, wakeTime);
+    // 前回の起床が子機へ告げた窓位置を守る（告げた後の時計補正・送信見送りでオフセットが変わっていても、
+    // 子機はその時刻を狙って寝ている）。グリッド境界から半周期以内の時だけ使う
+    if (promisedWindowAt != 0) {
+        int promised = (int)(promisedWindowAt - wakeTime) + gridOffsetSec(wakeTime);
+        if (promised >= 0 && promised < MEASUREMENT_INTERVAL_MIN * 30) g_windowOffsetSec = promised;
+        promisedWindowAt = 0;
+    }
+    g_windowMarginSec = windowMarginSec(wakeTime);   // 時計が怪しいほど窓を前後に広げる
 
-            // NTP同期（RTCクロックは非LTE起床でもタイムスタンプに使う）
-            time_t now; time(&now);
-            if (!ntpSynced || lastNtpSyncTime == 0 || (now - lastNtpSyncTime >= NTP_SYNC_INTERVAL_SEC)) {
-                Serial.println("[NTP] Time sync...");
-                if (syncNTP()) { ntpSynced = true; time(&lastNtpSyncTime); printCurrentTime(); }
-            }
+    // 工程の締切はグリッド境界基準（起動時点 millis()=0 のグリッド内位置を基準にする）。
+    // 直列起床のLTE前処理は窓を遅らせてよい範囲まで、並列起床は送信が締切に間に合う時刻まで
+    schedule.reset(wakeCounter, gridOffsetSec(wakeTime) * 1000L - (int32_t)millis(), 0);
+    const int32_t windowOpenMs = (g_windowOffsetSec - g_windowMarginSec) * 1000L;
+    const int32_t cycleDeadlineMs = WAKE_CYCLE_DEADLINE_SEC * 1000L;
+    g_lteDeadlineMs = cycleDeadlineMs - PHASE_EST_UPLOAD_MS;
 
-            // サーバー設定取得
-            if (!configFetched || (bootCount - lastConfigFetch >= CONFIG_FETCH_INTERVAL)) {
-                Serial.println("[CONFIG] Fetching device config...");
-                if (fetchConfigFromServer()) {
-                    lastConfigFetch = bootCount; configFetched = true;
-                    Serial.printf("[CONFIG] hash:0x%08X children:%d\n", cachedParentIdHash, cachedChildCount);
-                } else if (!configFetched) {
-                    cachedParentIdHash = computeParentIdHashLocal(DEVICE_ID);
-                    Serial.printf("[WARN] Local hash fallback: 0x%08X\n", cachedParentIdHash);
-                }
-            }
-        } else {
-            Serial.println("[ERROR] Modem init failed (retry next LTE wake)");
-            consecutiveFailures++;
-        }
-    } else {
-        Serial.printf("[MODEM] Skip LTE (wake %lu; upload every %d)\n",
-                      (unsigned long)wakeCounter, ROUNDS_PER_UPLOAD);
+    if (lteParallel) {
+        lteParallel = startModemTask();
+    }
+    if (!lteParallel) g_lteDeadlineMs = windowOpenMs + WINDOW_LATE_MAX_SEC * 1000L;
+    if (lteWake && !lteParallel) {
+        ModemBringup bringup;
+        bringUpModem(bringup);
+        modemOk = applyModemBringup(bringup);
+        if (modemOk) syncTimeAndConfig();
+    } else if (!lteWake) {
+        Serial.printf("[MODEM] Skip LTE (wake %lu; upload every %d, energy %s)\n",
+                      (unsigned long)wakeCounter, energyPlanNow.roundsPerUpload, kEnergyTierName[energyState.tier]);
     }
 
     // 子機データ初期化（RTCキャッシュから）
@@ -477,16 +759,15 @@ void setup() {
     }
     Serial.printf("[LoRa] Active children: %d\n", activeChildCount);
 
-    // ペアリング（LTE時かつPENDINGがある場合のみ。子機を起こしてからペア送信）
-    if (lteWake && modemOk && hasPendingChildren && pendingChildCount > 0) {
-        sendMWXWakeTrigger();
-        delay(500);
-        executePairingMode();
-    }
+    // ペアリング（LTE時かつPENDINGがある場合のみ。並列起床では設定取得後=受信窓の後）
+    if (lteWake && modemOk) runPendingPairing();
 
     // 親機センサー
     Serial.println("\n[SENSOR] Reading parent sensor...");
-    if (!readParentSensors()) Serial.println("[WARN] Parent sensor read failed");
+    schedule.admit(PH_SENSORS, PHASE_EST_SENSORS_MS, windowOpenMs, false, millis());
+    bool sensorOk = readParentSensors();
+    schedule.finish(PH_SENSORS, sensorOk, millis());
+    if (!sensorOk) Serial.println("[WARN] Parent sensor read failed");
     Serial.printf("  Parent: %.2fC %.2f%% %.1fhPa\n",
                   parentData.temperature, parentData.humidity, parentData.pressure);
 
@@ -496,54 +777,126 @@ void setup() {
 
     // 子機データ収集（子機起点プッシュ受信＋ACK）
     Serial.println("\n[LoRa] Collecting child data (window + ACK)...");
+    const uint32_t windowMs = CHILD_RESPONSE_TIMEOUT + g_windowMarginSec * 2000UL;
+    schedule.admit(PH_WINDOW, windowMs, windowOpenMs + windowMs, false, millis());
     bool allReceived = collectChildData();
+    schedule.finish(PH_WINDOW, true, millis());
     if (activeChildCount > 0 && !allReceived) {
         Serial.println("[WARN] Not all children pushed this round");
     }
 
-    // 今回のラウンドをRTCに蓄積
+    // 並列起床: 受信窓の間に初期化していたモデムの完了を待つ
+    if (lteParallel) {
+        ModemBringup bringup;
+        waitModemTask(bringup);
+        modemOk = applyModemBringup(bringup);
+    }
+
+    // 今回のラウンドをRTCに蓄積（設定取得で子機リストが変わる前に）
     storeRoundToRtc();
 
+    if (lteParallel && modemOk) {
+        syncTimeAndConfig();
+        runPendingPairing();
+    }
+
+    // LTE時: RTCの圧縮蓄積を送信用に開く（通番だけ控え、ラウンドは送る時に読む）
+    if (lteWake && modemOk) openRtcRounds();
+
+    // 電界が悪く、次の起床まで待った方が安ければ送信を見送る（蓄積はRTCに残す）
+    bool deferUpload = lteWake && modemOk && shouldDeferUpload();
+    if (deferUpload) {
+        schedule.skip(PH_UPLOAD, PHASE_EST_UPLOAD_MS);
+        httpSessionClose();
+        if (MODEM_PSM_ENABLE) psmArmed = armModemPsm();
+    }
+
     // LTE時: 蓄積した全ラウンドをまとめて送信
-    if (lteWake && modemOk) {
+    if (lteWake && modemOk && !deferUpload) {
         Serial.printf("\n[HTTP] Uploading %d accumulated round(s)...\n", rtcRoundCount);
-        if (uploadAllRounds()) {
-            Serial.println("[OK] Batch upload success");
+        schedule.admit(PH_UPLOAD, PHASE_EST_UPLOAD_MS, cycleDeadlineMs, false, millis());
+        bool uploaded = uploadAllRounds();
+        repackRtcRounds();   // 未達分だけでRTCを詰め直す
+        schedule.finish(PH_UPLOAD, uploaded, millis());
+        if (!refineTimeFromHttpDate(false)) applyHttpDate();   // 送信応答の Date で時計を照合
+        if (uploaded) {
+            // 送信の実測（電界で正規化）を学習して、見送りの判定へ返す
+            float mA = (servingRat == RAT_NBIOT) ? RAT_NBIOT_ACTIVE_MA : RAT_CATM_ACTIVE_MA;
+            uploadRecordSent(uploadPolicy, uploadPolicyParams(), linkQuality,
+                             ratEnergyUj(linkStats.upMs, mA, RAT_SUPPLY_V), linkStats.upBytes);
+            Serial.printf("[OK] Batch upload success (%d older round(s) left for backfill)\n", rtcRoundCount);
             consecutiveFailures = 0;
-            rtcRoundCount = 0;   // 送信成功でバッファクリア
             markOtaValidIfPending();   // サーバ到達 → OTA新ファーム確定
         } else {
             Serial.println("[ERROR] Batch upload failed (keep buffer, retry next LTE wake)");
             consecutiveFailures++;
         }
 
-        // ACコマンド
-        irCtrl.begin();
-        AcCommandPending acCmd = fetchPendingAcCommand();
-        if (acCmd.found) {
-            Serial.printf("[AC] Executing: mode=%d tempC=%.1f\n", (int)acCmd.mode, acCmd.tempC);
-            irCtrl.send(acCmd.mode, acCmd.tempC);
-            ackAcCommand(acCmd.id);
+        // 送信応答のヒントで設定変更/OTA新版が分かった時だけ設定を取り直す
+        // （ヒントが無い=旧サーバ/送信失敗なら従来の取得周期）
+        if (INGEST_HINTS_ENABLE && configFetched && !configFetchedThisWake && energyPlanNow.configFetch) {
+            bool due = ingestHints.valid ? (ingestHints.configChanged || ingestHints.ota) : configCheckDue();
+            if (due && refreshConfig(cycleDeadlineMs)) runPendingPairing();
+        }
+
+        // ACコマンド（ヒントで届いていれば追加の要求なし。予算が無ければ次のLTE起床で取得）。
+        // 電池残量が少ない段階ではヒントで届いた分だけ/しない
+        if (!(ingestHints.valid ? energyPlanNow.acFromHints : energyPlanNow.acPoll)) {
+            Serial.printf("[ENERGY] AC check skipped (%s)\n", kEnergyTierName[energyState.tier]);
+        } else if (schedule.admit(PH_AC, ingestHints.valid ? 0 : PHASE_EST_AC_MS, cycleDeadlineMs, true, millis())) {
+            runAcCommand();
+            schedule.finish(PH_AC, true, millis());
+        } else {
+            Serial.println("[SCHED] AC check postponed (cycle budget)");
         }
 
+        // 起床中のHTTPセッションを閉じる（OTAは専用の接続でストリーミング受信する）
+        httpSessionClose();
+        // 本起床のセッション確立は次のLTE起床のバッチで報告する（送信中のバッチの長さを変えない）
+        linkStats.tls = SERVER_TLS_ENABLE;
+        linkStats.opens = wakeOpens;
+        linkStats.openMs = wakeOpenMs;
+
         // 【LTE OTA】センサ送信完了後に実行(データ欠損を防ぐ)。新版があり事前条件OKなら書換→再起動。
         if (g_otaAvailable) {
             int bat = parentData.batteryLevel;   // 親は外部電源だとVBUS給電で電池不定。<50%かつ電池駆動時のみ見送り。
             bool batteryOk = (parentData.vbusMv > 4000) || (bat <= 0) || (bat >= OTA_MIN_BATTERY_PCT);
-            if (!batteryOk) {
+            if (!energyPlanNow.otaAllowed) {
+                Serial.printf("[ENERGY] OTA skipped (%s, VBUS %dmV)\n", kEnergyTierName[energyState.tier], parentData.vbusMv);
+            } else if (!batteryOk) {
                 Serial.printf("[OTA] skip: battery %d%% < %d%% (no external power)\n", bat, OTA_MIN_BATTERY_PCT);
-            } else {
+            } else if (schedule.admit(PH_OTA, PHASE_EST_OTA_MS, cycleDeadlineMs, true, millis())) {
                 performOta();   // 成功時は戻らない(esp_restart)。失敗時は旧ファーム維持で継続。
+                schedule.finish(PH_OTA, false, millis());
+            } else {
+                // 次のLTE起床で設定を取り直す（OTA有無はconfig応答でしか分からない）
+                Serial.println("[SCHED] OTA postponed (cycle budget), refetch config next LTE wake");
+                lastConfigFetch = bootCount - CONFIG_FETCH_INTERVAL;
             }
         }
+
+        // 本起床の接続コストを在圏RATの µJ/byte として記録（次回アタッチのRAT選択に使う）
+        if (RAT_ADAPTIVE_ENABLE) recordRatSample();
+
+        // 全送信完了後・ディープスリープ直前にのみPSMを有効化（次のLTE起床で復帰）
+        if (MODEM_PSM_ENABLE) psmArmed = armModemPsm();
     }
 
+    // 工程記録を確定（LTE起床の記録は次のLTE起床で送信）
+    const WakeCycleLog& cycle = schedule.close(millis());
+    logWakeCycle(cycle);
+    if (lteWake) lastCycle = cycle;
+
+    // 子機へ告げた次窓を、本起床の時計補正を済ませた時計の時刻として記録
+    commitWindowPromise();
+
     // 20分グリッドまでスリープ
     uint64_t sleepDuration = calculateSleepDuration();
 #ifdef TEST_FAST
     sleepDuration = 15;  // テスト: 15秒で再起床し毎回LTE送信を試行(観測用)
 #endif
-    Serial.printf("\n[SLEEP] Deep sleep for %llu s (lteWake=%d)...\n", sleepDuration, lteWake);
+    Serial.printf("\n[SLEEP] Deep sleep for %llu s (lteWake=%d parallel=%d, awake %lus)...\n",
+                  (unsigned long long)sleepDuration, lteWake, lteParallel, millis() / 1000);
     goToDeepSleep(sleepDuration);
 }
 
@@ -551,6 +904,482 @@ void loop() {
     // ディープスリープ使用時はloop()は実行されない
 }
 
+// ===== LTE起床 =====
+
+/**
+ * モデムを使える状態にする（PSM復帰 or アタッチ）＋CA証明書。結果は b に返す。
+ * 並列起床ではモデムタスク（別コア）から呼ばれるので、触るのはモデム側の状態（modemState/
+ * lastAttach/bandCache/servingRat/psmArmed/CA）だけ。メインタスクと共有する linkStats/uploadPolicy/
+ * schedule/consecutiveFailures は applyModemBringup() で反映する（schedule は締切判定で読むのみ）
+ */
+bool bringUpModem(ModemBringup& b) {
+    b = {};
+    modemSerial.begin(MODEM_BAUD_RATE, SERIAL_8N1, MODEM_RX_PIN, MODEM_TX_PIN);
+    initAtEngine();
+    delay(100);
+    Serial.println("\n[MODEM] LTE wake: initializing...");
+    b.startMs = millis();
+    // PSMで登録を保持していれば再アタッチせず復帰。失敗時はフル初期化
+    bool resumed = MODEM_PSM_ENABLE && psmArmed && resumeModem();
+    psmArmed = false;
+    if (!resumed && !initModem()) {
+        Serial.println("[ERROR] Modem init failed (retry next LTE wake)");
+        b.endMs = millis();
+        return false;
+    }
+    modemState.isInitialized = true;
+    b.resumed = resumed;
+    b.regMs = resumed ? 0 : lastAttach.registration;
+    b.bandScope = resumed ? (uint8_t)BAND_SCOPE_NONE : lastAttach.bandScope;
+    b.band = bandCache.band;
+    b.rat = servingRat;
+    b.prepMs = millis() - b.startMs;
+    parseCesq(sendATCommand("AT+CESQ", 2000).c_str(), b.quality);   // アタッチ直後の電界
+
+    if (SERVER_TLS_ENABLE && !uploadCACert()) {
+        Serial.println("[SSL] CA cert upload failed (TLS session will not open this wake)");
+    }
+    b.endMs = millis();
+    b.ok = true;
+    return true;
+}
+
+/**
+ * モデム準備の結果を本起床の状態へ反映する（メインタスク）。工程記録・失敗回数・接続統計・電界の学習
+ */
+bool applyModemBringup(const ModemBringup& b) {
+    schedule.admit(PH_ATTACH, PHASE_EST_ATTACH_MS, g_lteDeadlineMs, false, b.startMs);
+    schedule.finish(PH_ATTACH, b.ok, b.endMs);
+    if (!b.ok) {
+        consecutiveFailures++;
+        return false;
+    }
+    linkStats.resumed = b.resumed;
+    if (b.resumed) linkStats.resumes++; else linkStats.attaches++;
+    linkStats.prepMs = b.prepMs;
+    linkStats.regMs = b.regMs;
+    linkStats.bandScope = b.bandScope;
+    linkStats.band = b.band;
+    linkStats.rat = b.rat;
+    Serial.printf("[LINK] %s in %lums (attaches:%lu resumes:%lu)\n", b.resumed ? "resume" : "attach",
+                  (unsigned long)linkStats.prepMs, (unsigned long)linkStats.attaches,
+                  (unsigned long)linkStats.resumes);
+
+    linkQuality = b.quality;
+    uploadObserve(uploadPolicy, linkQuality);
+    linkStats.rsrp = linkQuality.valid ? linkQuality.rsrpDbm : 0;
+    linkStats.rsrq = linkQuality.valid ? linkQuality.rsrqDb : 0;
+    if (linkQuality.valid) {
+        Serial.printf("[LINK] RSRP %d dBm RSRQ %d dB (avg %.1f dBm, n=%u)\n", linkQuality.rsrpDbm, linkQuality.rsrqDb,
+                      uploadPolicy.rsrpAvg, uploadPolicy.rsrpSamples);
+    } else {
+        Serial.println("[LINK] RSRP unknown");
+    }
+    return true;
+}
+
+/**
+ * PMU の読み値（parentData）で電池残量の段階を更新し、本起床の動作（送信間隔・設定/AC/OTA）を決める
+ * batteryPresent=false（PMU無し・電池未接続）は残量不明として扱う（batteryLevel の0と区別する）
+ */
+void updateEnergyTier(bool batteryPresent, bool charging) {
+    if (!ENERGY_GOVERNOR_ENABLE) return;
+    EnergyParams p = { ENERGY_SAVE_ENTER_PCT, ENERGY_SAVE_EXIT_PCT, ENERGY_CRITICAL_ENTER_PCT, ENERGY_CRITICAL_EXIT_PCT,
+                       ENERGY_VBUS_PRESENT_MV,
+                       { ROUNDS_PER_UPLOAD, ENERGY_SAVE_ROUNDS_PER_UPLOAD, ENERGY_CRITICAL_ROUNDS_PER_UPLOAD },
+                       MAX_ROUNDS_PER_UPLOAD };
+    EnergyReading r = { batteryPresent ? parentData.batteryLevel : ENERGY_NO_BATTERY, parentData.vbusMv, charging };
+    uint8_t before = energyState.tier;
+    energyUpdate(energyState, r, p);
+    energyPlanNow = energyPlan(energyState.tier, r, p);
+    Serial.printf("[ENERGY] %s%s%s (battery %d%%, VBUS %dmV%s): upload every %d, config %s, AC %s, OTA %s\n",
+                  before != energyState.tier ? kEnergyTierName[before] : "",
+                  before != energyState.tier ? " -> " : "", kEnergyTierName[energyState.tier],
+                  r.batteryPct, r.vbusMv, r.charging ? ", charging" : "", energyPlanNow.roundsPerUpload,
+                  energyPlanNow.configPoll ? "poll" : energyPlanNow.configFetch ? "hints" : "off",
+                  energyPlanNow.acPoll ? "poll" : energyPlanNow.acFromHints ? "hints" : "off",
+                  energyPlanNow.otaAllowed ? "ok" : "off");
+}
+
+// 送信バッチに載せる動作段階（CBORキー11 / JSON "energy"）
+EnergyReport energyReport() {
+    return { energyState.tier, energyState.changes, energyState.charging };
+}
+
+UploadPolicyParams uploadPolicyParams() {
+    return { UPLOAD_RSRP_REF_DBM, UPLOAD_CE_DB_PER_DOUBLING, UPLOAD_DEFAULT_UJ_PER_BYTE,
+             UPLOAD_FRESHNESS_MAX_SEC, UPLOAD_MAX_DEFERRALS, UPLOAD_DEFER_MARGIN };
+}
+
+// 今の計測値・動作段階・工程記録・応答ヒント用の値をエンベロープに写す
+static void snapshotEnvelope(BatchEnvelope& e) {
+    e.link = linkStats;
+    e.energy = energyReport();
+    e.cycle = lastCycle;
+    strncpy(e.etag, configEtag, sizeof(e.etag) - 1);
+    e.etag[sizeof(e.etag) - 1] = '\0';
+    e.meta = { FIRMWARE_VERSION_CODE, e.etag, acAckId, acAckAt };
+}
+
+// 送信バッチの seq_epoch / have_from（保持中の最古: 同じ通番系列が退避ログにあればその先頭）
+static BatchSeq heldSeq() {
+    if (roundLog.open && roundLog.count > 0 && roundLog.headEpoch == roundEpoch) return { roundEpoch, roundLog.headSeq };
+    for (int i = 0; i < rtcRoundTotal; i++) {
+        if (!rtcRoundGone[i]) return { roundEpoch, rtcRoundSeq[i] };
+    }
+    return { roundEpoch, roundSeq + 1 };
+}
+
+// バッチ範囲をCBORで書き出す（buf=nullptr なら長さだけ数える）
+static size_t cborEncodeRange(uint8_t* buf, size_t cap, const BatchRange& r) {
+    const BatchEnvelope* e = r.env;
+    return cborEncodeBatch(buf, cap, DEVICE_ID, DEVICE_SECRET, r.bootCount, r.rounds, r.count,
+                           e ? &e->link : nullptr, e && e->cycle.wake ? &e->cycle : nullptr,
+                           e && INGEST_HINTS_ENABLE ? &e->meta : nullptr, &r.seq, e ? &e->energy : nullptr);
+}
+
+// ラウンド1件を送信エンコードで書いた長さ
+static size_t roundBodyBytes(const RtcRound& r) {
+#if INGEST_USE_CBOR
+    CborWriter w(nullptr, 0);
+    cborWriteRound(w, r);
+#else
+    PayloadWriter w;
+    writeRoundJson(w, r);
+#endif
+    return w.length();
+}
+
+// 今送る場合のバイト見積り（送信エンコードのバッチ長＋HTTPヘッダ）
+// 外枠（ラウンド0件）の長さに、未達のラウンドを1件ずつ読んで数えた長さを足す（全件は展開しない）
+static uint32_t uploadBytesEstimate() {
+    BatchEnvelope env;
+    snapshotEnvelope(env);
+    BatchRange range = { nullptr, 0, &env, heldSeq(), bootCount };
+#if INGEST_USE_CBOR
+    size_t n = cborEncodeRange(nullptr, 0, range) + (rtcRoundCount >= 24 ? 1 : 0);   // 24件以上は配列の頭が1バイト増える
+#else
+    PayloadWriter counter;
+    writeBatchJson(counter, &range);
+    size_t n = counter.length() + (rtcRoundCount > 1 ? rtcRoundCount - 1 : 0);   // 区切りの ","
+#endif
+    for (int i = 0; i < rtcRoundTotal; i++) {
+        if (rtcRoundGone[i] || !readRtcRound(i, rtcRoundBuf[0])) continue;
+        n += roundBodyBytes(rtcRoundBuf[0]);
+    }
+    return (uint32_t)n + UPLOAD_HTTP_OVERHEAD_BYTES;
+}
+
+/**
+ * 送信を次の起床へ見送るか（upload_policy.h）。判定は linkStats に残して本送信のバッチで報告する
+ */
+bool shouldDeferUpload() {
+    UploadContext c = {};
+    c.q = linkQuality;
+    time_t now; time(&now);
+    const RtcRound& oldest = rtcRoundBuf[0];   // 開いた直後なので位置0が最古
+    bool haveOldest = rtcRoundCount > 0 && readRtcRound(0, rtcRoundBuf[0]);
+    c.oldestAgeSec = (haveOldest && now > oldest.ts) ? (uint32_t)(now - oldest.ts) : 0;
+    c.retryAfterSec = MEASUREMENT_INTERVAL_MIN * 60;
+    c.queued = rtcRoundCount;
+    c.queueCap = ROUND_LOG_ENABLE ? 0xFF : MAX_RTC_ROUNDS;   // 退避できるなら一杯でも失わない
+    float mA = (servingRat == RAT_NBIOT) ? RAT_NBIOT_ACTIVE_MA : RAT_CATM_ACTIVE_MA;
+    c.reconnectUj = ratEnergyUj(linkStats.prepMs + UPLOAD_RECONNECT_EXTRA_MS, mA, RAT_SUPPLY_V);
+    UploadDecision d = { UPLOAD_SEND, 1.0f, 1.0f, 0.0f, 0.0f };
+    if (UPLOAD_DEFER_ENABLE && rtcRoundCount > 0) {
+        c.bytes = uploadBytesEstimate();
+        d = uploadDecide(uploadPolicy, uploadPolicyParams(), c);
+        Serial.printf("[POLICY] %s: %lu B x%.1f (usual x%.1f) extra %.0f mJ vs wait %.0f mJ, oldest %lus, deferred %u\n",
+                      kUploadVerdictName[d.verdict], (unsigned long)c.bytes, d.penaltyNow, d.penaltyExpected,
+                      d.extraUj / 1000, d.waitUj / 1000, (unsigned long)c.oldestAgeSec, uploadPolicy.deferrals);
+    }
+    uploadDeferred = d.verdict == UPLOAD_DEFER;
+    if (uploadDeferred) {
+        uploadRecordDeferred(uploadPolicy, linkQuality);
+        return true;
+    }
+    linkStats.verdict = d.verdict;
+    linkStats.defers = uploadPolicy.deferrals;
+    linkStats.deferRsrp = uploadPolicy.deferRsrpDbm;
+    return false;
+}
+
+/**
+ * 時計合わせとサーバー設定取得（取得周期到来時）。
+ * 時計は毎LTE起床、NITZ/前回CNTPで合っているモデム時計を AT+CCLK? 1回で読んで合わせる。
+ * 同期期限切れでモデム時計が使えなければ設定取得（ETag保持なら304）の Date で合わせ、
+ * どちらも無い/食い違う時だけ CNTP（応答待ちで数秒〜30秒かかる）。
+ * CNTP・設定取得は g_lteDeadlineMs までに見積りが収まらなければ次のLTE起床へ見送る
+ * （初回の設定取得だけは親IDハッシュが要るので必ず行う）。
+ */
+void syncTimeAndConfig() {
+    time_t now; time(&now);
+    bool timeDue = !ntpSynced || lastNtpSyncTime == 0 || (now - lastNtpSyncTime >= NTP_SYNC_INTERVAL_SEC);
+    bool fromModem = syncTimeFromModem();
+    bool needDate = timeDue && !fromModem;
+
+    // サーバー設定取得（応答ヒントを使う場合、取得済みなら送信応答を見てから決める）。
+    // 時計合わせに Date が要る時も取りに行く
+    if (!configFetched || (!INGEST_HINTS_ENABLE && energyPlanNow.configFetch && configCheckDue()) || needDate) {
+        refreshConfig(g_lteDeadlineMs);
+    }
+
+    // Date で照合/代用。Date が無い・モデム時計と食い違う時だけ CNTP
+    if (refineTimeFromHttpDate(needDate)) return;
+    if (schedule.admit(PH_NTP, PHASE_EST_NTP_MS, g_lteDeadlineMs, true, millis())) {
+        Serial.println("[NTP] Time sync (fallback)...");
+        bool synced = syncNTP();
+        if (synced) printCurrentTime();
+        else if (httpDate.valid) applyHttpDate();   // CNTP不可: サーバ時刻に揃えておく
+        schedule.finish(PH_NTP, synced, millis());
+    } else {
+        Serial.println("[SCHED] NTP postponed (attach used the budget)");
+        if (httpDate.valid) applyHttpDate();
+    }
+}
+
+/**
+ * 時計を t(+fracMs) に合わせ、情報源と誤差を記録（工程スケジュールのグリッド基準も取り直す）
+ */
+void applyTime(time_t t, uint16_t fracMs, uint8_t source, uint16_t errMs) {
+    struct timeval before;
+    gettimeofday(&before, NULL);
+    struct timeval tv = { .tv_sec = t, .tv_usec = (suseconds_t)fracMs * 1000 };
+    settimeofday(&tv, NULL);
+    long stepMs = (long)(t - before.tv_sec) * 1000L + fracMs - before.tv_usec / 1000;
+
+    ntpSynced = true;
+    lastNtpSyncTime = t;
+    timeQuality = { source, errMs, t };
+    schedule.rebase(gridOffsetSec(t) * 1000L + fracMs, millis());   // 時計が動いたので基準を取り直す
+    Serial.printf("[TIME] Set from %s: step %+ldms (err %ums)\n", kTimeSourceName[source], stepMs, errMs);
+}
+
+/**
+ * モデム時計を "+CCLK: \"yy/MM/dd,hh:mm:ss+zz\"" から読む（未設定の時計は false）
+ */
+bool readModemClock(time_t& t) {
+    String response = sendATCommand("AT+CCLK?", 3000);
+    int start = response.indexOf("+CCLK: \"");
+    if (start < 0) return false;
+    start += 8;
+    int end = response.indexOf("\"", start);
+    if (end <= start) return false;
+    return parseCclk(response.substring(start, end).c_str(), t);
+}
+
+/**
+ * NITZ(またはこのモデム起動中のCNTP)で合わせたモデム時計があれば、それで時計を合わせる。
+ * モデム時計は水晶なので、ESP32のスリープ中RC時計より桁違いにずれが小さい
+ */
+bool syncTimeFromModem() {
+    if (modemClock.source == TS_NONE) return false;
+    time_t now; time(&now);
+    if (now - modemClock.syncedAt > TIME_MODEM_CLOCK_MAX_AGE_SEC) {
+        Serial.printf("[TIME] Modem clock (%s) too old, not used\n", kTimeSourceName[modemClock.source]);
+        return false;
+    }
+    time_t t;
+    if (!readModemClock(t)) {
+        Serial.println("[TIME] Modem clock not set");
+        modemClock = {};
+        return false;
+    }
+    uint32_t err = TIME_CCLK_ERR_MS + timeUncertaintyMs(modemClock, now, TIME_MODEM_DRIFT_PPM);
+    applyTime(t, 500, modemClock.source, err > 0xFFFF ? 0xFFFF : (uint16_t)err);   // 秒未満は不明なので中央
+    return true;
+}
+
+/**
+ * 本起床で最後に受けた HTTP Date で時計を合わせる（標本は使い切り）
+ */
+void applyHttpDate() {
+    int64_t ms = timeSampleMsAt(httpDate, millis());
+    applyTime((time_t)(ms / 1000), (uint16_t)(ms % 1000), TS_HTTP_DATE, TIME_HTTP_DATE_ERR_MS);
+    httpDate.valid = false;
+}
+
+/**
+ * HTTP Date と時計を照合する。
+ * 時計の不確かさが Date の誤差より大きければ Date で合わせる。差が許容(TIME_AGREE_MAX_MS)を
+ * 超え、かつ時計自身の不確かさでも説明できない時は食い違い（モデム時計は以後使わない）。
+ * 戻り値: false = 食い違い、または required なのに Date が無い（→ CNTP で確かめる）
+ */
+bool refineTimeFromHttpDate(bool required) {
+    if (!httpDate.valid) return !required;
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    int64_t diff = timeSampleMsAt(httpDate, millis()) - ((int64_t)tv.tv_sec * 1000 + tv.tv_usec / 1000);
+    uint64_t gap = diff < 0 ? -diff : diff;
+    uint32_t unc = timeUncertaintyMs(timeQuality, tv.tv_sec, TIME_RC_DRIFT_PPM);
+    Serial.printf("[TIME] Date vs clock %+lldms (clock %s, uncertainty %s%ums)\n", (long long)diff,
+                  kTimeSourceName[timeQuality.source], unc == UINT32_MAX ? ">" : "", unc == UINT32_MAX ? 0u : unc);
+    if (gap > TIME_AGREE_MAX_MS && unc < gap) {
+        Serial.println("[TIME] Clock disagrees with server Date");
+        if (timeQuality.source == TS_NITZ || timeQuality.source == TS_NTP) modemClock = {};
+        return false;
+    }
+    if (unc > TIME_HTTP_DATE_ERR_MS) applyHttpDate();
+    else httpDate.valid = false;
+    return true;
+}
+
+/**
+ * 時計の不確かさから受信窓を前後に広げる秒（上限 WINDOW_TIME_MARGIN_MAX_SEC）
+ */
+int windowMarginSec(time_t at) {
+    uint32_t unc = timeUncertaintyMs(timeQuality, at, TIME_RC_DRIFT_PPM);
+    if (unc >= (uint32_t)WINDOW_TIME_MARGIN_MAX_SEC * 1000) return WINDOW_TIME_MARGIN_MAX_SEC;
+    return (int)((unc + 999) / 1000);
+}
+
+/**
+ * サーバー設定を取得して反映（deadlineMs までに見積りが収まらなければ見送り）。
+ * 戻り値: 取得できた
+ */
+bool refreshConfig(int32_t deadlineMs) {
+    if (!schedule.admit(PH_CONFIG, PHASE_EST_CONFIG_MS, deadlineMs, configFetched, millis())) {
+        Serial.println("[SCHED] Config fetch postponed (cycle budget)");
+        return false;
+    }
+    Serial.println("[CONFIG] Fetching device config...");
+    bool fetched = fetchConfigFromServer();
+    if (fetched) {
+        lastConfigFetch = bootCount; configFetched = true;
+        Serial.printf("[CONFIG] hash:0x%08X children:%d\n", cachedParentIdHash, cachedChildCount);
+    } else if (!configFetched) {
+        cachedParentIdHash = computeParentIdHashLocal(DEVICE_ID);
+        Serial.printf("[WARN] Local hash fallback: 0x%08X\n", cachedParentIdHash);
+    }
+    configFetchedThisWake = true;
+    schedule.finish(PH_CONFIG, fetched, millis());
+    return fetched;
+}
+
+/**
+ * サーバー設定にペアリング待ち子機があれば、子機を起こしてからペア送信
+ */
+void runPendingPairing() {
+    if (!hasPendingChildren || pendingChildCount <= 0) return;
+    sendMWXWakeTrigger();
+    delay(500);
+    executePairingMode();
+}
+
+/**
+ * この起床でLTE初期化を受信窓より前に直列で済ませる必要があるか。
+ * 初回(設定=親IDハッシュ未取得)と NTP 同期期限切れ(窓位置が決まらない)は直列。
+ */
+bool lteNeedsSequential(time_t at) {
+    if (!LTE_PARALLEL_ENABLE) return true;
+    if (!configFetched || !ntpSynced || lastNtpSyncTime == 0) return true;
+    return at - lastNtpSyncTime >= NTP_SYNC_INTERVAL_SEC;
+}
+
+/**
+ * 時刻 at の直近グリッド境界からの秒（境界の手前=RC早起きなら負。-grid/2 .. grid/2）
+ */
+int gridOffsetSec(time_t at) {
+    struct tm ti;
+    localtime_r(&at, &ti);
+    int grid = MEASUREMENT_INTERVAL_MIN * 60;
+    int intoGrid = (ti.tm_min * 60 + ti.tm_sec) % grid;
+    return intoGrid > grid / 2 ? intoGrid - grid : intoGrid;
+}
+
+/**
+ * 工程別の予定/実績をログ出力（予定超過・見送りの確認用）
+ */
+void logWakeCycle(const WakeCycleLog& c) {
+    static const char* const kStatus[] = { "-", "ok", "OVERRUN", "skipped", "failed", "running" };
+    Serial.printf("[SCHED] wake %lu: start grid%+ldms, awake %lums\n", (unsigned long)c.wake,
+                  (long)c.startMs, (unsigned long)c.totalMs);
+    for (int i = 0; i < PH_COUNT; i++) {
+        const PhaseRecord& p = c.phase[i];
+        if (p.status == PHASE_NOT_RUN) continue;
+        Serial.printf("  %-8s plan %5.1fs  actual %5.1fs  %s\n", kWakePhaseName[i],
+                      p.plannedDs / 10.0f, p.actualDs / 10.0f, kStatus[p.status]);
+    }
+}
+
+/**
+ * 起床の受信窓オフセット（grid境界→窓open 秒）。LTEを直列で初期化する起床だけ
+ * LTE初期化を吸収する WINDOW_OPEN_OFFSET_SEC、それ以外は起動＋センサ読取り分のみ。
+ */
+int windowOffsetFor(bool lteWake, time_t at) {
+    if (!LTE_PARALLEL_ENABLE) return WINDOW_OPEN_OFFSET_SEC;
+    return (lteWake && lteNeedsSequential(at)) ? WINDOW_OPEN_OFFSET_SEC : WINDOW_OPEN_OFFSET_PARALLEL_SEC;
+}
+
+// 並列起床: モデムタスク（PRO_CPU）→ メイン（APP_CPU: LoRa/センサ）への完了通知（結果ごとコピーで渡す）
+static QueueHandle_t modemDoneQueue = nullptr;
+static TaskHandle_t modemTaskHandle = nullptr;
+static uint32_t modemTaskStartMs = 0;
+
+// 締切で打ち切られても at.cancel() で各ATが即失敗するので、結果（失敗）を送って終わる。
+// 送った後は at/modemSerial/PWRKEY に触れない（以後のモデム操作はメインタスクだけ）
+static void modemTask(void*) {
+    ModemBringup b;
+    bringUpModem(b);
+    xQueueSend(modemDoneQueue, &b, pdMS_TO_TICKS(1000));   // 長さ1に1回だけなので通常は待たない
+    vTaskDelete(nullptr);
+}
+
+/**
+ * モデム初期化を別コアのタスクで開始（受信窓と並行）。false=タスク生成失敗（直列で行う）
+ */
+bool startModemTask() {
+    if (!modemDoneQueue) modemDoneQueue = xQueueCreate(1, sizeof(ModemBringup));
+    if (!modemDoneQueue) return false;
+    BaseType_t ok = xTaskCreatePinnedToCore(modemTask, "modem", MODEM_TASK_STACK, nullptr,
+                                            MODEM_TASK_PRIORITY, &modemTaskHandle, MODEM_TASK_CORE);
+    if (ok != pdPASS) {
+        Serial.println("[MODEM] Task create failed, sequential init");
+        return false;
+    }
+    modemTaskStartMs = millis();
+    Serial.printf("[MODEM] LTE init in parallel on core %d\n", MODEM_TASK_CORE);
+    return true;
+}
+
+/**
+ * モデムタスクの完了を待ち、結果を b に受け取る（アタッチは受信窓の間に大半が終わっている）。
+ * 待つのは g_lteDeadlineMs＋猶予まで。過ぎたら at.cancel() でタスクを打ち切り、終了の報告を
+ * 受けてからメインがモデムを AT+CPOWD で切る。失敗として返す（蓄積して眠る）
+ */
+bool waitModemTask(ModemBringup& b) {
+    unsigned long t0 = millis();
+    b = {};
+    int32_t left = schedule.remainingMs(g_lteDeadlineMs, t0);
+    TickType_t wait = pdMS_TO_TICKS((uint32_t)(left > 0 ? left : 0) + MODEM_TASK_GRACE_MS);
+    if (xQueueReceive(modemDoneQueue, &b, wait) != pdTRUE) {
+        Serial.printf("[MODEM] Parallel init timed out (waited %lums), cancelling\n", millis() - t0);
+        at.cancel();
+        if (xQueueReceive(modemDoneQueue, &b, pdMS_TO_TICKS(MODEM_TASK_ABORT_MS)) == pdTRUE) {
+            // タスクは結果を送って終わる（以後 at/PWRKEY に触れない）。電源断はメインだけが行う
+            at.resume();
+            powerOffModem();
+            modemState.isInitialized = false;
+            modemState.isConnected = false;
+        } else {
+            // 打ち切れない待ち（ATエンジン外）: 以後ピンに触れないよう止め、PWRKEY を離したまま眠る。
+            // モデムの状態は分からないので UART も PWRKEY も使わない（次の起床の AT 確認に任せる）
+            Serial.println("[MODEM] Task did not stop, suspending it");
+            vTaskSuspend(modemTaskHandle);
+            digitalWrite(MODEM_PWRKEY_PIN, LOW);
+        }
+        modemTaskHandle = nullptr;
+        b = {};
+        b.startMs = modemTaskStartMs;
+        b.endMs = millis();
+        return false;
+    }
+    modemTaskHandle = nullptr;
+    Serial.printf("[MODEM] Parallel init %s (waited %lums after window)\n",
+                  b.ok ? "done" : "failed", millis() - t0);
+    return b.ok;
+}
+
 // ===== TWELITE関連関数 =====
 
 /**
@@ -634,7 +1463,8 @@ bool collectChildData() {
     unsigned long startTime = millis();
     uint8_t payload[64];
 
-    while (millis() - startTime < CHILD_RESPONSE_TIMEOUT) {
+    const unsigned long windowMs = CHILD_RESPONSE_TIMEOUT + g_windowMarginSec * 2000UL;
+    while (millis() - startTime < windowMs) {
         int16_t rssi = 0;
         int n = lora.recv(payload, sizeof(payload), &rssi, 500);
         if (n >= 17 && payload[0] == TWELITE_HEADER) {
@@ -670,6 +1500,9 @@ bool collectChildData() {
  */
 void sendDataAck(uint32_t parentIdHash, uint32_t childId) {
     uint16_t nextWin = secondsToNextWindow();  // 【明示同期】次の受信窓openまでの秒数
+    g_ackSent = true;
+    g_ackSentMs = millis();
+    g_ackNextWin = nextWin;
     uint8_t p[16];
     p[0] = TWELITE_HEADER;
     p[1] = PROTOCOL_VERSION;
@@ -693,7 +1526,7 @@ void sendDataAck(uint32_t parentIdHash, uint32_t childId) {
 
 /**
  * 【明示同期】現在(ACK送出時)から親機の「次の受信窓が開く」までの秒数を返す。
- * = 次の20分グリッド境界(NTP壁時計)までの秒数 + WINDOW_OPEN_OFFSET_SEC。
+ * = 次の20分グリッド境界(NTP壁時計)までの秒数 + 次の起床の窓オフセット(windowOffsetFor)。
  * 窓はwaitUntilWindowOpen()で grid境界+OFFSET のNTP絶対時刻に固定されるので、次窓openも
  * nextGrid+OFFSETで決定的。子機はこの値+窓中央狙いオフセットで寝て毎サイクル親時計に再同期。
  */
@@ -707,33 +1540,43 @@ uint16_t secondsToNextWindow() {
     // intoGridがgrid近く→toNextGridが極小(数秒)になり、"目の前の境界=今回の起床分"を次窓と
     // 誤認する(本来の次起床は+1周期先)。境界手前(grid/2以下)なら1周期足して真の次起床を指す。
     if (toNextGrid <= grid / 2) toNextGrid += grid;
-    long v = (long)toNextGrid + WINDOW_OPEN_OFFSET_SEC;    // 窓はNTPで grid+OFFSET に固定
+    // 次の起床のオフセット（その起床がLTEを直列初期化するなら後ろへずれる）。
+    // 本起床の送信見送り(uploadDeferred)は窓の後で決まるので、LTE起床なら見送って次もLTEになりうるとみなす。
+    // 窓の後の時計補正・見送り判定はこの値を変えない（commitWindowPromise で次の起床がこの時刻を守る）
+    bool nextLte = !configFetched || (wakesSinceLte + 1 >= energyPlanNow.roundsPerUpload) || g_lteWake;
+    int offset = windowOffsetFor(nextLte, now + toNextGrid);
+    long v = (long)toNextGrid + offset;                    // 窓はNTPで grid+OFFSET に固定
     if (v < 1) v = 1;
     if (v > 65535) v = 65535;
     return (uint16_t)v;
 }
 
 /**
- * 【明示同期/窓のNTP固定】受信窓を開く前に、NTPで「対象グリッド境界+WINDOW_OPEN_OFFSET_SEC」
+ * 【明示同期】本起床で DATA_ACK を送っていれば、告げた次窓openを時計補正後の時刻に直して RTC へ残す。
+ * ACK送出後に applyTime() で時計が動いても、送出からの経過は millis() で測るので子機の狙いと一致する
+ */
+void commitWindowPromise() {
+    promisedWindowAt = 0;
+    if (!g_ackSent) return;
+    time_t now; time(&now);
+    uint32_t sinceAckSec = (millis() - g_ackSentMs + 500) / 1000;
+    promisedWindowAt = now - (time_t)sinceAckSec + g_ackNextWin;
+    Serial.printf("[SYNC] Next window promised at grid%+ds\n", gridOffsetSec(promisedWindowAt));
+}
+
+/**
+ * 【明示同期/窓のNTP固定】受信窓を開く前に、NTPで「対象グリッド境界+本起床の窓オフセット」
  * まで待つ。親機がRCドリフトで早起きしても窓openを絶対時刻に揃え、子機(同じ絶対時刻を狙う)と
  * 一致させる。既にその時刻を過ぎている(遅起き/LTE初期化が長い)場合は待たず即open。
  */
 void waitUntilWindowOpen() {
-    time_t now; struct tm ti;
-    time(&now); localtime_r(&now, &ti);
-    int grid = MEASUREMENT_INTERVAL_MIN * 60;
-    int intoGrid = (ti.tm_min * 60 + ti.tm_sec) % grid;
-    int secToOpen;
-    if (intoGrid > grid / 2) {
-        // 境界手前で起床(早起き)。対象境界は (grid-intoGrid)秒後。窓open=そこ+OFFSET
-        secToOpen = (grid - intoGrid) + WINDOW_OPEN_OFFSET_SEC;
-    } else {
-        // 境界を過ぎている。対象境界はintoGrid秒前。窓open=OFFSET-intoGrid秒後
-        secToOpen = WINDOW_OPEN_OFFSET_SEC - intoGrid;
-    }
+    time_t now; time(&now);
+    // 境界手前で起床(早起き)なら負 → 対象境界は |offset|秒後。過ぎていれば offset秒前
+    // 時計の不確かさ分(g_windowMarginSec)だけ早く開け、同じだけ長く開けておく
+    int secToOpen = g_windowOffsetSec - g_windowMarginSec - gridOffsetSec(now);
     if (secToOpen > 0) {
-        Serial.printf("[SYNC] wait-to-grid: %ds (open window at grid+%ds NTP)\n",
-                      secToOpen, WINDOW_OPEN_OFFSET_SEC);
+        Serial.printf("[SYNC] wait-to-grid: %ds (open window at grid+%ds-%ds, time %s)\n",
+                      secToOpen, g_windowOffsetSec, g_windowMarginSec, kTimeSourceName[timeQuality.source]);
         delay((uint32_t)secToOpen * 1000UL);
     }
 }
@@ -756,45 +1599,37 @@ void markOtaValidIfPending() {
 
 /**
  * CARECVで生バイトを1回受信し out[] に格納。戻り値=受信バイト数(0=データ無し,-1=エラー/タイムアウト)。
- * 応答書式: "...\r\n+CARECV: <len>,<len個の生バイト>\r\nOK\r\n"。lenをテキスト解析後、
- * 生バイトはStringに入れずuint8_tへ直接読む(ファームは0x00を含むためString不可)。
- */
-int carecvRaw(uint8_t* out, int maxOut, uint32_t timeoutMs) {
-    modemSerial.print("AT+CARECV=0,1460\r\n");
-    // Phase1: "+CARECV: <len>," までをテキストで読む
-    String hdr = ""; unsigned long t = millis(); int len = -1;
-    while (millis() - t < timeoutMs) {
-        while (modemSerial.available()) {
-            char c = (char)modemSerial.read();
-            hdr += c;
-            int ci = hdr.indexOf("+CARECV:");
-            if (ci >= 0) {
-                int comma = hdr.indexOf(",", ci + 8);
-                if (comma > 0) { len = hdr.substring(ci + 9, comma).toInt(); goto haveLen; }
-            }
-            if (hdr.indexOf("ERROR") >= 0) return -1;
-            if (hdr.length() > 200) hdr = hdr.substring(hdr.length() - 40); // 肥大防止
-        }
-        delay(2);
-    }
-    return -1; // +CARECV来ず
-haveLen:
-    if (len <= 0) {
-        // 末尾OKを排出
-        unsigned long d = millis();
-        while (millis() - d < 500) { while (modemSerial.available()) modemSerial.read(); delay(5); }
-        return 0;
-    }
-    // Phase2: len個の生バイトを読む
-    int got = 0; t = millis();
-    while (got < len && got < maxOut && millis() - t < timeoutMs) {
-        if (modemSerial.available()) { out[got++] = (uint8_t)modemSerial.read(); t = millis(); }
-        else delay(1);
+ * clientID: CAOPENで割当てられた接続(OTAは0、HTTPセッションは httpSession.clientID)。
+ * 応答書式: "+CARECV: <len>,<len個の生バイト>\r\nOK\r\n"。生バイトはATエンジンが
+ * out[] へ直接格納する(ファームは0x00を含むためString不可)。途中のURCは購読側へ回る。
+ */
+int carecvRaw(uint8_t* out, int maxOut, uint32_t timeoutMs, int clientID) {
+    char cmd[32];
+    snprintf(cmd, sizeof(cmd), "AT+CARECV=%d,%d", clientID, maxOut < 1460 ? maxOut : 1460);
+    size_t got = 0;
+    if (at.execBinary(cmd, "+CARECV: ", out, maxOut, got, timeoutMs) != AT_OK) return -1;
+    return (int)got;
+}
+
+// OTAボディの書込先（HTTPパーサのボディコールバック）
+struct OtaWriter {
+    uint32_t written;
+    bool error;
+};
+
+static void otaBodySink(const uint8_t* p, size_t n, void* ctx) {
+    OtaWriter& w = *(OtaWriter*)ctx;
+    if (w.error) return;
+    if (w.written + n > g_otaSize) n = g_otaSize - w.written;
+    if (n == 0) return;
+    if (Update.write((uint8_t*)p, n) != n) {
+        Serial.printf("[OTA] write err %d at %u\n", Update.getError(), (unsigned)w.written);
+        w.error = true;
+        return;
     }
-    // Phase3: 末尾 \r\nOK\r\n を排出
-    unsigned long d = millis();
-    while (millis() - d < 400) { while (modemSerial.available()) modemSerial.read(); delay(5); }
-    return got;
+    w.written += n;
+    if ((w.written % 51200) < n)
+        Serial.printf("[OTA] %u / %u bytes\n", (unsigned)w.written, (unsigned)g_otaSize);
 }
 
 /**
@@ -816,8 +1651,12 @@ bool performOta() {
 
     // 堅牢CAOPEN: 全スロットクローズ+バッファ排出+リトライ
     for (int cid = 0; cid <= 2; cid++) sendATCommand("AT+CACLOSE=" + String(cid), 1200);
-    while (modemSerial.available()) modemSerial.read();
-    delay(1200);
+    at.service(1200);
+    // 配信は平文(MD5照合)。起床中のセッションがTLSなら cid 0 の SSL 指定を外す
+    if (httpSession.tlsReady) {
+        sendATCommand("AT+CASSLCFG=0,\"SSL\",0", 2000);
+        httpSession.tlsReady = false;
+    }
     String r; bool opened = false;
     for (int a = 0; a < 3 && !opened; a++) {
         r = sendATCommand(String("AT+CAOPEN=0,0,\"TCP\",\"") + host + "\"," + String(OTA_HTTP_PORT), 20000);
@@ -828,46 +1667,34 @@ bool performOta() {
 
     String req = "GET " + g_otaUrl + " HTTP/1.1\r\nHost: " + String(host)
                + "\r\nConnection: keep-alive\r\n\r\n";
-    sendATCommand("AT+CASEND=0," + String(req.length()), 5000);
-    modemSerial.print(req);
+    urcState.dataReady &= ~1u;
+    if (at.exec(("AT+CASEND=0," + String(req.length())).c_str(), 5000) == AT_PROMPT) {
+        at.write((const uint8_t*)req.c_str(), req.length());
+        at.waitResult(5000);
+    }
 
     // 最初の +CADATAIND を待つ
-    { String wb; unsigned long t0 = millis();
-      while (millis() - t0 < 12000) { while (modemSerial.available()) wb += (char)modemSerial.read();
-          if (wb.indexOf("+CADATAIND:") >= 0) break; delay(20); } }
+    { unsigned long t0 = millis();
+      while (!(urcState.dataReady & 1u) && millis() - t0 < 12000) at.service(20); }
 
-    // ストリーミング: CARECVの生バイトをHTTPヘッダ除去してUpdate.writeへ
+    // ストリーミング: CARECVの生バイトをHTTPパーサに通し、ボディ(長さ指定/chunked)だけUpdate.writeへ
     static uint8_t buf[1500];
-    uint32_t written = 0; bool headerDone = false; String hdrAccum = "";
+    OtaWriter ota = { 0, false };
+    HttpResponseParser resp(otaBodySink, &ota);
     unsigned long lastProgress = millis();
-    while (written < g_otaSize && millis() - lastProgress < 90000) {
+    while (!resp.done() && !ota.error && ota.written < g_otaSize && millis() - lastProgress < 90000) {
         int n = carecvRaw(buf, sizeof(buf), 5000);
-        if (n < 0) { delay(150); continue; }
-        if (n == 0) { delay(250); continue; }
+        if (n < 0) { at.service(150); continue; }
+        if (n == 0) { at.service(250); continue; }
         lastProgress = millis();
-        int bodyStart = 0;
-        if (!headerDone) {
-            int i = 0;
-            for (; i < n && !headerDone; i++) {
-                hdrAccum += (char)buf[i];
-                if (hdrAccum.endsWith("\r\n\r\n")) headerDone = true;
-                if (hdrAccum.length() > 800) hdrAccum = hdrAccum.substring(hdrAccum.length() - 8);
-            }
-            if (!headerDone) continue;   // このチャンクは全てヘッダ
-            bodyStart = i;               // ボディは buf[i] から
-        }
-        int bodyLen = n - bodyStart;
-        if (bodyLen > 0) {
-            if (written + (uint32_t)bodyLen > g_otaSize) bodyLen = g_otaSize - written;
-            if (Update.write(buf + bodyStart, bodyLen) != (size_t)bodyLen) {
-                Serial.printf("[OTA] write err %d at %u\n", Update.getError(), (unsigned)written);
-                Update.abort(); sendATCommand("AT+CACLOSE=0", 2000); return false;
-            }
-            written += bodyLen;
-            if ((written % 51200) < (uint32_t)bodyLen)
-                Serial.printf("[OTA] %u / %u bytes\n", (unsigned)written, (unsigned)g_otaSize);
+        resp.feed(buf, n);
+        if (resp.headersDone() && resp.status() != 200) {
+            Serial.printf("[OTA] HTTP %d -> abort\n", resp.status());
+            ota.error = true;
         }
     }
+    uint32_t written = ota.written;
+    if (ota.error) { Update.abort(); sendATCommand("AT+CACLOSE=0", 2000); return false; }
     sendATCommand("AT+CACLOSE=0", 3000);
 
     if (written != g_otaSize) {
@@ -1031,57 +1858,71 @@ bool isAllChildDataReceived() {
 
 // ===== SSL: CA証明書アップロード =====
 
-/**
- * ISRG Root X1 CA証明書をSIM7080Gファイルシステムに書き込む
- * 電源オン時に1回だけ実行 (caCertUploaded RTCフラグで管理)
- */
-bool uploadCACert() {
-    if (caCertUploaded) return true;
-
-    Serial.println("[SSL] Uploading CA cert to modem filesystem...");
+static bool atHasDownloadPrompt(const char* resp, void*) { return strstr(resp, "DOWNLOAD") != nullptr; }
 
-    sendATCommand("AT+CFSINIT", 3000);
+// 組込みCA証明書のハッシュ（FNV-1a。モデムFSの "ca.id" に16進で残して照合する）
+uint32_t caCertHash() {
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < CA_CERT_LEN; i++) { h ^= (uint8_t)CA_CERT_PEM[i]; h *= 16777619u; }
+    return h ? h : 1;
+}
 
+/**
+ * モデムFS(カスタマーエリア)へファイルを書く（CFSINIT済みで呼ぶ）
+ */
+static bool cfsWriteFile(const char* name, const uint8_t* data, size_t len) {
     // CFSWFILE: カスタマーエリア(3), ファイル名, 上書き(0), バイト数, タイムアウト(ms)
-    String cmd = "AT+CFSWFILE=3,\"ca.pem\",0," + String(CA_CERT_LEN) + ",10000";
-    while (modemSerial.available()) modemSerial.read();
-    modemSerial.println(cmd);
+    char cmd[64];
+    snprintf(cmd, sizeof(cmd), "AT+CFSWFILE=3,\"%s\",0,%u,10000", name, (unsigned)len);
 
     // "DOWNLOAD" プロンプト待ち (最大5秒)
-    String prompt = "";
-    unsigned long t = millis();
-    while (millis() - t < 5000) {
-        while (modemSerial.available()) prompt += (char)modemSerial.read();
-        if (prompt.indexOf("DOWNLOAD") >= 0 || prompt.indexOf(">") >= 0) break;
-        if (prompt.indexOf("ERROR") >= 0) break;
-        delay(50);
-    }
-    Serial.printf("[SSL] CFSWFILE prompt: '%s'\n", prompt.substring(0, 20).c_str());
-
-    if (prompt.indexOf("DOWNLOAD") < 0 && prompt.indexOf(">") < 0) {
+    AtStatus st = at.exec(cmd, 5000, atHasDownloadPrompt);
+    Serial.printf("[SSL] CFSWFILE %s prompt: '%.20s'\n", name, at.response());
+    if (st != AT_MATCH && st != AT_PROMPT) {
         Serial.println("[SSL] CFSWFILE prompt not received");
-        sendATCommand("AT+CFSTERM", 2000);
         return false;
     }
 
-    // 証明書データ送信 (バイナリ書き込み)
-    modemSerial.write((const uint8_t*)CA_CERT_PEM, CA_CERT_LEN);
+    // データ送信 (バイナリ書き込み) → OK 待ち (最大10秒)
+    at.write(data, len);
+    at.waitResult(10000);
+    String result = at.response();
+    Serial.printf("[SSL] CFSWFILE result: '%s'\n", result.c_str());
+    return result.indexOf("OK") >= 0;
+}
+
+/**
+ * ISRG Root X1 CA証明書をSIM7080Gファイルシステムに書き込む。
+ * 書込時に証明書のハッシュを "ca.id" に残し、電源オン後はそれを読んで一致すれば書込と変換を
+ * 省く。照合済みのハッシュはRTCに覚えるので、以後の起床ではATコマンドも送らない。
+ */
+bool uploadCACert() {
+    uint32_t hash = caCertHash();
+    if (caCertOnModem == hash) return true;
 
-    // OK 待ち (最大10秒)
-    String result = "";
-    t = millis();
-    while (millis() - t < 10000) {
-        while (modemSerial.available()) result += (char)modemSerial.read();
-        if (result.indexOf("OK") >= 0 || result.indexOf("ERROR") >= 0) break;
-        delay(100);
+    char id[9];
+    snprintf(id, sizeof(id), "%08x", (unsigned)hash);
+    sendATCommand("AT+CFSINIT", 3000);
+    String onModem = sendATCommand("AT+CFSRFILE=3,\"ca.id\",0,8,0", 3000);
+    if (onModem.indexOf(id) >= 0) {
+        sendATCommand("AT+CFSTERM", 2000);
+        caCertOnModem = hash;
+        Serial.printf("[SSL] CA cert on modem matches (%s), upload skipped\n", id);
+        return true;
     }
-    Serial.printf("[SSL] CFSWFILE result: '%s'\n", result.c_str());
 
+    Serial.println("[SSL] Uploading CA cert to modem filesystem...");
+    bool ok = cfsWriteFile("ca.pem", (const uint8_t*)CA_CERT_PEM, CA_CERT_LEN);
+    // 証明書が書けてから ca.id を更新（途中で失敗したら次回も照合に落ちて書き直す）
+    if (ok) ok = cfsWriteFile("ca.id", (const uint8_t*)id, 8);
     sendATCommand("AT+CFSTERM", 2000);
 
-    if (result.indexOf("OK") >= 0) {
-        caCertUploaded = true;
-        Serial.printf("[SSL] CA cert uploaded (%d bytes)\n", CA_CERT_LEN);
+    // PEM を SSL で使える形式へ変換（結果はモデムに残る）
+    if (ok) ok = sendATCommand("AT+CSSLCFG=\"convert\",2,\"ca.pem\"", 5000).indexOf("OK") >= 0;
+
+    if (ok) {
+        caCertOnModem = hash;
+        Serial.printf("[SSL] CA cert uploaded (%u bytes, id %s)\n", (unsigned)CA_CERT_LEN, id);
         return true;
     }
 
@@ -1091,177 +1932,103 @@ bool uploadCACert() {
 
 // ===== v2: サーバー設定取得 =====
 
+/**
+ * 設定の再取得時期か。ETagを保持していれば条件付き取得(304なら応答はヘッダのみ)なので
+ * 毎LTE起床で確認し、保持していなければ従来通り CONFIG_FETCH_INTERVAL 毎
+ */
+bool configCheckDue() {
+    if (CONFIG_ETAG_ENABLE && configEtag[0] && energyPlanNow.configPoll) return true;
+    return bootCount - lastConfigFetch >= CONFIG_FETCH_INTERVAL;
+}
+
+// 設定応答のボディを受信チャンクのまま解釈する（応答全体を String に溜めない）
+struct ConfigStream {
+    DeviceConfigParser parser;
+    uint32_t parseUs = 0;    // 解釈に使った時間の合計
+    explicit ConfigStream(DeviceConfig& cfg) : parser(cfg) {}
+};
+
+static void configBodySink(const uint8_t* p, size_t n, void* ctx) {
+    ConfigStream& s = *(ConfigStream*)ctx;
+    uint32_t t0 = micros();
+    s.parser.feed((const char*)p, n);
+    s.parseUs += micros() - t0;
+}
+
+// 応答の ETag ヘッダを引用符を外して受け取る（ctx = char[sizeof(configEtag)]）。
+// 引用符なしで持つのは送信ボディの "cfg" にそのまま載せるため
+static void configHeaderSink(const char* name, const char* value, void* ctx) {
+    if (strcasecmp(name, "ETag") != 0 || strncmp(value, "W/", 2) == 0) return;   // 弱いETagは使わない
+    char* out = (char*)ctx;
+    if (*value == '"') value++;
+    size_t n = 0;
+    while (value[n] && value[n] != '"' && n < sizeof(configEtag) - 1) { out[n] = value[n]; n++; }
+    out[n] = '\0';
+}
+
 /**
  * サーバーからデバイス設定を取得（GET /api/devices/config/:deviceId?secret=xxx）
- * レスポンスJSONをパースしてRTCキャッシュに保存
+ * レスポンスJSONをパースしてRTCキャッシュに保存。
+ * 前回のETagを If-None-Match で送り、304(変更なし)ならRTCキャッシュをそのまま使う。
+ * 応答が途中で切れた・解釈できなかった場合もRTCキャッシュには触れず失敗を返す。
  */
 bool fetchConfigFromServer() {
-    // HTTPS GET リクエスト。&fw= で稼働中バージョンを申告(OTA判定用)
+    // GET リクエスト。&fw= で稼働中バージョンを申告(OTA判定用)
     String configPath = String(SERVER_CONFIG_PATH) + DEVICE_ID + "?secret=" + DEVICE_SECRET
                       + "&fw=" + String(FIRMWARE_VERSION_CODE);
 
-    String r;
-    // TCP接続 (HTTP port 80)
-    sendATCommand("AT+CACLOSE=0", 1000);  // 念のため既存接続をクローズ
-    r = sendATCommand("AT+CAOPEN=0,0,\"TCP\",\"" + String(SERVER_HOST) + "\",80", 20000);
-    Serial.printf("[CONFIG] CAOPEN(TCP): '%s'\n", r.c_str());
-    if (r.indexOf("OK") < 0) {
-        Serial.println("[CONFIG] SSL connection failed");
-        return false;
-    }
-    // +CAOPEN: <clientID>,0 からclientIDを取得
-    int cfgClientID = 0;
-    {
-        int cidx = r.indexOf("+CAOPEN: ");
-        if (cidx >= 0) {
-            int ns = cidx + 9;
-            int cm = r.indexOf(",", ns);
-            if (cm > ns) cfgClientID = r.substring(ns, cm).toInt();
-        }
-    }
-    Serial.printf("[CONFIG] clientID: %d\n", cfgClientID);
-    delay(200);
-
-    // GETリクエスト送信 (HTTP/1.1 + keep-alive)
-    String httpReq = "GET " + configPath + " HTTP/1.1\r\n";
-    httpReq += "Host: " + String(SERVER_HOST) + "\r\n";
-    httpReq += "Connection: keep-alive\r\n\r\n";
-
-    r = sendATCommand("AT+CASEND=" + String(cfgClientID) + "," + String(httpReq.length()), 5000);
-    Serial.printf("[CONFIG] CASEND prompt: '%s'\n", r.c_str());
-    modemSerial.print(httpReq);
-
-    // +CADATAIND を待ってからCARECVで生HTTPデータを収集（複数チャンク対応）
-    String httpData = "";
-    int targetBodyLen = -1;
-    int httpHeaderEnd  = -1;
-    unsigned long t = millis();
-
-    // 最初の +CADATAIND を待つ（最大10秒）
-    {
-        String waitBuf = "";
-        while (millis() - t < 10000) {
-            while (modemSerial.available()) waitBuf += (char)modemSerial.read();
-            if (waitBuf.indexOf("+CADATAIND:") >= 0) break;
-            if (waitBuf.indexOf("+CASTATE:") >= 0) break;
-            delay(50);
-        }
-        Serial.printf("[CONFIG] waitBuf: '%s'\n", waitBuf.substring(0, 100).c_str());
-    }
-
-    // CARECVを繰り返してHTTPデータを収集（最大15秒、最大20回）
-    for (int attempt = 0; attempt < 20 && millis() - t < 15000; attempt++) {
-        modemSerial.print("AT+CARECV=" + String(cfgClientID) + ",1460\r\n");
-        String chunk = "";
-        unsigned long rt = millis();
-        while (millis() - rt < 3000) {
-            while (modemSerial.available()) chunk += (char)modemSerial.read();
-            if (chunk.endsWith("\r\nOK\r\n") || chunk.indexOf("ERROR") >= 0) break;
-            delay(10);
-        }
-
-        // +CARECV: <len>,<data> から生データを抽出
-        int caIdx = chunk.indexOf("+CARECV:");
-        if (caIdx >= 0) {
-            int commaPos = chunk.indexOf(",", caIdx + 8);
-            if (commaPos > 0) {
-                int recvLen = chunk.substring(caIdx + 9, commaPos).toInt();
-                if (recvLen > 0) {
-                    httpData += chunk.substring(commaPos + 1, commaPos + 1 + recvLen);
-                    Serial.printf("[CONFIG] CARECV got %d bytes, total httpData: %d\n", recvLen, httpData.length());
-                } else {
-                    // 0バイト → 少し待ってリトライ
-                    delay(300);
-                    continue;
-                }
-            }
-        } else {
-            delay(200);
-            continue;
-        }
-
-        // Content-Length を取得（まだ未取得の場合）
-        if (targetBodyLen < 0) {
-            int clIdx = httpData.indexOf("Content-Length: ");
-            int hdrEnd = httpData.indexOf("\r\n\r\n");
-            if (clIdx >= 0 && hdrEnd > clIdx) {
-                int clEnd = httpData.indexOf("\r\n", clIdx + 16);
-                targetBodyLen = httpData.substring(clIdx + 16, clEnd).toInt();
-                httpHeaderEnd = hdrEnd;
-                Serial.printf("[CONFIG] Content-Length: %d\n", targetBodyLen);
-            }
-        }
-
-        // ボディが揃ったか確認
-        if (targetBodyLen > 0 && httpHeaderEnd >= 0) {
-            int bodyAvail = (int)httpData.length() - httpHeaderEnd - 4;
-            Serial.printf("[CONFIG] body avail: %d / %d\n", bodyAvail, targetBodyLen);
-            if (bodyAvail >= targetBodyLen) break;
-        }
+    // 初回/未取得時は条件なし（RTCキャッシュが空なので304では困る）
+    char cond[sizeof(configEtag) + 24] = "";
+    if (CONFIG_ETAG_ENABLE && configFetched && configEtag[0]) {
+        snprintf(cond, sizeof(cond), "If-None-Match: \"%s\"\r\n", configEtag);
     }
 
-    String cfgResp = httpData;
-    Serial.printf("[CONFIG] httpData total: %d bytes\n", httpData.length());
-
-    String response = cfgResp;
-    Serial.printf("[CONFIG] CARECV (first 200): '%s'\n", response.substring(0, 200).c_str());
-    sendATCommand("AT+CACLOSE=" + String(cfgClientID), 3000);
-
-    bool success = false;
-    int bodyLen = 0;
-
-    // 古いモデムバッファの残滓を除去してHTTPレスポンス先頭から解析
-    int httpStart = response.indexOf("HTTP/");
-    if (httpStart >= 0) {
-        response = response.substring(httpStart);
+    // 起床中のHTTPセッション上でGET。ボディは受信しながら json_tok.h で1回走査し、
+    // 子機表・ペアリング待ち・firmware{} を直接埋める
+    static ConfigChild cfgChildren[MAX_CHILD_DEVICES];
+    DeviceConfig cfg;
+    cfg.children = cfgChildren;
+    cfg.childCap = MAX_CHILD_DEVICES;
+    ConfigStream stream(cfg);
+    char etag[sizeof(configEtag)] = "";
+    HttpResponseParser parser(configBodySink, &stream, configHeaderSink, etag);
+    int status = httpRequest("GET", configPath, HTTP_NO_BODY, parser, cond[0] ? cond : nullptr);
+    int bodyLen = (int)stream.parser.bytes();
+    bool parsed = stream.parser.finish();
+    Serial.printf("[CONFIG] HTTP %d, body: %d bytes\n", status, bodyLen);
+
+    if (status == 304) {
+        // 変更なし: 子機リスト・親IDハッシュはRTCキャッシュのまま。ETag保持時は
+        // ペアリング待ち/OTA新版が無かった（下記）ので、それらの再解析も不要
+        Serial.printf("[CONFIG] Not modified (%s)\n", configEtag);
+        markOtaValidIfPending();
+        return cachedParentIdHash != 0;
     }
 
-    if (response.indexOf("HTTP/") >= 0 && (response.indexOf(" 200") >= 0 || response.indexOf(" 201") >= 0)) {
-        // HTTPヘッダーとボディを分離（HTTP/以降から\r\n\r\nを探す）
-        int bodyStart = response.indexOf("\r\n\r\n");
-        if (bodyStart >= 0) {
-            // Content-Lengthで正確なボディ長を取得
-            int contentLen = 0;
-            int clIdx = response.indexOf("Content-Length: ");
-            if (clIdx >= 0 && clIdx < bodyStart) {
-                int clEnd = response.indexOf("\r\n", clIdx + 16);
-                if (clEnd > 0) contentLen = response.substring(clIdx + 16, clEnd).toInt();
-            }
-            int bodyOffset = bodyStart + 4;
-            if (contentLen > 0) {
-                response = response.substring(bodyOffset, bodyOffset + contentLen);
-            } else {
-                response = response.substring(bodyOffset);
-            }
-        }
-        bodyLen = response.length();
-        success = bodyLen > 0;
-        Serial.printf("[CONFIG] HTTP 200 OK, body: %d bytes\n", bodyLen);
+    bool success = (status == 200 || status == 201) && bodyLen > 0;
+    if (success && !(parsed && parser.done())) {
+        // 途中で切れた/壊れた応答は何も反映しない（子機表を半端に差し替えない）。
+        // ETagも捨て、次の起床では条件なしで全文を取り直す
+        Serial.printf("[CONFIG] Malformed or truncated body (%d bytes), cache kept\n", bodyLen);
+        configEtag[0] = '\0';
+        success = false;
     }
-
-    if (success && bodyLen > 0) {
-
-        // JSONパース（簡易パーサー）
+    if (success) {
         // レスポンス例: {"success":true,"data":{"deviceId":"foxsense-001","parentIdHash":2849513012,...}}
-        Serial.println("[CONFIG] Response: " + response);
+        Serial.printf("[CONFIG] Parsed in %lu us\n", (unsigned long)stream.parseUs);
 
         // parentIdHash取得
-        int hashIdx = response.indexOf("\"parentIdHash\":");
-        if (hashIdx >= 0) {
-            int hashStart = hashIdx + 15;
-            int hashEnd = response.indexOf(",", hashStart);
-            if (hashEnd < 0) hashEnd = response.indexOf("}", hashStart);
-            if (hashEnd > hashStart) {
-                String hashStr = response.substring(hashStart, hashEnd);
-                hashStr.trim();
-                cachedParentIdHash = (uint32_t)strtoul(hashStr.c_str(), NULL, 10);
-                Serial.printf("[CONFIG] parentIdHash: 0x%08X\n", cachedParentIdHash);
-            }
+        if (cfg.parentIdHash != 0) {
+            cachedParentIdHash = cfg.parentIdHash;
+            Serial.printf("[CONFIG] parentIdHash: 0x%08X\n", cachedParentIdHash);
+        }
+        if (cfg.transport != ingestTransport) {
+            ingestTransport = cfg.transport;
+            Serial.printf("[CONFIG] Ingest transport: %s\n", ingestTransport == TRANSPORT_UDP ? "udp" : "http");
         }
 
-        // 子機リストパース
-        int childrenIdx = response.indexOf("\"children\":[");
-        if (childrenIdx >= 0) {
+        // 子機リスト（"children" が無い応答ではキャッシュを変えない）
+        if (cfg.hasChildren) {
             // 既存キャッシュクリア
             cachedChildCount = 0;
             pendingChildCount = 0;
@@ -1271,108 +2038,51 @@ bool fetchConfigFromServer() {
                 cachedChildLogicalIds[i] = 0;
             }
 
-            // 各子機エントリをパース
-            int searchPos = childrenIdx + 12;
-            int childIdx = 0;
-
-            while (childIdx < MAX_CHILD_DEVICES) {
-                int objStart = response.indexOf("{", searchPos);
-                int objEnd = response.indexOf("}", objStart);
-                if (objStart < 0 || objEnd < 0) break;
-
-                String childObj = response.substring(objStart, objEnd + 1);
-
-                // deviceIdNum取得
-                int didIdx = childObj.indexOf("\"deviceIdNum\":");
-                uint32_t childDeviceId = 0;
-                if (didIdx >= 0) {
-                    int didStart = didIdx + 14;
-                    int didEnd = childObj.indexOf(",", didStart);
-                    if (didEnd < 0) didEnd = childObj.indexOf("}", didStart);
-                    String didStr = childObj.substring(didStart, didEnd);
-                    didStr.trim();
-                    childDeviceId = (uint32_t)strtoul(didStr.c_str(), NULL, 10);
-                }
-
-                // logicalId取得
-                int lidIdx = childObj.indexOf("\"logicalId\":");
-                uint8_t logicalId = childIdx;
-                if (lidIdx >= 0) {
-                    int lidStart = lidIdx + 12;
-                    int lidEnd = childObj.indexOf(",", lidStart);
-                    if (lidEnd < 0) lidEnd = childObj.indexOf("}", lidStart);
-                    String lidStr = childObj.substring(lidStart, lidEnd);
-                    lidStr.trim();
-                    logicalId = (uint8_t)lidStr.toInt();
-                }
-
-                // pairingStatus取得
-                int psIdx = childObj.indexOf("\"pairingStatus\":\"");
-                String pairingStatus = "PAIRED";
-                if (psIdx >= 0) {
-                    int psStart = psIdx + 17;
-                    int psEnd = childObj.indexOf("\"", psStart);
-                    if (psEnd > psStart) {
-                        pairingStatus = childObj.substring(psStart, psEnd);
-                    }
-                }
-
-                // deviceId(hex文字列)取得
-                int dhIdx = childObj.indexOf("\"deviceId\":\"");
-                String deviceIdHex = "";
-                if (dhIdx >= 0) {
-                    int dhStart = dhIdx + 12;
-                    int dhEnd = childObj.indexOf("\"", dhStart);
-                    if (dhEnd > dhStart) {
-                        deviceIdHex = childObj.substring(dhStart, dhEnd);
-                    }
-                }
-
-                if (childDeviceId != 0) {
-                    cachedChildIds[childIdx] = childDeviceId;
-                    cachedChildLogicalIds[childIdx] = logicalId;
-                    cachedChildCount++;
-
-                    Serial.printf("[CONFIG] Child[%d]: 0x%08X (logical:%d, status:%s)\n",
-                                  childIdx, childDeviceId, logicalId, pairingStatus.c_str());
-
-                    // ペアリング待ち子機を記録
-                    if (pairingStatus == "PENDING") {
-                        hasPendingChildren = true;
-                        if (pendingChildCount < MAX_CHILD_DEVICES) {
-                            pendingChildren[pendingChildCount].deviceId = childDeviceId;
-                            pendingChildren[pendingChildCount].logicalId = logicalId;
-                            deviceIdHex.toCharArray(pendingChildren[pendingChildCount].deviceIdHex, 9);
-                            pendingChildCount++;
-                        }
-                    }
-
-                    childIdx++;
+            for (int i = 0; i < cfg.childCount; i++) {
+                const ConfigChild& c = cfgChildren[i];
+                cachedChildIds[i] = c.id;
+                cachedChildLogicalIds[i] = c.logicalId;
+                cachedChildCount++;
+
+                Serial.printf("[CONFIG] Child[%d]: 0x%08X (logical:%d, status:%s)\n",
+                              i, c.id, c.logicalId, c.pending ? "PENDING" : "PAIRED");
+
+                // ペアリング待ち子機を記録
+                if (c.pending) {
+                    hasPendingChildren = true;
+                    pendingChildren[pendingChildCount].deviceId = c.id;
+                    pendingChildren[pendingChildCount].logicalId = c.logicalId;
+                    memcpy(pendingChildren[pendingChildCount].deviceIdHex, c.idHex, sizeof(c.idHex));
+                    pendingChildCount++;
                 }
-
-                searchPos = objEnd + 1;
+            }
+            if (cfg.childTotal > cfg.childCount) {
+                Serial.printf("[WARN] Config lists %u children, only %u kept (server cap mismatch, MAX_CHILD_DEVICES=%d)\n",
+                              cfg.childTotal, cfg.childCount, MAX_CHILD_DEVICES);
             }
         }
 
-        // OTA: firmware{} をパース(あれば新版候補、無ければ最新)
+        // OTA: firmware{}(あれば新版候補、null/無ければ最新)
         g_otaAvailable = false;
-        int fwIdx = response.indexOf("\"firmware\":{");
-        if (fwIdx >= 0) {
-            int fwEnd = response.indexOf("}", fwIdx);
-            String fw = (fwEnd > fwIdx) ? response.substring(fwIdx, fwEnd + 1) : String("");
-            uint32_t vc = 0, sz = 0; String url = "", md5 = ""; int p;
-            if ((p = fw.indexOf("\"versionCode\":")) >= 0) vc = (uint32_t)strtoul(fw.substring(p + 14).c_str(), NULL, 10);
-            if ((p = fw.indexOf("\"size\":")) >= 0)        sz = (uint32_t)strtoul(fw.substring(p + 7).c_str(), NULL, 10);
-            if ((p = fw.indexOf("\"url\":\"")) >= 0)  { int s = p + 7, e = fw.indexOf("\"", s); if (e > s) url = fw.substring(s, e); }
-            if ((p = fw.indexOf("\"md5\":\"")) >= 0)  { int s = p + 7, e = fw.indexOf("\"", s); if (e > s) md5 = fw.substring(s, e); }
-            if (vc > FIRMWARE_VERSION_CODE && sz > 0 && url.length() > 0 && md5.length() == 32) {
-                g_otaAvailable = true; g_otaVerCode = vc; g_otaSize = sz; g_otaUrl = url; g_otaMd5 = md5;
+        if (cfg.hasFirmware) {
+            const ConfigFirmware& fw = cfg.fw;
+            if (fw.versionCode > FIRMWARE_VERSION_CODE && fw.size > 0 && fw.url[0] && strlen(fw.md5) == 32) {
+                g_otaAvailable = true; g_otaVerCode = fw.versionCode; g_otaSize = fw.size; g_otaUrl = fw.url; g_otaMd5 = fw.md5;
                 Serial.printf("[OTA] update available: vcode %u -> %u, %u bytes, url=%s md5=%s\n",
-                              (unsigned)FIRMWARE_VERSION_CODE, (unsigned)vc, (unsigned)sz, url.c_str(), md5.c_str());
+                              (unsigned)FIRMWARE_VERSION_CODE, (unsigned)fw.versionCode, (unsigned)fw.size, fw.url, fw.md5);
             }
         }
     }
 
+    // ETagは全文を解釈できた応答で、ペアリング待ち/OTA新版が無い時だけ保持する。後者はRTCに無いので、
+    // 304で解析を省くと次の起床で失われる（保持しなければ次回も全文を受けて解析する）
+    if (success) {
+        bool cacheable = CONFIG_ETAG_ENABLE && etag[0] && parsed && parser.done()
+                       && !hasPendingChildren && !g_otaAvailable;
+        strcpy(configEtag, cacheable ? etag : "");
+        if (etag[0]) Serial.printf("[CONFIG] ETag %s (%s)\n", etag, cacheable ? "cached" : "not cached");
+    }
+
     // サーバ到達成功 → OTA probation確定(ロールバック解除)
     if (success) markOtaValidIfPending();
 
@@ -1503,11 +2213,25 @@ bool reportPairingResult(const char* childDeviceIdHex, const char* status) {
     payload += "}";
 
     // 生TCP送信 (SHCONN は cid=0 問題で動作しないため回避)
-    return sendRawHTTPTCP("POST", pairingPath, String(SERVER_HOST), payload);
+    return sendRawHTTPTCP("POST", pairingPath, payload);
 }
 
 // ===== モデム関連関数 =====
 
+/**
+ * PWRKEY を1回押す（LOW→HIGH 1s→LOW。起動/PSM起床、起動中なら電源断）。モデムタスクが
+ * 打ち切られていれば押さない（押し始めたら最後まで押し、ピンは必ず LOW で終わる）
+ */
+static bool pulseModemPwrkey() {
+    if (at.cancelled()) return false;
+    digitalWrite(MODEM_PWRKEY_PIN, LOW);
+    delay(100);
+    digitalWrite(MODEM_PWRKEY_PIN, HIGH);
+    delay(1000);
+    digitalWrite(MODEM_PWRKEY_PIN, LOW);
+    return true;
+}
+
 bool powerOnModem() {
     Serial.println("[MODEM] Powering on...");
 
@@ -1528,16 +2252,9 @@ bool powerOnModem() {
     // 複数回リトライ: 1回だけ試して失敗するとPWRKEYで動作中のモデムを切ってしまう
     Serial.println("[MODEM] Checking if already running (5 tries)...");
     auto tryATOnce = [&]() -> bool {
-        while (modemSerial.available()) modemSerial.read();
-        modemSerial.println("AT");
-        String r = "";
-        unsigned long t = millis();
-        while (millis() - t < 1500) {
-            while (modemSerial.available()) r += (char)modemSerial.read();
-            delay(10);
-        }
-        Serial.printf("[MODEM] tryAT: '%s'\n", r.c_str());
-        return r.indexOf("OK") >= 0;
+        bool ok = at.exec("AT", 1500) == AT_OK;
+        Serial.printf("[MODEM] tryAT: '%s'\n", at.response());
+        return ok;
     };
 
     for (int attempt = 0; attempt < 5; attempt++) {
@@ -1545,68 +2262,45 @@ bool powerOnModem() {
             Serial.println("[MODEM] Already running! Skipping PWRKEY.");
             return true;
         }
-        delay(500);
+        at.service(500);
     }
 
     // 起動していないのでPWRKEYで起動
     // PWRKEY シーケンス (LilyGo T-SIM7080G-S3 公式パターン)
     // LOW(idle) → HIGH(active,1s) → LOW(idle)
     Serial.println("[MODEM] Not running. PWRKEY: LOW→HIGH(1s)→LOW");
-    digitalWrite(MODEM_PWRKEY_PIN, LOW);
-    delay(100);
-    digitalWrite(MODEM_PWRKEY_PIN, HIGH);
-    delay(1000);
-    digitalWrite(MODEM_PWRKEY_PIN, LOW);
+    modemClock = {};   // 起動し直したモデムの時計は NITZ/CNTP を受けるまで使えない
+    if (!pulseModemPwrkey()) return false;
     Serial.println("[MODEM] PWRKEY done, waiting 15s for boot...");
-    delay(15000);
+    at.service(15000);
 
     // ATコマンド確認 (最大15回)
     Serial.println("[MODEM] Trying AT commands...");
     for (int i = 0; i < 15; i++) {
-        while (modemSerial.available()) modemSerial.read();
-        modemSerial.println("AT");
-        delay(500);
-        String response = "";
-        unsigned long t = millis();
-        while (millis() - t < 1000) {
-            while (modemSerial.available()) response += (char)modemSerial.read();
-            delay(10);
-        }
-        response.trim();
-        Serial.printf("[AT #%d] '%s'\n", i + 1, response.c_str());
-        if (response.indexOf("OK") >= 0) {
+        at.service(500);
+        bool ok = at.exec("AT", 1000) == AT_OK;
+        Serial.printf("[AT #%d] '%s'\n", i + 1, at.response());
+        if (ok) {
             Serial.println("[MODEM] AT OK!");
             return true;
         }
-        delay(500);
+        at.service(500);
     }
 
     // PWRKEYで起動に失敗した場合、もう1回PWRKEY試行
     Serial.println("[MODEM] First boot attempt failed, trying PWRKEY again...");
-    digitalWrite(MODEM_PWRKEY_PIN, LOW);
-    delay(100);
-    digitalWrite(MODEM_PWRKEY_PIN, HIGH);
-    delay(1000);
-    digitalWrite(MODEM_PWRKEY_PIN, LOW);
+    if (!pulseModemPwrkey()) return false;
     Serial.println("[MODEM] Second PWRKEY done, waiting 15s...");
-    delay(15000);
+    at.service(15000);
     for (int i = 0; i < 10; i++) {
-        while (modemSerial.available()) modemSerial.read();
-        modemSerial.println("AT");
-        delay(500);
-        String response = "";
-        unsigned long t = millis();
-        while (millis() - t < 1000) {
-            while (modemSerial.available()) response += (char)modemSerial.read();
-            delay(10);
-        }
-        response.trim();
-        Serial.printf("[AT2 #%d] '%s'\n", i + 1, response.c_str());
-        if (response.indexOf("OK") >= 0) {
+        at.service(500);
+        bool ok = at.exec("AT", 1000) == AT_OK;
+        Serial.printf("[AT2 #%d] '%s'\n", i + 1, at.response());
+        if (ok) {
             Serial.println("[MODEM] AT OK (2nd attempt)!");
             return true;
         }
-        delay(500);
+        at.service(500);
     }
 
     Serial.println("[MODEM] No AT response.");
@@ -1618,61 +2312,90 @@ void powerOffModem() {
     delay(2000);
 }
 
-bool initModem() {
-    while (modemSerial.available()) modemSerial.read();
+// CPSI? 応答が Cat-M1/NB-IoT で在圏中か
+static bool cpsiOnline(const String& cpsi) {
+    return cpsi.indexOf("LTE CAT-M1,Online") >= 0 || cpsi.indexOf("NB-IOT,Online") >= 0;
+}
 
-    if (!powerOnModem()) {
+// CPSI? 応答から在圏RAT
+static uint8_t cpsiRat(const String& cpsi) {
+    if (cpsi.indexOf("LTE CAT-M1,Online") >= 0) return RAT_CATM;
+    if (cpsi.indexOf("NB-IOT,Online") >= 0) return RAT_NBIOT;
+    return RAT_UNKNOWN;
+}
+
+/**
+ * 高速アタッチ判定: モデムが前回の設定(APN/RAT)を保持しているか
+ * CFUN=0→再設定→CFUN=1 の無線リセットが不要かを、問い合わせのみで確認する。
+ */
+static bool modemProvisioned() {
+    String cgdcont = sendATCommand("AT+CGDCONT?", 3000);
+    if (cgdcont.indexOf(String("+CGDCONT: 1,\"IP\",\"") + LTE_APN + "\"") < 0) {
+        Serial.printf("[MODEM] APN mismatch: '%s'\n", cgdcont.c_str());
         return false;
     }
-    Serial.println("[MODEM] AT OK");
-
-    sendATCommand("ATE0", 1000);
-    sendATCommand("AT+CMEE=2", 1000);  // 詳細エラーコード有効化
-
-    String response = sendATCommand("AT+CPIN?", 5000);
-    if (response.indexOf("READY") < 0) {
-        Serial.println("[MODEM] SIM not ready");
+    String cnmp = sendATCommand("AT+CNMP?", 2000);
+    if (cnmp.indexOf("+CNMP: " + String(MODEM_NETWORK_MODE)) < 0) {
+        Serial.printf("[MODEM] CNMP mismatch: '%s'\n", cnmp.c_str());
         return false;
     }
-    Serial.println("[MODEM] SIM ready");
-
-    // HTTPモジュール不調フラグ: CFUN=1,1 でモデムをソフトリセット
-    if (modemNeedsReset) {
-        Serial.println("[MODEM] HTTPモジュール再初期化のためCFUN=1,1ソフトリセット...");
-        sendATCommand("AT+CFUN=1,1", 5000);
-        delay(20000);  // モデム再起動待ち
-        // リセット後は通常フローで再登録
-        modemNeedsReset = false;
-        Serial.println("[MODEM] CFUN=1,1 done, re-initializing...");
-        // CPINが準備できるまで待つ
-        for (int i = 0; i < 15; i++) {
-            String cpin = sendATCommand("AT+CPIN?", 3000);
-            if (cpin.indexOf("READY") >= 0) break;
-            delay(2000);
-        }
+    String cmnb = sendATCommand("AT+CMNB?", 2000);
+    if (cmnb.indexOf("+CMNB: " + String(ratMode)) < 0) {
+        Serial.printf("[MODEM] CMNB mismatch: '%s'\n", cmnb.c_str());
+        return false;
     }
+    return true;
+}
 
-    // Cat-M1登録済みかを CFUN=0 の前に確認
-    // 登録済みかつモデムリセット不要なら CFUN=0/1 リセットをスキップ
-    String cpsiEarly = sendATCommand("AT+CPSI?", 3000);
-    Serial.printf("[MODEM] Early CPSI: %s\n", cpsiEarly.c_str());
+/**
+ * サービングセルを学習: "+CPSI: LTE CAT-M1,Online,440-10,0x1A2B,12345678,123,EUTRAN-BAND19,6100,..."
+ */
+static void learnServingCell(const String& cpsi) {
+    // AT+CBANDCFG の絞り込みは Cat-M1 側のみ（NB-IoT 在圏時は学習しない）
+    if (cpsiRat(cpsi) != RAT_CATM) return;
+    int b = cpsi.indexOf("EUTRAN-BAND");
+    if (b < 0) return;
+    int band = cpsi.substring(b + 11).toInt();
+    if (band <= 0 || band > 255) return;
+    int e = cpsi.indexOf(',', b);
+    int o = cpsi.indexOf("Online,");
+    int oe = (o >= 0) ? cpsi.indexOf(',', o + 7) : -1;
+    if (band != bandCache.band) Serial.printf("[BAND] Learned band %d (was %d)\n", band, bandCache.band);
+    bandCache.band = (uint8_t)band;
+    bandCache.earfcn = (e >= 0) ? (uint16_t)cpsi.substring(e + 1).toInt() : 0;
+    bandCache.oper[0] = '\0';
+    if (oe > o + 7 && oe - (o + 7) < (int)sizeof(bandCache.oper)) {
+        strncpy(bandCache.oper, cpsi.c_str() + o + 7, oe - (o + 7));
+        bandCache.oper[oe - (o + 7)] = '\0';
+    }
+    Serial.printf("[BAND] Serving: band %u earfcn %u oper %s\n",
+                  bandCache.band, bandCache.earfcn, bandCache.oper);
+}
 
-    // 【2026-07 修正】CFUN=1,1 高速パスを無効化。
-    // 登録済みのとき CFUN=1,1 でモデムをリブートしてからコンテキスト設定しても
-    // CNACT の PDPコンテキスト活性化がタイムアウトする不具合があったため、
-    // 登録済みでも下記の「フル初期化」(CFUN=0→CGDCONT→CNCFG→CFUN=1→登録→
-    // connectNetwork = 4月まで正常に送信できていた既知の正常シーケンス)を毎回通す。
-    (void)cpsiEarly;
+// Cat-M1 の探索バンドを設定（無線オフ中に呼ぶ。設定はモデムの不揮発領域に残る）
+static void setBandScope(uint8_t scope) {
+    String bands = (scope == BAND_SCOPE_CACHED) ? String(bandCache.band)
+                 : (scope == BAND_SCOPE_REGIONAL) ? String(CATM_BANDS_REGIONAL) : String(CATM_BANDS_ALL);
+    Serial.printf("[BAND] Scan scope %s: %s\n", kBandScopeName[scope], bands.c_str());
+    sendATCommand("AT+CBANDCFG=\"CAT-M\"," + bands, 3000);
+}
 
-    // SIM情報取得
-    String imsi = sendATCommand("AT+CIMI", 3000);
-    Serial.printf("[MODEM] IMSI: %s\n", imsi.c_str());
-    String iccid = sendATCommand("AT+CCID", 3000);
-    Serial.printf("[MODEM] ICCID: %s\n", iccid.c_str());
+// 探索範囲を広げて再探索（無線オフ→バンド設定→無線オン→オペレーター自動選択）
+static void widenBandScope(uint8_t scope) {
+    sendATCommand("AT+CFUN=0", 8000);
+    at.service(2000);
+    setBandScope(scope);
+    urcState.cereg = -1;
+    sendATCommand("AT+CFUN=1", 8000);
+    at.service(3000);
+    sendATCommand("AT+COPS=0", 5000);
+}
 
+// フル初期化: 無線オフ→APN/RAT/バンド設定→無線オン→オペレーター自動選択
+static void provisionModem(uint8_t bandScope) {
     // ラジオオフ→設定変更→オン の順で確実に設定
     sendATCommand("AT+CFUN=0", 8000);
-    delay(2000);
+    at.service(2000);
 
     // APN設定 (SORACOM) - シンプルな構成
     String apnCmd = String("AT+CGDCONT=1,\"IP\",\"") + LTE_APN + "\"";
@@ -1683,66 +2406,249 @@ bool initModem() {
     sendATCommand(String("AT+CNCFG=0,1,\"") + LTE_APN + "\"", 3000);
 
     // LTE only + Cat-M1 only (plan-D は Cat-M1 対応、NB-IoT非対応)
-    sendATCommand("AT+CNMP=38", 3000);   // LTE only
-    sendATCommand("AT+CMNB=1", 3000);   // Cat-M1 only
+    sendATCommand("AT+CNMP=" + String(MODEM_NETWORK_MODE), 3000);   // LTE only
+    sendATCommand("AT+CMNB=" + String(ratMode), 3000);   // 1=Cat-M1 only（RAT自動選択時は 2/3 も）
+    if (BAND_CACHE_ENABLE) setBandScope(bandScope);
+
+    // 登録状態の変化を +CEREG URC で通知させる（登録待ちループを早く抜ける）
+    urcState.cereg = -1;
+    sendATCommand("AT+CEREG=1", 2000);
 
     sendATCommand("AT+CFUN=1", 8000);
-    delay(3000);
+    at.service(3000);
 
     // CFUN=1後にオペレーター自動選択 (ラジオON後でないと有効にならない)
     sendATCommand("AT+COPS=0", 5000);
-    delay(2000);
-
-    // 接続前の診断情報
-    String csq = sendATCommand("AT+CSQ", 2000);
-    Serial.printf("[MODEM] Signal: %s\n", csq.c_str());
-    String cpsiNow = sendATCommand("AT+CPSI?", 3000);
-    Serial.printf("[MODEM] Network state: %s\n", cpsiNow.c_str());
+    at.service(2000);
+}
 
-    // 既に登録済みか確認
-    if (cpsiNow.indexOf("LTE CAT-M1,Online") >= 0 || cpsiNow.indexOf("NB-IOT,Online") >= 0) {
-        Serial.println("[MODEM] Registered on Cat-M1/NB-IoT!");
-        modemState.signalStrength = getSignalStrength();
-        if (!connectNetwork()) {
+/**
+ * ネットワーク登録待ち（最大 maxTries 回 × 約5秒）
+ * 戻り値: true=登録済み(ホーム/ローミング)
+ */
+static bool waitRegistration(int maxTries) {
+    for (int i = 0; i < maxTries; i++) {
+        // 工程の締切を過ぎたら打ち切り（窓/送信を守る。データはRTCに残り次のLTE起床で送る）
+        if (schedule.expired(g_lteDeadlineMs, millis())) {
+            Serial.println("[NET] Attach deadline reached, giving up this wake");
             return false;
         }
-        modemState.isConnected = true;
-        return true;
-    }
-
-    Serial.println("[MODEM] Waiting for network registration...");
-    bool registered = false;
-    for (int i = 0; i < 60; i++) {
-        response = sendATCommand("AT+CEREG?", 2000);
+        String response = sendATCommand("AT+CEREG?", 2000);
         if (i < 5 || i % 10 == 0) {
             Serial.printf("[NET #%d] CEREG: '%s'\n", i, response.c_str());
         }
         if (response.indexOf(",1") >= 0 || response.indexOf(",5") >= 0) {
-            registered = true;
-            break;
+            return true;
         }
         if (response.indexOf(",3") >= 0) {
             Serial.println("[NET] Registration DENIED!");
-            break;
+            return false;
         }
         // CPSI でも確認
         String cpsi = sendATCommand("AT+CPSI?", 2000);
-        if (cpsi.indexOf("LTE CAT-M1,Online") >= 0 || cpsi.indexOf("NB-IOT,Online") >= 0) {
+        if (cpsiOnline(cpsi)) {
             Serial.printf("[NET] CPSI registered: %s\n", cpsi.c_str());
-            registered = true;
-            break;
+            return true;
+        }
+        // 登録状態の変化は +CEREG URC で届くので、待ち中に来たら即次のループで確認
+        at.service(1000);
+        if (urcState.cereg == 1 || urcState.cereg == 5) {
+            Serial.printf("[NET] CEREG URC registered (stat=%d)\n", urcState.cereg);
+            return true;
+        }
+    }
+    return false;
+}
+
+// SIM情報（IMSI/ICCID）をRTCキャッシュから、無ければモデムに問い合わせて埋める
+static void loadSimIdentity() {
+    if (rtcImsi[0] && rtcIccid[0]) {
+        Serial.printf("[MODEM] IMSI: %s ICCID: %s (cached)\n", rtcImsi, rtcIccid);
+        return;
+    }
+    String imsi = sendATCommand("AT+CIMI", 3000);
+    String iccid = sendATCommand("AT+CCID", 3000);
+    Serial.printf("[MODEM] IMSI: %s\n", imsi.c_str());
+    Serial.printf("[MODEM] ICCID: %s\n", iccid.c_str());
+    // 応答の最初の空でない行（後ろに結果行 "OK" が続く）が数字だけならキャッシュ（ERROR等は次回再取得）。
+    // ICCID は19桁の時に末尾を 'F' で埋める SIM があるので、末尾1文字だけ許す
+    auto cacheId = [](const String& resp, char* out, size_t cap, size_t minLen, bool trailingF) {
+        const char* p = resp.c_str();
+        while (*p == '\r' || *p == '\n') p++;
+        size_t n = strcspn(p, "\r\n");
+        if (n < minLen || n >= cap) return;
+        for (size_t i = 0; i < n; i++) {
+            bool ok = isdigit((unsigned char)p[i]) || (trailingF && i == n - 1 && (p[i] == 'F' || p[i] == 'f'));
+            if (!ok) return;
         }
-        delay(1000);
+        memcpy(out, p, n);
+        out[n] = '\0';
+    };
+    cacheId(imsi, rtcImsi, sizeof(rtcImsi), 6, false);
+    cacheId(iccid, rtcIccid, sizeof(rtcIccid), 10, true);
+}
+
+static void logAttachTiming(const AttachTiming& t) {
+    Serial.printf("[ATTACH] %s(scan:%s): power=%lu sim=%lu check=%lu provision=%lu reg=%lu pdp=%lu total=%lums\n",
+                  t.fast ? "fast" : "full", kBandScopeName[t.bandScope],
+                  (unsigned long)t.powerOn, (unsigned long)t.sim, (unsigned long)t.check,
+                  (unsigned long)t.provision, (unsigned long)t.registration,
+                  (unsigned long)t.pdp, (unsigned long)t.total);
+}
+
+bool initModem() {
+    AttachTiming t = {};
+    t.bandScope = BAND_SCOPE_NONE;
+    servingRat = RAT_UNKNOWN;
+    ratMode = RAT_ADAPTIVE_ENABLE
+        ? ratNextMode(ratStats, RAT_REEVAL_ATTACHES, RAT_MAX_FAILURES, RAT_BOTH_MARGIN) : RAT_CMNB_CATM;
+    if (RAT_ADAPTIVE_ENABLE) {
+        Serial.printf("[RAT] CMNB=%u (Cat-M1 %.2f uJ/B x%u, NB-IoT %.2f uJ/B x%u)\n", ratMode,
+                      ratStats.ujPerByte[RAT_CATM], ratStats.samples[RAT_CATM],
+                      ratStats.ujPerByte[RAT_NBIOT], ratStats.samples[RAT_NBIOT]);
+    }
+    unsigned long t0 = millis();
+    unsigned long mark = t0;
+    auto lap = [&mark]() -> uint32_t {
+        unsigned long now = millis();
+        uint32_t d = now - mark;
+        mark = now;
+        return d;
+    };
+
+    at.poll();   // 起動時の残りバイト(RDY等)を処理
+
+    if (!powerOnModem()) {
+        return false;
     }
+    Serial.println("[MODEM] AT OK");
 
-    if (!registered) {
+    sendATCommand("ATE0", 1000);
+    sendATCommand("AT+CMEE=2", 1000);  // 詳細エラーコード有効化
+    sendATCommand("AT+CLTS=1", 1000);  // NITZでモデム時計を更新（*PSUTTZ URC。時計合わせに使う）
+    t.powerOn = lap();
+
+    String response = sendATCommand("AT+CPIN?", 5000);
+    if (response.indexOf("READY") < 0) {
+        Serial.println("[MODEM] SIM not ready");
         return false;
     }
-    Serial.println("[MODEM] Network registered");
+    Serial.println("[MODEM] SIM ready");
+
+    // HTTPモジュール不調フラグ: CFUN=1,1 でモデムをソフトリセット
+    bool didReset = false;
+    if (modemNeedsReset) {
+        Serial.println("[MODEM] HTTPモジュール再初期化のためCFUN=1,1ソフトリセット...");
+        sendATCommand("AT+CFUN=1,1", 5000);
+        at.service(20000);  // モデム再起動待ち
+        // リセット後は通常フローで再登録
+        modemNeedsReset = false;
+        didReset = true;
+        Serial.println("[MODEM] CFUN=1,1 done, re-initializing...");
+        // CPINが準備できるまで待つ
+        for (int i = 0; i < 15; i++) {
+            String cpin = sendATCommand("AT+CPIN?", 3000);
+            if (cpin.indexOf("READY") >= 0) break;
+            at.service(2000);
+        }
+    }
+
+    // SIM情報（SIMが替わらない限り不変なのでRTCにキャッシュ）
+    loadSimIdentity();
+    t.sim = lap();
+
+    // 高速アタッチ: モデムはディープスリープ中も通電したまま(DC3保持)なので、
+    // APN/RAT設定と登録が残っていれば CFUN=0/1 の無線リセット(〜数十秒)を省く。
+    // 【2026-07】CFUN=1,1 直後の高速化は CNACT タイムアウトの原因だったため、
+    // ソフトリセットした起床は従来通りフル初期化を通す。
+    // PDP活性化(connectNetwork: CNCFG→CNACT)は高速パスでも毎回フルで行う。
+    if (MODEM_FAST_ATTACH && !didReset) {
+        String cpsi = sendATCommand("AT+CPSI?", 3000);
+        Serial.printf("[MODEM] Early CPSI: %s\n", cpsi.c_str());
+        bool provisioned = modemProvisioned();
+        bool online = provisioned && cpsiOnline(cpsi);
+        t.check = lap();
+
+        if (provisioned && !online) {
+            // 設定は一致・未在圏: 無線はオンのまま短時間だけ登録を待つ
+            urcState.cereg = -1;
+            sendATCommand("AT+CEREG=1", 2000);
+            online = waitRegistration(FAST_ATTACH_REG_TRIES);
+            t.registration = lap();
+        }
+
+        if (online) {
+            Serial.println("[MODEM] Fast attach: provisioned & registered");
+            t.fast = true;
+            String serving = sendATCommand("AT+CPSI?", 3000);
+            servingRat = cpsiRat(serving);
+            if (BAND_CACHE_ENABLE) learnServingCell(serving);
+            modemState.signalStrength = getSignalStrength();
+            if (connectNetwork()) {
+                t.pdp = lap();
+                t.total = millis() - t0;
+                lastAttach = t;
+                logAttachTiming(t);
+                modemState.isConnected = true;
+                return true;
+            }
+            Serial.println("[MODEM] Fast attach PDP failed, falling back to full init");
+            t.fast = false;
+            t.pdp = lap();
+        } else {
+            Serial.println("[MODEM] Fast attach not possible, full init");
+        }
+    }
+
+    // 学習済みバンドがあればそこに絞って探索（全バンド走査が最も長く不安定な工程）
+    uint8_t scope = (BAND_CACHE_ENABLE && bandCache.band) ? BAND_SCOPE_CACHED : BAND_SCOPE_ALL;
+    provisionModem(scope);
+    t.provision = lap();
+
+    // 接続前の診断情報
+    String csq = sendATCommand("AT+CSQ", 2000);
+    Serial.printf("[MODEM] Signal: %s\n", csq.c_str());
+    String cpsiNow = sendATCommand("AT+CPSI?", 3000);
+    Serial.printf("[MODEM] Network state: %s\n", cpsiNow.c_str());
+
+    // 既に登録済みか確認
+    bool registered = cpsiOnline(cpsiNow);
+    if (registered) {
+        Serial.println("[MODEM] Registered on Cat-M1/NB-IoT!");
+    } else {
+        Serial.println("[MODEM] Waiting for network registration...");
+        registered = waitRegistration(scope == BAND_SCOPE_ALL ? 60 : BAND_SCAN_TRIES);
+        // 見つからなければ探索範囲を段階的に広げる
+        while (!registered && scope < BAND_SCOPE_ALL) {
+            scope++;
+            Serial.printf("[BAND] Not found, widening scan to %s\n", kBandScopeName[scope]);
+            widenBandScope(scope);
+            registered = waitRegistration(scope == BAND_SCOPE_ALL ? 60 : BAND_SCAN_TRIES);
+        }
+        if (!registered) {
+            if (RAT_ADAPTIVE_ENABLE) ratRecordFailure(ratStats, ratMode);
+            t.registration += lap();
+            t.total = millis() - t0;
+            lastAttach = t;
+            logAttachTiming(t);
+            return false;
+        }
+        Serial.println("[MODEM] Network registered");
+    }
+    t.registration += lap();
+    t.bandScope = scope;
+    String serving = cpsiOnline(cpsiNow) ? cpsiNow : sendATCommand("AT+CPSI?", 3000);
+    servingRat = cpsiRat(serving);
+    if (BAND_CACHE_ENABLE) learnServingCell(serving);
 
     modemState.signalStrength = getSignalStrength();
 
-    if (!connectNetwork()) {
+    bool connected = connectNetwork();
+    t.pdp += lap();
+    t.total = millis() - t0;
+    lastAttach = t;
+    logAttachTiming(t);
+    if (!connected) {
         return false;
     }
 
@@ -1760,7 +2666,7 @@ bool connectNetwork() {
 
     // CNACT=0 でコンテキスト0を使用 (CGDCONT=1がpdpidx=0に対応)
     sendATCommand("AT+CNACT=0,0", 5000);
-    delay(1000);
+    at.service(1000);
 
     // PDP Context有効化要求
     String response = sendATCommand("AT+CNACT=0,1", 5000);
@@ -1772,8 +2678,8 @@ bool connectNetwork() {
     // 接続確立まで最大30秒ポーリング
     Serial.println("[MODEM] Waiting for PDP context activation...");
     unsigned long waitStart = millis();
-    while (millis() - waitStart < 30000) {
-        delay(3000);
+    while (millis() - waitStart < 30000 && !at.cancelled()) {
+        at.service(3000);
         response = sendATCommand("AT+CNACT?", 5000);
         if (response.indexOf("+CNACT: 0,1") >= 0) {
             int start = response.indexOf("\"") + 1;
@@ -1792,11 +2698,9 @@ bool connectNetwork() {
                     // モデムがPSMスリープに入りUART無応答(CASTATE/CAOPENが空)になって
                     // 送信不達だった。PSMは省電力目的だが、サイクル内で送信を終える前に
                     // 寝られると困るため無効化する(deep-sleep自体はESP32側で行う)。
-                    // 【将来の省電力再設計】PSMを使うなら「全送信完了後・ESP deep-sleep
-                    //   直前」にのみ CPSMS=1 を投入し、かつ次回起床時にモデムをPSMから
-                    //   確実に復帰させる処理(DTRトグル/PWRKEYで叩き起こす+応答待ち)を
-                    //   modem初期化前に追加すること。これが無いと起床時に無応答で送信不達に
-                    //   戻る。実機での起床→復帰検証が必須のため本コミットでは無効のまま。
+                    // PSMは「全送信完了後・ESP deep-sleep直前」にのみ armModemPsm() で
+                    //   CPSMS=1 を投入し、次回起床時は resumeModem() がPWRKEYで叩き起こす
+                    //   (MODEM_PSM_ENABLE。実機での起床→復帰検証が済むまで既定は無効)。
                     String psmResp = sendATCommand("AT+CPSMS=0", 3000);
                     Serial.printf("[MODEM] PSM disabled: '%s'\n", psmResp.c_str());
                     return true;
@@ -1810,253 +2714,752 @@ bool connectNetwork() {
     return false;
 }
 
-bool syncNTP() {
-    sendATCommand("AT+CNTP=\"pool.ntp.org\",36", 3000);
-    sendATCommand("AT+CNTP", 30000);
-    delay(3000);
-
-    String response = sendATCommand("AT+CCLK?", 3000);
-    if (response.indexOf("+CCLK:") >= 0) {
-        int start = response.indexOf("\"") + 1;
-        int end = response.indexOf("\"", start);
-        if (start > 0 && end > start) {
-            String timeStr = response.substring(start, end);
-            int year = 2000 + timeStr.substring(0, 2).toInt();
-            int month = timeStr.substring(3, 5).toInt();
-            int day = timeStr.substring(6, 8).toInt();
-            int hour = timeStr.substring(9, 11).toInt();
-            int minute = timeStr.substring(12, 14).toInt();
-            int second = timeStr.substring(15, 17).toInt();
-
-            struct tm timeinfo;
-            timeinfo.tm_year = year - 1900;
-            timeinfo.tm_mon = month - 1;
-            timeinfo.tm_mday = day;
-            timeinfo.tm_hour = hour;
-            timeinfo.tm_min = minute;
-            timeinfo.tm_sec = second;
-            timeinfo.tm_isdst = 0;
-
-            time_t t = mktime(&timeinfo);
-            struct timeval tv = { .tv_sec = t, .tv_usec = 0 };
-            settimeofday(&tv, NULL);
-            return true;
+/**
+ * PSM復帰: 前回スリープ前にPSMへ入れたモデムを起こし、登録とPDPが残っていれば
+ * powerOnModem()/initModem() の再アタッチを省いてそのまま使う。
+ * 戻り値: false=復帰不可（呼び出し側でフル初期化）
+ */
+bool resumeModem() {
+    Serial.println("[PSM] Resuming modem from PSM...");
+    at.poll();
+
+    // PSM中はUART無応答。T3324経過前なら起きているのでまずATを試す
+    bool awake = false;
+    for (int i = 0; i < 2 && !awake; i++) awake = at.exec("AT", 1000) == AT_OK;
+    if (!awake) {
+        // PWRKEYパルスでPSMから起床（電源断状態なら起動するが、その場合は未登録でフル初期化へ）
+        if (!pulseModemPwrkey()) return false;
+        for (int i = 0; i < 10 && !awake; i++) {
+            at.service(300);
+            awake = at.exec("AT", 1000) == AT_OK;
         }
     }
-    return false;
+    if (!awake) {
+        Serial.println("[PSM] No AT response after wake");
+        return false;
+    }
+    sendATCommand("ATE0", 1000);
+
+    // 起床中はPSMに戻らないよう無効化（送信途中でUART無応答になる既知不具合の回避）
+    sendATCommand("AT+CPSMS=0", 3000);
+
+    urcState.cereg = -1;
+    String cereg = sendATCommand("AT+CEREG?", 2000);
+    if (cereg.indexOf(",1") < 0 && cereg.indexOf(",5") < 0) {
+        Serial.printf("[PSM] Not registered after wake: '%s'\n", cereg.c_str());
+        return false;
+    }
+    sendATCommand("AT+CEREG=1", 2000);
+    servingRat = cpsiRat(sendATCommand("AT+CPSI?", 3000));
+
+    // PDN接続はPSM中も保持される。CNACT が落ちていればPDP活性化だけやり直す
+    String cnact = sendATCommand("AT+CNACT?", 3000);
+    int q = cnact.indexOf("+CNACT: 0,1,\"");
+    if (q >= 0) {
+        int start = q + 13;
+        int end = cnact.indexOf("\"", start);
+        modemState.ipAddress = (end > start) ? cnact.substring(start, end) : "";
+    }
+    if (q < 0 || modemState.ipAddress.length() == 0 || modemState.ipAddress == "0.0.0.0") {
+        Serial.println("[PSM] PDP context lost, re-activating");
+        if (!connectNetwork()) return false;
+    }
+    Serial.println("[PSM] Resumed: IP " + modemState.ipAddress);
+
+    modemState.signalStrength = getSignalStrength();
+    modemState.isConnected = true;
+    return true;
 }
 
 /**
- * 生TCP (AT+CAOPEN) でHTTPリクエストを送信
+ * PSM有効化（全送信完了後・ディープスリープ直前に呼ぶ）。
+ * T3412 を LTE起床間隔の2倍、T3324 を PSM_ACTIVE_TIME_SEC で要求し、付与値を確認する。
+ * 戻り値: true=次回起床でPSM復帰を試せる（T3412 が次のLTE起床まで持つ）
  */
-bool sendRawHTTPTCP(const String& method, const String& path,
-                    const String& host, const String& body) {
-    // TCP接続 (HTTP port 80)
-    // 直前のkeep-alive接続やモデム割当clientID漏れで client slot が埋まると
-    // CAOPENが空応答(モデム無応答)になるため、全スロットをクローズしてバッファを
-    // 排出し、状態を確認してから開く。CAOPENは数回リトライ。
-    // (2026-07: バッチ送信でCAOPENが空応答になり送信不達だった不具合の修正)
-    String cst = sendATCommand("AT+CASTATE?", 2000);
-    Serial.printf("[TCP] CASTATE before: '%s'\n", cst.c_str());
-    for (int cid = 0; cid <= 2; cid++) {
-        sendATCommand("AT+CACLOSE=" + String(cid), 1500);
+bool armModemPsm() {
+    char tau[9], active[9];
+    psmEncodeT3412(PSM_TAU_SEC, tau);
+    psmEncodeT3324(PSM_ACTIVE_TIME_SEC, active);
+    String resp = sendATCommand(String("AT+CPSMS=1,,,\"") + tau + "\",\"" + active + "\"", 3000);
+    if (resp.indexOf("OK") < 0) {
+        Serial.printf("[PSM] CPSMS=1 failed: '%s'\n", resp.c_str());
+        return false;
     }
-    while (modemSerial.available()) modemSerial.read();  // 残バッファ排出
-    delay(1500);
-    String r;
-    bool opened = false;
-    for (int attempt = 0; attempt < 3; attempt++) {
-        r = sendATCommand("AT+CAOPEN=0,0,\"TCP\",\"" + host + "\",80", 20000);
-        Serial.printf("[TCP] CAOPEN try%d: '%s'\n", attempt, r.c_str());
-        if (r.indexOf("+CAOPEN: 0,0") >= 0) { opened = true; break; }
-        sendATCommand("AT+CACLOSE=0", 2000);
-        delay(2000);
+
+    // 付与値は +CEREG: 4,<stat>,<tac>,<ci>,<AcT>,<cause>,<reject>,"<T3324>","<T3412>"
+    sendATCommand("AT+CEREG=4", 2000);
+    String cereg = sendATCommand("AT+CEREG?", 2000);
+    sendATCommand("AT+CEREG=1", 2000);
+    const char* fields[9] = {};
+    int nf = 0;
+    const char* p = strstr(cereg.c_str(), "+CEREG: ");
+    if (p) {
+        p += 8;
+        fields[nf++] = p;
+        while (nf < 9 && (p = strchr(p, ',')) != nullptr) fields[nf++] = ++p;
     }
-    if (!opened) {
+    uint32_t grantedActive = (nf > 7 && fields[7][0] == '"') ? psmDecodeT3324(fields[7] + 1) : 0;
+    uint32_t grantedTau = (nf > 8 && fields[8][0] == '"') ? psmDecodeT3412(fields[8] + 1) : 0;
+    Serial.printf("[PSM] Requested T3412=%s T3324=%s, granted TAU=%lus active=%lus\n",
+                  tau, active, (unsigned long)grantedTau, (unsigned long)grantedActive);
+
+    // 付与なし/PSM停止/次のLTE起床より短いTAUなら、次回はフル初期化
+    uint32_t uploadIntervalSec = (uint32_t)energyPlanNow.roundsPerUpload * MEASUREMENT_INTERVAL_MIN * 60;
+    if (grantedTau == 0 || grantedTau == PSM_TIMER_DEACTIVATED || grantedTau < uploadIntervalSec ||
+        grantedActive == PSM_TIMER_DEACTIVATED) {
+        Serial.println("[PSM] Network did not grant usable PSM timers");
         return false;
     }
-    // +CAOPEN: <clientID>,0 からclientIDを取得 (モデムが割り当て)
-    int clientID = 0;
-    int idx = r.indexOf("+CAOPEN: ");
-    if (idx >= 0) {
-        int numStart = idx + 9;
-        int comma = r.indexOf(",", numStart);
-        if (comma > numStart) clientID = r.substring(numStart, comma).toInt();
-    }
-    Serial.printf("[TCP] Assigned clientID: %d\n", clientID);
-    delay(200);
-
-    // HTTPリクエスト構築 (HTTP/1.1 + keep-alive)
+    return true;
+}
+
+/**
+ * 本起床の接続コスト（アタッチ/復帰＋HTTP送受信の時間×RAT別平均電流）を
+ * 在圏RATの µJ/byte として記録する
+ */
+void recordRatSample() {
+    if (servingRat == RAT_UNKNOWN || wakeHttpBytes == 0) return;
+    float mA = (servingRat == RAT_NBIOT) ? RAT_NBIOT_ACTIVE_MA : RAT_CATM_ACTIVE_MA;
+    float uj = ratEnergyUj(linkStats.prepMs + wakeHttpMs, mA, RAT_SUPPLY_V);
+    ratRecord(ratStats, servingRat, uj, wakeHttpBytes);
+    Serial.printf("[RAT] %s: %lums, %lu bytes -> %.2f uJ/B (avg %.2f, n=%u)\n",
+                  servingRat == RAT_NBIOT ? "NB-IoT" : "Cat-M1",
+                  (unsigned long)(linkStats.prepMs + wakeHttpMs), (unsigned long)wakeHttpBytes,
+                  uj / wakeHttpBytes, ratStats.ujPerByte[servingRat], ratStats.samples[servingRat]);
+}
+
+static bool atHasCntpResult(const char* resp, void*) { return strstr(resp, "+CNTP:") != nullptr; }
+
+/**
+ * CNTP で時計を合わせる（NITZ/Date が使えない時の後備え）。モデム時計も合うので以後は CCLK で読める
+ */
+bool syncNTP() {
+    sendATCommand("AT+CNTP=\"pool.ntp.org\",36", 3000);
+    // 同期結果 "+CNTP: <code>" は OK の後に届くので、それまで待つ（1=成功）
+    at.exec("AT+CNTP", 30000, atHasCntpResult);
+    if (!strstr(at.response(), "+CNTP: 1")) {
+        Serial.printf("[NTP] CNTP failed: '%s'\n", at.response());
+        return false;
+    }
+    time_t t;
+    if (!readModemClock(t)) return false;
+    applyTime(t, 500, TS_NTP, TIME_CCLK_ERR_MS);
+    modemClock = { TS_NTP, 0, t };
+    return true;
+}
+
+static uint8_t casendBuf[MODEM_CASEND_MAX];
+
+/**
+ * チャンクバッファの内容を1回のCASENDで送る。
+ * ">" プロンプト→生データ→OK を待つ（送信中に届いた +CADATAIND はURC側で記録される）
+ */
+static bool casendFlush(CasendStream& s) {
+    char cmd[32];
+    snprintf(cmd, sizeof(cmd), "AT+CASEND=%d,%u", s.clientID, (unsigned)s.fill);
+    if (at.exec(cmd, 5000) != AT_PROMPT) {
+        Serial.printf("[TCP] CASEND prompt missing at %u: '%s'\n", (unsigned)s.sent, at.response());
+        return false;
+    }
+    at.write(casendBuf, s.fill);
+    s.sent += s.fill;
+    s.fill = 0;
+    if (at.waitResult(5000) != AT_OK) {
+        Serial.printf("[TCP] CASEND chunk failed at %u: '%s'\n", (unsigned)s.sent, at.response());
+        return false;
+    }
+    return true;
+}
+
+/**
+ * CASENDストリームへ書込（PayloadSink）。
+ * 1回のCASENDの上限(MODEM_CASEND_MAX)毎に分割し、次のデータが来た時点で満杯チャンクを送る
+ * （最後のチャンクは casendFinish で送る）。
+ */
+void casendWrite(const char* p, size_t n, void* ctx) {
+    CasendStream& s = *(CasendStream*)ctx;
+    while (n > 0 && s.ok) {
+        if (s.fill == MODEM_CASEND_MAX) s.ok = casendFlush(s);
+        size_t c = MODEM_CASEND_MAX - s.fill;
+        if (c > n) c = n;
+        memcpy(casendBuf + s.fill, p, c);
+        s.fill += c; p += c; n -= c;
+    }
+}
+
+/**
+ * 残りのチャンクを送ってストリームを閉じる
+ */
+bool casendFinish(CasendStream& s) {
+    if (s.ok && s.fill > 0) s.ok = casendFlush(s);
+    return s.ok;
+}
+
+// ===== HTTPセッション管理（1回のLTE起床で1本のkeep-alive接続を使い回す） =====
+// config取得・バッチ送信・ACコマンド取得/ACK・ペアリング結果報告は全て同じサーバ宛てなので、
+// リクエスト毎に「全スロットクローズ→CAOPEN→CASEND→CARECV→CACLOSE」を繰り返さず、
+// 起床中は1本のTCP接続(HTTP/1.1 keep-alive)で順に処理する。
+// サーバ側がアイドル切断した場合のみ、次のリクエスト前に検知して透過的に再接続する。
+
+/**
+ * セッション(cid 0)をTLSにする設定（起床毎に1回。CAOPENで証明書検証付きハンドシェイク）。
+ * SIM7080G はTLSセッションの再開(チケット/ID)をATで扱えないため、1起床1ハンドシェイクに抑える
+ */
+static bool configureTls() {
+    if (caCertOnModem != caCertHash() && !uploadCACert()) {
+        Serial.println("[TLS] CA cert not on modem, not connecting");
+        return false;
+    }
+    sendATCommand("AT+CSSLCFG=\"sslversion\",0,3", 2000);                 // TLS 1.2
+    sendATCommand("AT+CSSLCFG=\"sni\",0,\"" SERVER_HOST "\"", 2000);
+    sendATCommand("AT+CASSLCFG=0,\"SSL\",1", 2000);
+    sendATCommand("AT+CASSLCFG=0,\"CACERT\",\"ca.pem\"", 2000);
+    sendATCommand("AT+CASSLCFG=0,\"CRINDEX\",0", 2000);                   // SSLコンテキスト0を使う
+    httpSession.tlsReady = true;
+    return true;
+}
+
+/**
+ * 起床中のHTTPセッションを開く（既に開いていれば何もしない）
+ * 全スロットクローズ+バッファ排出は起床後の初回接続時のみ行う。
+ */
+bool httpSessionOpen() {
+    if (httpSession.open) return true;
+
+    // 直前のkeep-alive接続やモデム割当clientID漏れで client slot が埋まると
+    // CAOPENが空応答(モデム無応答)になるため、全スロットをクローズしてバッファを
+    // 排出し、状態を確認してから開く。CAOPENは数回リトライ。
+    // (2026-07: バッチ送信でCAOPENが空応答になり送信不達だった不具合の修正)
+    if (!httpSession.slotsCleared) {
+        String cst = sendATCommand("AT+CASTATE?", 2000);
+        Serial.printf("[TCP] CASTATE before: '%s'\n", cst.c_str());
+        for (int cid = 0; cid <= 2; cid++) {
+            sendATCommand("AT+CACLOSE=" + String(cid), 1500);
+        }
+        at.service(1500);   // 残バッファはURC/不要行として処理される
+        httpSession.slotsCleared = true;
+    }
+
+    // TLS: 証明書検証付きで張る（CA未配置なら平文へは落とさず、データはRTCに残して次回）
+    if (SERVER_TLS_ENABLE && !httpSession.tlsReady && !configureTls()) return false;
+
+    String r;
+    bool opened = false;
+    unsigned long openStart = millis();
+    for (int attempt = 0; attempt < 3; attempt++) {
+        r = sendATCommand("AT+CAOPEN=0,0,\"TCP\",\"" + String(SERVER_HOST) + "\"," +
+                          String(SERVER_TLS_ENABLE ? SERVER_PORT : SERVER_HTTP_PORT), 20000);
+        Serial.printf("[TCP] CAOPEN try%d: '%s'\n", attempt, r.c_str());
+        if (r.indexOf("+CAOPEN: 0,0") >= 0) { opened = true; break; }
+        sendATCommand("AT+CACLOSE=0", 2000);
+        at.service(2000);
+    }
+    if (!opened) return false;
+
+    // +CAOPEN: <clientID>,0 からclientIDを取得 (モデムが割り当て。接続中は再取得しない)
+    httpSession.clientID = 0;
+    int idx = r.indexOf("+CAOPEN: ");
+    if (idx >= 0) {
+        int numStart = idx + 9;
+        int comma = r.indexOf(",", numStart);
+        if (comma > numStart) httpSession.clientID = r.substring(numStart, comma).toInt();
+    }
+    httpSession.open = true;
+    urcState.closed &= ~(1u << httpSession.clientID);
+    urcState.dataReady &= ~(1u << httpSession.clientID);
+    // 接続確立の所要（TLSはハンドシェイク込み。平文の起床と比べて暗号化のコストを見る）
+    uint32_t openMs = millis() - openStart;
+    wakeOpens++;
+    wakeOpenMs += openMs;
+    Serial.printf("[TCP] Session open (clientID: %d, %s %lums)\n", httpSession.clientID,
+                  SERVER_TLS_ENABLE ? "TLS handshake" : "TCP connect", (unsigned long)openMs);
+    at.service(200);
+    return true;
+}
+
+/**
+ * HTTPセッションを閉じる（起床の終わり、またはOTA前に呼ぶ）
+ */
+void httpSessionClose() {
+    if (!httpSession.open) return;
+    sendATCommand("AT+CACLOSE=" + String(httpSession.clientID), 3000);
+    httpSession.open = false;
+    Serial.printf("[TCP] Session closed (%d req, %d reconnect)\n",
+                  httpSession.requests, httpSession.reconnects);
+}
+
+/**
+ * セッションのTCP接続がまだ生きているか（サーバのアイドル切断検知用）
+ * +CASTATE: <clientID>,1 = 接続中
+ */
+bool httpSessionAlive() {
+    at.poll();
+    if (urcState.closed & (1u << httpSession.clientID)) return false;   // +CASTATE URC で切断済み
+    String r = sendATCommand("AT+CASTATE?", 2000);
+    return r.indexOf("+CASTATE: " + String(httpSession.clientID) + ",1") >= 0;
+}
+
+/**
+ * CARECVでHTTP応答1件分を受信して resp に流し込み、ステータスコードを返す（0=応答無し）
+ * 受信チャンク毎にパーサへ投入し、ボディ(Content-Length/chunked)が揃った時点で受信を打ち切る。
+ * serverClose: 応答に Connection: close が付いていた／受信中に切断された
+ */
+int httpReadResponse(int clientID, HttpResponseParser& resp, bool& serverClose) {
+    serverClose = false;
+    resp.reset();
+
+    // +CADATAIND を待つ（+CASTATE は受信前の切断）
+    uint16_t bit = 1u << clientID;
+    {
+        unsigned long t = millis();
+        while (!(urcState.dataReady & bit) && !(urcState.closed & bit) && millis() - t < 12000) at.service(20);
+        if (!(urcState.dataReady & bit) && (urcState.closed & bit)) serverClose = true;
+        if ((urcState.dataReady & bit) && !ttfbMeasured && ttfbStartMs != 0) {
+            linkStats.ttfbMs = millis() - ttfbStartMs;
+            ttfbMeasured = true;
+            Serial.printf("[LINK] TTFB %lums\n", (unsigned long)linkStats.ttfbMs);
+        }
+        urcState.dataReady &= ~bit;
+    }
+    uint32_t firstDataMs = millis();
+
+    static uint8_t buf[1460];
+    size_t got = 0;
+    unsigned long t = millis();
+    while (!resp.done() && !resp.failed() && millis() - t < 15000) {
+        int n = carecvRaw(buf, sizeof(buf), 3000, clientID);
+        if (n < 0) break;                                   // ERROR(切断済み等)
+        if (n == 0) {
+            // 長さ不明(Content-Length無し・非chunked): 受信が途切れたら完了扱い
+            if (resp.headersDone() && resp.contentLength() < 0 && !resp.chunked()) break;
+            at.service(200);
+            continue;
+        }
+        got += n;
+        wakeHttpBytes += n;
+        resp.feed(buf, n);
+    }
+    resp.finish();
+
+    if (resp.status() == 0) {
+        Serial.printf("[TCP] No HTTP response (%u bytes)\n", (unsigned)got);
+        if (got == 0) serverClose = serverClose || !httpSessionAlive();
+        return 0;
+    }
+    // Date ヘッダは時計合わせ/照合に使う（秒切捨てなので秒未満は中央とみなす）
+    time_t dt;
+    if (resp.date()[0] && parseHttpDate(resp.date(), dt)) httpDate = { true, dt, 500, firstDataMs };
+    if (resp.connectionClose()) serverClose = true;
+    if (!resp.done()) {
+        // 途中で途切れた応答の残りが次のリクエストに混ざらないよう接続を捨てる
+        Serial.printf("[TCP] Incomplete response (%u body bytes)\n", (unsigned)resp.bodyBytes());
+        serverClose = true;
+    }
+    return resp.status();
+}
+
+/**
+ * セッション上でHTTPリクエストを1件処理し、ステータスコードを返す（0=通信失敗）
+ * ボディはヘッダに続けてCASENDチャンクへ直接書き出す（Content-Length は body.length）。
+ * extraHeaders: 追加のリクエストヘッダ（"Name: value\r\n" の連結。nullptr=なし）
+ * 応答は resp のコールバックへ逐次渡す。サーバ側で切断済みなら再接続して1回だけ再送する。
+ */
+int httpRequest(const String& method, const String& path, const HttpBody& body, HttpResponseParser& resp,
+                const char* extraHeaders) {
+    // HTTPリクエストヘッダ構築 (HTTP/1.1 + keep-alive)
     // HTTP/1.0+Connection:close はサーバーが応答後即FINを送り、
     // +CADATAINDと+CASTATEが同時到着してCARECVが間に合わない問題を回避
-    String httpReq = method + " " + path + " HTTP/1.1\r\n";
-    httpReq += "Host: " + host + "\r\n";
-    httpReq += "Connection: keep-alive\r\n";
-    if (body.length() > 0) {
-        httpReq += "Content-Type: application/json\r\n";
-        httpReq += "Content-Length: " + String(body.length()) + "\r\n";
-    }
-    httpReq += "\r\n";
-    httpReq += body;
-
-    Serial.printf("[TCP] Sending HTTP %s, %d bytes\n", method.c_str(), httpReq.length());
-
-    // CASEND: データ送信 (">" プロンプト後にデータ送信)
-    r = sendATCommand("AT+CASEND=" + String(clientID) + "," + String(httpReq.length()), 5000);
-    Serial.printf("[TCP] CASEND prompt: '%s'\n", r.c_str());
-    modemSerial.print(httpReq);
-
-    // +CADATAIND 受信後すぐにCARECVを呼ぶ (接続がcloseされる前に)
-    // sendATCommandはbufferをクリアするのでここでは使わず直接読み書きする
-    String sBuf = "";
-    String httpResp = "";
-    unsigned long t = millis();
-    while (millis() - t < 12000) {
-        while (modemSerial.available()) sBuf += (char)modemSerial.read();
-
-        if (sBuf.indexOf("+CADATAIND:") >= 0) {
-            // AT+CARECV=<clientID>,<datalen> datalen上限=1460
-            modemSerial.print("AT+CARECV=" + String(clientID) + ",1460\r\n");
-            unsigned long rt = millis();
-            while (millis() - rt < 5000) {
-                while (modemSerial.available()) httpResp += (char)modemSerial.read();
-                if (httpResp.indexOf("ERROR") >= 0 || (httpResp.length() > 6 && httpResp.endsWith("\r\nOK\r\n"))) break;
-                delay(10);
+    char head[384];
+    PayloadWriter hw(head, sizeof(head));
+    hw.str(method.c_str()).raw(" ", 1).str(path.c_str()).str(" HTTP/1.1\r\n");
+    hw.str("Host: " SERVER_HOST "\r\n");
+    hw.str("Connection: keep-alive\r\n");
+    if (extraHeaders) hw.str(extraHeaders);   // "Name: value\r\n" 形式
+    if (body.length > 0) {
+        hw.str("Content-Type: ").str(body.contentType).str("\r\n");
+        hw.str("Content-Length: ").num((long)body.length).str("\r\n");
+    }
+    hw.str("\r\n");
+    if (!hw.ok()) {
+        Serial.printf("[TCP] Request header too long: %s\n", path.c_str());
+        return 0;
+    }
+
+    unsigned long reqStart = millis();
+    if (!ttfbMeasured && ttfbStartMs == 0) ttfbStartMs = reqStart;   // 本起床の最初の要求（CAOPEN含む）
+
+    for (int attempt = 0; attempt < 2; attempt++) {
+        // アイドル中にサーバが切断していたら再接続
+        if (httpSession.open && !httpSessionAlive()) {
+            Serial.println("[TCP] Server closed idle session, reconnecting");
+            sendATCommand("AT+CACLOSE=" + String(httpSession.clientID), 2000);
+            httpSession.open = false;
+            httpSession.reconnects++;
+        }
+        if (!httpSessionOpen()) { wakeHttpMs += millis() - reqStart; return 0; }
+
+        Serial.printf("[TCP] %s %s (%u bytes)\n", method.c_str(), path.c_str(), (unsigned)(hw.length() + body.length));
+        // CASEND: データ送信 (">" プロンプト後にデータ送信。上限超えは分割)
+        urcState.dataReady &= ~(1u << httpSession.clientID);
+        CasendStream cs = { httpSession.clientID, 0, 0, true };
+        casendWrite(head, hw.length(), &cs);
+        if (body.write) {
+            PayloadWriter bw(casendWrite, &cs);
+            body.write(bw, body.ctx);
+            if (bw.length() != body.length) {   // 1回目と出力が違うと Content-Length が壊れる
+                Serial.printf("[TCP] Body length mismatch: %u != %u\n", (unsigned)bw.length(), (unsigned)body.length);
+                cs.ok = false;
             }
-            Serial.printf("[TCP] CARECV resp: '%s'\n", httpResp.substring(0, 200).c_str());
-            break;
+        } else if (body.length > 0) {
+            casendWrite((const char*)body.bytes, body.length, &cs);
         }
-        if (sBuf.indexOf("+CASTATE:") >= 0) {
-            Serial.printf("[TCP] State changed (too late): '%s'\n", sBuf.c_str());
-            break;
+        bool sent = casendFinish(cs);
+        wakeHttpBytes += cs.sent;
+        bool serverClose = !sent;
+        int status = sent ? httpReadResponse(httpSession.clientID, resp, serverClose) : 0;
+        if (status > 0) httpSession.requests++;
+        if (serverClose) {
+            sendATCommand("AT+CACLOSE=" + String(httpSession.clientID), 2000);
+            httpSession.open = false;
         }
-        delay(50);
+        // 応答が得られたか、送信済みで切断以外の失敗(タイムアウト)なら再送しない
+        if (status > 0 || (sent && !serverClose)) { wakeHttpMs += millis() - reqStart; return status; }
+        httpSession.reconnects++;
     }
-    Serial.printf("[TCP] sBuf: '%s'\n", sBuf.substring(0, 100).c_str());
-    r = httpResp;
+    wakeHttpMs += millis() - reqStart;
+    return 0;
+}
+
+static void stringBodySink(const uint8_t* p, size_t n, void* ctx) {
+    ((String*)ctx)->concat((const char*)p, n);
+}
+
+/**
+ * 応答ボディを String に受ける版
+ */
+int httpRequest(const String& method, const String& path, const HttpBody& body, String& respBody) {
+    respBody = "";
+    HttpResponseParser resp(stringBodySink, &respBody);
+    return httpRequest(method, path, body, resp);
+}
 
-    sendATCommand("AT+CACLOSE=" + String(clientID), 3000);
+/**
+ * JSON(文字列)ボディ版
+ */
+int httpRequest(const String& method, const String& path, const String& body, String& respBody) {
+    HttpBody b = { "application/json", body.length(), (const uint8_t*)body.c_str(), nullptr, nullptr };
+    return httpRequest(method, path, body.length() > 0 ? b : HTTP_NO_BODY, respBody);
+}
 
-    bool success = r.indexOf(" 200") >= 0 || r.indexOf(" 201") >= 0 || r.indexOf(" 204") >= 0;
+/**
+ * HTTPセッション上でリクエストを送信し、2xx応答なら成功
+ */
+bool sendRawHTTPTCP(const String& method, const String& path, const String& body) {
+    HttpBody b = { "application/json", body.length(), (const uint8_t*)body.c_str(), nullptr, nullptr };
+    HttpResponseParser resp;   // 応答ボディは読み捨て
+    int status = httpRequest(method, path, b, resp);
+    Serial.printf("[TCP] HTTP %d\n", status);
+    bool success = status == 200 || status == 201 || status == 204;
     if (success) modemNeedsReset = false;
     return success;
 }
 
 /**
- * 全データ（親機+子機）をサーバーに送信
+ * バッチのエンベロープ（応答ヒントの判定材料・LTE接続計測・工程記録）を書き出す
  */
-bool sendAllDataToServer() {
-    String timestamp = getTimestamp();
+static void writeBatchEnvelopeJson(PayloadWriter& w, const BatchEnvelope& e) {
+    if (INGEST_HINTS_ENABLE) {
+        // 応答ヒントの判定材料（稼働中ファーム/保持中の設定ETag）と、前回ヒントのAC完了通知
+        w.str("\"fw\":").num((long)FIRMWARE_VERSION_CODE).str(",");
+        if (e.etag[0]) w.str("\"cfg\":\"").str(e.etag).str("\",");
+        if (e.meta.acAckId) {
+            w.str("\"ac_ack\":[{\"id\":").num(e.meta.acAckId).str(",\"at\":\"");
+            writeJstTimestamp(w, e.meta.acAckAt);
+            w.str("\"}],");
+        }
+    }
+    w.str("\"link\":{\"resumed\":").str(e.link.resumed ? "true" : "false");
+    w.str(",\"attaches\":").num(e.link.attaches);
+    w.str(",\"resumes\":").num(e.link.resumes);
+    w.str(",\"prep_ms\":").num(e.link.prepMs);
+    w.str(",\"ttfb_ms\":").num(e.link.ttfbMs);
+    w.str(",\"reg_ms\":").num(e.link.regMs);
+    w.str(",\"band\":").num(e.link.band);
+    w.str(",\"band_scope\":").num(e.link.bandScope);
+    w.str(",\"rat\":").num(e.link.rat);
+    w.str(",\"tls\":").str(e.link.tls ? "true" : "false");
+    w.str(",\"opens\":").num(e.link.opens);
+    w.str(",\"open_ms\":").num(e.link.openMs);
+    w.str(",\"up_transport\":\"").str(kUpTransportName[e.link.upTransport]).str("\"");
+    w.str(",\"up_bytes\":").num(e.link.upBytes);
+    w.str(",\"up_ms\":").num(e.link.upMs);
+    w.str(",\"up_retx\":").num(e.link.upRetx);
+    w.str(",\"rsrp\":").num(e.link.rsrp);
+    w.str(",\"rsrq\":").num(e.link.rsrq);
+    w.str(",\"verdict\":\"").str(kUploadVerdictName[e.link.verdict]).str("\"");
+    w.str(",\"defers\":").num(e.link.defers);
+    w.str(",\"defer_rsrp\":").num(e.link.deferRsrp).str("},");
+    w.str("\"energy\":{\"tier\":\"").str(kEnergyTierName[e.energy.tier]);
+    w.str("\",\"changes\":").num(e.energy.changes);
+    w.str(",\"charging\":").str(e.energy.charging ? "true" : "false").str("},");
+    if (e.cycle.wake) {
+        w.str("\"cycle\":{\"wake\":").num(e.cycle.wake);
+        w.str(",\"start_ms\":").num(e.cycle.startMs);
+        w.str(",\"total_ms\":").num(e.cycle.totalMs);
+        w.str(",\"phases\":{");
+        for (int i = 0; i < PH_COUNT; i++) {
+            const PhaseRecord& p = e.cycle.phase[i];
+            if (i) w.str(",");
+            w.str("\"").str(kWakePhaseName[i]).str("\":[").num((uint32_t)p.plannedDs * 100);
+            w.str(",").num((uint32_t)p.actualDs * 100).str(",").num(p.status).str("]");
+        }
+        w.str("}},");
+    }
+}
 
-    // JSONペイロード構築
-    String payload = "{";
-    payload += "\"parent_id\":\"" + String(DEVICE_ID) + "\",";
-    payload += "\"secret\":\"" + String(DEVICE_SECRET) + "\",";
-    payload += "\"timestamp\":\"" + timestamp + "\",";
-    payload += "\"boot_count\":" + String(bootCount) + ",";
-
-    // 親機データ
-    payload += "\"parent\":{";
-    payload += "\"temperature\":" + String(parentData.temperature, 2) + ",";
-    payload += "\"humidity\":" + String(parentData.humidity, 2) + ",";
-    payload += "\"pressure\":" + String(parentData.pressure, 1) + ",";
-    payload += "\"battery\":" + String(parentData.batteryLevel) + ",";
-    // VBUS電圧を送信直前に再取得（ディープスリープ復帰直後は0になるため）
-    int vbusMvNow = (int)PMU.getVbusVoltage();
-    payload += "\"vbus_mv\":" + String(vbusMvNow) + ",";
-    payload += "\"signal\":" + String(modemState.signalStrength);
-    payload += "},";
-
-    // 子機データ配列
-    payload += "\"children\":[";
-    bool first = true;
-    for (int i = 0; i < MAX_CHILD_DEVICES; i++) {
-        if (cachedChildIds[i] != 0x00000000) {
-            if (!first) payload += ",";
-            first = false;
-
-            // デバイスIDを8桁16進数文字列に変換
-            char hexId[9];
-            snprintf(hexId, sizeof(hexId), "%08x", cachedChildIds[i]);
-
-            payload += "{";
-            payload += "\"device_id\":\"" + String(hexId) + "\",";
-            payload += "\"temperature\":" + String(childDataList[i].temperature, 2) + ",";
-            payload += "\"humidity\":" + String(childDataList[i].humidity, 2) + ",";
-            payload += "\"pressure\":" + String(childDataList[i].pressure, 1) + ",";
-            payload += "\"rssi\":" + String(childDataList[i].rssi) + ",";
-            payload += "\"battery\":" + String(childDataList[i].battery) + ",";
-            if (childDataList[i].vccMv > 0) {
-                payload += "\"voltage\":" + String(childDataList[i].vccMv) + ",";
-            }
-            payload += "\"received\":" + String(childDataList[i].received ? "true" : "false");
-            payload += "}";
+/**
+ * 蓄積ラウンドの範囲（ctx=BatchRange）を1リクエスト分のバッチJSONとして書き出す
+ * {"parent_id","secret","boot_count","fw","cfg","ac_ack":[...],"link":{...},"cycle":{...},"rounds":[{timestamp,parent,children}, ...]}
+ * （fw〜cycle は envelope の時だけ。1起床で複数回送る時は最初の1回に載せる）
+ */
+void writeBatchJson(PayloadWriter& w, void* ctx) {
+    const BatchRange& range = *(const BatchRange*)ctx;
+    w.str("{\"parent_id\":\"" DEVICE_ID "\",");
+    w.str("\"secret\":\"" DEVICE_SECRET "\",");
+    w.str("\"boot_count\":").num(range.bootCount).str(",");
+    if (range.seq.epoch) {
+        w.str("\"seq_epoch\":").num(range.seq.epoch).str(",");
+        w.str("\"have_from\":").num(range.seq.haveFrom).str(",");
+    }
+    if (range.env) writeBatchEnvelopeJson(w, *range.env);
+    w.str("\"rounds\":[");
+    for (int i = 0; i < range.count; i++) {
+        if (i) w.str(",");
+        writeRoundJson(w, range.rounds[i]);
+    }
+    w.str("]}");
+}
+
+// ---------------------------------------------------------------------
+// 退避ログの記憶域（LittleFS。既定パーティションの "spiffs" 領域を使う）
+// 1起床で同じセグメントへ続けて追記/読出しするので、最後に開いたファイルを1つ保持する
+// ---------------------------------------------------------------------
+struct LittleFsLogCtx {
+    File file;
+    char name[16];
+    bool appending;
+};
+static LittleFsLogCtx littleFsLog = {};
+
+static File* littleFsLogOpen(LittleFsLogCtx* c, const char* name, bool append) {
+    if (c->file && c->appending == append && strcmp(c->name, name) == 0) return &c->file;
+    if (c->file) c->file.close();
+    c->name[0] = '\0';
+    c->file = LittleFS.open(name, append ? FILE_APPEND : FILE_READ);
+    if (!c->file) return nullptr;
+    snprintf(c->name, sizeof(c->name), "%s", name);
+    c->appending = append;
+    return &c->file;
+}
+
+static void littleFsLogClose(LittleFsLogCtx* c) {
+    if (c->file) c->file.close();
+    c->name[0] = '\0';
+}
+
+static long littleFsLogSize(void* ctx, const char* name) {
+    LittleFsLogCtx* c = (LittleFsLogCtx*)ctx;
+    if (c->file && strcmp(c->name, name) == 0) {
+        if (c->appending) c->file.flush();
+        return (long)c->file.size();
+    }
+    if (!LittleFS.exists(name)) return -1;
+    File f = LittleFS.open(name, FILE_READ);
+    long n = f ? (long)f.size() : -1;
+    if (f) f.close();
+    return n;
+}
+
+static size_t littleFsLogRead(void* ctx, const char* name, uint32_t off, uint8_t* buf, size_t n) {
+    LittleFsLogCtx* c = (LittleFsLogCtx*)ctx;
+    if (!LittleFS.exists(name)) return 0;
+    File* f = littleFsLogOpen(c, name, false);
+    if (!f || !f->seek(off)) return 0;
+    return f->read(buf, n);
+}
+
+static bool littleFsLogAppend(void* ctx, const char* name, const uint8_t* p, size_t n) {
+    LittleFsLogCtx* c = (LittleFsLogCtx*)ctx;
+    File* f = littleFsLogOpen(c, name, true);
+    if (!f) return false;
+    bool ok = f->write(p, n) == n;
+    f->flush();   // 電断で失うのを最後の1件までにする
+    return ok;
+}
+
+static bool littleFsLogWrite(void* ctx, const char* name, const uint8_t* p, size_t n) {
+    LittleFsLogCtx* c = (LittleFsLogCtx*)ctx;
+    if (strcmp(c->name, name) == 0) littleFsLogClose(c);
+    File f = LittleFS.open(name, FILE_WRITE);
+    if (!f) return false;
+    bool ok = f.write(p, n) == n;
+    f.close();
+    return ok;
+}
+
+static void littleFsLogRemove(void* ctx, const char* name) {
+    LittleFsLogCtx* c = (LittleFsLogCtx*)ctx;
+    if (strcmp(c->name, name) == 0) littleFsLogClose(c);
+    if (LittleFS.exists(name)) LittleFS.remove(name);
+}
+
+static const RoundLogIo roundLogIo = {
+    &littleFsLog, littleFsLogSize, littleFsLogRead, littleFsLogAppend, littleFsLogWrite, littleFsLogRemove
+};
+
+/**
+ * 退避ログを使える状態にする（本起床で初めて使う時に LittleFS をマウントし、
+ * RTCの状態が無ければ（電源オン/リセット後）記憶域から開き直す）
+ */
+bool roundLogReady() {
+    if (!ROUND_LOG_ENABLE || roundLogMountFailed) return false;
+    if (!roundLogMounted) {
+        if (!LittleFS.begin(true)) {   // 初回はフォーマット
+            Serial.println("[LOG] LittleFS mount failed, flash spill disabled this wake");
+            roundLogMountFailed = true;
+            return false;
         }
+        roundLogMounted = true;
     }
-    payload += "]";
-    payload += "}";
+    if (!roundLog.open) {
+        unsigned long t0 = millis();
+        roundLogOpen(roundLog, roundLogIo, ROUND_LOG_SEG_BYTES, ROUND_LOG_MAX_SEGS);
+        Serial.printf("[LOG] Opened: %lu round(s) queued (seg %lu..%lu), %lu ms\n", (unsigned long)roundLog.count,
+                      (unsigned long)roundLog.head.seg, (unsigned long)roundLog.tail.seg, millis() - t0);
+    }
+    return true;
+}
 
-    Serial.println("[HTTP] Payload length: " + String(payload.length()));
-    Serial.println("[HTTP] Payload: " + payload);
+// 退避ログに未送信があるか（空と分かっていればマウントしない）
+bool roundLogPending() {
+    if (!ROUND_LOG_ENABLE || (roundLog.open && roundLog.count == 0)) return false;
+    return roundLogReady() && roundLog.count > 0;
+}
 
-    // 生TCP HTTP送信 (SHCONN は cid=0 をデフォルト使用で失敗するため回避)
-    bool success = sendRawHTTPTCP("POST", String(SERVER_PATH), String(SERVER_HOST), payload);
-    if (success) {
-        Serial.println("[HTTP] Data sent successfully");
-    } else {
-        Serial.println("[HTTP] Data send failed");
-        modemNeedsReset = true;
+/**
+ * RTCの圧縮蓄積を送信用に開く（古い順に1回だけ展開して通番を控え、外す印を消す）
+ */
+void openRtcRounds() {
+    unsigned long t0 = micros();
+    RoundPackReader rd(rtcRoundArena, rtcPack);
+    rtcRoundTotal = 0;
+    while (rtcRoundTotal < MAX_RTC_ROUNDS && rd.next(rtcRoundBuf[0])) rtcRoundSeq[rtcRoundTotal++] = rtcRoundBuf[0].seq;
+    rtcRoundCount = rtcRoundTotal;
+    memset(rtcRoundGone, 0, sizeof(rtcRoundGone));
+    rtcReaderPos = MAX_RTC_ROUNDS;   // 次の readRtcRound は先頭から
+    Serial.printf("[RTC] Opened %d round(s) from %u B, %lu us\n", rtcRoundTotal, rtcPack.bytes, micros() - t0);
+    if (rtcRoundTotal != rtcPack.count) {
+        Serial.printf("[RTC] WARN: %u round(s) expected, arena damaged\n", rtcPack.count);
     }
-    return success;
 }
 
 /**
- * 蓄積した1ラウンド分（親＋子機）からサーバ送信JSONを構築
+ * 蓄積の idx 番目（古い順の位置）を読む。差分の連鎖なので前回より後ろなら続きから、
+ * 前なら先頭から展開し直す（新しい順に読むと1件ごとに先頭から。48件でも数十ms）
  */
-String buildRoundPayload(const RtcRound& r) {
-    struct tm ti; localtime_r(&r.ts, &ti);
-    char tsbuf[32]; strftime(tsbuf, sizeof(tsbuf), "%Y-%m-%dT%H:%M:%S+09:00", &ti);
+bool readRtcRound(int idx, RtcRound& r) {
+    if (idx < 0 || idx >= rtcRoundTotal) return false;
+    if (idx < rtcReaderPos) {
+        rtcReader = RoundPackReader(rtcRoundArena, rtcPack);
+        rtcReaderPos = 0;
+    }
+    while (rtcReaderPos <= idx) {
+        if (!rtcReader.next(r)) return false;
+        rtcReaderPos++;
+    }
+    return true;
+}
 
-    String payload = "{";
-    payload += "\"parent_id\":\"" + String(DEVICE_ID) + "\",";
-    payload += "\"secret\":\"" + String(DEVICE_SECRET) + "\",";
-    payload += "\"timestamp\":\"" + String(tsbuf) + "\",";
-    payload += "\"boot_count\":" + String(bootCount) + ",";
-    payload += "\"parent\":{";
-    payload += "\"temperature\":" + String(r.pTemp, 2) + ",";
-    payload += "\"humidity\":" + String(r.pHumid, 2) + ",";
-    payload += "\"pressure\":" + String(r.pPres, 1) + ",";
-    payload += "\"battery\":" + String(r.pBat) + ",";
-    payload += "\"vbus_mv\":" + String(r.pVbus) + ",";
-    payload += "\"signal\":" + String(r.pSignal);
-    payload += "},";
-    payload += "\"children\":[";
-    for (int i = 0; i < r.childCount; i++) {
-        if (i) payload += ",";
-        char hexId[9]; snprintf(hexId, sizeof(hexId), "%08x", r.child[i].id);
-        payload += "{";
-        payload += "\"device_id\":\"" + String(hexId) + "\",";
-        payload += "\"temperature\":" + String(r.child[i].temp, 2) + ",";
-        payload += "\"humidity\":" + String(r.child[i].humid, 2) + ",";
-        payload += "\"pressure\":" + String(r.child[i].pres, 1) + ",";
-        payload += "\"rssi\":" + String(r.child[i].rssi) + ",";
-        payload += "\"battery\":" + String(r.child[i].bat) + ",";
-        payload += "\"received\":" + String(r.child[i].received ? "true" : "false");
-        payload += "}";
-    }
-    payload += "]}";
-    return payload;
-}
-
-/**
- * 今回の計測（親＋子機）をRTC蓄積バッファに1ラウンド追加
+static void markRtcRoundGone(int idx) {
+    if (rtcRoundGone[idx]) return;
+    rtcRoundGone[idx] = true;
+    rtcRoundCount--;
+}
+
+/**
+ * 印の付いたラウンドを外してRTCの圧縮蓄積を詰め直す（外した分で差分が大きくなり
+ * 収まらなければ最古から捨てる）。詰め直した後は openRtcRounds した状態になる
  */
-void storeRoundToRtc() {
-    if (rtcRoundCount >= MAX_RTC_ROUNDS) {
-        for (int i = 1; i < MAX_RTC_ROUNDS; i++) rtcRounds[i - 1] = rtcRounds[i];  // 最古を破棄
-        rtcRoundCount = MAX_RTC_ROUNDS - 1;
+void repackRtcRounds() {
+    if (rtcRoundCount == rtcRoundTotal && rtcRoundTotal == rtcPack.count) return;   // 外す分なし
+    // 読み元の写し（差分が大きくなると、まだ読んでいない所を書き潰すため）
+    static uint8_t src[RTC_ROUND_ARENA_BYTES];
+    static RoundPackState srcPack;   // 予測状態込みで500バイト超（スタックに置かない）
+    memcpy(src, rtcRoundArena, rtcPack.bytes);
+    srcPack = rtcPack;
+    int skip = 0;
+    for (;;) {
+        roundPackClear(rtcPack);
+        RoundPackReader rd(src, srcPack);
+        int kept = 0;
+        bool fit = true;
+        for (int i = 0; i < rtcRoundTotal && rd.next(rtcRoundBuf[0]); i++) {
+            if (rtcRoundGone[i] || kept++ < skip) continue;
+            if (!roundPackAppend(rtcRoundArena, sizeof(rtcRoundArena), rtcPack, rtcRoundBuf[0])) { fit = false; break; }
+            rtcRoundSeq[rtcPack.count - 1] = rtcRoundBuf[0].seq;
+        }
+        if (fit) break;
+        skip++;
     }
-    RtcRound& r = rtcRounds[rtcRoundCount];
+    if (skip > 0) Serial.printf("[RTC] Repack overflow, dropped %d oldest round(s)\n", skip);
+    rtcRoundTotal = rtcRoundCount = rtcPack.count;
+    memset(rtcRoundGone, 0, sizeof(rtcRoundGone));
+    rtcReaderPos = MAX_RTC_ROUNDS;
+}
+
+// 最古の1ラウンドを破棄（RTCが一杯で退避もできない時）
+static void dropOldestRtcRound() {
+    openRtcRounds();
+    if (rtcRoundTotal == 0) { roundPackClear(rtcPack); return; }
+    markRtcRoundGone(0);
+    repackRtcRounds();
+    Serial.println("[RTC] Buffer full, dropped oldest round");
+}
+
+/**
+ * RTC蓄積の古い順にフラッシュの退避ログへ移す（移せた分をRTCから外す）
+ */
+void spillRoundsToLog() {
+    if (rtcPack.count == 0 || !roundLogReady()) return;
+    static RtcRound r;   // 1件 800 バイト超（スタックに置かない）
+    uint32_t dropped0 = roundLog.dropped;
+    RoundPackReader rd(rtcRoundArena, rtcPack);
+    int n = 0;
+    while (rd.next(r) && roundLogAppend(roundLog, roundLogIo, roundEpoch, r)) n++;
+    littleFsLogClose(&littleFsLog);
+    if (n >= rtcPack.count) {
+        roundPackClear(rtcPack);
+    } else if (n > 0) {
+        // 途中で失敗: 移せた分を外して詰め直す
+        openRtcRounds();
+        for (int i = 0; i < n && i < rtcRoundTotal; i++) markRtcRoundGone(i);
+        repackRtcRounds();
+    }
+    Serial.printf("[LOG] Spilled %d round(s) to flash: %lu queued%s\n", n, (unsigned long)roundLog.count,
+                  roundLog.dropped != dropped0 ? ", oldest segment dropped (log full)" : "");
+}
+
+/**
+ * 今回の計測（親＋子機）をRTC蓄積バッファに1ラウンド追加（圧縮表現で追記。展開はしない）
+ * RTCが一杯なら古い分をフラッシュの退避ログへ移す。CRITICAL では電池切れでRTCごと消えうるので
+ * 毎回移す（RTCには今回の1件だけを置く）。移せなければ最古を破棄
+ */
+void storeRoundToRtc() {
+    if (ROUND_LOG_ENABLE && rtcPack.count > 0 && energyState.tier == ENERGY_CRITICAL) spillRoundsToLog();
+    static RtcRound r;   // 1件 800 バイト超（スタックに置かない）
+    memset(&r, 0, sizeof(r));
+    if (roundEpoch == 0) roundEpoch = (esp_random() & 0x7FFFFFFF) | 1;   // 電源投入後の最初のラウンド
+    r.seq = ++roundSeq;
     time(&r.ts);
     r.pTemp = parentData.temperature; r.pHumid = parentData.humidity; r.pPres = parentData.pressure;
     r.pBat = parentData.batteryLevel; r.pVbus = parentData.vbusMv; r.pSignal = modemState.signalStrength;
@@ -2073,53 +3476,419 @@ void storeRoundToRtc() {
         c.bat = childDataList[i].battery;
         c.lid = childDataList[i].logicalId;
     }
-    rtcRoundCount++;
-    Serial.printf("[RTC] Stored round (buffered:%d, children:%d)\n", rtcRoundCount, r.childCount);
+    const size_t cap = sizeof(rtcRoundArena);
+    if (rtcPack.count >= MAX_RTC_ROUNDS || !roundPackAppend(rtcRoundArena, cap, rtcPack, r)) {
+        if (ROUND_LOG_ENABLE) spillRoundsToLog();
+        while (rtcPack.count >= MAX_RTC_ROUNDS || !roundPackAppend(rtcRoundArena, cap, rtcPack, r)) {
+            if (rtcPack.count == 0) {
+                Serial.printf("[RTC] ERROR: round #%lu does not fit the arena\n", (unsigned long)r.seq);
+                return;
+            }
+            dropOldestRtcRound();
+        }
+    }
+    Serial.printf("[RTC] Stored round #%lu (buffered:%u, %u B packed, children:%d)\n", (unsigned long)r.seq,
+                  rtcPack.count, rtcPack.bytes, r.childCount);
 }
 
 /**
- * 蓄積した全ラウンドをまとめてサーバ送信（1回のLTEセッションで連続POST）
- * 途中失敗したら中断し、バッファを保持して次回LTE起床時に再送する。
+ * 蓄積した全ラウンドをサーバ送信（設定の送信経路で。UDPで届かなかった分はHTTPで送る）
+ * 送信バイト・所要・再送数は linkStats の up* に残し、次回のバッチで経路の比較に使う。
+ * 失敗したらバッファ（未達分）を保持して次回LTE起床時に再送する。
  */
 bool uploadAllRounds() {
-    bool allOk = true;
-    for (int i = 0; i < rtcRoundCount; i++) {
-        String payload = buildRoundPayload(rtcRounds[i]);
-        Serial.printf("[HTTP] Round %d/%d (%d bytes)\n", i + 1, rtcRoundCount, payload.length());
-        if (!sendRawHTTPTCP("POST", String(SERVER_PATH), String(SERVER_HOST), payload)) {
-            allOk = false; modemNeedsReset = true; break;
+    if (rtcRoundCount == 0 && !roundLogPending()) return true;
+    ingestHints = {};
+    uint32_t bytes0 = wakeHttpBytes;
+    unsigned long t0 = millis();
+    uint8_t transport = 0, retx = 0;
+    bool ok = false;
+    if (ingestTransport == TRANSPORT_UDP) {
+        int acked = uploadRoundsUdp(retx);
+        transport = 1;
+        ok = rtcRoundCount == 0;
+        Serial.printf("[UDP] %d round(s) acked, %d left, %u retx\n", acked, rtcRoundCount, retx);
+    }
+    if (!ok) {
+        if (transport == 1) transport = 2;
+        ok = uploadRoundsHttp(true);
+    } else if (roundLogPending()) {
+        // 退避ログの後追いはHTTPで（エンベロープはUDPで届いた）
+        transport = 2;
+        uploadRoundsHttp(false);
+    }
+    linkStats.upTransport = transport;
+    linkStats.upRetx = retx;
+    linkStats.upBytes = wakeHttpBytes - bytes0;
+    linkStats.upMs = millis() - t0;
+    Serial.printf("[LINK] Upload %s: %lu B, %lu ms\n", kUpTransportName[transport],
+                  (unsigned long)linkStats.upBytes, (unsigned long)linkStats.upMs);
+    return ok;
+}
+
+/**
+ * 届いたラウンドに外す印を付ける: 送った位置 idx[0 .. count) と、
+ * サーバが連続して受取済みと返した seq ≤ ackSeq（0=応答に無し）
+ */
+static void dropDeliveredRounds(const int* idx, int count, uint32_t ackSeq) {
+    for (int i = 0; i < count; i++) markRtcRoundGone(idx[i]);
+    int more = 0;
+    for (int i = 0; ackSeq && i < rtcRoundTotal; i++) {
+        if (rtcRoundGone[i] || rtcRoundSeq[i] > ackSeq) continue;
+        markRtcRoundGone(i);
+        more++;
+    }
+    if (more > 0) Serial.printf("[HTTP] Server already has %d more round(s) (ack_seq %lu)\n", more, (unsigned long)ackSeq);
+}
+
+/**
+ * 蓄積ラウンドを最新から先にHTTPでバッチPOST（keep-alive の1接続上で）
+ * 1件目のリクエストにはRTC蓄積を最新から新しい順に UPLOAD_BATCH_MAX_ROUNDS 件まで、
+ * 起床毎のバイト予算に収まるだけ載せる（通常の送信間隔の分はこの1回で全部届く）。
+ * 停電/圏外明けの積み残しだけを、古い順（フラッシュの退避ログ → RTC）に予算(バイト/時間)内で
+ * 後追い送信する（古い順=サーバの連続ACK ack_seq が進む順）。
+ * 届いたリクエストの分と、サーバが ack_seq で受取済みと返した分をRTC/退避ログから外すので、
+ * 応答を取り損ねた分も含めて既にサーバにあるラウンドは再送しない（残りは次のLTE起床で続きから）。
+ * envelope: 1件目に fw/cfg/ac_ack/link/cycle を載せる（UDPで届いた後の後追いでは false）
+ * 戻り値: 1件目（最新ラウンドを含む）が届いた
+ */
+bool uploadRoundsHttp(bool envelope) {
+    if (rtcRoundCount == 0 && !roundLogPending()) return true;
+    uint32_t bytes0 = wakeHttpBytes;
+    unsigned long t0 = millis();
+    bool first = true, ok = true;
+    for (;;) {
+        bool fromLog = !(first && rtcRoundCount > 0) && roundLogPending();
+        if (!fromLog && rtcRoundCount == 0) break;
+        uint32_t used = wakeHttpBytes - bytes0;
+        if (!first && (used >= UPLOAD_BACKFILL_BUDGET_BYTES || millis() - t0 >= UPLOAD_BACKFILL_BUDGET_MS)) {
+            Serial.printf("[HTTP] Backfill budget used (%lu B, %lu ms), %d+%lu round(s) left for next LTE wake\n",
+                          (unsigned long)used, millis() - t0, rtcRoundCount,
+                          (unsigned long)(roundLog.open ? roundLog.count : 0));
+            break;
+        }
+        // 予算の残り（ヘッダ分を除く）。どのリクエストも最低1件は送る
+        size_t room = used + UPLOAD_HTTP_OVERHEAD_BYTES < UPLOAD_BACKFILL_BUDGET_BYTES
+                    ? UPLOAD_BACKFILL_BUDGET_BYTES - used - UPLOAD_HTTP_OVERHEAD_BYTES : 0;
+        int idx[UPLOAD_BATCH_MAX_ROUNDS];   // RTC蓄積の位置（届いたら外す）
+        int count = 0;
+        size_t bytes = 0;
+        BatchSeq seq;
+        RoundLogPos next;
+        if (fromLog) {
+            uint32_t epoch = 0;
+            count = roundLogPeek(roundLog, roundLogIo, rtcRoundBuf, UPLOAD_BATCH_MAX_ROUNDS, epoch, next);
+            if (count == 0) {
+                // 末尾まで読めるレコードが無い（壊れた残り）→ 空にして次へ
+                if (!roundLogAdvance(roundLog, roundLogIo, next, roundLog.count)) break;
+                continue;
+            }
+            int fit = 0;
+            while (fit < count && (fit == 0 || bytes + roundBodyBytes(rtcRoundBuf[fit]) <= room)) {
+                bytes += roundBodyBytes(rtcRoundBuf[fit++]);
+            }
+            // 予算を超える分は読み直して外す（next を送る分の直後に合わせる）
+            if (fit < count) count = roundLogPeek(roundLog, roundLogIo, rtcRoundBuf, fit, epoch, next);
+            seq = { epoch, roundLog.headSeq };
+        } else {
+            // 1件目は最新から新しい順、以降は未達を古い順に（送る分だけ圧縮蓄積から読む）
+            for (int i = 0; i < rtcRoundTotal && count < UPLOAD_BATCH_MAX_ROUNDS; i++) {
+                int k = first ? rtcRoundTotal - 1 - i : i;
+                if (rtcRoundGone[k]) continue;
+                if (!readRtcRound(k, rtcRoundBuf[count])) break;
+                size_t n = roundBodyBytes(rtcRoundBuf[count]);
+                if (count > 0 && bytes + n > room) break;
+                bytes += n;
+                idx[count++] = k;
+            }
+            if (count == 0) break;
+            seq = heldSeq();
+        }
+        uint32_t ackSeq = 0;
+        if (!postRoundsHttp(rtcRoundBuf, count, first && envelope, seq, ackSeq)) {
+            ok = !first;
+            break;
+        }
+        if (fromLog) {
+            if (!roundLogAdvance(roundLog, roundLogIo, next, count)) {
+                // 送達済みだが先頭を進められない（メタ書込み失敗）。続けると同じ分を再送するので打ち切る
+                Serial.println("[LOG] Head advance failed, stop backfill this wake");
+                break;
+            }
+            if (ackSeq) roundLogDropAcked(roundLog, roundLogIo, seq.epoch, ackSeq);
+            if (ackSeq && seq.epoch == roundEpoch) dropDeliveredRounds(nullptr, 0, ackSeq);
+        } else {
+            dropDeliveredRounds(idx, count, ackSeq);
+            if (ackSeq && roundLog.open) roundLogDropAcked(roundLog, roundLogIo, roundEpoch, ackSeq);
         }
-        delay(200);
+        first = false;
     }
-    return allOk;
+    if (roundLogMounted) littleFsLogClose(&littleFsLog);
+    return ok;
 }
 
-String sendATCommand(const String& cmd, unsigned long timeout) {
-    while (modemSerial.available()) modemSerial.read();
-    modemSerial.println(cmd);
+/**
+ * rounds[0 .. count) を1回のHTTP交換でバッチPOST（envelope=エンベロープも載せる）
+ * seq: 送るラウンドの通番系列と保持中の最古（退避ログの分は古い epoch のことがある）
+ * ackSeq: 応答の "ack_seq"（保持中の最古から連続してサーバにある最大の seq。無ければ0）
+ */
+bool postRoundsHttp(const RtcRound* rounds, int count, bool envelope, const BatchSeq& seq, uint32_t& ackSeq) {
+    // エンベロープはここで1回だけ写す（長さの計測と送信の書出しで同じ値を使う）
+    BatchEnvelope env;
+    if (envelope) snapshotEnvelope(env);
+    BatchRange range = { rounds, count, envelope ? &env : nullptr, seq, bootCount };
+    // 応答は先頭の "hints" だけ読めればよい（以降の "data" は切り捨て）
+    char text[256] = "";
+    BodyBuffer buf = { text, sizeof(text), 0 };
+    HttpResponseParser resp(bodyBufferSink, &buf);
+    int status;
+#if INGEST_USE_CBOR
+    // CBOR: 整数キー+固定小数点で送信バイトを削減（スキーマは round_cbor.h）
+    static uint8_t cbor[ROUND_CBOR_MAX_BYTES(UPLOAD_BATCH_MAX_ROUNDS)];   // 1リクエストは最大でこの件数
+#if INGEST_ENCODING_STATS
+    unsigned long t0 = micros();
+#endif
+    size_t cborLen = cborEncodeRange(cbor, sizeof(cbor), range);
+#if INGEST_ENCODING_STATS
+    unsigned long cborUs = micros() - t0;
+    t0 = micros();
+    PayloadWriter jsonCounter;
+    writeBatchJson(jsonCounter, &range);
+    Serial.printf("[HTTP] Encode: CBOR %u B / %lu us, JSON %u B / %lu us\n",
+                  (unsigned)cborLen, cborUs, (unsigned)jsonCounter.length(), micros() - t0);
+#endif
+    Serial.printf("[HTTP] Batch: %d round(s)%s, %u bytes (CBOR)\n", count, envelope ? "" : " backfill", (unsigned)cborLen);
+    HttpBody body = { "application/cbor", cborLen, cbor, nullptr, nullptr };
+    status = (cborLen > 0) ? httpRequest("POST", String(SERVER_PATH), body, resp) : 0;
+#else
+    // JSONは1回目の書出しで長さだけ数え、送信時にCASENDチャンクへ直接書き出す（ヒープ不使用）
+#if INGEST_ENCODING_STATS
+    unsigned long t0 = micros();
+#endif
+    PayloadWriter jsonCounter;
+    writeBatchJson(jsonCounter, &range);
+#if INGEST_ENCODING_STATS
+    unsigned long jsonUs = micros() - t0;
+    t0 = micros();
+    size_t cborLen = cborEncodeRange(nullptr, 0, range);
+    Serial.printf("[HTTP] Encode: JSON %u B / %lu us, CBOR %u B / %lu us\n",
+                  (unsigned)jsonCounter.length(), jsonUs, (unsigned)cborLen, micros() - t0);
+#endif
+    Serial.printf("[HTTP] Batch: %d round(s)%s, %u bytes\n", count, envelope ? "" : " backfill", (unsigned)jsonCounter.length());
+    HttpBody body = { "application/json", jsonCounter.length(), nullptr, writeBatchJson, &range };
+    status = httpRequest("POST", String(SERVER_PATH), body, resp);
+#endif
+    Serial.printf("[TCP] HTTP %d\n", status);
+    bool ok = status == 200 || status == 201 || status == 204;
+    modemNeedsReset = !ok;
+    if (ok) {
+        const char* a = strstr(text, "\"ack_seq\":");
+        ackSeq = a ? (uint32_t)strtoul(a + 10, nullptr, 10) : 0;
+    }
+    if (ok && envelope) {
+        acAckId = 0;   // 完了通知は届いた
+        if (INGEST_HINTS_ENABLE) parseIngestHints(text);
+    }
+    return ok;
+}
 
-    String response = "";
-    unsigned long startTime = millis();
+/**
+ * UDPデータグラム1件をCASENDで送る（CASEND上限を超えるものは呼び出し側で除外済み）
+ */
+static bool udpSendDatagram(const uint8_t* p, size_t n) {
+    CasendStream cs = { UDP_CLIENT_ID, 0, 0, true };
+    casendWrite((const char*)p, n, &cs);
+    bool sent = casendFinish(cs);
+    wakeHttpBytes += cs.sent;
+    return sent;
+}
 
-    while (millis() - startTime < timeout) {
-        while (modemSerial.available()) {
-            char c = modemSerial.read();
-            response += c;
+/**
+ * 蓄積ラウンドを1件1データグラムでUDP送信し（udp_ingest.h）、ACKの来たものをRTCから消す。
+ * link/cycle/fw/cfg/ac_ack は先頭の「ラウンド0件」のデータグラムに1回だけ載せ、ラウンドは新しい順に送る。
+ * 1巡送ってACKを待ち、未達分だけを UDP_SEND_PASSES 巡まで再送する。
+ * 戻り値: ACKを得たラウンド数（届いた分に外す印を付ける。未達分は後の repackRtcRounds で残る）
+ */
+int uploadRoundsUdp(uint8_t& retx) {
+    // datagram[0] = エンベロープ、[1..] = ラウンド
+    static uint8_t dgram[MODEM_CASEND_MAX];
+    static uint16_t msgIds[MAX_RTC_ROUNDS + 1];
+    bool acked[MAX_RTC_ROUNDS + 1] = {};
+    bool skip[MAX_RTC_ROUNDS + 1] = {};
+    const int total = rtcRoundTotal + 1;
+    for (int i = 0; i < rtcRoundTotal; i++) skip[i + 1] = rtcRoundGone[i];
+    BatchEnvelope env;
+    snapshotEnvelope(env);
+    BatchSeq seq = heldSeq();
+
+    sendATCommand("AT+CACLOSE=" + String(UDP_CLIENT_ID), 1500);
+    String r = sendATCommand("AT+CAOPEN=" + String(UDP_CLIENT_ID) + ",0,\"UDP\",\"" + String(UDP_INGEST_HOST) + "\"," +
+                             String(UDP_INGEST_PORT), 10000);
+    if (r.indexOf("+CAOPEN: " + String(UDP_CLIENT_ID) + ",0") < 0) {
+        Serial.printf("[UDP] CAOPEN failed: '%s'\n", r.c_str());
+        return 0;
+    }
+    const uint16_t bit = 1u << UDP_CLIENT_ID;
+    urcState.dataReady &= ~bit;
+    for (int i = 0; i < total; i++) msgIds[i] = ++udpMsgId;
+
+    int acks = 0;
+    uint8_t lastFlags = UDP_HINT_UNKNOWN;
+    for (int pass = 0; pass < UDP_SEND_PASSES && acks < total; pass++) {
+        for (int k = 0; k < total; k++) {
+            int i = (k == 0) ? 0 : total - k;   // エンベロープ → 新しいラウンド順
+            if (acked[i] || skip[i]) continue;
+            // 毎回エンコードし直す（RTCの圧縮蓄積から読む。再送用の控えは持たない）
+            size_t n = udpWriteHeader(dgram, UDP_DATA, msgIds[i]);
+            size_t c = (i == 0)
+                ? cborEncodeBatch(dgram + n, sizeof(dgram) - n, DEVICE_ID, DEVICE_SECRET, bootCount, nullptr, 0, &env.link,
+                                  env.cycle.wake ? &env.cycle : nullptr, INGEST_HINTS_ENABLE ? &env.meta : nullptr, &seq,
+                                  &env.energy)
+                : readRtcRound(i - 1, rtcRoundBuf[0])
+                    ? cborEncodeBatch(dgram + n, sizeof(dgram) - n, DEVICE_ID, DEVICE_SECRET, bootCount, rtcRoundBuf, 1,
+                                      nullptr, nullptr, nullptr, &seq)
+                    : 0;
+            if (c == 0) {
+                // CASEND1回に収まらない（子機数が多い等）→ HTTPへ回す
+                Serial.printf("[UDP] datagram %d too large, left for HTTP\n", i);
+                skip[i] = true;
+                continue;
+            }
+            if (!udpSendDatagram(dgram, n + c)) break;
+            if (pass > 0) retx++;
         }
-        if (response.indexOf("OK") >= 0 || response.indexOf("ERROR") >= 0 ||
-            response.indexOf("+SHREQ:") >= 0 || response.indexOf(">") >= 0 ||
-            response.indexOf("+CNTP:") >= 0 || response.indexOf("+SHREAD:") >= 0 ||
-            response.indexOf("+APP PDP:") >= 0 ||  // SIM7080G PDP非同期通知
-            response.indexOf("+CAURC:") >= 0) {    // TCP/UDP非同期通知
-            break;
+        // ACKを待つ（CARECVは複数のACKを連結して返しうる）
+        unsigned long t = millis();
+        int want = 0;
+        for (int i = 0; i < total; i++) if (!acked[i] && !skip[i]) want++;
+        while (want > 0 && millis() - t < UDP_ACK_TIMEOUT_MS) {
+            if (!(urcState.dataReady & bit)) { at.service(20); continue; }
+            urcState.dataReady &= ~bit;
+            uint8_t buf[UDP_ACK_BYTES * 16];
+            int got;
+            while ((got = carecvRaw(buf, sizeof(buf), 1000, UDP_CLIENT_ID)) > 0) {
+                wakeHttpBytes += got;
+                for (int o = 0; o + UDP_ACK_BYTES <= got; o += UDP_ACK_BYTES) {
+                    UdpAck a;
+                    if (!udpParseAck(buf + o, UDP_ACK_BYTES, a)) continue;
+                    for (int i = 0; i < total; i++) {
+                        if (msgIds[i] != a.msgId || acked[i]) continue;
+                        if (a.status == UDP_ACK_STORED || a.status == UDP_ACK_DUPLICATE) {
+                            acked[i] = true; acks++; want--;
+                            lastFlags = a.flags;
+                        } else {
+                            Serial.printf("[UDP] msg %u rejected (status %u)\n", a.msgId, a.status);
+                            skip[i] = true; want--;
+                        }
+                    }
+                }
+            }
         }
-        delay(10);
+    }
+    sendATCommand("AT+CACLOSE=" + String(UDP_CLIENT_ID), 2000);
+
+    // エンベロープが届いた = ac_ack も届いた
+    if (acked[0]) acAckId = 0;
+    // 最後のACKのヒント（サーバが分からなければ従来の取得周期で判断）
+    if (INGEST_HINTS_ENABLE && acks > 0 && !(lastFlags & UDP_HINT_UNKNOWN) && !(lastFlags & UDP_HINT_AC)) {
+        ingestHints.valid = true;
+        ingestHints.configChanged = lastFlags & UDP_HINT_CONFIG;
+        ingestHints.ota = lastFlags & UDP_HINT_OTA;
     }
 
+    // 届いたラウンドに外す印（未達分は順序を保ってRTCに残る）
+    int done = 0;
+    for (int i = 0; i < rtcRoundTotal; i++) {
+        if (!acked[i + 1]) continue;
+        markRtcRoundGone(i);
+        done++;
+    }
+    // エンベロープだけが未達でラウンドが全部届いた場合、link等は次回のバッチで送られる
+    return done;
+}
+
+/**
+ * 送信応答 {"success":true,"hints":{"config":bool,"ota":bool,"ac":{...}},"data":...} の hints を読む
+ */
+void parseIngestHints(char* text) {
+    char* h = strstr(text, "\"hints\":{");
+    if (!h) return;
+    char* end = strstr(h, "\"data\":");
+    if (end) *end = '\0';
+    ingestHints.valid = true;
+    ingestHints.configChanged = strstr(h, "\"config\":true") != nullptr;
+    ingestHints.ota = strstr(h, "\"ota\":true") != nullptr;
+    const char* ac = strstr(h, "\"ac\":{");
+    if (ac) ingestHints.ac = parseAcCommand(ac);
+    Serial.printf("[HTTP] Hints: config=%d ota=%d ac=%d\n", ingestHints.configChanged, ingestHints.ota,
+                  ingestHints.ac.found ? ingestHints.ac.id : 0);
+}
+
+/**
+ * ATコマンドを1つ実行し、応答全文を返す（OK/ERROR/">" で完了。URCは購読側へ回る）
+ */
+String sendATCommand(const String& cmd, unsigned long timeout) {
+    at.exec(cmd.c_str(), timeout);
+    String response = at.response();
     response.trim();
     return response;
 }
 
+// ===== URCハンドラ =====
+
+static void onUrcDataInd(const char* line, void*) {      // "+CADATAIND: <cid>"
+    int cid = atoi(line + 12);
+    if (cid >= 0 && cid < 16) urcState.dataReady |= 1u << cid;
+}
+
+static void onUrcCaState(const char* line, void*) {      // "+CASTATE: <cid>,<state>"
+    int cid = atoi(line + 10);
+    const char* comma = strchr(line, ',');
+    if (cid < 0 || cid >= 16 || !comma) return;
+    if (atoi(comma + 1) == 0) {
+        urcState.closed |= 1u << cid;
+        Serial.printf("[URC] connection %d closed by peer\n", cid);
+    } else {
+        urcState.closed &= ~(1u << cid);
+    }
+}
+
+static void onUrcCereg(const char* line, void*) {        // "+CEREG: <stat>[,...]"
+    urcState.cereg = atoi(line + 8);
+    Serial.printf("[URC] CEREG stat=%d\n", urcState.cereg);
+}
+
+static void onUrcCaUrc(const char* line, void*) {        // "+CAURC: ..."
+    Serial.printf("[URC] %s\n", line);
+}
+
+static void onUrcNitz(const char* line, void*) {         // "*PSUTTZ: ..." / "+CTZV: ..."（CLTS=1: NITZでモデム時計更新）
+    time_t now; time(&now);
+    modemClock = { TS_NITZ, 0, now };
+    Serial.printf("[URC] %s\n", line);
+}
+
+static void onUrcAppPdp(const char* line, void*) {       // "+APP PDP: <pdpidx>,ACTIVE|DEACTIVE"
+    urcState.pdpActive = strstr(line, "DEACTIVE") == nullptr;
+    Serial.printf("[URC] %s\n", line);
+}
+
+/**
+ * ATエンジンのURC購読を登録（modemSerial.begin 直後に1回）
+ */
+void initAtEngine() {
+    static bool done = false;
+    if (done) return;
+    at.subscribe("+CADATAIND:", onUrcDataInd);
+    at.subscribe("+CASTATE:", onUrcCaState);
+    at.subscribe("+CEREG:", onUrcCereg);
+    at.subscribe("+CAURC:", onUrcCaUrc);
+    at.subscribe("+APP PDP:", onUrcAppPdp);
+    at.subscribe("*PSUTTZ:", onUrcNitz);
+    at.subscribe("+CTZV:", onUrcNitz);
+    done = true;
+}
+
 void goToDeepSleep(uint64_t sleepTimeSec) {
     Serial.flush();
     gpio_hold_en((gpio_num_t)MODEM_PWRKEY_PIN);
@@ -2267,89 +4036,74 @@ AcCommandPending fetchPendingAcCommand() {
 
     String path = "/api/devices/" + String(DEVICE_ID) + "/ac-command?secret=" + String(DEVICE_SECRET);
 
-    // TCP接続 (HTTP port 80)
-    sendATCommand("AT+CACLOSE=0", 1000);
-    String r = sendATCommand("AT+CAOPEN=0,0,\"TCP\",\"" + String(SERVER_HOST) + "\",80", 20000);
-    if (r.indexOf("OK") < 0) {
-        Serial.println("[AC] CAOPEN failed");
-        return result;
-    }
-    int clientID = 0;
-    {
-        int idx = r.indexOf("+CAOPEN: ");
-        if (idx >= 0) {
-            int ns = idx + 9;
-            int cm = r.indexOf(",", ns);
-            if (cm > ns) clientID = r.substring(ns, cm).toInt();
-        }
-    }
-    delay(200);
-
-    String httpReq = "GET " + path + " HTTP/1.1\r\n";
-    httpReq += "Host: " + String(SERVER_HOST) + "\r\n";
-    httpReq += "Connection: keep-alive\r\n\r\n";
-
-    r = sendATCommand("AT+CASEND=" + String(clientID) + "," + String(httpReq.length()), 5000);
-    modemSerial.print(httpReq);
-
-    // +CADATAIND を待ってからCARECVで受信
-    String sBuf = "";
-    String httpResp = "";
-    unsigned long t = millis();
-    while (millis() - t < 10000) {
-        while (modemSerial.available()) sBuf += (char)modemSerial.read();
-        if (sBuf.indexOf("+CADATAIND:") >= 0) {
-            modemSerial.print("AT+CARECV=" + String(clientID) + ",1460\r\n");
-            unsigned long rt = millis();
-            while (millis() - rt < 5000) {
-                while (modemSerial.available()) httpResp += (char)modemSerial.read();
-                if (httpResp.endsWith("\r\nOK\r\n") || httpResp.indexOf("ERROR") >= 0) break;
-                delay(10);
-            }
-            break;
-        }
-        if (sBuf.indexOf("+CASTATE:") >= 0) break;
-        delay(50);
-    }
-    sendATCommand("AT+CACLOSE=" + String(clientID), 3000);
+    char text[256] = "";
+    BodyBuffer buf = { text, sizeof(text), 0 };
+    HttpResponseParser resp(bodyBufferSink, &buf);
+    int status = httpRequest("GET", path, HTTP_NO_BODY, resp);
 
     // HTTP 200以外は無視
-    if (httpResp.indexOf(" 200") < 0) return result;
-
-    // JSONボディ抽出 (ヘッダー後の部分)
-    int bodyStart = httpResp.indexOf("\r\n\r\n");
-    if (bodyStart < 0) return result;
-    String body = httpResp.substring(bodyStart + 4);
+    if (status != 200) return result;
 
     // {"pending":false} チェック
-    if (body.indexOf("\"pending\":false") >= 0) return result;
+    if (strstr(text, "\"pending\":false")) return result;
+    return parseAcCommand(text);
+}
+
+/**
+ * ACコマンドのJSON（{"id":..,"mode":"..","tempC":..}）を解釈。不完全なら found=false
+ * （ac-command 応答と、送信応答のヒント "ac":{...} の両方で使う）
+ */
+AcCommandPending parseAcCommand(const char* text) {
+    AcCommandPending result = {false, 0, AcMode::COOL, 25.0f};
 
     // id
-    int idIdx = body.indexOf("\"id\":");
-    if (idIdx < 0) return result;
-    result.id = body.substring(idIdx + 5).toInt();
+    const char* p = strstr(text, "\"id\":");
+    if (!p) return result;
+    result.id = atoi(p + 5);
 
     // mode
-    int modeIdx = body.indexOf("\"mode\":\"");
-    if (modeIdx < 0) return result;
-    String modeStr = body.substring(modeIdx + 8, modeIdx + 12);
-    if      (modeStr.startsWith("COOL")) result.mode = AcMode::COOL;
-    else if (modeStr.startsWith("HEAT")) result.mode = AcMode::HEAT;
-    else if (modeStr.startsWith("DRY"))  result.mode = AcMode::DRY;
-    else if (modeStr.startsWith("FAN"))  result.mode = AcMode::FAN;
-    else if (modeStr.startsWith("OFF"))  result.mode = AcMode::OFF;
+    p = strstr(text, "\"mode\":\"");
+    if (!p) return result;
+    p += 8;
+    if      (strncmp(p, "COOL", 4) == 0) result.mode = AcMode::COOL;
+    else if (strncmp(p, "HEAT", 4) == 0) result.mode = AcMode::HEAT;
+    else if (strncmp(p, "DRY", 3) == 0)  result.mode = AcMode::DRY;
+    else if (strncmp(p, "FAN", 3) == 0)  result.mode = AcMode::FAN;
+    else if (strncmp(p, "OFF", 3) == 0)  result.mode = AcMode::OFF;
     else return result;
 
     // tempC
-    int tempIdx = body.indexOf("\"tempC\":");
-    if (tempIdx >= 0) {
-        result.tempC = body.substring(tempIdx + 8).toFloat();
-    }
+    p = strstr(text, "\"tempC\":");
+    if (p) result.tempC = atof(p + 8);
 
     result.found = true;
     return result;
 }
 
+/**
+ * 未実行のACコマンドを実行。送信応答のヒントで届いたものは完了通知を次の送信ボディに載せ、
+ * ヒントが無ければ従来通り ac-command を問い合わせて ac-ack を送る
+ */
+void runAcCommand() {
+    AcCommandPending acCmd = ingestHints.valid ? ingestHints.ac : fetchPendingAcCommand();
+    if (!acCmd.found) return;
+    if (!ingestHints.valid && (uint32_t)acCmd.id == acAckId) {
+        // 実行済みで完了通知が未達のまま送信に失敗し続けている: 再実行せず通知だけ送る
+        if (ackAcCommand(acCmd.id)) acAckId = 0;
+        return;
+    }
+    irCtrl.begin();
+    Serial.printf("[AC] Executing: mode=%d tempC=%.1f\n", (int)acCmd.mode, acCmd.tempC);
+    irCtrl.send(acCmd.mode, acCmd.tempC);
+    if (ingestHints.valid) {
+        acAckId = (uint32_t)acCmd.id;
+        time(&acAckAt);
+        Serial.printf("[AC] cmd %d done, ack rides on next upload\n", acCmd.id);
+    } else {
+        ackAcCommand(acCmd.id);
+    }
+}
+
 /**
  * ACコマンド実行完了をサーバーに通知
  * POST /api/devices/:deviceId/ac-ack
@@ -2358,7 +4112,7 @@ AcCommandPending fetchPendingAcCommand() {
 bool ackAcCommand(int cmdId) {
     String path = "/api/devices/" + String(DEVICE_ID) + "/ac-ack";
     String body = "{\"id\":" + String(cmdId) + ",\"secret\":\"" + String(DEVICE_SECRET) + "\",\"status\":\"done\"}";
-    bool ok = sendRawHTTPTCP("POST", path, String(SERVER_HOST), body);
+    bool ok = sendRawHTTPTCP("POST", path, body);
     Serial.printf("[AC] ACK cmd %d: %s\n", cmdId, ok ? "OK" : "FAIL");
     return ok;
 }
@@ -0,0 +1,95 @@
+#ifndef PAYLOAD_WRITER_H
+#define PAYLOAD_WRITER_H
+
+// =====================================================================
+// ヒープ不使用のペイロード書出し  ※親機ファーム/ホスト共用
+// ---------------------------------------------------------------------
+// String += と String(float, 2) の一時オブジェクトで送信JSONを組み立てると、
+// 毎起床ESP32-S3のヒープを断片化させCPU時間も食う。本クラスは書式化結果を
+//   - 呼び出し側のバッファ（char buf[]）
+//   - シンク関数（CASENDチャンクへ直接 等）
+//   - どこにも書かず長さだけ数える（AT+CASEND/Content-Length を先に確定する1パス目）
+// のいずれかへ直接流す。同じ書出し関数を2回呼べば「長さ確定→本送信」になる。
+// =====================================================================
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <math.h>
+
+typedef void (*PayloadSink)(const char* p, size_t n, void* ctx);
+
+class PayloadWriter {
+public:
+    // 長さ計測のみ
+    PayloadWriter() : _buf(nullptr), _cap(0), _sink(nullptr), _ctx(nullptr), _len(0), _overflow(false) {}
+    // 呼び出し側バッファへ書込（容量不足は ok()==false。余裕があれば終端'\0'も付与）
+    PayloadWriter(char* buf, size_t cap) : _buf(buf), _cap(cap), _sink(nullptr), _ctx(nullptr), _len(0), _overflow(false) {}
+    // シンクへ逐次出力
+    PayloadWriter(PayloadSink sink, void* ctx) : _buf(nullptr), _cap(0), _sink(sink), _ctx(ctx), _len(0), _overflow(false) {}
+
+    PayloadWriter& raw(const char* s, size_t n) {
+        if (_sink) {
+            _sink(s, n, _ctx);
+        } else if (_buf) {
+            if (_len + n > _cap) { _overflow = true; return *this; }
+            memcpy(_buf + _len, s, n);
+            if (_len + n < _cap) _buf[_len + n] = '\0';
+        }
+        _len += n;
+        return *this;
+    }
+
+    PayloadWriter& str(const char* s) { return raw(s, strlen(s)); }
+
+    // 整数（10進）。int64_t で受けるので uint32_t の 2^31 以上も負にならない
+    PayloadWriter& num(int64_t v) {
+        char t[21]; int n = 0;
+        uint64_t u = (v < 0) ? 0ULL - (uint64_t)v : (uint64_t)v;
+        while (u > 0xFFFFFFFFULL) { t[20 - n++] = '0' + (char)(u % 10); u /= 10; }
+        uint32_t u32 = (uint32_t)u;   // 32bit に収まる分は32bit除算で（ESP32の64bit除算はライブラリ呼出し）
+        do { t[20 - n++] = '0' + (u32 % 10); u32 /= 10; } while (u32);
+        if (v < 0) t[20 - n++] = '-';
+        return raw(t + 21 - n, n);
+    }
+
+    // 固定小数点（String(v, decimals) 相当）。NaNは0、±inf・範囲外はスケール後 ±2e9 に丸める（cborFixed と同じ）
+    PayloadWriter& fixed(float v, uint8_t decimals) {
+        static const int32_t kScale[] = {1, 10, 100, 1000};
+        if (decimals > 3) decimals = 3;
+        float x = isnan(v) ? 0.0f : v * kScale[decimals];
+        if (x > 2.0e9f) x = 2.0e9f;
+        if (x < -2.0e9f) x = -2.0e9f;
+        int32_t scaled = (int32_t)lroundf(x);
+        bool neg = scaled < 0;
+        uint32_t a = neg ? 0u - (uint32_t)scaled : (uint32_t)scaled;
+        if (neg) raw("-", 1);
+        num(a / kScale[decimals]);
+        if (decimals == 0) return *this;
+        char f[4]; uint32_t frac = a % kScale[decimals];
+        for (int i = decimals - 1; i >= 0; i--) { f[i] = '0' + (frac % 10); frac /= 10; }
+        raw(".", 1);
+        return raw(f, decimals);
+    }
+
+    // 8桁小文字16進（子機ID "%08x" 相当）
+    PayloadWriter& hex8(uint32_t v) {
+        static const char kHex[] = "0123456789abcdef";
+        char t[8];
+        for (int i = 7; i >= 0; i--) { t[i] = kHex[v & 0xF]; v >>= 4; }
+        return raw(t, 8);
+    }
+
+    size_t length() const { return _len; }
+    bool ok() const { return !_overflow; }
+
+private:
+    char* _buf;
+    size_t _cap;
+    PayloadSink _sink;
+    void* _ctx;
+    size_t _len;
+    bool _overflow;
+};
+
+#endif // PAYLOAD_WRITER_H
@@ -0,0 +1,71 @@
+#ifndef PSM_TIMER_H
+#define PSM_TIMER_H
+
+// =====================================================================
+// PSMタイマ（3GPP TS 24.008 GPRS Timer 2/3）の符号化・復号  ※親機ファーム/ホスト共用
+// ---------------------------------------------------------------------
+// AT+CPSMS の要求値と +CEREG: 4,... の付与値は "010 00110" のような8桁2進文字列
+// （上位3ビット=単位, 下位5ビット=値 0..31）。
+//   T3412(拡張, GPRS Timer 3): 周期TAU。この間はネットワークに登録が保持される
+//   T3324(GPRS Timer 2)      : アクティブ時間。RRC解放後この時間だけ着信待ちしてPSMへ
+// 要求は「指定秒数以上で最小の表現」に切り上げる（ネットワークは付与値を変えてよい）。
+// =====================================================================
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define PSM_TIMER_DEACTIVATED 0xFFFFFFFFUL
+
+// 単位ビット → 秒（0=非対応/停止）
+inline uint32_t psmT3412UnitSec(uint8_t unit) {
+    static const uint32_t k[8] = { 600, 3600, 36000, 2, 30, 60, 1152000, 0 };
+    return k[unit & 7];
+}
+inline uint32_t psmT3324UnitSec(uint8_t unit) {
+    static const uint32_t k[8] = { 2, 60, 360, 0, 0, 0, 0, 0 };
+    return k[unit & 7];
+}
+
+// 秒数 → 8桁2進文字列（out は9バイト以上）。表現できない長さは最大値に丸める
+inline void psmEncode(uint32_t sec, uint32_t (*unitSec)(uint8_t), char* out) {
+    uint8_t bestUnit = 0, bestVal = 31;
+    uint32_t best = 0;
+    if (sec == 0) sec = 1;
+    for (uint8_t u = 0; u < 7; u++) {
+        uint32_t us = unitSec(u);
+        if (us == 0) continue;
+        uint32_t v = (sec + us - 1) / us;
+        if (v > 31) continue;
+        uint32_t t = v * us;
+        if (best == 0 || t < best) { best = t; bestUnit = u; bestVal = (uint8_t)v; }
+    }
+    if (best == 0) {
+        // 最大の単位で値31
+        for (uint8_t u = 0; u < 7; u++)
+            if (unitSec(u) > unitSec(bestUnit)) bestUnit = u;
+        bestVal = 31;
+    }
+    uint8_t b = (uint8_t)(bestUnit << 5) | bestVal;
+    for (int i = 0; i < 8; i++) out[i] = (b & (0x80 >> i)) ? '1' : '0';
+    out[8] = '\0';
+}
+
+inline void psmEncodeT3412(uint32_t sec, char* out) { psmEncode(sec, psmT3412UnitSec, out); }
+inline void psmEncodeT3324(uint32_t sec, char* out) { psmEncode(sec, psmT3324UnitSec, out); }
+
+// 8桁2進文字列 → 秒。停止は PSM_TIMER_DEACTIVATED、不正な文字列は 0
+inline uint32_t psmDecode(const char* s, uint32_t (*unitSec)(uint8_t)) {
+    uint8_t b = 0;
+    for (int i = 0; i < 8; i++) {
+        if (s[i] != '0' && s[i] != '1') return 0;
+        b = (uint8_t)((b << 1) | (s[i] - '0'));
+    }
+    uint32_t us = unitSec(b >> 5);
+    if (us == 0) return PSM_TIMER_DEACTIVATED;
+    return (b & 0x1F) * us;
+}
+
+inline uint32_t psmDecodeT3412(const char* s) { return psmDecode(s, psmT3412UnitSec); }
+inline uint32_t psmDecodeT3324(const char* s) { return psmDecode(s, psmT3324UnitSec); }
+
+#endif // PSM_TIMER_H
@@ -0,0 +1,115 @@
+#ifndef RAT_SELECT_H
+#define RAT_SELECT_H
+
+// =====================================================================
+// Cat-M1 / NB-IoT の選択（送信1バイトあたりのエネルギーで比較）  ※親機ファーム/ホスト共用
+// ---------------------------------------------------------------------
+// LTE起床ごとに「実際に在圏したRAT」「アタッチ時間」「HTTP送受信時間」「送受信バイト」を
+// ratRecord() し、RAT毎の µJ/byte を指数移動平均で持つ。エネルギーはモデム電流を実測できない
+// ため 時間×RAT別の平均電流(設定値)×電源電圧 で見積もる。
+// ratNextMode() が次回アタッチの AT+CMNB 値（1=Cat-M1, 2=NB-IoT, 3=両方）を返す:
+//   - 未計測のRATを試す（失敗したら再評価周期まで待つ）
+//   - 連続失敗が上限に達したRATは使わない。ただし再評価周期ごとに1回だけ試し直す
+//     （失敗数を上限の1つ手前へ戻す。成功すれば復帰、また失敗すれば次の周期まで締め出す）
+//   - 両方計測済みで差が小さければ「両方」（モデムに任せ、片方圏外時の保険にする）
+//   - それ以外は安い方。reevalEvery 回ごとに他方を1回試して再評価する
+// 構造体はRTCメモリに置く前提のPOD（ゼロ初期化で未計測状態）。
+// =====================================================================
+
+#include <stdint.h>
+
+enum RatId : uint8_t { RAT_CATM = 0, RAT_NBIOT = 1, RAT_COUNT = 2, RAT_UNKNOWN = 0xFF };
+
+#define RAT_CMNB_CATM  1
+#define RAT_CMNB_NBIOT 2
+#define RAT_CMNB_BOTH  3
+
+struct RatStats {
+    float ujPerByte[RAT_COUNT];   // µJ/byte の指数移動平均（0=未計測）
+    uint16_t samples[RAT_COUNT];
+    uint8_t failures[RAT_COUNT];  // 連続アタッチ失敗回数（成功で0）
+    uint16_t sinceProbe;          // 前回の再評価からのLTE起床回数
+    uint8_t mode;                 // 現在の CMNB 値（0=未決定）
+};
+
+inline uint8_t ratCmnb(uint8_t rat) { return rat == RAT_NBIOT ? RAT_CMNB_NBIOT : RAT_CMNB_CATM; }
+
+// エネルギー見積り µJ = ms × mA × V
+inline float ratEnergyUj(uint32_t ms, float mA, float volts) { return (float)ms * mA * volts; }
+
+/**
+ * 1回のLTE起床の計測を記録（rat=在圏したRAT。bytes=送受信合計）
+ */
+inline void ratRecord(RatStats& s, uint8_t rat, float energyUj, uint32_t bytes) {
+    if (rat >= RAT_COUNT || bytes == 0) return;
+    float v = energyUj / (float)bytes;
+    s.ujPerByte[rat] = (s.samples[rat] == 0) ? v : s.ujPerByte[rat] * 0.7f + v * 0.3f;
+    if (s.samples[rat] < 0xFFFF) s.samples[rat]++;
+    s.failures[rat] = 0;
+}
+
+// アタッチ失敗を記録（mode で試したRAT。両方モードなら両方に数える）
+inline void ratRecordFailure(RatStats& s, uint8_t mode) {
+    if ((mode == RAT_CMNB_CATM || mode == RAT_CMNB_BOTH) && s.failures[RAT_CATM] < 0xFF) s.failures[RAT_CATM]++;
+    if ((mode == RAT_CMNB_NBIOT || mode == RAT_CMNB_BOTH) && s.failures[RAT_NBIOT] < 0xFF) s.failures[RAT_NBIOT]++;
+}
+
+/**
+ * 次回アタッチの CMNB 値を決める
+ * maxFailures: これ以上連続失敗したRATは再評価周期の試し直しまで試行/選択しない
+ * bothMargin : 両RATの差がこの比率以内なら「両方」
+ */
+inline uint8_t ratNextMode(RatStats& s, uint16_t reevalEvery, uint8_t maxFailures, float bothMargin) {
+    if (s.sinceProbe < 0xFFFF) s.sinceProbe++;
+
+    // 締め出したRATの試し直し（一時的な圏外・基地局保守で恒久に外さない）。
+    // 片方だけならそのRATで、両方なら両方許可でアタッチする
+    if (s.mode != 0 && maxFailures > 0 && reevalEvery > 0 && s.sinceProbe >= reevalEvery) {
+        bool locked[RAT_COUNT];
+        for (int r = 0; r < RAT_COUNT; r++) {
+            locked[r] = s.failures[r] >= maxFailures;
+            if (locked[r]) s.failures[r] = maxFailures - 1;
+        }
+        if (locked[RAT_CATM] || locked[RAT_NBIOT]) {
+            s.sinceProbe = 0;
+            s.mode = locked[RAT_CATM] && locked[RAT_NBIOT] ? RAT_CMNB_BOTH
+                   : ratCmnb(locked[RAT_CATM] ? RAT_CATM : RAT_NBIOT);
+            return s.mode;
+        }
+    }
+
+    bool usable[RAT_COUNT];
+    for (int r = 0; r < RAT_COUNT; r++) usable[r] = s.failures[r] < maxFailures;
+
+    // 最初は従来通り Cat-M1
+    if (s.mode == 0) { s.mode = RAT_CMNB_CATM; return s.mode; }
+
+    // 使える方が片方だけならそれに固定（両方使えなければ従来の Cat-M1）
+    if (!usable[RAT_CATM] || !usable[RAT_NBIOT]) {
+        s.mode = usable[RAT_NBIOT] && !usable[RAT_CATM] ? RAT_CMNB_NBIOT : RAT_CMNB_CATM;
+        return s.mode;
+    }
+
+    // 未計測のRATを試す（失敗後は再評価周期まで待つ） / 周期的に他方を試して再評価
+    for (int r = 0; r < RAT_COUNT; r++) {
+        if (s.samples[r] > 0) continue;
+        if (s.failures[r] == 0 || s.sinceProbe >= reevalEvery) {
+            s.mode = ratCmnb(r); s.sinceProbe = 0; return s.mode;
+        }
+        s.mode = ratCmnb(r == RAT_CATM ? RAT_NBIOT : RAT_CATM);
+        return s.mode;
+    }
+    uint8_t best = (s.ujPerByte[RAT_NBIOT] < s.ujPerByte[RAT_CATM]) ? RAT_NBIOT : RAT_CATM;
+    uint8_t other = best == RAT_CATM ? RAT_NBIOT : RAT_CATM;
+    if (reevalEvery > 0 && s.sinceProbe >= reevalEvery) {
+        s.sinceProbe = 0;
+        s.mode = ratCmnb(other);
+        return s.mode;
+    }
+
+    float lo = s.ujPerByte[best], hi = s.ujPerByte[other];
+    s.mode = (hi - lo <= lo * bothMargin) ? RAT_CMNB_BOTH : ratCmnb(best);
+    return s.mode;
+}
+
+#endif // RAT_SELECT_H
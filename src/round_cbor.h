@@ -0,0 +1,418 @@
+#ifndef ROUND_CBOR_H
+#define ROUND_CBOR_H
+
+// =====================================================================
+// 蓄積ラウンドのCBOR(RFC 8949)バッチエンコーダ/参照デコーダ  ※親機ファーム/ホスト共用
+// ---------------------------------------------------------------------
+// JSONはラウンド×子機ごとにフィールド名と "%.2f" 文字列を繰り返すため、子機8台で
+// 1ラウンド数百バイトになる。CBOR版はキーを整数化し、値を固定小数点の整数で送る。
+// Content-Type: application/cbor で送り、サーバはJSON/CBORの両方を受け付ける。
+//
+// 配列の位置で読むフィールド（round・キー5/6/10/11 の要素）を足したら ROUND_CBOR_SCHEMA_VERSION を上げ、
+// サーバ（foxsense-api src/utils/roundCbor.js）の版別の読み方も同時に足す。
+//   v1: キー0-4、round は seq なしの8要素
+//   v2: キー5(21要素)〜11、round の9要素目 seq
+//
+// スキーマ v2（数値は全て整数。温湿度×100, 気圧×10。NaN は0、範囲外は丸める）:
+//   batch = map {
+//     0: 2                    スキーマバージョン
+//     1: "6C265A30"           parent_id
+//     2: "xxxxxxxx-..."       secret
+//     3: boot_count
+//     4: [round, ...]
+//     5: [resumed, attaches, resumes, prep_ms, ttfb_ms, reg_ms, band, band_scope, rat, tls, opens, open_ms,
+//         up_transport, up_bytes, up_ms, up_retx, rsrp, rsrq, verdict, defers, defer_rsrp]   LTE接続計測（任意）
+//     6: [wake, start_ms, total_ms, [[planned_ds, actual_ds, status], ...]]  直近LTE起床の工程記録（任意）
+//     7: fw_code              稼働中ファーム（応答ヒントのOTA判定用。任意）
+//     8: "etag"               保持中の設定ETag（引用符なし。応答ヒントの設定変更判定用。任意）
+//     9: [[ac_id, ts], ...]   前回の応答ヒントで実行したACコマンドの完了通知（任意）
+//    10: [epoch, have_from]   ラウンド通番の範囲（任意。round_data.h BatchSeq）
+//    11: [tier, changes, charging]  電池残量による動作段階（任意。round_data.h EnergyReport）
+//   }
+//   round = [ts(unix秒), pTemp, pHumid, pPres, pBat, pVbus, pSignal, [child, ...], seq]
+//   child = [id, 1, temp, humid, pres, rssi, bat]   受信あり
+//         | [id, 0]                                  未受信(値は送らない)
+//   ts は親機RTCの time_t（JST壁時計をUTCとして数えた秒。JSON版の "+09:00" 表記と同じ基準）
+//   キー6の工程は WakePhase 順（wake_schedule.h）。時間は0.1秒単位、status は PhaseStatus
+//   エンベロープの報告はどれも round_data.h の構造体で受け取る（工程/電池の方針ヘッダには依存しない）
+// =====================================================================
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <math.h>
+#include "round_data.h"
+
+#define ROUND_CBOR_SCHEMA_VERSION 2
+// n ラウンドのバッチが取りうる最大バイト数（エンベロープ + ラウンド毎の最悪長）
+#define ROUND_CBOR_MAX_BYTES(n) (312 + (n) * (48 + 26 * MAX_CHILD_DEVICES))
+
+// エンベロープの付帯情報（キー7-9。サーバは応答の hints を決めるのに使う）
+struct BatchMeta {
+    uint32_t fwCode;
+    const char* configEtag;   // nullptr/空 = 保持なし
+    uint32_t acAckId;         // 0 = 完了通知なし
+    time_t acAckAt;           // 実行時刻（ts と同じ基準）
+};
+
+// ---- エンコーダ: buf=nullptr なら長さだけ数える(2パスで事前に長さを確定できる) ----
+class CborWriter {
+public:
+    CborWriter(uint8_t* buf, size_t cap) : _buf(buf), _cap(cap), _len(0), _overflow(false) {}
+
+    void unum(uint64_t v)         { head(0, v); }
+    void snum(int64_t v)          { if (v >= 0) head(0, (uint64_t)v); else head(1, (uint64_t)(-1 - v)); }
+    void text(const char* s)      { size_t n = strlen(s); head(3, n); put((const uint8_t*)s, n); }
+    void array(size_t n)          { head(4, n); }
+    void map(size_t n)            { head(5, n); }
+
+    size_t length() const { return _len; }
+    bool ok() const { return !_overflow; }
+
+private:
+    uint8_t* _buf;
+    size_t _cap, _len;
+    bool _overflow;
+
+    void head(uint8_t major, uint64_t v) {
+        uint8_t h[9]; size_t n;
+        major <<= 5;
+        if (v < 24)               { h[0] = major | (uint8_t)v; n = 1; }
+        else if (v <= 0xFF)       { h[0] = major | 24; h[1] = (uint8_t)v; n = 2; }
+        else if (v <= 0xFFFF)     { h[0] = major | 25; h[1] = v >> 8; h[2] = v; n = 3; }
+        else if (v <= 0xFFFFFFFF) { h[0] = major | 26; for (int i = 0; i < 4; i++) h[1 + i] = v >> (24 - 8 * i); n = 5; }
+        else                      { h[0] = major | 27; for (int i = 0; i < 8; i++) h[1 + i] = v >> (56 - 8 * i); n = 9; }
+        put(h, n);
+    }
+
+    void put(const uint8_t* p, size_t n) {
+        if (_buf) {
+            if (_len + n > _cap) { _overflow = true; return; }
+            memcpy(_buf + _len, p, n);
+        }
+        _len += n;
+    }
+};
+
+// ---- デコーダ（参照実装。不正/切り詰めデータは false） ----
+class CborReader {
+public:
+    CborReader(const uint8_t* p, size_t n) : _p(p), _end(p + n) {}
+
+    bool head(uint8_t& major, uint64_t& v) {
+        if (_p >= _end) return false;
+        uint8_t ib = *_p++;
+        major = ib >> 5;
+        uint8_t ai = ib & 0x1F;
+        if (ai < 24) { v = ai; return true; }
+        int n = (ai == 24) ? 1 : (ai == 25) ? 2 : (ai == 26) ? 4 : (ai == 27) ? 8 : -1;
+        if (n < 0 || _end - _p < n) return false;   // 不定長(31)は非対応
+        v = 0;
+        while (n--) v = (v << 8) | *_p++;
+        return true;
+    }
+
+    bool integer(int64_t& out) {
+        uint8_t m; uint64_t v;
+        if (!head(m, v)) return false;
+        if (m == 0) { out = (int64_t)v; return true; }
+        if (m == 1) { out = -1 - (int64_t)v; return true; }
+        return false;
+    }
+
+    bool container(uint8_t major, uint64_t& n) {
+        uint8_t m;
+        return head(m, n) && m == major;
+    }
+
+    // text(3)/bytes(2) を最大 cap-1 文字コピー（終端付与）
+    bool text(char* out, size_t cap) {
+        uint8_t m; uint64_t n;
+        if (!head(m, n) || (m != 3 && m != 2) || (uint64_t)(_end - _p) < n) return false;
+        size_t c = (n < cap - 1) ? (size_t)n : cap - 1;
+        memcpy(out, _p, c); out[c] = '\0';
+        _p += n;
+        return true;
+    }
+
+    // 未知キーの値を1要素読み飛ばす
+    bool skip() {
+        uint8_t m; uint64_t v;
+        if (!head(m, v)) return false;
+        switch (m) {
+            case 0: case 1: case 7: return true;
+            case 2: case 3: if ((uint64_t)(_end - _p) < v) return false; _p += v; return true;
+            case 4: for (uint64_t i = 0; i < v; i++) if (!skip()) return false; return true;
+            case 5: for (uint64_t i = 0; i < v * 2; i++) if (!skip()) return false; return true;
+            case 6: return skip();
+        }
+        return false;
+    }
+
+    bool atEnd() const { return _p == _end; }
+
+private:
+    const uint8_t* _p;
+    const uint8_t* _end;
+};
+
+// 固定小数点化（PayloadWriter::fixed と同じく NaN は0。±∞/範囲外は int32 に収まるよう丸める）
+inline int32_t cborFixed(float v, int scale) {
+    if (isnan(v)) return 0;
+    float x = v * scale;
+    if (x > 2.0e9f) return 2000000000;
+    if (x < -2.0e9f) return -2000000000;
+    return (int32_t)lroundf(x);
+}
+
+/**
+ * 1ラウンドを round 配列として書く（バッチのキー4の要素。round_log.h のレコードも同じ形）
+ */
+inline void cborWriteRound(CborWriter& w, const RtcRound& r) {
+    w.array(9);
+    w.unum((uint64_t)r.ts);
+    w.snum(cborFixed(r.pTemp, 100));
+    w.snum(cborFixed(r.pHumid, 100));
+    w.snum(cborFixed(r.pPres, 10));
+    w.snum(r.pBat);
+    w.snum(r.pVbus);
+    w.snum(r.pSignal);
+    w.array(r.childCount);
+    for (int j = 0; j < r.childCount; j++) {
+        const RtcChild& c = r.child[j];
+        if (!c.received) { w.array(2); w.unum(c.id); w.unum(0); continue; }
+        w.array(7);
+        w.unum(c.id);
+        w.unum(1);
+        w.snum(cborFixed(c.temp, 100));
+        w.snum(cborFixed(c.humid, 100));
+        w.snum(cborFixed(c.pres, 10));
+        w.snum(c.rssi);
+        w.unum(c.bat);
+    }
+    w.unum(r.seq);
+}
+
+/**
+ * round 配列を1つ読む（子機上限超過分・将来の追加フィールドは読み飛ばす）
+ */
+inline bool cborReadRound(CborReader& rd, RtcRound& r) {
+    memset(&r, 0, sizeof(r));
+    uint64_t nf;
+    int64_t f[7], v;
+    if (!rd.container(4, nf) || nf < 8) return false;
+    for (int j = 0; j < 7; j++) if (!rd.integer(f[j])) return false;
+    r.ts = (time_t)f[0];
+    r.pTemp = f[1] / 100.0f; r.pHumid = f[2] / 100.0f; r.pPres = f[3] / 10.0f;
+    r.pBat = (int)f[4]; r.pVbus = (int)f[5]; r.pSignal = (int)f[6];
+    uint64_t nc;
+    if (!rd.container(4, nc)) return false;
+    for (uint64_t j = 0; j < nc; j++) {
+        uint64_t cf; int64_t id, rcv;
+        if (!rd.container(4, cf) || cf < 2 || !rd.integer(id) || !rd.integer(rcv)) return false;
+        RtcChild tmp; memset(&tmp, 0, sizeof(tmp));
+        RtcChild& c = (r.childCount < MAX_CHILD_DEVICES) ? r.child[r.childCount++] : tmp;
+        c.id = (uint32_t)id;
+        c.received = rcv != 0;
+        if (cf >= 7) {
+            int64_t t, h, p, rs, b;
+            if (!rd.integer(t) || !rd.integer(h) || !rd.integer(p) ||
+                !rd.integer(rs) || !rd.integer(b)) return false;
+            c.temp = t / 100.0f; c.humid = h / 100.0f; c.pres = p / 10.0f;
+            c.rssi = (int8_t)rs; c.bat = (uint8_t)b;
+            cf -= 5;
+        }
+        for (uint64_t x = 2; x < cf; x++) if (!rd.skip()) return false;  // 将来の追加フィールド
+    }
+    if (nf >= 9) { if (!rd.integer(v)) return false; r.seq = (uint32_t)v; }
+    for (uint64_t x = 9; x < nf; x++) if (!rd.skip()) return false;
+    return true;
+}
+
+/**
+ * 蓄積ラウンド群をCBORバッチに直列化。buf=nullptr で長さのみ計算。
+ * 戻り値=バイト数（0=容量不足）
+ */
+inline size_t cborEncodeBatch(uint8_t* buf, size_t cap, const char* parentId, const char* secret,
+                              uint32_t bootCount, const RtcRound* rounds, int count,
+                              const LinkStats* link = nullptr, const WakeCycleLog* cycle = nullptr,
+                              const BatchMeta* meta = nullptr, const BatchSeq* seq = nullptr,
+                              const EnergyReport* energy = nullptr) {
+    CborWriter w(buf, cap);
+    bool etag = meta && meta->configEtag && meta->configEtag[0];
+    bool ack = meta && meta->acAckId;
+    w.map(5 + (link ? 1 : 0) + (cycle ? 1 : 0) + (meta ? 1 : 0) + (etag ? 1 : 0) + (ack ? 1 : 0) + (seq ? 1 : 0) + (energy ? 1 : 0));
+    w.unum(0); w.unum(ROUND_CBOR_SCHEMA_VERSION);
+    w.unum(1); w.text(parentId);
+    w.unum(2); w.text(secret);
+    w.unum(3); w.unum(bootCount);
+    w.unum(4); w.array(count);
+    for (int i = 0; i < count; i++) cborWriteRound(w, rounds[i]);
+    if (link) {
+        w.unum(5); w.array(21);
+        w.unum(link->resumed ? 1 : 0);
+        w.unum(link->attaches);
+        w.unum(link->resumes);
+        w.unum(link->prepMs);
+        w.unum(link->ttfbMs);
+        w.unum(link->regMs);
+        w.unum(link->band);
+        w.unum(link->bandScope);
+        w.unum(link->rat);
+        w.unum(link->tls ? 1 : 0);
+        w.unum(link->opens);
+        w.unum(link->openMs);
+        w.unum(link->upTransport);
+        w.unum(link->upBytes);
+        w.unum(link->upMs);
+        w.unum(link->upRetx);
+        w.snum(link->rsrp);
+        w.snum(link->rsrq);
+        w.unum(link->verdict);
+        w.unum(link->defers);
+        w.snum(link->deferRsrp);
+    }
+    if (cycle) {
+        w.unum(6); w.array(4);
+        w.unum(cycle->wake);
+        w.snum(cycle->startMs);
+        w.unum(cycle->totalMs);
+        w.array(WAKE_PHASE_COUNT);
+        for (int i = 0; i < WAKE_PHASE_COUNT; i++) {
+            const PhaseRecord& p = cycle->phase[i];
+            w.array(3); w.unum(p.plannedDs); w.unum(p.actualDs); w.unum(p.status);
+        }
+    }
+    if (meta) { w.unum(7); w.unum(meta->fwCode); }
+    if (etag) { w.unum(8); w.text(meta->configEtag); }
+    if (ack) {
+        w.unum(9); w.array(1);
+        w.array(2); w.unum(meta->acAckId); w.unum((uint64_t)meta->acAckAt);
+    }
+    if (seq) { w.unum(10); w.array(2); w.unum(seq->epoch); w.unum(seq->haveFrom); }
+    if (energy) { w.unum(11); w.array(3); w.unum(energy->tier); w.unum(energy->changes); w.unum(energy->charging ? 1 : 0); }
+    return w.ok() ? w.length() : 0;
+}
+
+// 参照デコーダの出力（エンベロープ部）
+struct CborBatchHeader {
+    uint32_t version;
+    char parentId[16];
+    char secret[48];
+    uint32_t bootCount;
+    int roundCount;          // 格納したラウンド数
+    bool hasLink;            // キー5（LTE接続計測）あり
+    LinkStats link;
+    bool hasCycle;           // キー6（工程記録）あり
+    WakeCycleLog cycle;
+    uint32_t fwCode;         // キー7（0=なし）
+    char configEtag[40];     // キー8（空=なし）
+    uint32_t acAckId;        // キー9 の先頭（0=なし）
+    time_t acAckAt;
+    BatchSeq seq;            // キー10（epoch=0 はなし）
+    bool hasEnergy;          // キー11（動作段階）あり
+    EnergyReport energy;
+};
+
+/**
+ * CBORバッチを復号（サーバ実装・検証用の参照デコーダ）。
+ * rounds[] に最大 maxRounds 件を格納し、超過分/子機上限超過分は読み飛ばす。
+ */
+inline bool cborDecodeBatch(const uint8_t* data, size_t len, CborBatchHeader& hdr,
+                            RtcRound* rounds, int maxRounds) {
+    CborReader rd(data, len);
+    memset(&hdr, 0, sizeof(hdr));
+    uint64_t nkeys;
+    if (!rd.container(5, nkeys)) return false;
+    for (uint64_t k = 0; k < nkeys; k++) {
+        int64_t key, v;
+        if (!rd.integer(key)) return false;
+        switch (key) {
+            case 0: if (!rd.integer(v)) return false; hdr.version = (uint32_t)v; break;
+            case 1: if (!rd.text(hdr.parentId, sizeof(hdr.parentId))) return false; break;
+            case 2: if (!rd.text(hdr.secret, sizeof(hdr.secret))) return false; break;
+            case 3: if (!rd.integer(v)) return false; hdr.bootCount = (uint32_t)v; break;
+            case 4: {
+                uint64_t nr;
+                if (!rd.container(4, nr)) return false;
+                for (uint64_t i = 0; i < nr; i++) {
+                    if (i >= (uint64_t)maxRounds) { if (!rd.skip()) return false; continue; }
+                    if (!cborReadRound(rd, rounds[hdr.roundCount++])) return false;
+                }
+                break;
+            }
+            case 5: {
+                uint64_t nf; int64_t f[21] = {0, 0, 0, 0, 0, 0, 0, 0, 0xFF};
+                if (!rd.container(4, nf) || nf < 5) return false;
+                for (uint64_t j = 0; j < nf; j++) {
+                    if (j < 21) { if (!rd.integer(f[j])) return false; }
+                    else if (!rd.skip()) return false;
+                }
+                hdr.hasLink = true;
+                hdr.link.resumed = f[0] != 0;
+                hdr.link.attaches = (uint32_t)f[1]; hdr.link.resumes = (uint32_t)f[2];
+                hdr.link.prepMs = (uint32_t)f[3]; hdr.link.ttfbMs = (uint32_t)f[4];
+                hdr.link.regMs = (uint32_t)f[5]; hdr.link.band = (uint8_t)f[6];
+                hdr.link.bandScope = (uint8_t)f[7]; hdr.link.rat = (uint8_t)f[8];
+                hdr.link.tls = f[9] != 0; hdr.link.opens = (uint8_t)f[10]; hdr.link.openMs = (uint32_t)f[11];
+                hdr.link.upTransport = (uint8_t)f[12]; hdr.link.upBytes = (uint32_t)f[13];
+                hdr.link.upMs = (uint32_t)f[14]; hdr.link.upRetx = (uint8_t)f[15];
+                hdr.link.rsrp = (int16_t)f[16]; hdr.link.rsrq = (int8_t)f[17]; hdr.link.verdict = (uint8_t)f[18];
+                hdr.link.defers = (uint8_t)f[19]; hdr.link.deferRsrp = (int16_t)f[20];
+                break;
+            }
+            case 6: {
+                uint64_t nf, np; int64_t wake, start, total;
+                if (!rd.container(4, nf) || nf < 4 || !rd.integer(wake) || !rd.integer(start) ||
+                    !rd.integer(total) || !rd.container(4, np)) return false;
+                hdr.hasCycle = true;
+                hdr.cycle.wake = (uint32_t)wake;
+                hdr.cycle.startMs = (int32_t)start;
+                hdr.cycle.totalMs = (uint32_t)total;
+                for (uint64_t i = 0; i < np; i++) {
+                    uint64_t pf; int64_t pl, ac, st;
+                    if (!rd.container(4, pf) || pf < 3 || !rd.integer(pl) || !rd.integer(ac) ||
+                        !rd.integer(st)) return false;
+                    for (uint64_t x = 3; x < pf; x++) if (!rd.skip()) return false;
+                    if (i >= WAKE_PHASE_COUNT) continue;   // 将来の追加工程
+                    hdr.cycle.phase[i] = PhaseRecord{(uint16_t)pl, (uint16_t)ac, (uint8_t)st};
+                }
+                for (uint64_t x = 4; x < nf; x++) if (!rd.skip()) return false;
+                break;
+            }
+            case 7: if (!rd.integer(v)) return false; hdr.fwCode = (uint32_t)v; break;
+            case 8: if (!rd.text(hdr.configEtag, sizeof(hdr.configEtag))) return false; break;
+            case 9: {
+                uint64_t na;
+                if (!rd.container(4, na)) return false;
+                for (uint64_t i = 0; i < na; i++) {
+                    uint64_t af; int64_t id, ts;
+                    if (!rd.container(4, af) || af < 2 || !rd.integer(id) || !rd.integer(ts)) return false;
+                    for (uint64_t x = 2; x < af; x++) if (!rd.skip()) return false;
+                    if (i == 0) { hdr.acAckId = (uint32_t)id; hdr.acAckAt = (time_t)ts; }
+                }
+                break;
+            }
+            case 10: {
+                uint64_t ns; int64_t ep, from;
+                if (!rd.container(4, ns) || ns < 2 || !rd.integer(ep) || !rd.integer(from)) return false;
+                for (uint64_t x = 2; x < ns; x++) if (!rd.skip()) return false;
+                hdr.seq.epoch = (uint32_t)ep; hdr.seq.haveFrom = (uint32_t)from;
+                break;
+            }
+            case 11: {
+                uint64_t ne; int64_t tier, changes, charging;
+                if (!rd.container(4, ne) || ne < 3 || !rd.integer(tier) || !rd.integer(changes) ||
+                    !rd.integer(charging)) return false;
+                for (uint64_t x = 3; x < ne; x++) if (!rd.skip()) return false;
+                hdr.hasEnergy = true;
+                hdr.energy.tier = (uint8_t)tier; hdr.energy.changes = (uint16_t)changes; hdr.energy.charging = charging != 0;
+                break;
+            }
+            default: if (!rd.skip()) return false;   // 将来の追加キー
+        }
+    }
+    return rd.atEnd();
+}
+
+#endif // ROUND_CBOR_H
@@ -0,0 +1,89 @@
+#ifndef ROUND_DATA_H
+#define ROUND_DATA_H
+
+// =====================================================================
+// 蓄積ラウンド（20分毎の計測1回分: 親機＋子機）のデータ構造  ※親機ファーム/ホスト共用
+// ---------------------------------------------------------------------
+// 親機は計測毎に1ラウンドをRTCメモリへ蓄積し、LTE起床時にまとめてサーバへ送る。
+// 送信エンコード(JSON / CBOR)の両方がこの構造体を入力とする。
+// =====================================================================
+
+#include <stdint.h>
+#include <time.h>
+#include "config.h"
+
+struct RtcChild {
+    uint32_t id; bool received;
+    float temp, humid, pres; int8_t rssi; uint8_t bat; uint8_t lid;
+};
+struct RtcRound {
+    uint32_t seq;          // ラウンド通番（roundEpoch 内で1からの連番。サーバの重複判定・連続ACKのキー）
+    time_t ts;
+    float pTemp, pHumid, pPres; int pBat; int pVbus; int pSignal;
+    uint8_t childCount;
+    RtcChild child[MAX_CHILD_DEVICES];
+};
+
+// ラウンド通番の範囲（全リクエストに載せる）。電源投入で通番が1に戻るので epoch で区別し、
+// サーバは (parent, epoch, seq) で重複を判定して、haveFrom から連続して受け取った最大の seq を返す
+struct BatchSeq {
+    uint32_t epoch;        // 電源投入毎の乱数（31bit, 0以外）
+    uint32_t haveFrom;     // 親機が保持している最古ラウンドの seq
+};
+
+// LTE接続の計測（バッチ毎に1回だけエンベロープへ載せる。アタッチ/PSM復帰の省電力効果の評価用）
+struct LinkStats {
+    bool resumed;          // 今回の起床はPSMから復帰（再アタッチなし）
+    uint32_t attaches;     // 累計フルアタッチ回数（initModem 成功）
+    uint32_t resumes;      // 累計PSM復帰回数
+    uint32_t prepMs;       // 今回のモデム準備時間（アタッチ or 復帰）
+    uint32_t ttfbMs;       // 直近の起床で最初のHTTP要求→応答到着（CAOPEN含む）
+    uint32_t regMs;        // 今回のネットワーク登録待ち（登録維持なら0）
+    uint8_t band;          // サービングセルのバンド（EUTRAN-BANDn, 0=不明）
+    uint8_t bandScope;     // 登録できた探索範囲 0=学習バンド 1=国内 2=全バンド 3=探索なし
+    uint8_t rat;           // 在圏したRAT 0=Cat-M1 1=NB-IoT 255=不明
+    // 前回のLTE起床のセッション確立（本バッチを送る接続は次回に載る）
+    bool tls;              // セッションはTLS
+    uint8_t opens;         // セッション確立回数（サーバ切断による張り直しを含む）
+    uint32_t openMs;       // その所要の合計（TLSはハンドシェイク込み）
+    // 前回のLTE起床のラウンド送信（HTTP/UDPの比較用。本バッチ自身の送信は次回に載る）
+    uint8_t upTransport;   // 0=HTTP 1=UDP 2=UDP→HTTPへ切替
+    uint8_t upRetx;        // UDP再送データグラム数
+    uint32_t upBytes;      // アプリ層の送受信バイト（HTTPはヘッダ込み、UDPはACK込み）
+    uint32_t upMs;         // 送信開始〜完了（接続確立込み）
+    // 電界と送信見送り（upload_policy.h）。本起床の値
+    int16_t rsrp;          // アタッチ直後の RSRP dBm（0=不明）
+    int8_t rsrq;           // 同 RSRQ dB
+    uint8_t verdict;       // UploadVerdict（本起床で送った理由）
+    uint8_t defers;        // 本送信の前に見送った起床数
+    int16_t deferRsrp;     // 最初に見送った時の RSRP（本起床の rsrp と比べて見送りの当否を見る）
+};
+
+// ---- エンベロープで報告する各所の状態（送信エンコードが読む形。持ち主のヘッダには依存しない） ----
+
+// 起床サイクルの工程数（wake_schedule.h の WakePhase。順序もそちらと同一）
+#define WAKE_PHASE_COUNT 8
+
+// 1工程の予定/実績（0.1秒単位。窓150s・OTA数分も収まる）
+struct PhaseRecord {
+    uint16_t plannedDs;
+    uint16_t actualDs;
+    uint8_t status;        // PhaseStatus（wake_schedule.h）
+};
+
+// 1起床分の工程記録（wake_schedule.h WakeScheduler が書く。RTCに置く前提のPOD）
+struct WakeCycleLog {
+    uint32_t wake;          // wakeCounter
+    int32_t startMs;        // 起床時刻のグリッド境界からのずれ（負=早起き）
+    uint32_t totalMs;       // 起床〜スリープ直前
+    PhaseRecord phase[WAKE_PHASE_COUNT];
+};
+
+// 電池残量による動作段階（energy_governor.h EnergyState から送信時に写す）
+struct EnergyReport {
+    uint8_t tier;          // EnergyTier
+    uint16_t changes;      // 段階が変わった回数
+    bool charging;
+};
+
+#endif // ROUND_DATA_H
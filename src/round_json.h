@@ -0,0 +1,56 @@
+#ifndef ROUND_JSON_H
+#define ROUND_JSON_H
+
+// =====================================================================
+// 蓄積ラウンドのJSON書出し（ingest の "rounds" 要素）  ※親機ファーム/ホスト共用
+// ---------------------------------------------------------------------
+// JSON版の ingest ボディのうちラウンド部分。エンベロープ（fw/cfg/link/cycle 等）は
+// 親機の状態を読むので main.cpp 側で書く。CBOR版（round_cbor.h）と同じ RtcRound を入力とし、
+// ホストでは両エンコードの大きさ・時間の比較に使う（tools/bench/ingest_encoding_bench.cpp）。
+// =====================================================================
+
+#include <time.h>
+#include "payload_writer.h"
+#include "round_data.h"
+
+/**
+ * JST壁時計の time_t を "YYYY-MM-DDTHH:MM:SS+09:00" で書き出す
+ */
+inline void writeJstTimestamp(PayloadWriter& w, time_t ts) {
+    struct tm ti; localtime_r(&ts, &ti);
+    char buf[32];
+    w.raw(buf, strftime(buf, sizeof(buf), "%Y-%m-%dT%H:%M:%S+09:00", &ti));
+}
+
+/**
+ * 蓄積した1ラウンド分（親＋子機）の本体 {"timestamp","parent","children"} を書き出す
+ * (parent_id/secret/boot_count はバッチ共通のエンベロープ側に1回だけ載せる)
+ */
+inline void writeRoundJson(PayloadWriter& w, const RtcRound& r) {
+    w.str("{\"seq\":").num(r.seq);
+    w.str(",\"timestamp\":\""); writeJstTimestamp(w, r.ts); w.str("\",");
+    w.str("\"parent\":{");
+    w.str("\"temperature\":").fixed(r.pTemp, 2).str(",");
+    w.str("\"humidity\":").fixed(r.pHumid, 2).str(",");
+    w.str("\"pressure\":").fixed(r.pPres, 1).str(",");
+    w.str("\"battery\":").num(r.pBat).str(",");
+    w.str("\"vbus_mv\":").num(r.pVbus).str(",");
+    w.str("\"signal\":").num(r.pSignal);
+    w.str("},");
+    w.str("\"children\":[");
+    for (int i = 0; i < r.childCount; i++) {
+        const RtcChild& c = r.child[i];
+        if (i) w.str(",");
+        w.str("{\"device_id\":\"").hex8(c.id).str("\",");
+        w.str("\"temperature\":").fixed(c.temp, 2).str(",");
+        w.str("\"humidity\":").fixed(c.humid, 2).str(",");
+        w.str("\"pressure\":").fixed(c.pres, 1).str(",");
+        w.str("\"rssi\":").num(c.rssi).str(",");
+        w.str("\"battery\":").num(c.bat).str(",");
+        w.str("\"received\":").str(c.received ? "true" : "false");
+        w.str("}");
+    }
+    w.str("]}");
+}
+
+#endif // ROUND_JSON_H
@@ -0,0 +1,311 @@
+#ifndef ROUND_LOG_H
+#define ROUND_LOG_H
+
+// =====================================================================
+// 蓄積ラウンドのフラッシュ退避キュー（追記専用のセグメントログ）  ※親機ファーム/ホスト共用
+// ---------------------------------------------------------------------
+// RTCの蓄積は圧縮表現で MAX_RTC_ROUNDS 件（48件≒16時間。子機が多いと領域で先に頭打ち）で、
+// それを超える圏外や電断で計測が消える。
+// RTCを書込みキャッシュとし、溢れる分をフラッシュ上のログへ退避して数週間分を保持する。
+//
+//   セグメント : 番号順のファイル（segBytes 以下）。末尾へ追記するだけで書換えない。
+//                送信済みになったセグメントは丸ごと消す（同じ場所を書き直さない=摩耗が偏らない）
+//   レコード   : len(2,LE) crc16(2,LE) | CBOR [epoch] + round（round_cbor.h の round 配列と同形）
+//   先頭位置   : メタ2面（m0/m1）に世代番号付きで交互に書き、CRCの合う新しい方を採る
+//
+// 追記は O(1)（末尾位置はRTCに保持。ファイル長と食い違えば途中で切れた書込みとみなし、
+// 次のセグメントから書く）。送信済みの切り詰めはメタ1回（＋済んだセグメント削除）で、件数によらない。
+// 電断からの復帰（roundLogOpen）だけは先頭から読み直して件数と末尾を確かめる:
+//   - 追記中の電断: 末尾レコードの長さ/CRCが合わない → そのセグメントは封じて次から追記
+//   - メタ書込み中の電断: もう1面の旧い先頭が残る → 送信済みを再送しうる（サーバは seq で重複排除）
+//   - 先頭より前のセグメントが消し残り: 開く時に消す
+// 容量（maxSegs セグメント）を超えたら最古のセグメントを捨てる（件数を dropped に数える）。
+// 記憶域は RoundLogIo の関数で差し替える（親機は LittleFS、ホストはメモリ上の模擬）。
+// 状態はRTCに置く前提のPOD（open=false なら roundLogOpen で記憶域から復元）。
+// =====================================================================
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include "round_cbor.h"
+
+#define ROUND_LOG_REC_HEADER 4
+#define ROUND_LOG_REC_MAX (ROUND_LOG_REC_HEADER + 5 + 48 + 26 * MAX_CHILD_DEVICES)
+#define ROUND_LOG_META_BYTES 18
+
+// 記憶域（名前はファイル名。ctx は実装側の任意データ）
+struct RoundLogIo {
+    void* ctx;
+    long (*size)(void* ctx, const char* name);                                          // 無ければ -1
+    size_t (*read)(void* ctx, const char* name, uint32_t off, uint8_t* buf, size_t n);  // 読めたバイト数
+    bool (*append)(void* ctx, const char* name, const uint8_t* p, size_t n);            // 末尾へ追記（無ければ作る）
+    bool (*write)(void* ctx, const char* name, const uint8_t* p, size_t n);             // 内容を置換（メタ用）
+    void (*remove)(void* ctx, const char* name);
+};
+
+struct RoundLogPos {
+    uint32_t seg;
+    uint32_t off;
+};
+
+struct RoundLogState {
+    bool open;
+    uint32_t segBytes;
+    uint16_t maxSegs;
+    RoundLogPos head;           // 最古の未送信レコード
+    RoundLogPos tail;           // 次に追記する位置
+    uint32_t count;             // 未送信レコード数
+    uint32_t headEpoch;         // 先頭レコードの epoch / seq（count=0 なら無効）
+    uint32_t headSeq;
+    uint32_t metaGen;
+    uint32_t dropped;           // 容量超過で捨てたレコード数
+};
+
+inline uint16_t roundLogCrc16(const uint8_t* p, size_t n) {
+    uint16_t crc = 0xFFFF;   // CRC-16/CCITT-FALSE
+    while (n--) {
+        crc ^= (uint16_t)(*p++) << 8;
+        for (int i = 0; i < 8; i++) crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+    }
+    return crc;
+}
+
+inline void roundLogSegName(char* out, size_t cap, uint32_t seg) { snprintf(out, cap, "/rl_s%08x", (unsigned)seg); }
+inline void roundLogMetaName(char* out, size_t cap, int slot) { snprintf(out, cap, "/rl_m%d", slot); }
+
+inline uint32_t roundLogGet32(const uint8_t* p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+inline void roundLogPut32(uint8_t* p, uint32_t v) { p[0] = v; p[1] = v >> 8; p[2] = v >> 16; p[3] = v >> 24; }
+
+enum RoundLogRead : uint8_t {
+    RL_OK = 0,      // 1件読めた
+    RL_SKIP,        // 枠は正しいが中身が読めない（next へ進めて捨てる）
+    RL_BAD,         // 長さ/CRC不一致・セグメント末 → 次のセグメントへ
+    RL_END          // 末尾に達した
+};
+
+/**
+ * pos のレコードを読む（RL_OK/RL_SKIP なら next=次のレコード位置）
+ */
+inline uint8_t roundLogReadAt(const RoundLogState& st, const RoundLogIo& io, RoundLogPos pos,
+                              uint32_t& epoch, RtcRound& r, RoundLogPos& next) {
+    if (pos.seg > st.tail.seg || (pos.seg == st.tail.seg && pos.off >= st.tail.off)) return RL_END;
+    char name[16];
+    roundLogSegName(name, sizeof(name), pos.seg);
+    static uint8_t rec[ROUND_LOG_REC_MAX];   // スタックを食わないよう静的に（呼び出しは1タスクから）
+    if (pos.off + ROUND_LOG_REC_HEADER > st.segBytes ||
+        io.read(io.ctx, name, pos.off, rec, ROUND_LOG_REC_HEADER) != ROUND_LOG_REC_HEADER) return RL_BAD;
+    uint16_t len = (uint16_t)(rec[0] | (rec[1] << 8));
+    uint16_t crc = (uint16_t)(rec[2] | (rec[3] << 8));
+    if (len == 0 || len > ROUND_LOG_REC_MAX - ROUND_LOG_REC_HEADER ||
+        pos.off + ROUND_LOG_REC_HEADER + len > st.segBytes ||
+        io.read(io.ctx, name, pos.off + ROUND_LOG_REC_HEADER, rec + ROUND_LOG_REC_HEADER, len) != len ||
+        roundLogCrc16(rec + ROUND_LOG_REC_HEADER, len) != crc) return RL_BAD;
+    next = { pos.seg, pos.off + ROUND_LOG_REC_HEADER + len };
+    CborReader rd(rec + ROUND_LOG_REC_HEADER, len);
+    int64_t ep;
+    if (!rd.integer(ep) || !cborReadRound(rd, r)) return RL_SKIP;
+    epoch = (uint32_t)ep;
+    return RL_OK;
+}
+
+// 先頭レコードの epoch/seq を読み直す（壊れた/読めないレコードは読み飛ばした先の1件）
+inline void roundLogRefreshHead(RoundLogState& st, const RoundLogIo& io) {
+    st.headEpoch = st.headSeq = 0;
+    RoundLogPos pos = st.head, next;
+    RtcRound r;
+    for (;;) {
+        uint8_t rc = roundLogReadAt(st, io, pos, st.headEpoch, r, next);
+        if (rc == RL_OK) { st.headSeq = r.seq; return; }
+        if (rc == RL_END) { st.count = 0; st.headEpoch = 0; return; }
+        pos = (rc == RL_SKIP) ? next : RoundLogPos{ pos.seg + 1, 0 };
+    }
+}
+
+inline bool roundLogWriteMeta(RoundLogState& st, const RoundLogIo& io) {
+    uint8_t m[ROUND_LOG_META_BYTES];
+    uint32_t gen = st.metaGen + 1;
+    m[0] = 'R'; m[1] = 'L'; m[2] = 1; m[3] = 0;
+    roundLogPut32(m + 4, gen);
+    roundLogPut32(m + 8, st.head.seg);
+    roundLogPut32(m + 12, st.head.off);
+    uint16_t crc = roundLogCrc16(m, 16);
+    m[16] = (uint8_t)crc; m[17] = (uint8_t)(crc >> 8);
+    char name[16];
+    roundLogMetaName(name, sizeof(name), gen & 1);
+    if (!io.write(io.ctx, name, m, sizeof(m))) return false;
+    st.metaGen = gen;
+    return true;
+}
+
+/**
+ * 記憶域から状態を復元する（電源投入/リセット後に1回。先頭から末尾まで読んで件数を数える）
+ */
+inline void roundLogOpen(RoundLogState& st, const RoundLogIo& io, uint32_t segBytes, uint16_t maxSegs) {
+    memset(&st, 0, sizeof(st));
+    st.segBytes = segBytes;
+    st.maxSegs = maxSegs;
+    st.head = { 1, 0 };
+    char name[16];
+    for (int slot = 0; slot < 2; slot++) {
+        uint8_t m[ROUND_LOG_META_BYTES];
+        roundLogMetaName(name, sizeof(name), slot);
+        if (io.read(io.ctx, name, 0, m, sizeof(m)) != sizeof(m) || m[0] != 'R' || m[1] != 'L' ||
+            roundLogCrc16(m, 16) != (uint16_t)(m[16] | (m[17] << 8))) continue;
+        uint32_t gen = roundLogGet32(m + 4);
+        if (st.metaGen && (int32_t)(gen - st.metaGen) <= 0) continue;
+        st.metaGen = gen;
+        st.head = { roundLogGet32(m + 8), roundLogGet32(m + 12) };
+    }
+    // 先頭より前の消し残り（メタを書いた後・削除前の電断。1回の切り詰めは maxSegs 以内）
+    for (uint32_t s = st.head.seg > maxSegs ? st.head.seg - maxSegs : 1; s < st.head.seg; s++) {
+        roundLogSegName(name, sizeof(name), s);
+        if (io.size(io.ctx, name) >= 0) io.remove(io.ctx, name);
+    }
+    // 末尾: 先頭から maxSegs 以内で最後にあるセグメント（追記に失敗して番号が飛んでいることがある）
+    uint32_t last = st.head.seg;
+    for (uint32_t s = st.head.seg + 1; s - st.head.seg < maxSegs; s++) {
+        roundLogSegName(name, sizeof(name), s);
+        if (io.size(io.ctx, name) >= 0) last = s;
+    }
+    roundLogSegName(name, sizeof(name), last);
+    long sz = io.size(io.ctx, name);
+    st.tail = { last, sz > 0 ? (uint32_t)sz : 0 };
+
+    // 件数を数え、末尾セグメントの途中で壊れていたら封じる
+    RoundLogPos pos = st.head, next;
+    RtcRound r;
+    uint32_t epoch;
+    for (;;) {
+        uint8_t rc = roundLogReadAt(st, io, pos, epoch, r, next);
+        if (rc == RL_END) break;
+        if (rc == RL_OK) { st.count++; pos = next; continue; }
+        if (rc == RL_SKIP) { pos = next; continue; }
+        if (pos.seg >= st.tail.seg) {
+            st.tail = { st.tail.seg + 1, 0 };
+            break;
+        }
+        pos = { pos.seg + 1, 0 };
+    }
+    roundLogRefreshHead(st, io);
+    st.open = true;
+}
+
+/**
+ * 先頭を pos へ進める（taken=取り出した件数）。メタを書いてから済んだセグメントを消す
+ */
+inline bool roundLogAdvance(RoundLogState& st, const RoundLogIo& io, RoundLogPos pos, uint32_t taken) {
+    RoundLogPos old = st.head;
+    uint32_t oldCount = st.count;
+    st.head = pos;
+    st.count = st.count > taken ? st.count - taken : 0;
+    if (!roundLogWriteMeta(st, io)) { st.head = old; st.count = oldCount; return false; }
+    char name[16];
+    for (uint32_t s = old.seg; s < pos.seg; s++) {
+        roundLogSegName(name, sizeof(name), s);
+        io.remove(io.ctx, name);
+    }
+    roundLogRefreshHead(st, io);
+    return true;
+}
+
+// 最古のセグメントを捨てる（容量超過）。メタを書けず先頭が進まなければ false
+inline bool roundLogDropOldest(RoundLogState& st, const RoundLogIo& io) {
+    RoundLogPos pos = st.head, next;
+    RtcRound r;
+    uint32_t epoch, n = 0;
+    while (pos.seg == st.head.seg) {
+        uint8_t rc = roundLogReadAt(st, io, pos, epoch, r, next);
+        if (rc == RL_END) break;
+        if (rc == RL_OK) n++;
+        pos = (rc == RL_BAD) ? RoundLogPos{ pos.seg + 1, 0 } : next;
+    }
+    if (!roundLogAdvance(st, io, { st.head.seg + 1, 0 }, n)) return false;
+    st.dropped += n;
+    return true;
+}
+
+/**
+ * 1ラウンドを末尾へ追記（epoch=そのラウンドの通番系列）
+ */
+inline bool roundLogAppend(RoundLogState& st, const RoundLogIo& io, uint32_t epoch, const RtcRound& r) {
+    uint8_t rec[ROUND_LOG_REC_MAX];
+    CborWriter w(rec + ROUND_LOG_REC_HEADER, sizeof(rec) - ROUND_LOG_REC_HEADER);
+    w.unum(epoch);
+    cborWriteRound(w, r);
+    if (!w.ok()) return false;
+    uint16_t len = (uint16_t)w.length();
+    uint16_t crc = roundLogCrc16(rec + ROUND_LOG_REC_HEADER, len);
+    rec[0] = (uint8_t)len; rec[1] = (uint8_t)(len >> 8);
+    rec[2] = (uint8_t)crc; rec[3] = (uint8_t)(crc >> 8);
+    uint32_t n = ROUND_LOG_REC_HEADER + len;
+
+    char name[16];
+    if (st.tail.off > 0) {
+        // 末尾の長さが食い違う = 前回の追記が途中で切れた（リセット等）→ 封じて次のセグメントへ
+        roundLogSegName(name, sizeof(name), st.tail.seg);
+        if (io.size(io.ctx, name) != (long)st.tail.off) st.tail = { st.tail.seg + 1, 0 };
+    }
+    if (st.tail.off + n > st.segBytes) st.tail = { st.tail.seg + 1, 0 };
+    while (st.tail.seg - st.head.seg >= st.maxSegs) {
+        if (!roundLogDropOldest(st, io)) return false;   // 先頭を進められない（メタ書込み失敗）→ 容量を超えて書かない
+    }
+
+    roundLogSegName(name, sizeof(name), st.tail.seg);
+    if (!io.append(io.ctx, name, rec, n)) {
+        st.tail = { st.tail.seg + 1, 0 };
+        return false;
+    }
+    st.tail.off += n;
+    if (st.count++ == 0) { st.headEpoch = epoch; st.headSeq = r.seq; }
+    return true;
+}
+
+/**
+ * 先頭から同じ epoch のレコードを最大 max 件読む（消さない）。
+ * next=取り出した分の次の位置（roundLogAdvance に渡す）。読めないレコードは数えずに飛ばす
+ */
+inline int roundLogPeek(const RoundLogState& st, const RoundLogIo& io, RtcRound* out, int max,
+                        uint32_t& epoch, RoundLogPos& next) {
+    RoundLogPos pos = st.head, nx;
+    int n = 0;
+    uint32_t ep;
+    while (n < max) {
+        uint8_t rc = roundLogReadAt(st, io, pos, ep, out[n], nx);
+        if (rc == RL_END) break;
+        if (rc == RL_BAD) { pos = { pos.seg + 1, 0 }; continue; }
+        if (rc == RL_SKIP) { pos = nx; continue; }
+        if (n > 0 && ep != epoch) break;
+        epoch = ep;
+        n++;
+        pos = nx;
+    }
+    next = pos;
+    return n;
+}
+
+/**
+ * 先頭から epoch が同じで seq ≤ ackSeq のレコードを捨てる（サーバが連続して受取済みと返した分）。
+ * 残す最初のレコードまで読み進めてから先頭を1回で進める（メタ書込みは件数によらず1回）
+ */
+inline uint32_t roundLogDropAcked(RoundLogState& st, const RoundLogIo& io, uint32_t epoch, uint32_t ackSeq) {
+    if (st.count == 0 || st.headEpoch != epoch || st.headSeq > ackSeq) return 0;
+    RoundLogPos pos = st.head, next;
+    RtcRound r;
+    uint32_t ep, n = 0;
+    for (;;) {
+        uint8_t rc = roundLogReadAt(st, io, pos, ep, r, next);
+        if (rc == RL_END) break;
+        if (rc == RL_BAD) { pos = { pos.seg + 1, 0 }; continue; }
+        if (rc == RL_OK) {
+            if (ep != epoch || r.seq > ackSeq) break;
+            n++;
+        }
+        pos = next;
+    }
+    if (n == 0 || !roundLogAdvance(st, io, pos, n)) return 0;
+    return n;
+}
+
+#endif // ROUND_LOG_H
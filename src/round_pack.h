@@ -0,0 +1,284 @@
+#ifndef ROUND_PACK_H
+#define ROUND_PACK_H
+
+// =====================================================================
+// 蓄積ラウンドのRTC向け圧縮表現（前ラウンドとの差分をビット列で詰める）  ※親機ファーム/ホスト共用
+// ---------------------------------------------------------------------
+// RtcRound は子機 MAX_CHILD_DEVICES 台分の float を常に持つため1件 800 バイト超で、
+// RTCメモリには4ラウンドしか置けない。実際の値は20分でほとんど変わらないので、
+//   - 値は送信と同じ固定小数点（温湿度×100, 気圧×10。round_cbor.h と同じ量子化）
+//   - ts は前回の間隔との差（delta-of-delta: 定刻なら0）、seq は +1 との差
+//   - その他の値は前ラウンドの同じ子機の値との差（子機は前回受信した値を予測に使う）
+//   - 子機リスト（id, lid）は前ラウンドと同じなら1ビット、受信有無は1台1ビット
+// とし、差を Gorilla の時刻圧縮と同じ可変長の桁区分で書く:
+//   '0' = 0 / '10'+7bit / '110'+12bit / '1110'+20bit / '1111'+32bit（符号付き）
+// ラウンド毎にバイト境界へ揃えて追記する（先頭ラウンドは予測0から=キーフレーム）。
+// 追記は直前ラウンドの予測状態（RoundPackPred）だけで行い、展開は送信時に先頭から順に読む。
+// 途中のラウンドを外す時は、残す分を読み元の写しから読みながら詰め直す（親機の repackRtcRounds）。
+// NaN（センサ読み取り失敗）は予約値 ROUND_PACK_NAN で保持する。
+// 状態はRTCに置く前提のPOD（ゼロ初期化=空）。
+// =====================================================================
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <math.h>
+#include "round_data.h"
+
+#define ROUND_PACK_NAN INT16_MIN
+
+static_assert(MAX_CHILD_DEVICES < 64, "child count is written in 6 bits");
+
+// 予測に使う子機1台分（最後に受信した値。固定小数点）
+struct RoundPackChild {
+    uint32_t id;
+    int16_t temp, humid, pres;
+    int8_t rssi;
+    uint8_t bat;
+    uint8_t lid;
+};
+
+// 直前ラウンド（次の追記の予測元）
+struct RoundPackPred {
+    uint32_t seq;
+    uint32_t ts;
+    int32_t dts;                // 直前の ts 間隔
+    int16_t temp, humid, pres, bat, vbus, signal;
+    uint8_t childCount;
+    RoundPackChild child[MAX_CHILD_DEVICES];
+};
+
+struct RoundPackState {
+    uint16_t count;             // 蓄積ラウンド数
+    uint16_t bytes;             // アリーナの使用バイト
+    RoundPackPred last;         // 最後に追記したラウンド
+};
+
+inline int16_t roundPackFixed(float v, int scale) {
+    if (isnan(v)) return ROUND_PACK_NAN;
+    long x = lroundf(v * scale);
+    return (int16_t)(x > 32767 ? 32767 : x < -32767 ? -32767 : x);
+}
+
+inline float roundPackFloat(int16_t v, int scale) {
+    return v == ROUND_PACK_NAN ? NAN : v / (float)scale;
+}
+
+inline int16_t roundPackClamp(int v) {
+    return (int16_t)(v > 32767 ? 32767 : v < -32767 ? -32767 : v);
+}
+
+// ---- ビット列（MSBから詰める） ----
+class PackBitWriter {
+public:
+    PackBitWriter(uint8_t* buf, size_t cap) : _buf(buf), _cap(cap), _bit(0), _overflow(false) {}
+
+    void bits(uint32_t v, int n) {
+        for (int i = n - 1; i >= 0; i--) {
+            size_t byte = _bit >> 3;
+            if (byte >= _cap) { _overflow = true; return; }
+            uint8_t mask = (uint8_t)(0x80 >> (_bit & 7));
+            if ((v >> i) & 1) _buf[byte] |= mask; else _buf[byte] &= (uint8_t)~mask;
+            _bit++;
+        }
+    }
+
+    void delta(int32_t d) {
+        if (d == 0)                            { bits(0, 1); }
+        else if (d >= -64 && d < 64)           { bits(2, 2);  bits((uint32_t)d & 0x7F, 7); }
+        else if (d >= -2048 && d < 2048)       { bits(6, 3);  bits((uint32_t)d & 0xFFF, 12); }
+        else if (d >= -(1 << 19) && d < (1 << 19)) { bits(14, 4); bits((uint32_t)d & 0xFFFFF, 20); }
+        else                                   { bits(15, 4); bits((uint32_t)d, 32); }
+    }
+
+    size_t bytes() const { return (_bit + 7) >> 3; }
+    bool ok() const { return !_overflow; }
+
+private:
+    uint8_t* _buf;
+    size_t _cap, _bit;
+    bool _overflow;
+};
+
+class PackBitReader {
+public:
+    PackBitReader(const uint8_t* buf, size_t n) : _buf(buf), _n(n), _bit(0), _bad(false) {}
+
+    uint32_t bits(int n) {
+        uint32_t v = 0;
+        for (int i = 0; i < n; i++) {
+            size_t byte = _bit >> 3;
+            if (byte >= _n) { _bad = true; return 0; }
+            v = (v << 1) | ((_buf[byte] >> (7 - (_bit & 7))) & 1);
+            _bit++;
+        }
+        return v;
+    }
+
+    int32_t delta() {
+        if (!bits(1)) return 0;
+        if (!bits(1)) return signExtend(bits(7), 7);
+        if (!bits(1)) return signExtend(bits(12), 12);
+        if (!bits(1)) return signExtend(bits(20), 20);
+        return (int32_t)bits(32);
+    }
+
+    void align() { _bit = (_bit + 7) & ~(size_t)7; }
+    size_t offset() const { return _bit >> 3; }
+    bool ok() const { return !_bad; }
+
+private:
+    const uint8_t* _buf;
+    size_t _n, _bit;
+    bool _bad;
+
+    static int32_t signExtend(uint32_t v, int n) {
+        return (v & (1u << (n - 1))) ? (int32_t)(v | ~((1u << n) - 1)) : (int32_t)v;
+    }
+};
+
+// 新しい子機リストの予測値を旧予測から id で引き継ぐ（見つからなければ0から）
+inline void roundPackRemapChildren(RoundPackPred& p, const uint32_t* ids, const uint8_t* lids, int n) {
+    RoundPackChild next[MAX_CHILD_DEVICES];
+    for (int j = 0; j < n; j++) {
+        memset(&next[j], 0, sizeof(next[j]));
+        for (int k = 0; k < p.childCount; k++) {
+            if (p.child[k].id == ids[j]) { next[j] = p.child[k]; break; }
+        }
+        next[j].id = ids[j];
+        next[j].lid = lids[j];
+    }
+    memcpy(p.child, next, sizeof(RoundPackChild) * n);
+    p.childCount = (uint8_t)n;
+}
+
+/**
+ * 1ラウンドを予測 p との差分で書き、p を今回の値へ進める
+ */
+inline void roundPackEncode(PackBitWriter& w, RoundPackPred& p, const RtcRound& r) {
+    // 通番・時刻は32bitで回り込む差として書く
+    w.delta((int32_t)(r.seq - (p.seq + 1)));
+    int32_t dts = (int32_t)((uint32_t)r.ts - p.ts);
+    w.delta((int32_t)((uint32_t)dts - (uint32_t)p.dts));
+    p.seq = r.seq; p.ts = (uint32_t)r.ts; p.dts = dts;
+
+    int16_t v[6] = { roundPackFixed(r.pTemp, 100), roundPackFixed(r.pHumid, 100), roundPackFixed(r.pPres, 10),
+                     roundPackClamp(r.pBat), roundPackClamp(r.pVbus), roundPackClamp(r.pSignal) };
+    int16_t* pv[6] = { &p.temp, &p.humid, &p.pres, &p.bat, &p.vbus, &p.signal };
+    for (int i = 0; i < 6; i++) { w.delta(v[i] - *pv[i]); *pv[i] = v[i]; }
+
+    int n = r.childCount < MAX_CHILD_DEVICES ? r.childCount : MAX_CHILD_DEVICES;
+    bool same = n == p.childCount;
+    for (int j = 0; same && j < n; j++) same = r.child[j].id == p.child[j].id && r.child[j].lid == p.child[j].lid;
+    w.bits(same ? 1 : 0, 1);
+    if (!same) {
+        uint32_t ids[MAX_CHILD_DEVICES];
+        uint8_t lids[MAX_CHILD_DEVICES];
+        w.bits((uint32_t)n, 6);
+        for (int j = 0; j < n; j++) {
+            ids[j] = r.child[j].id; lids[j] = r.child[j].lid;
+            w.bits(ids[j], 32);
+            w.bits(lids[j], 8);
+        }
+        roundPackRemapChildren(p, ids, lids, n);
+    }
+    for (int j = 0; j < n; j++) w.bits(r.child[j].received ? 1 : 0, 1);
+    for (int j = 0; j < n; j++) {
+        const RtcChild& c = r.child[j];
+        if (!c.received) continue;
+        RoundPackChild& q = p.child[j];
+        int16_t t = roundPackFixed(c.temp, 100), h = roundPackFixed(c.humid, 100), pr = roundPackFixed(c.pres, 10);
+        w.delta(t - q.temp);
+        w.delta(h - q.humid);
+        w.delta(pr - q.pres);
+        w.delta(c.rssi - q.rssi);
+        w.delta(c.bat - q.bat);
+        q.temp = t; q.humid = h; q.pres = pr; q.rssi = c.rssi; q.bat = c.bat;
+    }
+}
+
+/**
+ * roundPackEncode の逆（未受信の子機の値は0）
+ */
+inline bool roundPackDecode(PackBitReader& rd, RoundPackPred& p, RtcRound& r) {
+    memset(&r, 0, sizeof(r));
+    p.seq += 1 + (uint32_t)rd.delta();
+    p.dts = (int32_t)((uint32_t)p.dts + (uint32_t)rd.delta());
+    p.ts += (uint32_t)p.dts;
+    r.seq = p.seq;
+    r.ts = (time_t)p.ts;
+
+    int16_t* pv[6] = { &p.temp, &p.humid, &p.pres, &p.bat, &p.vbus, &p.signal };
+    for (int i = 0; i < 6; i++) *pv[i] = (int16_t)(*pv[i] + rd.delta());
+    r.pTemp = roundPackFloat(p.temp, 100); r.pHumid = roundPackFloat(p.humid, 100); r.pPres = roundPackFloat(p.pres, 10);
+    r.pBat = p.bat; r.pVbus = p.vbus; r.pSignal = p.signal;
+
+    if (!rd.bits(1)) {
+        uint32_t ids[MAX_CHILD_DEVICES];
+        uint8_t lids[MAX_CHILD_DEVICES];
+        int n = (int)rd.bits(6);
+        if (n > MAX_CHILD_DEVICES) return false;
+        for (int j = 0; j < n; j++) { ids[j] = rd.bits(32); lids[j] = (uint8_t)rd.bits(8); }
+        roundPackRemapChildren(p, ids, lids, n);
+    }
+    r.childCount = p.childCount;
+    for (int j = 0; j < r.childCount; j++) {
+        r.child[j].id = p.child[j].id;
+        r.child[j].lid = p.child[j].lid;
+        r.child[j].received = rd.bits(1) != 0;
+    }
+    for (int j = 0; j < r.childCount; j++) {
+        RtcChild& c = r.child[j];
+        if (!c.received) continue;
+        RoundPackChild& q = p.child[j];
+        q.temp = (int16_t)(q.temp + rd.delta());
+        q.humid = (int16_t)(q.humid + rd.delta());
+        q.pres = (int16_t)(q.pres + rd.delta());
+        q.rssi = (int8_t)(q.rssi + rd.delta());
+        q.bat = (uint8_t)(q.bat + rd.delta());
+        c.temp = roundPackFloat(q.temp, 100); c.humid = roundPackFloat(q.humid, 100); c.pres = roundPackFloat(q.pres, 10);
+        c.rssi = q.rssi; c.bat = q.bat;
+    }
+    return rd.ok();
+}
+
+inline void roundPackClear(RoundPackState& st) {
+    memset(&st, 0, sizeof(st));
+}
+
+/**
+ * 1ラウンドを末尾へ追記。アリーナに収まらなければ何も変えずに false
+ */
+inline bool roundPackAppend(uint8_t* arena, size_t cap, RoundPackState& st, const RtcRound& r) {
+    if (st.bytes >= cap || st.count == 0xFFFF) return false;
+    static RoundPackPred p;   // RoundPackPred は500バイト超（スタックに置かない）
+    p = st.last;
+    PackBitWriter w(arena + st.bytes, cap - st.bytes);
+    roundPackEncode(w, p, r);
+    if (!w.ok()) return false;
+    st.last = p;
+    st.bytes = (uint16_t)(st.bytes + w.bytes());
+    st.count++;
+    return true;
+}
+
+// 先頭から順に展開する
+class RoundPackReader {
+public:
+    RoundPackReader(const uint8_t* arena, const RoundPackState& st)
+        : _rd(arena, st.bytes), _left(st.count) { memset(&_p, 0, sizeof(_p)); }
+
+    bool next(RtcRound& r) {
+        if (_left == 0 || !roundPackDecode(_rd, _p, r)) return false;
+        _rd.align();
+        _left--;
+        return true;
+    }
+
+private:
+    PackBitReader _rd;
+    RoundPackPred _p;
+    uint16_t _left;
+};
+
+#endif // ROUND_PACK_H
@@ -0,0 +1,121 @@
+#ifndef TIME_SOURCE_H
+#define TIME_SOURCE_H
+
+// =====================================================================
+// 時刻の情報源と品質（NITZ / HTTP Date / CNTP）  ※親機ファーム/ホスト共用
+// ---------------------------------------------------------------------
+// 時計合わせの情報源は安い順に
+//   1. モデム時計(AT+CCLK?)  … NITZ(*PSUTTZ)か前回のCNTPで合っていればAT1回で読める
+//   2. HTTP Date ヘッダ      … 設定取得/送信の応答に毎回付いてくる（秒単位）
+//   3. AT+CNTP               … 上の2つが無い/食い違う時だけ（応答待ちで数秒〜30秒）
+// TimeQuality は「最後にどの情報源で合わせたか・その時点の誤差・いつ合わせたか」で、
+// 経過時間×ドリフトを足したものを不確かさとして受信窓のマージンに使う。
+// time_t は既存どおり JST の壁時計を UTC として数えた値（"+09:00" を付けて出力）。
+// =====================================================================
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define TIME_JST_OFFSET_SEC (9 * 3600)
+
+enum TimeSource : uint8_t {
+    TS_NONE = 0,       // 未同期（電源投入直後のRC時計）
+    TS_HTTP_DATE,      // サーバ応答の Date ヘッダ
+    TS_NITZ,           // ネットワーク時刻（モデム時計経由）
+    TS_NTP             // AT+CNTP（モデム時計経由）
+};
+
+static const char* const kTimeSourceName[] = { "none", "date", "nitz", "ntp" };
+
+// 時計の質（RTCに置く前提のPOD。ゼロ初期化=未同期）
+struct TimeQuality {
+    uint8_t source;        // TimeSource
+    uint16_t errMs;        // 合わせた時点の誤差見積り
+    time_t syncedAt;       // 合わせた時刻（その時計での値）
+};
+
+// 起床中に得た時刻の標本（millis() 時点 atMs での値）
+struct TimeSample {
+    bool valid;
+    time_t t;
+    uint16_t fracMs;       // t の秒未満
+    uint32_t atMs;
+};
+
+/**
+ * 現在の不確かさ ms（合わせた時点の誤差 + 経過秒×ドリフトppm）。未同期は UINT32_MAX
+ */
+inline uint32_t timeUncertaintyMs(const TimeQuality& q, time_t now, uint32_t driftPpm) {
+    if (q.source == TS_NONE || q.syncedAt == 0) return UINT32_MAX;
+    uint32_t age = (now > q.syncedAt) ? (uint32_t)(now - q.syncedAt) : 0;
+    return q.errMs + (uint32_t)((uint64_t)age * driftPpm / 1000);
+}
+
+// 標本を millis() = nowMs の時点へ進めた値（ms 単位の通算。秒と秒未満は呼び出し側で分ける）
+inline int64_t timeSampleMsAt(const TimeSample& s, uint32_t nowMs) {
+    return (int64_t)s.t * 1000 + s.fracMs + (uint32_t)(nowMs - s.atMs);
+}
+
+// 1970-01-01 からの日数（proleptic Gregorian。TZ環境変数に依存しない）
+inline int64_t timeDaysFromCivil(int y, unsigned m, unsigned d) {
+    y -= m <= 2;
+    int64_t era = (y >= 0 ? y : y - 399) / 400;
+    unsigned yoe = (unsigned)(y - era * 400);
+    unsigned doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + (int64_t)doe - 719468;
+}
+
+inline time_t timeFromCivil(int y, int mo, int d, int h, int mi, int s) {
+    return (time_t)(timeDaysFromCivil(y, mo, d) * 86400 + h * 3600 + mi * 60 + s);
+}
+
+static inline int timeTwoDigits(const char* p) {
+    if (p[0] < '0' || p[0] > '9' || p[1] < '0' || p[1] > '9') return -1;
+    return (p[0] - '0') * 10 + (p[1] - '0');
+}
+
+/**
+ * AT+CCLK? の値 "yy/MM/dd,hh:mm:ss±zz"（zz=15分単位のTZ）を JST 壁時計へ。
+ * 未設定のモデム時計（80/01/06 など）は false
+ */
+inline bool parseCclk(const char* s, time_t& jst) {
+    if (strlen(s) < 17 || s[2] != '/' || s[5] != '/' || s[8] != ',' || s[11] != ':' || s[14] != ':') return false;
+    int yy = timeTwoDigits(s), mo = timeTwoDigits(s + 3), d = timeTwoDigits(s + 6);
+    int h = timeTwoDigits(s + 9), mi = timeTwoDigits(s + 12), sec = timeTwoDigits(s + 15);
+    if (yy < 24 || yy >= 80 || mo < 1 || mo > 12 || d < 1 || d > 31 || h < 0 || h > 23 || mi < 0 || mi > 59 || sec < 0 || sec > 60) return false;
+    int tzQuarter = 36;   // TZ欄が無ければ CNTP 設定どおり JST とみなす
+    if (s[17] == '+' || s[17] == '-') {
+        tzQuarter = atoi(s + 18);
+        if (s[17] == '-') tzQuarter = -tzQuarter;
+    }
+    time_t local = timeFromCivil(2000 + yy, mo, d, h, mi, sec);
+    jst = local - tzQuarter * 900 + TIME_JST_OFFSET_SEC;
+    return true;
+}
+
+/**
+ * HTTP Date（IMF-fixdate "Sun, 06 Nov 1994 08:49:37 GMT"）を JST 壁時計へ
+ */
+inline bool parseHttpDate(const char* s, time_t& jst) {
+    static const char kMon[] = "JanFebMarAprMayJunJulAugSepOctNovDec";
+    const char* c = strchr(s, ',');
+    if (!c) return false;
+    c++;
+    while (*c == ' ') c++;
+    // "06 Nov 1994 08:49:37 GMT"
+    if (strlen(c) < 20 || c[2] != ' ' || c[6] != ' ' || c[11] != ' ' || c[14] != ':' || c[17] != ':') return false;
+    int d = timeTwoDigits(c);
+    int mo = 0;
+    for (int i = 0; i < 12; i++) if (memcmp(c + 3, kMon + i * 3, 3) == 0) { mo = i + 1; break; }
+    int y = atoi(c + 7);
+    int h = timeTwoDigits(c + 12), mi = timeTwoDigits(c + 15), sec = timeTwoDigits(c + 18);
+    if (d < 1 || d > 31 || mo == 0 || y < 2024 || h < 0 || h > 23 || mi < 0 || mi > 59 || sec < 0 || sec > 60) return false;
+    jst = timeFromCivil(y, mo, d, h, mi, sec) + TIME_JST_OFFSET_SEC;
+    return true;
+}
+
+#endif // TIME_SOURCE_H
@@ -0,0 +1,82 @@
+#ifndef UART_RING_H
+#define UART_RING_H
+
+// =====================================================================
+// UART受信リングバッファ（固定長・ヒープ不使用）  ※親機ファーム/ホスト共用
+// ---------------------------------------------------------------------
+// UART の受信済みバイトを fill() でまとめて取り込み、呼び出し側は
+// 絶対位置（単調増加する uint32_t）で参照する。行が折り返していなければ
+// contiguous() でバッファ内を直接指すポインタを得られる（コピー不要）。
+// release() した位置より前の領域は次の fill() で上書きされる。
+// UART からの読出しは関数で受け取る（実機は HardwareSerial、ホストは擬似入力）。
+// N は2のべき乗。
+// =====================================================================
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+// 受信済みのバイトを待たずに最大 cap バイト読む。戻り値=読んだバイト数（0=受信なし）
+typedef size_t (*UartReadFn)(uint8_t* buf, size_t cap, void* ctx);
+
+template <size_t N>
+class UartRing {
+    static_assert((N & (N - 1)) == 0, "UartRing size must be a power of two");
+public:
+    UartRing() : _r(0), _w(0) {}
+
+    // 空き領域へ read で一括読込。戻り値=読込バイト数
+    size_t fill(UartReadFn read, void* ctx) {
+        size_t total = 0;
+        while (space() > 0) {
+            size_t idx = _w & (N - 1);
+            size_t n = space();
+            if (n > N - idx) n = N - idx;
+            n = read(_buf + idx, n, ctx);
+            if (n == 0) break;
+            _w += n;
+            total += n;
+        }
+        return total;
+    }
+
+    // 手元のバイト列を投入（空きに収まる分だけ。ホストの擬似入力・ベンチマーク用）
+    size_t push(const uint8_t* p, size_t n) {
+        if (n > space()) n = space();
+        size_t idx = _w & (N - 1);
+        size_t first = (n < N - idx) ? n : N - idx;
+        memcpy(_buf + idx, p, first);
+        if (n > first) memcpy(_buf, p + first, n - first);
+        _w += n;
+        return n;
+    }
+
+    uint32_t begin() const { return _r; }          // 未解放の先頭位置
+    uint32_t end() const { return _w; }            // 受信済みの末尾位置
+    size_t space() const { return N - (size_t)(_w - _r); }
+
+    uint8_t at(uint32_t pos) const { return _buf[pos & (N - 1)]; }
+
+    // [pos, pos+n) が折り返さず連続していればその先頭、折り返すなら nullptr
+    uint8_t* contiguous(uint32_t pos, size_t n) {
+        size_t idx = pos & (N - 1);
+        return (idx + n <= N) ? _buf + idx : nullptr;
+    }
+
+    // [pos, pos+n) を dst へコピー（折り返し対応）
+    void copy(uint32_t pos, uint8_t* dst, size_t n) const {
+        size_t idx = pos & (N - 1);
+        size_t first = (n < N - idx) ? n : N - idx;
+        memcpy(dst, _buf + idx, first);
+        if (n > first) memcpy(dst + first, _buf, n - first);
+    }
+
+    // pos より前を解放
+    void release(uint32_t pos) { _r = pos; }
+
+private:
+    uint8_t _buf[N];
+    uint32_t _r, _w;
+};
+
+#endif // UART_RING_H
@@ -0,0 +1,76 @@
+#ifndef UDP_INGEST_H
+#define UDP_INGEST_H
+
+// =====================================================================
+// UDP送信(ingest)のフレーム形式  ※親機ファーム/ホスト共用（参照サーバ tools/udp-ingest-ref/ も使う）
+// ---------------------------------------------------------------------
+// HTTPは起床毎の接続確立・ヘッダ・FINを払う。UDP版は蓄積ラウンド1件を1データグラムにし
+// （中身は round_cbor.h の1ラウンド分バッチ）、アプリ層のACKで届いたものだけRTCから消す。
+// ACKが来ないものは再送し、それでも残った分はHTTPで送る（データは失わない）。
+//
+//   DATA = 'F' 'U' ver type=1 msgId(2,BE) | CBORバッチ（rounds は1件。link等は先頭のみ）
+//   ACK  = 'F' 'U' ver type=2 msgId(2,BE) status flags    … 固定8バイト
+//
+// msgId は起床をまたいで一意になるよう呼び出し側で振る（サーバは parent_id+msgId で重複を
+// 判定し、再送には保存せず DUPLICATE を返す）。ACK の flags は送信応答ヒントと同じ意味
+// （設定変更/OTA新版/未実行ACコマンド）で、サーバが分からなければ UDP_HINT_UNKNOWN。
+// CARECV は複数のACKを連結して返しうるので、受信側は8バイト毎に区切って読む。
+// =====================================================================
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define UDP_INGEST_VERSION 1
+#define UDP_FRAME_HEADER 6
+#define UDP_ACK_BYTES 8
+
+enum UdpFrameType : uint8_t { UDP_DATA = 1, UDP_ACK = 2 };
+
+enum UdpAckStatus : uint8_t {
+    UDP_ACK_STORED = 0,      // 保存した
+    UDP_ACK_DUPLICATE,       // 保存済み（再送）
+    UDP_ACK_AUTH,            // parent_id/secret 不一致（再送しても無駄）
+    UDP_ACK_BAD              // 復号できない
+};
+
+// ACK flags（送信応答ヒントと同じ意味）
+#define UDP_HINT_CONFIG  0x01   // 設定が変わった
+#define UDP_HINT_OTA     0x02   // OTA新版あり
+#define UDP_HINT_AC      0x04   // 未実行のACコマンドあり（内容はHTTPで取る）
+#define UDP_HINT_UNKNOWN 0x80   // ヒントなし（従来の取得周期で判断する）
+
+struct UdpAck {
+    uint16_t msgId;
+    uint8_t status;
+    uint8_t flags;
+};
+
+inline size_t udpWriteHeader(uint8_t* out, uint8_t type, uint16_t msgId) {
+    out[0] = 'F'; out[1] = 'U'; out[2] = UDP_INGEST_VERSION; out[3] = type;
+    out[4] = (uint8_t)(msgId >> 8); out[5] = (uint8_t)msgId;
+    return UDP_FRAME_HEADER;
+}
+
+// DATA の見出しを検査して msgId を返す（ペイロードは p + UDP_FRAME_HEADER から）
+inline bool udpParseData(const uint8_t* p, size_t n, uint16_t& msgId) {
+    if (n <= UDP_FRAME_HEADER || p[0] != 'F' || p[1] != 'U' || p[2] != UDP_INGEST_VERSION || p[3] != UDP_DATA) return false;
+    msgId = (uint16_t)((p[4] << 8) | p[5]);
+    return true;
+}
+
+inline size_t udpWriteAck(uint8_t* out, const UdpAck& a) {
+    udpWriteHeader(out, UDP_ACK, a.msgId);
+    out[6] = a.status;
+    out[7] = a.flags;
+    return UDP_ACK_BYTES;
+}
+
+inline bool udpParseAck(const uint8_t* p, size_t n, UdpAck& a) {
+    if (n < UDP_ACK_BYTES || p[0] != 'F' || p[1] != 'U' || p[2] != UDP_INGEST_VERSION || p[3] != UDP_ACK) return false;
+    a.msgId = (uint16_t)((p[4] << 8) | p[5]);
+    a.status = p[6];
+    a.flags = p[7];
+    return true;
+}
+
+#endif // UDP_INGEST_H
@@ -0,0 +1,156 @@
+#ifndef UPLOAD_POLICY_H
+#define UPLOAD_POLICY_H
+
+// =====================================================================
+// 電界に応じた送信見送り（アタッチ直後の RSRP で「今送る」か「次の起床で送る」か）  ※親機ファーム/ホスト共用
+// ---------------------------------------------------------------------
+// Cat-M1 は電界が弱いとカバレッジ拡張(繰り返し送信)に入り、1バイトあたりのエネルギーが
+// 数倍〜十数倍になる。アタッチ直後に AT+CESQ で RSRP を測り、
+//   今送る余分 = 送信バイト × 良好時の µJ/byte × (今の倍率 − 普段の倍率)
+//   待つ費用   = もう1回LTE起床して接続する µJ × マージン
+// を比べて、余分の方が大きければ送信を見送り、蓄積ラウンドはRTCに残して次の起床で再判定する。
+// 倍率は基準RSRPから dbPerDoubling 下がる毎に2倍（上限 UPLOAD_CE_PENALTY_MAX）。
+// 鮮度（最古ラウンドの経過＋再試行までの時間）・蓄積の空き・連続見送り回数のどれかが
+// 限度に達していれば、電界が悪くても送る（FORCED）。判定材料は全てログと LinkStats に残す。
+// 状態はRTCに置く前提のPOD（ゼロ初期化=未計測。未計測の間は既定値で判定）。
+// =====================================================================
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#define UPLOAD_CE_PENALTY_MAX 32.0f
+
+// AT+CESQ で測った電界
+struct LinkQuality {
+    bool valid;
+    int16_t rsrpDbm;      // -140..-44
+    int8_t rsrqDb;        // -20..-3（0.5dB単位は切捨て。0=不明）
+};
+
+enum UploadVerdict : uint8_t {
+    UPLOAD_SEND = 0,      // 電界が普段並み → 送る
+    UPLOAD_DEFER,         // 見送る（次の起床で再判定）
+    UPLOAD_FORCED,        // 悪いが鮮度/蓄積/回数の限度で送る
+    UPLOAD_NO_METRIC      // 電界が読めない → 送る
+};
+
+static const char* const kUploadVerdictName[] = { "send", "defer", "forced", "no-metric" };
+
+struct UploadPolicyParams {
+    int16_t refDbm;             // これ以上なら倍率1
+    float dbPerDoubling;        // 倍率が2倍になるRSRPの低下幅
+    float defaultUjPerByte;     // 学習前の良好時 µJ/byte
+    uint32_t freshnessSec;      // 最古ラウンドをこれ以上待たせない
+    uint8_t maxDeferrals;       // 連続見送りの上限
+    float margin;               // 待つ費用に掛ける安全率（>1 で見送りに慎重）
+};
+
+// 学習状態（RTC）
+struct UploadPolicyState {
+    float rsrpAvg;              // 測った起床の RSRP の指数移動平均（= 次に待った時の期待値）
+    uint16_t rsrpSamples;
+    float txUjPerByte;          // 倍率1に換算した送信 µJ/byte の指数移動平均（0=未学習）
+    uint16_t txSamples;
+    uint8_t deferrals;          // 連続見送り回数（送信で0）
+    int16_t deferRsrpDbm;       // 最初に見送った時の RSRP（送信時の結果と比べる）
+};
+
+// 判定の入力（呼び出し側で集める）
+struct UploadContext {
+    LinkQuality q;
+    uint32_t bytes;             // 今送るバイト見積り（蓄積分のバッチ＋HTTPヘッダ）
+    float reconnectUj;          // 見送った場合にもう1回接続する µJ
+    uint32_t oldestAgeSec;      // 最古ラウンドの経過秒
+    uint32_t retryAfterSec;     // 見送った場合に次に送れるまでの秒
+    uint8_t queued;             // 蓄積ラウンド数（次の起床で1件増える）
+    uint8_t queueCap;
+};
+
+struct UploadDecision {
+    uint8_t verdict;            // UploadVerdict
+    float penaltyNow;
+    float penaltyExpected;
+    float extraUj;              // 今送ることの余分
+    float waitUj;               // 待つ費用（マージン込み）
+};
+
+/**
+ * "+CESQ: <rxlev>,<ber>,<rscp>,<ecno>,<rsrq>,<rsrp>" を読む（rsrq 0..34, rsrp 0..97。255=不明）
+ */
+inline bool parseCesq(const char* s, LinkQuality& q) {
+    q.valid = false;
+    const char* p = strstr(s, "+CESQ:");
+    if (!p) return false;
+    p += 6;
+    long f[6];
+    for (int i = 0; i < 6; i++) {
+        char* end;
+        f[i] = strtol(p, &end, 10);
+        if (end == p) return false;
+        p = end;
+        if (i < 5) { if (*p != ',') return false; p++; }
+    }
+    if (f[5] < 0 || f[5] > 97) return false;
+    q.rsrpDbm = (int16_t)(f[5] - 141);
+    q.rsrqDb = (f[4] >= 0 && f[4] <= 34) ? (int8_t)(-20 + f[4] / 2) : 0;
+    q.valid = true;
+    return true;
+}
+
+/**
+ * RSRP に対するエネルギー倍率（基準以上は1）
+ */
+inline float uploadCePenalty(float rsrpDbm, const UploadPolicyParams& p) {
+    if (rsrpDbm >= p.refDbm) return 1.0f;
+    float x = powf(2.0f, (p.refDbm - rsrpDbm) / p.dbPerDoubling);
+    return x > UPLOAD_CE_PENALTY_MAX ? UPLOAD_CE_PENALTY_MAX : x;
+}
+
+// 測った電界を期待値へ反映（見送った起床も含める: 「待った時の期待値」は全起床の平均）
+inline void uploadObserve(UploadPolicyState& s, const LinkQuality& q) {
+    if (!q.valid) return;
+    s.rsrpAvg = (s.rsrpSamples == 0) ? q.rsrpDbm : s.rsrpAvg * 0.8f + q.rsrpDbm * 0.2f;
+    if (s.rsrpSamples < 0xFFFF) s.rsrpSamples++;
+}
+
+/**
+ * 送るか見送るかを決める（状態は変えない。結果は uploadRecordDeferred / uploadRecordSent で残す）
+ */
+inline UploadDecision uploadDecide(const UploadPolicyState& s, const UploadPolicyParams& p, const UploadContext& c) {
+    UploadDecision d = { UPLOAD_NO_METRIC, 1.0f, 1.0f, 0.0f, 0.0f };
+    if (!c.q.valid) return d;
+    d.penaltyNow = uploadCePenalty(c.q.rsrpDbm, p);
+    d.penaltyExpected = uploadCePenalty(s.rsrpSamples ? s.rsrpAvg : (float)p.refDbm, p);
+    if (d.penaltyExpected > d.penaltyNow) d.penaltyExpected = d.penaltyNow;
+    float u = s.txSamples ? s.txUjPerByte : p.defaultUjPerByte;
+    d.extraUj = (float)c.bytes * u * (d.penaltyNow - d.penaltyExpected);
+    d.waitUj = c.reconnectUj * p.margin;
+    if (d.extraUj <= d.waitUj) { d.verdict = UPLOAD_SEND; return d; }
+    bool stale = c.oldestAgeSec + c.retryAfterSec > p.freshnessSec;
+    bool full = c.queued >= c.queueCap;
+    d.verdict = (stale || full || s.deferrals >= p.maxDeferrals) ? UPLOAD_FORCED : UPLOAD_DEFER;
+    return d;
+}
+
+inline void uploadRecordDeferred(UploadPolicyState& s, const LinkQuality& q) {
+    if (s.deferrals == 0) s.deferRsrpDbm = q.rsrpDbm;
+    if (s.deferrals < 0xFF) s.deferrals++;
+}
+
+/**
+ * 送信できた時の実測（energyUj / bytes）を倍率1へ換算して学習し、見送り回数を戻す
+ */
+inline void uploadRecordSent(UploadPolicyState& s, const UploadPolicyParams& p, const LinkQuality& q,
+                             float energyUj, uint32_t bytes) {
+    if (q.valid && bytes > 0 && energyUj > 0) {
+        float v = energyUj / (float)bytes / uploadCePenalty(q.rsrpDbm, p);
+        s.txUjPerByte = (s.txSamples == 0) ? v : s.txUjPerByte * 0.7f + v * 0.3f;
+        if (s.txSamples < 0xFFFF) s.txSamples++;
+    }
+    s.deferrals = 0;
+    s.deferRsrpDbm = 0;
+}
+
+#endif // UPLOAD_POLICY_H
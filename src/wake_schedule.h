@@ -0,0 +1,122 @@
+#ifndef WAKE_SCHEDULE_H
+#define WAKE_SCHEDULE_H
+
+// =====================================================================
+// 起床サイクルの工程スケジューラ（グリッド基準の締切と工程別予算）  ※親機ファーム/ホスト共用
+// ---------------------------------------------------------------------
+// 起床1回を工程（センサ/アタッチ/NTP/設定/受信窓/送信/AC/OTA）の列として扱い、各工程の
+// 締切を「20分グリッド境界からの経過ms」で与える。任意工程は 見積り時間 が締切までに
+// 収まらなければ実行せず SKIPPED として次回へ回す（必須工程は常に実行し、超過は OVERRUN）。
+// 予定(planned=見積りと締切までの残りの小さい方)と実績(actual)を工程毎に記録し、
+// RTCに残してサーバへ送る。時間は呼び出し側が millis() を渡す（ホストで検証可能）。
+// =====================================================================
+
+#include <stdint.h>
+#include "round_data.h"   // PhaseRecord / WakeCycleLog（送信エンコードと共有する記録の形）
+
+enum WakePhase : uint8_t {
+    PH_SENSORS = 0, PH_ATTACH, PH_NTP, PH_CONFIG, PH_WINDOW, PH_UPLOAD, PH_AC, PH_OTA, PH_COUNT
+};
+
+enum PhaseStatus : uint8_t {
+    PHASE_NOT_RUN = 0,   // この起床では対象外
+    PHASE_DONE,          // 予定内に完了
+    PHASE_OVERRUN,       // 完了したが予定超過
+    PHASE_SKIPPED,       // 予算不足で見送り（次回へ）
+    PHASE_FAILED,        // 実行したが失敗
+    PHASE_RUNNING        // 実行中（記録途中）
+};
+
+static const char* const kWakePhaseName[PH_COUNT] = {
+    "sensors", "attach", "ntp", "config", "window", "upload", "ac", "ota"
+};
+
+static_assert(PH_COUNT == WAKE_PHASE_COUNT, "WAKE_PHASE_COUNT (round_data.h) must match WakePhase");
+
+class WakeScheduler {
+public:
+    WakeScheduler() : _t0(0) { reset(0, 0, 0); }
+
+    /**
+     * 起床時に初期化。msIntoGrid=起床時刻のグリッド境界からの経過ms（早起きなら負）
+     */
+    void reset(uint32_t wake, int32_t msIntoGrid, uint32_t nowMs) {
+        _t0 = nowMs;
+        _grid0 = msIntoGrid;
+        for (int i = 0; i < PH_COUNT; i++) { _start[i] = 0; _log.phase[i] = PhaseRecord{0, 0, PHASE_NOT_RUN}; }
+        _log.wake = wake;
+        _log.startMs = msIntoGrid;
+        _log.totalMs = 0;
+    }
+
+    // 時計補正（NTP同期など）後にグリッド基準を取り直す。起床時刻のずれも補正後の値にする
+    void rebase(int32_t msIntoGrid, uint32_t nowMs) {
+        _grid0 = msIntoGrid - (int32_t)(nowMs - _t0);
+        _log.startMs = _grid0;
+    }
+
+    // 現在のグリッド境界からの経過ms
+    int32_t gridMs(uint32_t nowMs) const { return _grid0 + (int32_t)(nowMs - _t0); }
+
+    // 締切(グリッド基準ms)までの残り（過ぎていれば負）
+    int32_t remainingMs(int32_t deadlineGridMs, uint32_t nowMs) const { return deadlineGridMs - gridMs(nowMs); }
+
+    /**
+     * 工程開始の可否を判定して記録開始。
+     * optional=true で見積りが締切に収まらなければ SKIPPED として false。
+     * 必須工程は常に true（予定は残り時間で頭打ち）。
+     */
+    bool admit(WakePhase p, uint32_t estimateMs, int32_t deadlineGridMs, bool optional, uint32_t nowMs) {
+        int32_t left = remainingMs(deadlineGridMs, nowMs);
+        uint32_t planned = (left <= 0) ? 0 : ((uint32_t)left < estimateMs ? (uint32_t)left : estimateMs);
+        PhaseRecord& r = _log.phase[p];
+        r.actualDs = 0;
+        if (optional && planned < estimateMs) {
+            r.plannedDs = toDs(estimateMs);   // 見送り時は必要だった見積りを残す
+            r.status = PHASE_SKIPPED;
+            return false;
+        }
+        r.plannedDs = toDs(planned);
+        r.status = PHASE_RUNNING;
+        _start[p] = nowMs;
+        return true;
+    }
+
+    // 予算以外の理由（送信見送りなど）で実行しない工程を SKIPPED として記録
+    void skip(WakePhase p, uint32_t estimateMs) {
+        _log.phase[p] = PhaseRecord{toDs(estimateMs), 0, PHASE_SKIPPED};
+    }
+
+    // 工程終了（ok=false は失敗）
+    void finish(WakePhase p, bool ok, uint32_t nowMs) {
+        PhaseRecord& r = _log.phase[p];
+        if (r.status != PHASE_RUNNING) return;
+        r.actualDs = toDs(nowMs - _start[p]);
+        r.status = !ok ? PHASE_FAILED : (r.actualDs > r.plannedDs ? PHASE_OVERRUN : PHASE_DONE);
+    }
+
+    // 工程の締切を過ぎたか（長い待ちループの打ち切り判定用）
+    bool expired(int32_t deadlineGridMs, uint32_t nowMs) const { return remainingMs(deadlineGridMs, nowMs) <= 0; }
+
+    // スリープ直前に確定
+    const WakeCycleLog& close(uint32_t nowMs) {
+        _log.totalMs = nowMs - _t0;
+        for (int i = 0; i < PH_COUNT; i++) finish((WakePhase)i, true, nowMs);
+        return _log;
+    }
+
+    const WakeCycleLog& log() const { return _log; }
+
+private:
+    uint32_t _t0;
+    int32_t _grid0;
+    uint32_t _start[PH_COUNT];
+    WakeCycleLog _log;
+
+    static uint16_t toDs(uint32_t ms) {
+        uint32_t ds = (ms + 50) / 100;
+        return ds > 0xFFFF ? 0xFFFF : (uint16_t)ds;
+    }
+};
+
+#endif // WAKE_SCHEDULE_H
@@ -0,0 +1,173 @@
+// =====================================================================
+// 設定応答の分割解釈（src/device_config.h の DeviceConfigParser）の確認  ※ホスト用ユニットテスト（env:native）
+// ---------------------------------------------------------------------
+// 子機 0〜200 台・長い名前（エスケープ入り、JSON_TOK_MAX_STRING 超え）・子機内の入れ子の
+// オブジェクト/配列を含む合成応答を作り、次を確かめる:
+//   - 受信チャンクの大きさ（1B〜CASEND/CARECV 1回分）によらず、一括で読んだ結果と一致する
+//   - 子機表は MAX_CHILD_DEVICES 台まで格納し、応答中の台数（childTotal）は超過分も数える
+//     （サーバは親機1台あたりの紐付けを同じ数までに制限している）
+//   - 途中で切れた応答はどこで切れても finish() が失敗する（子機表を半端に差し替えない）
+// 応答の大きさごとの解釈時間は tools/bench/config_parse_bench.cpp で測る。
+//
+//   実行: pio test -e native -f native/test_config_parse
+// =====================================================================
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <algorithm>
+#include <unity.h>
+#include "config.h"
+#include "device_config.h"
+
+#define CARECV_CHUNK 1460   // 親機の受信1回分の上限
+
+// 親機 foxsense-001 の設定応答（サーバの buildDeviceConfig と同じ並び＋未知のキー）
+static std::string synthConfig(int children, int nameLen, bool nested, bool firmware) {
+    std::string name;
+    for (int i = 0; i < nameLen; i++) name += (i % 17 == 3) ? "\\\"" : (i % 13 == 5 ? "\\\\" : "x");
+    std::string s = "{\"success\":true,\"data\":{\"deviceId\":\"foxsense-001\",\"name\":\"a \\\"q\\\" }{ ,\","
+                    "\"meta\":{\"children\":[1,2]},\"parentIdHash\":2849513012,\"parentIdHashHex\":\"a9d8c134\",\"children\":[";
+    for (int i = 0; i < children; i++) {
+        char b[256];
+        snprintf(b, sizeof(b), "%s{\"deviceId\":\"%08x\",\"deviceIdNum\":%u,%s\"logicalId\":%d,\"pairingStatus\":\"%s\",\"name\":\"",
+                 i ? "," : "", 0x10000000u + i, 0x10000000u + i,
+                 nested ? "\"loc\":{\"lat\":1.5,\"tags\":[\"x\",{\"deviceIdNum\":9}]}," : "", i % 250,
+                 (i % 7 == 0) ? "PENDING" : "PAIRED");
+        s += b;
+        s += name;
+        s += "\"}";
+    }
+    s += "]";
+    if (firmware) s += ",\"firmware\":{\"versionCode\":42,\"size\":1234567,\"url\":\"/firmware/fw.bin\","
+                       "\"md5\":\"0123456789abcdef0123456789abcdef\",\"extra\":{\"size\":1}}";
+    else s += ",\"firmware\":null";
+    s += ",\"transport\":\"udp\"}}";
+    return s;
+}
+
+static bool sameConfig(const DeviceConfig& a, const DeviceConfig& b) {
+    if (a.parentIdHash != b.parentIdHash || a.hasChildren != b.hasChildren || a.childCount != b.childCount ||
+        a.childTotal != b.childTotal || a.hasFirmware != b.hasFirmware || a.transport != b.transport) return false;
+    if (a.hasFirmware && memcmp(&a.fw, &b.fw, sizeof(a.fw)) != 0) return false;
+    for (int i = 0; i < a.childCount; i++) {
+        if (memcmp(&a.children[i], &b.children[i], sizeof(ConfigChild)) != 0) return false;
+    }
+    return true;
+}
+
+// 一括で読んだ結果が応答の内容どおりか
+static bool checkContent(const DeviceConfig& c, int children, bool firmware, const char* name) {
+    int kept = children < MAX_CHILD_DEVICES ? children : MAX_CHILD_DEVICES;
+    if (c.parentIdHash != 2849513012u || !c.hasChildren || c.childTotal != children || c.childCount != kept ||
+        c.transport != TRANSPORT_UDP || c.hasFirmware != firmware) {
+        printf("%s: hash %u children %u/%u (want %d/%d) fw %d transport %u\n", name, c.parentIdHash,
+               c.childCount, c.childTotal, kept, children, c.hasFirmware, c.transport);
+        return false;
+    }
+    for (int i = 0; i < c.childCount; i++) {
+        const ConfigChild& ch = c.children[i];
+        char hex[9];
+        snprintf(hex, sizeof(hex), "%08x", 0x10000000u + i);
+        if (ch.id != 0x10000000u + i || ch.logicalId != i % 250 || ch.pending != (i % 7 == 0) || strcmp(ch.idHex, hex)) {
+            printf("%s: child %d wrong (id %08x lid %u pending %d hex %s)\n", name, i, ch.id, ch.logicalId, ch.pending, ch.idHex);
+            return false;
+        }
+    }
+    if (firmware && (c.fw.versionCode != 42 || c.fw.size != 1234567 || strcmp(c.fw.url, "/firmware/fw.bin") ||
+                     strcmp(c.fw.md5, "0123456789abcdef0123456789abcdef"))) {
+        printf("%s: firmware wrong (%u %u %s %s)\n", name, c.fw.versionCode, c.fw.size, c.fw.url, c.fw.md5);
+        return false;
+    }
+    return true;
+}
+
+static bool feedChunks(const std::string& js, size_t len, size_t chunk, DeviceConfig& c) {
+    DeviceConfigParser p(c);
+    for (size_t o = 0; o < len; o += chunk) p.feed(js.data() + o, std::min(chunk, len - o));
+    return p.finish() && p.bytes() == len;
+}
+
+static bool checkResponse(int children, int nameLen, bool nested, bool firmware) {
+    static ConfigChild ref[MAX_CHILD_DEVICES], got[MAX_CHILD_DEVICES];
+    char name[64];
+    snprintf(name, sizeof(name), "%d children, name %d B%s", children, nameLen, nested ? ", nested" : "");
+    std::string js = synthConfig(children, nameLen, nested, firmware);
+
+    DeviceConfig r = {};
+    r.children = ref; r.childCap = MAX_CHILD_DEVICES;
+    memset(ref, 0, sizeof(ref));
+    if (!parseDeviceConfig(js.c_str(), js.size(), r)) { printf("%s: parse failed\n", name); return false; }
+    if (!checkContent(r, children, firmware, name)) return false;
+
+    static const size_t chunks[] = { 1, 2, 3, 7, 64, 200, DEVICE_CONFIG_WINDOW - 1, DEVICE_CONFIG_WINDOW,
+                                     DEVICE_CONFIG_WINDOW + 1, CARECV_CHUNK };
+    for (size_t cs : chunks) {
+        DeviceConfig c = {};
+        c.children = got; c.childCap = MAX_CHILD_DEVICES;
+        memset(got, 0, sizeof(got));
+        if (!feedChunks(js, js.size(), cs, c) || !sameConfig(r, c)) {
+            printf("%s: %zu B chunks differ from one-shot parse\n", name, cs);
+            return false;
+        }
+    }
+    // 途中で切れた応答（先頭から1B刻み。長い応答は約400点）
+    size_t step = js.size() / 400 + 1;
+    for (size_t cut = 1; cut < js.size(); cut += step) {
+        DeviceConfig c = {};
+        c.children = got; c.childCap = MAX_CHILD_DEVICES;
+        if (feedChunks(js, cut, 64, c)) {
+            printf("%s: truncated at %zu/%zu B but finish() succeeded\n", name, cut, js.size());
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool checkMalformed() {
+    static ConfigChild ch[MAX_CHILD_DEVICES];
+    DeviceConfig c = {};
+    c.children = ch; c.childCap = MAX_CHILD_DEVICES;
+    bool ok = true;
+    if (parseDeviceConfig("{\"a\":[}", 7, c)) { printf("mismatched brackets accepted\n"); ok = false; }
+    if (!parseDeviceConfig("{\"data\":{\"parentIdHash\":5}}", 27, c) || c.hasChildren || c.parentIdHash != 5) {
+        printf("config without children: hasChildren %d hash %u\n", c.hasChildren, c.parentIdHash);
+        ok = false;
+    }
+    return ok;
+}
+
+void setUp() {}
+void tearDown() {}
+
+static void test_malformed() { TEST_ASSERT_TRUE(checkMalformed()); }
+
+static const int childCounts[] = { 0, 1, 8, MAX_CHILD_DEVICES, MAX_CHILD_DEVICES + 1, 100, 200 };
+
+static void checkNameLen(int nameLen) {
+    bool ok = true;
+    for (int n : childCounts) {
+        for (int nested = 0; nested < 2; nested++) ok = checkResponse(n, nameLen, nested, n % 2 == 0) && ok;
+    }
+    TEST_ASSERT_TRUE(ok);
+}
+
+static void test_names_empty() { checkNameLen(0); }
+static void test_names_short() { checkNameLen(10); }
+static void test_names_below_token_max() { checkNameLen(JSON_TOK_MAX_STRING - 1); }
+static void test_names_at_token_max() { checkNameLen(JSON_TOK_MAX_STRING); }
+static void test_names_long() { checkNameLen(500); }
+static void test_names_very_long() { checkNameLen(3000); }
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_malformed);
+    RUN_TEST(test_names_empty);
+    RUN_TEST(test_names_short);
+    RUN_TEST(test_names_below_token_max);
+    RUN_TEST(test_names_at_token_max);
+    RUN_TEST(test_names_long);
+    RUN_TEST(test_names_very_long);
+    return UNITY_END();
+}
@@ -0,0 +1,77 @@
+// =====================================================================
+// 電池残量に応じた動作段階（src/energy_governor.h）の確認  ※ホスト用ユニットテスト（env:native）
+// ---------------------------------------------------------------------
+// 閾値とヒステリシス、充電中の早戻り、電池なし（ENERGY_NO_BATTERY）と残量0%の区別を確かめる。
+//
+//   実行: pio test -e native -f native/test_energy_governor
+// =====================================================================
+
+#include <unity.h>
+#include "energy_governor.h"
+
+// 親機の既定値（config.h の ENERGY_*）
+static const EnergyParams params = { 40, 55, 20, 30, 4000, { 3, 4, 6 }, 48 };
+
+static uint8_t step(EnergyState& s, int pct, bool charging = false, int vbusMv = 0) {
+    EnergyReading r = { pct, vbusMv, charging };
+    return energyUpdate(s, r, params);
+}
+
+void setUp() {}
+void tearDown() {}
+
+static void test_thresholds_with_hysteresis() {
+    EnergyState s = {};
+    TEST_ASSERT_EQUAL_UINT8(ENERGY_NORMAL, step(s, 80));
+    TEST_ASSERT_EQUAL_UINT8(ENERGY_SAVE, step(s, 40));
+    TEST_ASSERT_EQUAL_UINT8(ENERGY_SAVE, step(s, 50));       // exit(55) 未満では戻らない
+    TEST_ASSERT_EQUAL_UINT8(ENERGY_CRITICAL, step(s, 20));
+    TEST_ASSERT_EQUAL_UINT8(ENERGY_CRITICAL, step(s, 25));
+    TEST_ASSERT_EQUAL_UINT8(ENERGY_SAVE, step(s, 30));
+    TEST_ASSERT_EQUAL_UINT8(ENERGY_NORMAL, step(s, 55));
+    TEST_ASSERT_EQUAL_UINT(4, s.changes);
+}
+
+static void test_charging_returns_early() {
+    EnergyState s = { ENERGY_CRITICAL, 15, false, 0 };
+    TEST_ASSERT_EQUAL_UINT8(ENERGY_SAVE, step(s, 21, true));
+    TEST_ASSERT_EQUAL_UINT8(ENERGY_NORMAL, step(s, 41, true));
+}
+
+static void test_no_battery_is_normal() {
+    EnergyState s = { ENERGY_CRITICAL, 10, false, 0 };
+    TEST_ASSERT_EQUAL_UINT8(ENERGY_NORMAL, step(s, ENERGY_NO_BATTERY, false, 5000));
+    TEST_ASSERT_EQUAL_UINT8(0, s.lastPct);
+}
+
+// 電池があって残量0%: 1段ずつではなく直ちに CRITICAL（充電中でも戻さない）
+static void test_drained_battery_is_critical() {
+    EnergyState s = {};
+    TEST_ASSERT_EQUAL_UINT8(ENERGY_CRITICAL, step(s, 0));
+    TEST_ASSERT_EQUAL_UINT8(ENERGY_CRITICAL, step(s, 0, true, 5000));
+    EnergyReading r = { 0, 0, false };
+    EnergyPlan e = energyPlan(s.tier, r, params);
+    TEST_ASSERT_EQUAL_UINT8(6, e.roundsPerUpload);
+    TEST_ASSERT_FALSE(e.configFetch);
+    TEST_ASSERT_FALSE(e.acPoll);
+    TEST_ASSERT_FALSE(e.otaAllowed);
+}
+
+static void test_plan_caps_rounds_per_upload() {
+    EnergyParams p = params;
+    p.queueCap = 4;
+    EnergyReading r = { 10, 0, false };
+    TEST_ASSERT_EQUAL_UINT8(4, energyPlan(ENERGY_CRITICAL, r, p).roundsPerUpload);
+    r.vbusMv = 5000;
+    TEST_ASSERT_TRUE(energyPlan(ENERGY_SAVE, r, p).otaAllowed);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_thresholds_with_hysteresis);
+    RUN_TEST(test_charging_returns_early);
+    RUN_TEST(test_no_battery_is_normal);
+    RUN_TEST(test_drained_battery_is_critical);
+    RUN_TEST(test_plan_caps_rounds_per_upload);
+    return UNITY_END();
+}
@@ -0,0 +1,97 @@
+// =====================================================================
+// Cat-M1 / NB-IoT の選択（src/rat_select.h）の確認  ※ホスト用ユニットテスト（env:native）
+// ---------------------------------------------------------------------
+// 未計測RATの試行、µJ/byte での選択と「両方」、再評価周期の試行、連続失敗での締め出しと
+// 再評価周期ごとの試し直し（一時的な圏外から復帰できること）を確かめる。
+//
+//   実行: pio test -e native -f native/test_rat_select
+// =====================================================================
+
+#include <unity.h>
+#include "rat_select.h"
+
+#define REEVAL 24
+#define MAX_FAILURES 3
+#define MARGIN 0.15f
+
+static uint8_t next(RatStats& s) { return ratNextMode(s, REEVAL, MAX_FAILURES, MARGIN); }
+
+void setUp() {}
+void tearDown() {}
+
+static void test_measures_both_then_picks_cheaper() {
+    RatStats s = {};
+    TEST_ASSERT_EQUAL_UINT8(RAT_CMNB_CATM, next(s));
+    ratRecord(s, RAT_CATM, 10000, 1000);   // 10 µJ/B
+    TEST_ASSERT_EQUAL_UINT8(RAT_CMNB_NBIOT, next(s));   // 未計測を試す
+    ratRecord(s, RAT_NBIOT, 5000, 1000);   // 5 µJ/B
+    TEST_ASSERT_EQUAL_UINT8(RAT_CMNB_NBIOT, next(s));
+    for (int i = 0; i < 10; i++) ratRecord(s, RAT_NBIOT, 9500, 1000);   // 差が15%以内に縮む
+    TEST_ASSERT_EQUAL_UINT8(RAT_CMNB_BOTH, next(s));
+}
+
+static void test_periodic_reevaluation() {
+    RatStats s = {};
+    next(s);
+    ratRecord(s, RAT_CATM, 10000, 1000);
+    next(s);
+    ratRecord(s, RAT_NBIOT, 5000, 1000);
+    for (int i = 1; i < REEVAL; i++) TEST_ASSERT_EQUAL_UINT8(RAT_CMNB_NBIOT, next(s));
+    TEST_ASSERT_EQUAL_UINT8(RAT_CMNB_CATM, next(s));   // 高い方を1回試す
+    TEST_ASSERT_EQUAL_UINT8(RAT_CMNB_NBIOT, next(s));
+}
+
+// NB-IoT が保守で続けて失敗 → 締め出し → 再評価周期で試し直して復帰
+static void test_lockout_then_recovery() {
+    RatStats s = {};
+    next(s);
+    ratRecord(s, RAT_CATM, 10000, 1000);
+    next(s);
+    ratRecord(s, RAT_NBIOT, 5000, 1000);
+    for (int i = 0; i < MAX_FAILURES; i++) {
+        TEST_ASSERT_EQUAL_UINT8(RAT_CMNB_NBIOT, next(s));
+        ratRecordFailure(s, RAT_CMNB_NBIOT);
+    }
+    // 締め出し中は Cat-M1 に固定。再評価周期が来たら NB-IoT を1回試す
+    int calls = 0;
+    uint8_t m;
+    while ((m = next(s)) == RAT_CMNB_CATM && calls < 2 * REEVAL) {
+        ratRecord(s, RAT_CATM, 10000, 1000);
+        calls++;
+    }
+    TEST_ASSERT_EQUAL_UINT8(RAT_CMNB_NBIOT, m);
+    TEST_ASSERT_TRUE(calls > 0 && calls < REEVAL);
+    // まだ圏外なら次の周期まで再び締め出す
+    ratRecordFailure(s, RAT_CMNB_NBIOT);
+    TEST_ASSERT_EQUAL_UINT(MAX_FAILURES, s.failures[RAT_NBIOT]);
+    for (int i = 0; i < REEVAL - 1; i++) TEST_ASSERT_EQUAL_UINT8(RAT_CMNB_CATM, next(s));
+    // 次の周期で復帰していれば、以後は安い NB-IoT に戻る
+    TEST_ASSERT_EQUAL_UINT8(RAT_CMNB_NBIOT, next(s));
+    ratRecord(s, RAT_NBIOT, 5000, 1000);
+    TEST_ASSERT_EQUAL_UINT(0, s.failures[RAT_NBIOT]);
+    TEST_ASSERT_EQUAL_UINT8(RAT_CMNB_NBIOT, next(s));
+}
+
+// 両方とも締め出されたら従来の Cat-M1。周期で両方許可を試し、在圏した方が復帰する
+static void test_both_locked_out() {
+    RatStats s = {};
+    next(s);
+    ratRecord(s, RAT_CATM, 10000, 1000);
+    next(s);
+    ratRecord(s, RAT_NBIOT, 5000, 1000);
+    for (int i = 0; i < MAX_FAILURES; i++) ratRecordFailure(s, RAT_CMNB_BOTH);
+    for (int i = 0; i < REEVAL - 1; i++) TEST_ASSERT_EQUAL_UINT8(RAT_CMNB_CATM, next(s));
+    TEST_ASSERT_EQUAL_UINT8(RAT_CMNB_BOTH, next(s));
+    ratRecord(s, RAT_CATM, 10000, 1000);
+    TEST_ASSERT_EQUAL_UINT8(RAT_CMNB_NBIOT, next(s));   // NB-IoT は上限の1つ手前でまだ使え、安い方
+    TEST_ASSERT_EQUAL_UINT(MAX_FAILURES - 1, s.failures[RAT_NBIOT]);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_measures_both_then_picks_cheaper);
+    RUN_TEST(test_periodic_reevaluation);
+    RUN_TEST(test_lockout_then_recovery);
+    RUN_TEST(test_both_locked_out);
+    return UNITY_END();
+}
@@ -0,0 +1,403 @@
+// =====================================================================
+// フラッシュ退避キュー（src/round_log.h）の電断試験  ※ホスト用ユニットテスト（env:native）
+// ---------------------------------------------------------------------
+// 記憶域をメモリ上の模擬（RoundLogIo）に差し替え、追記・セグメント切替・容量超過での最古破棄・
+// 先頭の切り詰め（advance / 受取済みの破棄）の各操作について、書込みの全バイト位置で電断させる。
+// 電断した操作は、追記なら先頭の一部だけ、メタの置換なら空にして一部だけ書けた状態で止まる
+// （LittleFS より厳しい生フラッシュ相当。削除は1単位として前後で切る）。
+// 電源投入（RTC消失 → roundLogOpen で復元）の後、次を確かめる:
+//   - 読み出せるラウンドが、電断までに書き終えた操作だけを反映した内容と完全に一致する
+//     （途中まで書けたレコードが現れない・確定したレコードが消えない・送信済みが戻らない）
+//   - 件数・先頭の epoch/seq が状態と一致する
+//   - 続けて追記・全件の取り出しができ、送信済みのセグメントが残らない
+// あわせて、メタの置換が失敗を返す記憶域（電断ではなく書込みエラー）で、容量超過の追記と
+// 受取済みの破棄が先頭・件数を変えずに失敗を返す（止まらずに戻る）こと、受取済みの破棄は
+// 件数によらずメタ書込み1回で済むことを確かめる。
+// 期待値は模擬記憶域の側で、書き終えた追記（レコード）とメタ（先頭位置）だけから組み立てる。
+//
+//   実行: pio test -e native -f native/test_round_log
+// =====================================================================
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <map>
+#include <string>
+#include <vector>
+#include <unity.h>
+#include "round_log.h"
+
+#define SEG_BYTES 256   // セグメントを小さくして切替・容量超過を数ラウンドで起こす
+#define MAX_SEGS  4
+
+// ---------------------------------------------------------------------
+// メモリ上の記憶域（書込みバイト数で電断する）
+// ---------------------------------------------------------------------
+struct PowerCut {};
+
+struct Entry {          // 書き終えたレコード
+    RoundLogPos pos;
+    uint32_t epoch;
+    uint32_t seq;
+};
+
+struct Store {
+    std::map<std::string, std::vector<uint8_t>> files;
+    std::vector<Entry> model;    // 書き終えた操作から見た未送信レコード（先頭=最古）
+    long written = 0;            // 書込み単位（バイト、削除は1）の累計
+    long cutAt = -1;             // この単位に達したら電断（-1=しない）
+    long torn = 0;               // 途中で切れた書込みの数
+    bool failWrite = false;      // true でメタの置換が何も書かずに失敗を返す
+    long metaWrites = 0;         // メタの置換の回数
+};
+static Store fs;
+
+static bool posLess(RoundLogPos a, RoundLogPos b) { return a.seg < b.seg || (a.seg == b.seg && a.off < b.off); }
+
+// n 単位を書けるだけ書く（電断ならその手前までの単位数を返して PowerCut）
+static size_t spend(size_t n) {
+    if (fs.cutAt < 0 || fs.written + (long)n <= fs.cutAt) { fs.written += n; return n; }
+    return (size_t)(fs.cutAt - fs.written);
+}
+
+static long ioSize(void*, const char* name) {
+    auto it = fs.files.find(name);
+    return it == fs.files.end() ? -1 : (long)it->second.size();
+}
+
+static size_t ioRead(void*, const char* name, uint32_t off, uint8_t* buf, size_t n) {
+    auto it = fs.files.find(name);
+    if (it == fs.files.end() || off >= it->second.size()) return 0;
+    size_t k = it->second.size() - off < n ? it->second.size() - off : n;
+    memcpy(buf, it->second.data() + off, k);
+    return k;
+}
+
+static bool ioAppend(void*, const char* name, const uint8_t* p, size_t n) {
+    std::vector<uint8_t>& f = fs.files[name];   // 開いた時点で作られる
+    uint32_t off = (uint32_t)f.size();
+    size_t k = spend(n);
+    f.insert(f.end(), p, p + k);
+    if (k < n) { fs.torn++; throw PowerCut(); }
+    // 1回の追記 = 1レコード
+    CborReader rd(p + ROUND_LOG_REC_HEADER, n - ROUND_LOG_REC_HEADER);
+    int64_t ep;
+    RtcRound r;
+    if (rd.integer(ep) && cborReadRound(rd, r)) {
+        fs.model.push_back({ { (uint32_t)strtoul(name + 5, nullptr, 16), off }, (uint32_t)ep, r.seq });
+    }
+    return true;
+}
+
+static bool ioWrite(void*, const char* name, const uint8_t* p, size_t n) {
+    if (fs.failWrite) return false;
+    fs.metaWrites++;
+    std::vector<uint8_t>& f = fs.files[name];
+    f.clear();
+    size_t k = spend(n);
+    f.assign(p, p + k);
+    if (k < n) { fs.torn++; throw PowerCut(); }
+    // 書き終えたメタ = 先頭位置の確定
+    if (n == ROUND_LOG_META_BYTES && roundLogCrc16(p, 16) == (uint16_t)(p[16] | (p[17] << 8))) {
+        RoundLogPos head = { roundLogGet32(p + 8), roundLogGet32(p + 12) };
+        size_t i = 0;
+        while (i < fs.model.size() && posLess(fs.model[i].pos, head)) i++;
+        fs.model.erase(fs.model.begin(), fs.model.begin() + i);
+    }
+    return true;
+}
+
+static void ioRemove(void*, const char* name) {
+    if (spend(1) < 1) throw PowerCut();
+    fs.files.erase(name);
+}
+
+static const RoundLogIo io = { nullptr, ioSize, ioRead, ioAppend, ioWrite, ioRemove };
+
+// ---------------------------------------------------------------------
+// ラウンドと確認
+// ---------------------------------------------------------------------
+static RtcRound mk(uint32_t seq) {
+    RtcRound r;
+    memset(&r, 0, sizeof(r));
+    r.seq = seq;
+    r.ts = 1760000000 + seq * 1200;
+    r.pTemp = 18 + (seq % 50) / 4.0f; r.pHumid = 55; r.pPres = 1008.5f;
+    r.pBat = 80; r.pSignal = 18;
+    r.childCount = 1 + seq % 5;   // レコード長を毎回変える
+    for (int i = 0; i < r.childCount; i++) {
+        RtcChild& c = r.child[i];
+        c.id = 0xA0000000u + i; c.lid = i + 1;
+        c.received = (seq + i) % 3 != 0;
+        c.temp = 17 + i; c.humid = 60; c.pres = 1007; c.rssi = -80; c.bat = 95;
+    }
+    return r;
+}
+
+static size_t recBytes(uint32_t epoch, const RtcRound& r) {
+    uint8_t buf[ROUND_LOG_REC_MAX];
+    CborWriter w(buf, sizeof(buf));
+    w.unum(epoch);
+    cborWriteRound(w, r);
+    return ROUND_LOG_REC_HEADER + w.length();
+}
+
+static bool sameRound(const RtcRound& a, const RtcRound& b) {
+    uint8_t x[ROUND_LOG_REC_MAX], y[ROUND_LOG_REC_MAX];
+    CborWriter wa(x, sizeof(x)), wb(y, sizeof(y));
+    cborWriteRound(wa, a);
+    cborWriteRound(wb, b);
+    return wa.length() == wb.length() && memcmp(x, y, wa.length()) == 0;
+}
+
+// 読み出せる全レコード（消さない）。中身が mk(seq) と違えば false
+static bool dump(const RoundLogState& st0, std::vector<Entry>& out) {
+    RoundLogState st = st0;
+    RtcRound r[4];
+    out.clear();
+    for (;;) {
+        uint32_t ep = 0;
+        RoundLogPos next;
+        int n = roundLogPeek(st, io, r, 4, ep, next);
+        if (n == 0) return true;
+        for (int i = 0; i < n; i++) {
+            if (!sameRound(r[i], mk(r[i].seq))) { printf("    seq %u: content differs\n", r[i].seq); return false; }
+            out.push_back({ {}, ep, r[i].seq });
+        }
+        st.head = next;
+    }
+}
+
+static bool sameEntries(const std::vector<Entry>& a, const std::vector<Entry>& b) {
+    if (a.size() != b.size()) return false;
+    for (size_t i = 0; i < a.size(); i++) {
+        if (a[i].epoch != b[i].epoch || a[i].seq != b[i].seq) return false;
+    }
+    return true;
+}
+
+static void printEntries(const char* label, const std::vector<Entry>& v) {
+    printf("    %s:", label);
+    for (const Entry& e : v) printf(" %u:%u", e.epoch, e.seq);
+    printf("\n");
+}
+
+// 電源投入後: 復元した内容が書き終えた操作の分と一致し、続けて使えるか
+static bool checkRecovery(const char* name, long cut) {
+    RoundLogState st;
+    roundLogOpen(st, io, SEG_BYTES, MAX_SEGS);
+    std::vector<Entry> got;
+    bool ok = dump(st, got) && sameEntries(got, fs.model);
+    if (ok && st.count != got.size()) ok = false;
+    if (ok && !got.empty() && (st.headEpoch != got[0].epoch || st.headSeq != got[0].seq)) ok = false;
+    if (!ok) {
+        printf("  %s: cut at unit %ld: recovered state differs (count %u, head %u:%u)\n", name, cut, st.count,
+               st.headEpoch, st.headSeq);
+        printEntries("recovered", got);
+        printEntries("committed", fs.model);
+        return false;
+    }
+
+    // 続けて追記（電源投入で新しい通番系列）→ 全件取り出し
+    const uint32_t epoch = 99;
+    for (uint32_t s = 1; s <= 3; s++) {
+        if (!roundLogAppend(st, io, epoch, mk(s))) { printf("  %s: cut at unit %ld: append after recovery failed\n", name, cut); return false; }
+    }
+    if (!dump(st, got) || !sameEntries(got, fs.model) || st.count != got.size()) {
+        printf("  %s: cut at unit %ld: appends after recovery not read back\n", name, cut);
+        printEntries("read", got);
+        printEntries("expected", fs.model);
+        return false;
+    }
+    RtcRound r[3];
+    uint32_t ep = 0;
+    RoundLogPos next;
+    while (int n = roundLogPeek(st, io, r, 3, ep, next)) {
+        if (!roundLogAdvance(st, io, next, n)) { printf("  %s: cut at unit %ld: drain failed\n", name, cut); return false; }
+    }
+    if (st.count != 0 || !fs.model.empty()) {
+        printf("  %s: cut at unit %ld: %u record(s) left after drain\n", name, cut, st.count);
+        return false;
+    }
+    // 送信済みのセグメントは消えている（追記中の末尾セグメントだけ残る）
+    for (auto& f : fs.files) {
+        if (f.first.compare(0, 5, "/rl_s") == 0 && strtoul(f.first.c_str() + 5, nullptr, 16) < st.head.seg) {
+            printf("  %s: cut at unit %ld: segment %s left behind the head after drain\n", name, cut, f.first.c_str());
+            return false;
+        }
+    }
+    return true;
+}
+
+// ---------------------------------------------------------------------
+// 場面: setup で記憶域を作り（電断なし）、op の書込み全単位それぞれで電断させる
+// ---------------------------------------------------------------------
+typedef void (*SetupFn)(RoundLogState& st);
+typedef void (*OpFn)(RoundLogState& st);
+
+static bool scenario(const char* name, SetupFn setup, OpFn op) {
+    fs = Store();
+    RoundLogState st;
+    roundLogOpen(st, io, SEG_BYTES, MAX_SEGS);
+    setup(st);
+    const Store base = fs;
+    const RoundLogState baseSt = st;
+
+    // 電断なしで書込み単位数を数える
+    fs.written = 0;
+    op(st);
+    long units = fs.written;
+    size_t before = base.model.size(), after = fs.model.size();
+
+    long torn = 0;
+    for (long cut = 0; cut <= units; cut++) {
+        fs = base;
+        fs.written = 0;
+        fs.torn = 0;
+        fs.cutAt = cut;
+        st = baseSt;
+        try {
+            op(st);
+        } catch (PowerCut&) {
+        }
+        torn += fs.torn;
+        fs.cutAt = -1;
+        if (!checkRecovery(name, cut)) return false;
+    }
+    printf("%-34s %4ld units, %4ld cut points (%3ld torn writes) ok, %2zu -> %2zu round(s)\n", name, units, units + 1, torn,
+           before, after);
+    return true;
+}
+
+// ---- 場面の準備 ----
+static uint32_t nextSeq;
+
+static void appendRounds(RoundLogState& st, int n) {
+    for (int i = 0; i < n; i++) roundLogAppend(st, io, 7, mk(++nextSeq));
+}
+
+// 次の追記がセグメントを切り替える所まで
+static void fillSegment(RoundLogState& st) {
+    while (st.tail.off == 0 || st.tail.off + recBytes(7, mk(nextSeq + 1)) <= SEG_BYTES) appendRounds(st, 1);
+}
+
+static void setupEmpty(RoundLogState&) { nextSeq = 0; }
+static void setupOne(RoundLogState& st) { nextSeq = 0; appendRounds(st, 1); }
+static void setupSegmentFull(RoundLogState& st) { nextSeq = 0; fillSegment(st); }
+static void setupLogFull(RoundLogState& st) {
+    nextSeq = 0;
+    fillSegment(st);
+    while (st.tail.seg - st.head.seg < MAX_SEGS - 1) { appendRounds(st, 1); fillSegment(st); }
+}
+static void setupFourSegments(RoundLogState& st) {
+    nextSeq = 0;
+    fillSegment(st);
+    while (st.tail.seg < MAX_SEGS) { appendRounds(st, 1); fillSegment(st); }
+}
+// 途中で切れた追記が末尾に残った記憶域（電断 → 復元済み）
+static void setupTornTail(RoundLogState& st) {
+    nextSeq = 0;
+    appendRounds(st, 2);
+    fs.cutAt = fs.written + 5;
+    try { appendRounds(st, 1); } catch (PowerCut&) {}
+    fs.cutAt = -1;
+    nextSeq--;
+    roundLogOpen(st, io, SEG_BYTES, MAX_SEGS);
+}
+
+// ---- 操作 ----
+static void opAppend(RoundLogState& st) { roundLogAppend(st, io, 7, mk(nextSeq + 1)); }
+
+static void opAdvance(RoundLogState& st, int take) {
+    RtcRound r[64];
+    uint32_t ep = 0;
+    RoundLogPos next;
+    int n = roundLogPeek(st, io, r, take, ep, next);
+    roundLogAdvance(st, io, next, n);
+}
+static void opAdvanceOne(RoundLogState& st) { opAdvance(st, 1); }
+static void opAdvanceTwoSegments(RoundLogState& st) {
+    // 先頭から2セグメント分＋1件（セグメント削除を2回含む）
+    RoundLogState s = st;
+    int take = 0;
+    RtcRound r;
+    uint32_t ep = 0;
+    RoundLogPos next;
+    while (s.head.seg < st.head.seg + 2 && roundLogPeek(s, io, &r, 1, ep, next) == 1) { s.head = next; take++; }
+    opAdvance(st, take + 1);
+}
+static void opDropAcked(RoundLogState& st) { roundLogDropAcked(st, io, 7, st.headSeq + 4); }
+
+// メタを書けない記憶域: 先頭を進める操作は状態を変えずに false を返し、書けるようになれば続けられる
+static bool checkMetaWriteFails() {
+    fs = Store();
+    RoundLogState st;
+    roundLogOpen(st, io, SEG_BYTES, MAX_SEGS);
+    setupLogFull(st);
+    const RoundLogState before = st;
+    const size_t records = fs.model.size();
+    fs.failWrite = true;
+    bool appended = roundLogAppend(st, io, 7, mk(nextSeq + 1));
+    uint32_t acked = roundLogDropAcked(st, io, 7, st.headSeq + 4);
+    fs.failWrite = false;
+    if (appended || acked != 0 || st.head.seg != before.head.seg || st.head.off != before.head.off ||
+        st.count != before.count || st.dropped != before.dropped || fs.model.size() != records) {
+        printf("  meta write fails: append %d, acked %u, head %u:%u -> %u:%u, count %u -> %u, dropped %u\n", appended,
+               acked, before.head.seg, before.head.off, st.head.seg, st.head.off, before.count, st.count, st.dropped);
+        return false;
+    }
+    if (!roundLogAppend(st, io, 7, mk(++nextSeq)) || !checkRecovery("meta write fails", -1)) {
+        printf("  meta write fails: log not usable after the write error cleared\n");
+        return false;
+    }
+    printf("%-34s ok, %u round(s) kept\n", "meta write fails (log full)", before.count);
+    return true;
+}
+
+// 受取済みの破棄は何件でもメタ書込み1回
+static bool checkDropAckedOneMeta() {
+    fs = Store();
+    RoundLogState st;
+    roundLogOpen(st, io, SEG_BYTES, MAX_SEGS);
+    setupFourSegments(st);
+    uint32_t want = st.count - 1;
+    fs.metaWrites = 0;
+    uint32_t n = roundLogDropAcked(st, io, 7, st.headSeq + want - 1);
+    if (n != want || st.count != 1 || fs.metaWrites != 1) {
+        printf("  drop acked: %u of %u round(s), %ld meta write(s), %u left\n", n, want, fs.metaWrites, st.count);
+        return false;
+    }
+    printf("%-34s ok, %u round(s) in %ld meta write\n", "drop acked (all but one)", n, fs.metaWrites);
+    return true;
+}
+
+void setUp() {}
+void tearDown() {}
+
+static void test_meta_write_fails() { TEST_ASSERT_TRUE(checkMetaWriteFails()); }
+static void test_drop_acked_one_meta_write() { TEST_ASSERT_TRUE(checkDropAckedOneMeta()); }
+static void test_append_empty_log() { TEST_ASSERT_TRUE(scenario("append (empty log)", setupEmpty, opAppend)); }
+static void test_append_same_segment() { TEST_ASSERT_TRUE(scenario("append (same segment)", setupOne, opAppend)); }
+static void test_append_rotate() { TEST_ASSERT_TRUE(scenario("append (rotate to next segment)", setupSegmentFull, opAppend)); }
+static void test_append_log_full() { TEST_ASSERT_TRUE(scenario("append (log full: drop oldest)", setupLogFull, opAppend)); }
+static void test_append_after_torn() { TEST_ASSERT_TRUE(scenario("append (after a torn append)", setupTornTail, opAppend)); }
+static void test_advance_within_segment() { TEST_ASSERT_TRUE(scenario("advance (within segment)", setupFourSegments, opAdvanceOne)); }
+static void test_advance_two_segments() {
+    TEST_ASSERT_TRUE(scenario("advance (across two segments)", setupFourSegments, opAdvanceTwoSegments));
+}
+static void test_drop_acked() { TEST_ASSERT_TRUE(scenario("drop acked (5 rounds)", setupFourSegments, opDropAcked)); }
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_meta_write_fails);
+    RUN_TEST(test_drop_acked_one_meta_write);
+    RUN_TEST(test_append_empty_log);
+    RUN_TEST(test_append_same_segment);
+    RUN_TEST(test_append_rotate);
+    RUN_TEST(test_append_log_full);
+    RUN_TEST(test_append_after_torn);
+    RUN_TEST(test_advance_within_segment);
+    RUN_TEST(test_advance_two_segments);
+    RUN_TEST(test_drop_acked);
+    return UNITY_END();
+}
@@ -0,0 +1,190 @@
+// =====================================================================
+// 蓄積ラウンドのRTC圧縮表現（src/round_pack.h）の往復確認  ※ホスト用ユニットテスト（env:native）
+// ---------------------------------------------------------------------
+// 詰めたラウンドを RoundPackReader で展開し、送信と同じ CBOR round 配列が元と一致すること
+// （RTCに置いても送信内容が変わらないこと）を確かめる。合成トレースのほか、子機リストの
+// 入れ替わり・NaN・大きな飛び（seq 欠番、時計の戻り、値の急変）と、アリーナが一杯の追記を扱う。
+// 1ラウンドあたりのバイト数は tools/bench/round_pack_bench.cpp で測る。
+//
+//   実行: pio test -e native -f native/test_round_pack
+// =====================================================================
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+#include <unity.h>
+#include "round_pack.h"
+#include "round_cbor.h"
+
+#define ARENA_BYTES 2688   // 親機の RTC_ROUND_ARENA_BYTES
+
+static uint8_t arena[ARENA_BYTES];
+
+static RtcRound mk(uint32_t seq, int children) {
+    RtcRound r;
+    memset(&r, 0, sizeof(r));
+    r.seq = seq;
+    r.ts = 1760000000 + seq * 1200;
+    r.pTemp = 18.25f; r.pHumid = 55.5f; r.pPres = 1008.5f;
+    r.pBat = 80; r.pVbus = 5000; r.pSignal = 18;
+    r.childCount = children;
+    for (int j = 0; j < children; j++) {
+        RtcChild& c = r.child[j];
+        c.id = 0xA0000000u + j; c.lid = j + 1;
+        c.received = true;
+        c.temp = 17 + j * 0.25f; c.humid = 60.5f; c.pres = 1007.1f; c.rssi = -70 - j; c.bat = 95;
+    }
+    return r;
+}
+
+// 合成トレース: 20分毎、日周の正弦＋ノイズ、受信漏れ5%
+static void synthTrace(std::vector<RtcRound>& out, int rounds, int children) {
+    srand(1);
+    auto noise = [](float a) { return a * ((rand() % 2001) / 1000.0f - 1.0f); };
+    for (int i = 0; i < rounds; i++) {
+        RtcRound r = mk(i + 1, children);
+        r.ts += (rand() % 5 == 0 ? rand() % 3 - 1 : 0);
+        float day = sinf(i * 2 * 3.14159265f / 72);
+        r.pTemp = 18 + 6 * day + noise(0.1f);
+        r.pHumid = 60 - 15 * day + noise(0.5f);
+        r.pPres = 1008 + 3 * sinf(i / 200.0f) + noise(0.1f);
+        r.pBat = 80 - i / 100; r.pVbus = day > 0 ? 5000 : 0; r.pSignal = 18 + rand() % 3;
+        for (int j = 0; j < children; j++) {
+            RtcChild& c = r.child[j];
+            c.received = rand() % 100 >= 5;
+            if (!c.received) { c.temp = c.humid = c.pres = 0; c.rssi = 0; c.bat = 0; continue; }
+            c.temp = 17 + j * 0.3f + 7 * day + noise(0.15f);
+            c.humid = 65 - 18 * day + noise(0.8f);
+            c.pres = 1007 + 3 * sinf(i / 200.0f) + noise(0.1f);
+            c.rssi = -70 - j - rand() % 4; c.bat = 95 - i / 150;
+        }
+        out.push_back(r);
+    }
+}
+
+static bool sameCbor(const RtcRound& a, const RtcRound& b) {
+    static uint8_t x[4096], y[4096];
+    CborWriter wa(x, sizeof(x)), wb(y, sizeof(y));
+    cborWriteRound(wa, a);
+    cborWriteRound(wb, b);
+    return wa.ok() && wb.ok() && wa.length() == wb.length() && memcmp(x, y, wa.length()) == 0;
+}
+
+// rounds を順に詰め、一杯になるたびに展開して照合してから空にして続ける。照合したラウンド数を返す（-1=不一致）
+static int packRoundTrip(const std::vector<RtcRound>& rounds) {
+    RoundPackState st;
+    roundPackClear(st);
+    size_t start = 0;
+    int checked = 0;
+    auto verify = [&](size_t end) {
+        RoundPackReader rd(arena, st);
+        RtcRound r;
+        for (size_t k = start; k < end; k++) {
+            if (!rd.next(r) || !sameCbor(r, rounds[k])) {
+                printf("    round %zu (seq %u) differs after unpack\n", k, rounds[k].seq);
+                return false;
+            }
+            checked++;
+        }
+        return !rd.next(r);   // 余分なラウンドが出てこない
+    };
+    for (size_t i = 0; i < rounds.size(); i++) {
+        if (roundPackAppend(arena, sizeof(arena), st, rounds[i])) continue;
+        if (st.count == 0 || !verify(i)) return -1;
+        roundPackClear(st);
+        start = i;
+        if (!roundPackAppend(arena, sizeof(arena), st, rounds[i])) return -1;
+    }
+    return verify(rounds.size()) ? checked : -1;
+}
+
+void setUp() {}
+void tearDown() {}
+
+static void test_synthetic_trace() {
+    std::vector<RtcRound> t;
+    synthTrace(t, 72 * 14, 8);
+    TEST_ASSERT_EQUAL_INT((int)t.size(), packRoundTrip(t));
+}
+
+static void test_max_children() {
+    std::vector<RtcRound> t;
+    synthTrace(t, 72, MAX_CHILD_DEVICES);
+    TEST_ASSERT_EQUAL_INT((int)t.size(), packRoundTrip(t));
+}
+
+// 子機の追加・削除・並べ替え・論理IDの変更（予測は id で引き継ぐ）
+static void test_child_list_changes() {
+    std::vector<RtcRound> t;
+    for (uint32_t s = 1; s <= 12; s++) {
+        RtcRound r = mk(s, 4);
+        if (s >= 4) r.childCount = 3;                              // 1台外れる
+        if (s >= 6) { r.child[3] = mk(s, 6).child[5]; r.childCount = 4; }   // 別の子機が入る
+        if (s >= 8) { RtcChild c = r.child[0]; r.child[0] = r.child[2]; r.child[2] = c; }   // 並べ替え
+        if (s >= 10) r.child[1].lid = 9;
+        if (s == 11) r.childCount = 0;
+        t.push_back(r);
+    }
+    TEST_ASSERT_EQUAL_INT((int)t.size(), packRoundTrip(t));
+}
+
+// NaN（センサ読み取り失敗）は NaN のまま戻る
+static void test_nan_values() {
+    RtcRound a = mk(1, 2), b = mk(2, 2);
+    b.pTemp = NAN; b.child[1].humid = NAN;
+    RoundPackState st;
+    roundPackClear(st);
+    TEST_ASSERT_TRUE(roundPackAppend(arena, sizeof(arena), st, a));
+    TEST_ASSERT_TRUE(roundPackAppend(arena, sizeof(arena), st, b));
+    TEST_ASSERT_TRUE(roundPackAppend(arena, sizeof(arena), st, mk(3, 2)));
+    RoundPackReader rd(arena, st);
+    RtcRound r;
+    TEST_ASSERT_TRUE(rd.next(r) && sameCbor(r, a));
+    TEST_ASSERT_TRUE(rd.next(r));
+    TEST_ASSERT_TRUE(isnan(r.pTemp));
+    TEST_ASSERT_TRUE(isnan(r.child[1].humid));
+    TEST_ASSERT_FALSE(isnan(r.child[1].temp));
+    TEST_ASSERT_TRUE(rd.next(r) && sameCbor(r, mk(3, 2)));   // NaN の後も予測が崩れない
+}
+
+// 差が大きい値（32bit の桁区分）: seq の欠番、時計の戻り・大きな進み、値の急変
+static void test_large_deltas() {
+    std::vector<RtcRound> t;
+    t.push_back(mk(1, 3));
+    RtcRound r = mk(500, 3); t.push_back(r);                    // seq 欠番
+    r = mk(501, 3); r.ts = 1700000000; t.push_back(r);          // 時計の戻り
+    r = mk(502, 3); r.ts = 2000000000; t.push_back(r);          // 大きな進み
+    r = mk(503, 3); r.pTemp = -40; r.pHumid = 0; r.pPres = 3000; r.pVbus = 0;
+    r.child[0].temp = 80; r.child[1].rssi = -128; r.child[2].bat = 0; t.push_back(r);
+    r = mk(504, 3); r.seq = 1; t.push_back(r);                  // seq の巻き戻り（電源投入後）
+    TEST_ASSERT_EQUAL_INT((int)t.size(), packRoundTrip(t));
+}
+
+// 収まらない追記は状態を変えずに失敗し、それまでの分はそのまま読める
+static void test_append_when_full() {
+    RoundPackState st;
+    roundPackClear(st);
+    uint32_t s = 0;
+    while (roundPackAppend(arena, sizeof(arena), st, mk(++s, MAX_CHILD_DEVICES))) {}
+    const RoundPackState before = st;
+    TEST_ASSERT_TRUE(st.count > 0);
+    TEST_ASSERT_FALSE(roundPackAppend(arena, sizeof(arena), st, mk(s, MAX_CHILD_DEVICES)));
+    TEST_ASSERT_TRUE(memcmp(&before, &st, sizeof(st)) == 0);
+    RoundPackReader rd(arena, st);
+    RtcRound r;
+    for (uint32_t k = 1; k < s; k++) TEST_ASSERT_TRUE(rd.next(r) && sameCbor(r, mk(k, MAX_CHILD_DEVICES)));
+    TEST_ASSERT_FALSE(rd.next(r));
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_synthetic_trace);
+    RUN_TEST(test_max_children);
+    RUN_TEST(test_child_list_changes);
+    RUN_TEST(test_nan_values);
+    RUN_TEST(test_large_deltas);
+    RUN_TEST(test_append_when_full);
+    return UNITY_END();
+}
@@ -0,0 +1,61 @@
+// =====================================================================
+// 設定応答の分割解釈（src/device_config.h の DeviceConfigParser）のベンチマーク  ※ホスト用
+// ---------------------------------------------------------------------
+// 子機 0〜200 台の合成応答を CARECV 1回分ずつ渡して解釈し、応答の大きさごとの時間を出す。
+// 分割位置・切れた応答の正しさは test/native/test_config_parse で確かめる。
+//
+//   ビルド: make -C tools/bench
+//   実行:   tools/bench/config_parse_bench
+// =====================================================================
+
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <string>
+#include <algorithm>
+#include "config.h"
+#include "device_config.h"
+
+#define CARECV_CHUNK 1460   // 親機の受信1回分の上限
+
+// 親機 foxsense-001 の設定応答（サーバの buildDeviceConfig と同じ並び＋入れ子・未知のキー）
+static std::string synthConfig(int children, int nameLen) {
+    std::string name(nameLen, 'x');
+    std::string s = "{\"success\":true,\"data\":{\"deviceId\":\"foxsense-001\",\"parentIdHash\":2849513012,"
+                    "\"parentIdHashHex\":\"a9d8c134\",\"children\":[";
+    for (int i = 0; i < children; i++) {
+        char b[256];
+        snprintf(b, sizeof(b), "%s{\"deviceId\":\"%08x\",\"deviceIdNum\":%u,\"loc\":{\"lat\":1.5,\"tags\":[\"x\",{\"deviceIdNum\":9}]},"
+                 "\"logicalId\":%d,\"pairingStatus\":\"%s\",\"name\":\"",
+                 i ? "," : "", 0x10000000u + i, 0x10000000u + i, i % 250, (i % 7 == 0) ? "PENDING" : "PAIRED");
+        s += b;
+        s += name;
+        s += "\"}";
+    }
+    s += "],\"firmware\":{\"versionCode\":42,\"size\":1234567,\"url\":\"/firmware/fw.bin\","
+         "\"md5\":\"0123456789abcdef0123456789abcdef\"},\"transport\":\"http\"}}";
+    return s;
+}
+
+int main() {
+    static ConfigChild ch[MAX_CHILD_DEVICES];
+    static const int childCounts[] = { 0, 1, 8, MAX_CHILD_DEVICES, MAX_CHILD_DEVICES + 1, 100, 200 };
+    printf("%8s %8s | %9s %9s\n", "children", "bytes", "parse us", "MB/s");
+    for (int n : childCounts) {
+        std::string js = synthConfig(n, 24);
+        const int iters = 2000;
+        bool ok = true;
+        auto t0 = std::chrono::steady_clock::now();
+        for (int i = 0; i < iters; i++) {
+            DeviceConfig c = {};
+            c.children = ch; c.childCap = MAX_CHILD_DEVICES;
+            DeviceConfigParser p(c);
+            for (size_t o = 0; o < js.size(); o += CARECV_CHUNK) p.feed(js.data() + o, std::min((size_t)CARECV_CHUNK, js.size() - o));
+            ok = p.finish() && ok;
+        }
+        double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t0).count() / iters;
+        if (!ok) { printf("%d children: parse failed\n", n); return 1; }
+        printf("%8d %8zu | %9.2f %9.1f\n", n, js.size(), us, js.size() / us);
+    }
+    return 0;
+}
@@ -0,0 +1,178 @@
+// =====================================================================
+// ingest ボディのエンコード比較（CBOR: src/round_cbor.h / JSON: src/round_json.h）  ※ホスト用
+// ---------------------------------------------------------------------
+// 同じ蓄積ラウンド群を CBORバッチと JSON "rounds" 配列で書き出し、バイト数と書出し時間を比べる。
+// 子機台数・ラウンド数を振った合成データを使う。あわせて次を確かめる（失敗で終了コード1）:
+//   - CBOR を復号したラウンドの JSON が元のラウンドの JSON と一致する（送信内容が変わらない）
+//   - 値が NaN のときは0、int32 に収まらない値・±∞ は丸めて書く（JSON版の PayloadWriter::fixed と同じ扱い）
+//
+//   ビルド: make -C tools/bench
+//   実行:   tools/bench/ingest_encoding_bench
+// =====================================================================
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <chrono>
+#include <vector>
+#include <string>
+#include "round_cbor.h"
+#include "round_json.h"
+
+#define PARENT_ID "A1B2C3D4"
+#define SECRET    "0123456789abcdef0123456789abcdef"
+
+static uint8_t cborBuf[1 << 20];
+static char jsonBuf[1 << 21];
+
+// 20分毎のラウンド（日周の正弦＋ノイズ、受信漏れ5%）
+static void synthRounds(std::vector<RtcRound>& out, int rounds, int children) {
+    srand(1);
+    auto noise = [](float a) { return a * ((rand() % 2001) / 1000.0f - 1.0f); };
+    out.assign(rounds, RtcRound());
+    for (int i = 0; i < rounds; i++) {
+        RtcRound& r = out[i];
+        memset(&r, 0, sizeof(r));
+        r.seq = i + 1;
+        r.ts = 1760000000 + i * 1200;
+        float day = sinf(i * 2 * 3.14159265f / 72);
+        r.pTemp = 18 + 6 * day + noise(0.1f);
+        r.pHumid = 60 - 15 * day + noise(0.5f);
+        r.pPres = 1008 + noise(0.1f);
+        r.pBat = 80; r.pVbus = day > 0 ? 5000 : 0; r.pSignal = 18 + rand() % 3;
+        r.childCount = children;
+        for (int j = 0; j < children; j++) {
+            RtcChild& c = r.child[j];
+            c.id = 0xA0000000u + j; c.lid = j + 1;
+            c.received = rand() % 100 >= 5;
+            if (!c.received) continue;
+            c.temp = 17 + j * 0.3f + 7 * day + noise(0.15f);
+            c.humid = 65 - 18 * day + noise(0.8f);
+            c.pres = 1007 + noise(0.1f);
+            c.rssi = -70 - j % 40; c.bat = 95;
+        }
+    }
+}
+
+static size_t encodeCbor(const std::vector<RtcRound>& v) {
+    return cborEncodeBatch(cborBuf, sizeof(cborBuf), PARENT_ID, SECRET, 1, v.data(), (int)v.size());
+}
+
+// main.cpp の JSON版と同じエンベロープ（parent_id/secret/boot_count ＋ rounds）
+static size_t encodeJson(const std::vector<RtcRound>& v) {
+    PayloadWriter w(jsonBuf, sizeof(jsonBuf));
+    w.str("{\"parent_id\":\"" PARENT_ID "\",\"secret\":\"" SECRET "\",\"boot_count\":").num(1);
+    w.str(",\"rounds\":[");
+    for (size_t i = 0; i < v.size(); i++) {
+        if (i) w.str(",");
+        writeRoundJson(w, v[i]);
+    }
+    w.str("]}");
+    return w.ok() ? w.length() : 0;
+}
+
+static std::string roundJson(const RtcRound& r) {
+    static char buf[16384];
+    PayloadWriter w(buf, sizeof(buf));
+    writeRoundJson(w, r);
+    return std::string(buf, w.length());
+}
+
+// 書出し1回あたりの時間（µs）
+template <typename F>
+static double timeUs(F f, int iters) {
+    auto t0 = std::chrono::steady_clock::now();
+    volatile size_t sink = 0;
+    for (int i = 0; i < iters; i++) sink = sink + f();
+    auto t1 = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::micro>(t1 - t0).count() / iters;
+}
+
+static bool checkRoundTrip(const std::vector<RtcRound>& v, const char* name) {
+    size_t n = encodeCbor(v);
+    static RtcRound decoded[256];
+    CborBatchHeader hdr;
+    if (!n || !cborDecodeBatch(cborBuf, n, hdr, decoded, 256) || hdr.roundCount != (int)v.size()) {
+        printf("%s: CBOR decode failed\n", name);
+        return false;
+    }
+    if (hdr.version != ROUND_CBOR_SCHEMA_VERSION) {
+        printf("%s: schema version %u != %d\n", name, hdr.version, ROUND_CBOR_SCHEMA_VERSION);
+        return false;
+    }
+    for (size_t i = 0; i < v.size(); i++) {
+        if (roundJson(decoded[i]) != roundJson(v[i])) {
+            printf("%s: round %zu differs after CBOR round trip\n  %s\n  %s\n", name, i,
+                   roundJson(v[i]).c_str(), roundJson(decoded[i]).c_str());
+            return false;
+        }
+    }
+    return true;
+}
+
+// 測れなかった値（NaN）と範囲外の値: 未定義動作にならず、JSON版と同じく NaN は0で届く
+static bool checkNonFinite() {
+    bool ok = true;
+    auto expect = [&](float v, int scale, int32_t want) {
+        int32_t got = cborFixed(v, scale);
+        if (got != want) { printf("cborFixed(%g, %d) = %d, want %d\n", v, scale, got, want); ok = false; }
+    };
+    expect(NAN, 100, 0);
+    expect(-NAN, 10, 0);
+    expect(INFINITY, 100, 2000000000);
+    expect(-INFINITY, 100, -2000000000);
+    expect(3.0e38f, 10, 2000000000);
+    expect(-3.0e38f, 10, -2000000000);
+    expect(23.456f, 100, 2346);
+    expect(-12.345f, 10, -123);
+
+    std::vector<RtcRound> v;
+    synthRounds(v, 1, 2);
+    v[0].pTemp = NAN; v[0].pPres = INFINITY;
+    v[0].child[0].received = true; v[0].child[0].humid = NAN; v[0].child[0].temp = -1.0e30f;
+    size_t n = encodeCbor(v);
+    RtcRound d[1];
+    CborBatchHeader hdr;
+    if (!n || !cborDecodeBatch(cborBuf, n, hdr, d, 1) || hdr.roundCount != 1) {
+        printf("non-finite round: CBOR decode failed\n");
+        return false;
+    }
+    if (d[0].pTemp != 0 || d[0].child[0].humid != 0) {
+        printf("non-finite round: NaN not sent as 0 (pTemp %g, child humid %g)\n", d[0].pTemp, d[0].child[0].humid);
+        ok = false;
+    }
+    if (!(d[0].pPres > 1.0e8f) || !(d[0].child[0].temp < -1.0e7f)) {
+        printf("non-finite round: out-of-range not clamped (pPres %g, child temp %g)\n", d[0].pPres, d[0].child[0].temp);
+        ok = false;
+    }
+    return ok;
+}
+
+int main() {
+    setenv("TZ", "UTC0", 1);   // 親機と同じく ts は JST壁時計を UTC として数えた秒
+    tzset();
+    bool ok = checkNonFinite();
+
+    static const int childCounts[] = { 1, 8, 32 };
+    static const int roundCounts[] = { 1, 6, 24, 48 };
+    printf("%8s %6s | %9s %9s %6s | %9s %9s\n", "children", "rounds", "CBOR B", "JSON B", "ratio", "CBOR us", "JSON us");
+    for (int children : childCounts) {
+        for (int rounds : roundCounts) {
+            std::vector<RtcRound> v;
+            synthRounds(v, rounds, children);
+            char name[32];
+            snprintf(name, sizeof(name), "%d children x %d", children, rounds);
+            ok = checkRoundTrip(v, name) && ok;
+            size_t cb = encodeCbor(v), jb = encodeJson(v);
+            if (!cb || !jb) { printf("%s: buffer too small\n", name); ok = false; continue; }
+            int iters = 200000 / (rounds * (children + 1)) + 10;
+            double ct = timeUs([&] { return encodeCbor(v); }, iters);
+            double jt = timeUs([&] { return encodeJson(v); }, iters);
+            printf("%8d %6d | %9zu %9zu %5.1fx | %9.2f %9.2f\n", children, rounds, cb, jb, (double)jb / cb, ct, jt);
+        }
+    }
+    printf(ok ? "OK\n" : "FAILED\n");
+    return ok ? 0 : 1;
+}
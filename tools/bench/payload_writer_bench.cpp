@@ -0,0 +1,222 @@
+// =====================================================================
+// 送信JSONの組み立て: String += と PayloadWriter（src/payload_writer.h）の比較  ※ホスト用
+// ---------------------------------------------------------------------
+// 子機 1〜64 台の1ラウンド分を、旧実装（buildRoundPayload: String += と String(float, 2) の一時オブジェクト）と
+// 現実装（writeRoundJson を長さ計測→CASENDチャンクへ直接の2パス）で書き出し、
+// 1回あたりの時間・ヒープ確保回数・確保バイトの最大値を比べる。あわせて num/fixed の境界値の書式を確かめる。
+// String はホストに無いので Arduino コアと同じ振る舞い（連結のたびに必要長ちょうどへ realloc、
+// "..." + String(x) は一時 String を作る）の最小実装で代用する。
+//
+//   ビルド: make -C tools/bench
+//   実行:   tools/bench/payload_writer_bench
+// =====================================================================
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <chrono>
+
+// 子機64台まで測るため、ラウンドの子機上限だけ親機の設定から差し替える
+#include "config.h"
+#undef MAX_CHILD_DEVICES
+#define MAX_CHILD_DEVICES 64
+#include "round_data.h"
+#include "round_json.h"
+
+#define BENCH_MAX_CHILDREN 64
+#define CASEND_CHUNK 1460   // 親機の CASEND 1回分の上限
+
+// ---------------------------------------------------------------------
+// Arduino String の代用（確保回数と同時確保の最大バイトを数える）
+// ---------------------------------------------------------------------
+static size_t heapAllocs, heapLive, heapPeak;
+
+static void* heapRealloc(void* p, size_t oldCap, size_t cap) {
+    heapAllocs++;
+    heapLive += cap - oldCap;
+    if (heapLive > heapPeak) heapPeak = heapLive;
+    return realloc(p, cap);
+}
+
+class String {
+public:
+    String(const char* s = "") { concat(s, strlen(s)); }
+    String(const String& o) { concat(o._buf, o._len); }
+    explicit String(long v) { char t[24]; concat(t, snprintf(t, sizeof(t), "%ld", v)); }
+    explicit String(int v) : String((long)v) {}
+    explicit String(unsigned v) : String((long)v) {}
+    String(float v, int decimals) { char t[48]; concat(t, snprintf(t, sizeof(t), "%.*f", decimals, (double)v)); }
+    ~String() { heapLive -= _cap; free(_buf); }
+    String& operator=(const String&) = delete;
+
+    String& concat(const char* s, size_t n) {
+        if (_len + n + 1 > _cap) {   // Arduino コアの reserve(): 必要長ちょうどへ realloc
+            size_t cap = _len + n + 1;
+            _buf = (char*)heapRealloc(_buf, _cap, cap);
+            _cap = cap;
+        }
+        memcpy(_buf + _len, s, n);
+        _len += n;
+        _buf[_len] = '\0';
+        return *this;
+    }
+    String& operator+=(const char* s) { return concat(s, strlen(s)); }
+    String& operator+=(const String& o) { return concat(o._buf, o._len); }
+    size_t length() const { return _len; }
+
+private:
+    char* _buf = nullptr;
+    size_t _len = 0, _cap = 0;
+};
+
+// StringSumHelper 相当: 左辺をコピーした一時 String に連結する
+static String operator+(const char* a, const String& b) { String s(a); s += b; return s; }
+static String operator+(String a, const char* b) { a += b; return a; }
+
+// ---------------------------------------------------------------------
+// 旧実装（String += で1ラウンド分を組み立て）
+// ---------------------------------------------------------------------
+static size_t buildRoundString(const RtcRound& r) {
+    struct tm ti; localtime_r(&r.ts, &ti);
+    char tsbuf[32]; strftime(tsbuf, sizeof(tsbuf), "%Y-%m-%dT%H:%M:%S+09:00", &ti);
+
+    String payload = "{";
+    payload += "\"seq\":" + String((unsigned)r.seq) + ",";
+    payload += "\"timestamp\":\"" + String(tsbuf) + "\",";
+    payload += "\"parent\":{";
+    payload += "\"temperature\":" + String(r.pTemp, 2) + ",";
+    payload += "\"humidity\":" + String(r.pHumid, 2) + ",";
+    payload += "\"pressure\":" + String(r.pPres, 1) + ",";
+    payload += "\"battery\":" + String(r.pBat) + ",";
+    payload += "\"vbus_mv\":" + String(r.pVbus) + ",";
+    payload += "\"signal\":" + String(r.pSignal);
+    payload += "},";
+    payload += "\"children\":[";
+    for (int i = 0; i < r.childCount; i++) {
+        if (i) payload += ",";
+        char hexId[9]; snprintf(hexId, sizeof(hexId), "%08x", r.child[i].id);
+        payload += "{";
+        payload += "\"device_id\":\"" + String(hexId) + "\",";
+        payload += "\"temperature\":" + String(r.child[i].temp, 2) + ",";
+        payload += "\"humidity\":" + String(r.child[i].humid, 2) + ",";
+        payload += "\"pressure\":" + String(r.child[i].pres, 1) + ",";
+        payload += "\"rssi\":" + String((int)r.child[i].rssi) + ",";
+        payload += "\"battery\":" + String((int)r.child[i].bat) + ",";
+        payload += "\"received\":" + String(r.child[i].received ? "true" : "false");
+        payload += "}";
+    }
+    payload += "]}";
+    return payload.length();
+}
+
+// ---------------------------------------------------------------------
+// 現実装（長さ計測 → CASENDチャンクへ直接）
+// ---------------------------------------------------------------------
+struct Chunk {
+    char buf[CASEND_CHUNK];
+    size_t fill;
+    size_t sent;
+};
+
+static void chunkSink(const char* p, size_t n, void* ctx) {
+    Chunk& c = *(Chunk*)ctx;
+    while (n) {
+        size_t k = CASEND_CHUNK - c.fill < n ? CASEND_CHUNK - c.fill : n;
+        memcpy(c.buf + c.fill, p, k);
+        c.fill += k; p += k; n -= k;
+        if (c.fill == CASEND_CHUNK) { c.sent += c.fill; c.fill = 0; }
+    }
+}
+
+static size_t buildRoundWriter(const RtcRound& r) {
+    PayloadWriter counter;
+    writeRoundJson(counter, r);
+    static Chunk c;
+    c.fill = c.sent = 0;
+    PayloadWriter w(chunkSink, &c);
+    writeRoundJson(w, r);
+    return (c.sent + c.fill == counter.length()) ? counter.length() : 0;
+}
+
+static void synthRound(RtcRound& r, int children) {
+    memset(&r, 0, sizeof(r));
+    r.seq = 1234;
+    r.ts = 1760000000;
+    r.pTemp = 21.37f; r.pHumid = 58.42f; r.pPres = 1008.3f;
+    r.pBat = 87; r.pVbus = 5012; r.pSignal = 19;
+    r.childCount = children;
+    for (int j = 0; j < children; j++) {
+        RtcChild& c = r.child[j];
+        c.id = 0xA0000000u + j; c.lid = j + 1;
+        c.received = j % 16 != 5;
+        c.temp = 17.25f + j * 0.31f; c.humid = 63.5f - j * 0.2f; c.pres = 1007.1f;
+        c.rssi = -70 - j % 40; c.bat = 95;
+    }
+}
+
+// 境界値の書式（64bit long のホストでも溢れず、uint32_t は正のまま、非有限の小数は丸める）
+static bool checkEdgeValues() {
+    struct { const char* want; int64_t v; } nums[] = {
+        { "0", 0 }, { "-1", -1 }, { "4294967295", (int64_t)UINT32_MAX }, { "2147483648", (int64_t)2147483648u },
+        { "-2147483648", INT32_MIN }, { "9223372036854775807", INT64_MAX }, { "-9223372036854775808", INT64_MIN },
+    };
+    struct { const char* want; float v; uint8_t d; } fixes[] = {
+        { "0.00", NAN, 2 }, { "20000000.00", INFINITY, 2 }, { "-20000000.00", -INFINITY, 2 },
+        { "2000000000", 1e30f, 0 }, { "-0.50", -0.5f, 2 }, { "21.25", 21.25f, 2 }, { "1007.1", 1007.1f, 1 },
+    };
+    bool ok = true;
+    char buf[32];
+    for (auto& c : nums) {
+        PayloadWriter w(buf, sizeof(buf));
+        w.num(c.v);
+        if (!w.ok() || strcmp(buf, c.want)) { printf("num(%s): got '%s'\n", c.want, buf); ok = false; }
+    }
+    for (auto& c : fixes) {
+        PayloadWriter w(buf, sizeof(buf));
+        w.fixed(c.v, c.d);
+        if (!w.ok() || strcmp(buf, c.want)) { printf("fixed(%s): got '%s'\n", c.want, buf); ok = false; }
+    }
+    return ok;
+}
+
+template <typename F>
+static double timeUs(F f, int iters) {
+    auto t0 = std::chrono::steady_clock::now();
+    volatile size_t sink = 0;
+    for (int i = 0; i < iters; i++) sink = sink + f();
+    auto t1 = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::micro>(t1 - t0).count() / iters;
+}
+
+int main() {
+    setenv("TZ", "UTC0", 1);   // 親機と同じく ts は JST壁時計を UTC として数えた秒
+    tzset();
+    static RtcRound r;
+    static const int childCounts[] = { 1, 2, 4, 8, 16, 32, BENCH_MAX_CHILDREN };
+    bool ok = checkEdgeValues();
+    printf("%8s %7s | %10s %7s %9s | %10s %7s %9s\n", "children", "bytes",
+           "String us", "allocs", "peak B", "writer us", "allocs", "peak B");
+    for (int children : childCounts) {
+        synthRound(r, children);
+        int iters = 20000 / children + 100;
+
+        heapAllocs = heapLive = heapPeak = 0;
+        size_t sb = buildRoundString(r);
+        size_t sAllocs = heapAllocs, sPeak = heapPeak;
+        double st = timeUs([&] { return buildRoundString(r); }, iters);
+
+        heapAllocs = heapLive = heapPeak = 0;
+        size_t wb = buildRoundWriter(r);
+        size_t wAllocs = heapAllocs, wPeak = heapPeak;
+        double wt = timeUs([&] { return buildRoundWriter(r); }, iters);
+
+        // 書式は同じなので長さが揃う
+        if (!wb || sb != wb) { printf("%d children: length mismatch (String %zu, writer %zu)\n", children, sb, wb); ok = false; }
+        printf("%8d %7zu | %10.2f %7zu %9zu | %10.2f %7zu %9zu\n",
+               children, wb, st, sAllocs, sPeak, wt, wAllocs, wPeak);
+    }
+    printf(ok ? "OK\n" : "FAILED\n");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,196 @@
+// =====================================================================
+// 蓄積ラウンドのRTC圧縮表現（src/round_pack.h）のベンチマーク  ※ホスト用
+// ---------------------------------------------------------------------
+// 実機のトレースで1ラウンドあたりのバイト数と、RTCの同じ領域に入るラウンド数を測る。
+// トレースは UDP参照サーバ（tools/udp-ingest-ref）の標準出力（1データグラム1行のJSON）をそのまま読む。
+// 親機ごとに ts 順へ並べ、同じ seq の重複（再送）は除く。トレースを渡さなければ
+// 合成トレース（日周変化＋ノイズ、子機8台、受信漏れ5%）で測る。
+// 展開したラウンドの CBOR round 配列が元と一致すること（送信内容が変わらないこと）も確かめる
+// （境界の場合を含む往復の確認は test/native/test_round_pack）。
+//
+//   ビルド: make -C tools/bench
+//   実行:   tools/bench/round_pack_bench [-a ARENA_BYTES] [capture.jsonl ...]
+// =====================================================================
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <vector>
+#include <map>
+#include <string>
+#include <algorithm>
+#include "round_pack.h"
+#include "round_cbor.h"
+
+#define DEFAULT_ARENA_BYTES 2688   // 親機の RTC_ROUND_ARENA_BYTES
+
+// "rounds":[{"seq":N,"ts":N,"parent":[t,h,p,bat,vbus,sig],"children":[["id",t,h,p,rssi,bat],["id"]]}, ...]
+static const char* parseRound(const char* p, RtcRound& r) {
+    memset(&r, 0, sizeof(r));
+    const char* q = strstr(p, "\"seq\":");
+    if (!q) return nullptr;
+    r.seq = (uint32_t)strtoul(q + 6, nullptr, 10);
+    if (!(q = strstr(q, "\"ts\":"))) return nullptr;
+    r.ts = (time_t)strtoll(q + 5, nullptr, 10);
+    if (!(q = strstr(q, "\"parent\":["))) return nullptr;
+    char* e;
+    q += 10;
+    r.pTemp = strtof(q, &e); q = e + 1;
+    r.pHumid = strtof(q, &e); q = e + 1;
+    r.pPres = strtof(q, &e); q = e + 1;
+    r.pBat = (int)strtol(q, &e, 10); q = e + 1;
+    r.pVbus = (int)strtol(q, &e, 10); q = e + 1;
+    r.pSignal = (int)strtol(q, &e, 10); q = e;
+    if (!(q = strstr(q, "\"children\":["))) return nullptr;
+    q += 12;
+    while (*q == '[' || *q == ',') {
+        if (*q == ',') { q++; continue; }
+        RtcChild tmp;
+        RtcChild& c = r.childCount < MAX_CHILD_DEVICES ? r.child[r.childCount++] : tmp;
+        memset(&c, 0, sizeof(c));
+        c.id = (uint32_t)strtoul(q + 2, &e, 16);
+        q = e + 1;   // 閉じ引用符
+        if (*q == ',') {
+            c.received = true;
+            c.temp = strtof(q + 1, &e); q = e + 1;
+            c.humid = strtof(q, &e); q = e + 1;
+            c.pres = strtof(q, &e); q = e + 1;
+            c.rssi = (int8_t)strtol(q, &e, 10); q = e + 1;
+            c.bat = (uint8_t)strtol(q, &e, 10); q = e;
+        }
+        if (*q != ']') return nullptr;
+        q++;
+    }
+    return *q == ']' ? q + 2 : nullptr;   // "]}"
+}
+
+static void loadCapture(FILE* f, std::map<std::string, std::vector<RtcRound>>& byParent) {
+    static char line[65536];
+    while (fgets(line, sizeof(line), f)) {
+        const char* id = strstr(line, "\"parent_id\":\"");
+        const char* rs = strstr(line, "\"rounds\":[");
+        if (!id || !rs) continue;
+        std::string parent(id + 13, strcspn(id + 13, "\""));
+        const char* p = rs + 10;
+        RtcRound r;
+        while (*p == '{' && (p = parseRound(p, r))) {
+            byParent[parent].push_back(r);
+            if (*p == ',') p++;
+        }
+    }
+}
+
+// 合成トレース: 20分毎、日周の正弦＋ノイズ
+static void synthTrace(std::vector<RtcRound>& out, int rounds, int children) {
+    srand(1);
+    auto noise = [](float a) { return a * ((rand() % 2001) / 1000.0f - 1.0f); };
+    time_t ts = 1760000000;
+    for (int i = 0; i < rounds; i++) {
+        RtcRound r;
+        memset(&r, 0, sizeof(r));
+        r.seq = i + 1;
+        r.ts = ts + i * 1200 + (rand() % 5 == 0 ? rand() % 3 - 1 : 0);
+        float day = sinf(i * 2 * 3.14159265f / 72);
+        r.pTemp = 18 + 6 * day + noise(0.1f);
+        r.pHumid = 60 - 15 * day + noise(0.5f);
+        r.pPres = 1008 + 3 * sinf(i / 200.0f) + noise(0.1f);
+        r.pBat = 80 - i / 100; r.pVbus = day > 0 ? 5000 : 0; r.pSignal = 18 + rand() % 3;
+        r.childCount = children;
+        for (int j = 0; j < children; j++) {
+            RtcChild& c = r.child[j];
+            c.id = 0xA0000000u + j; c.lid = j + 1;
+            c.received = rand() % 100 >= 5;
+            if (!c.received) continue;
+            c.temp = 17 + j * 0.3f + 7 * day + noise(0.15f);
+            c.humid = 65 - 18 * day + noise(0.8f);
+            c.pres = 1007 + 3 * sinf(i / 200.0f) + noise(0.1f);
+            c.rssi = -70 - j - rand() % 4; c.bat = 95 - i / 150;
+        }
+        out.push_back(r);
+    }
+}
+
+static size_t cborRoundBytes(const RtcRound& r, uint8_t* buf, size_t cap) {
+    CborWriter w(buf, cap);
+    cborWriteRound(w, r);
+    return w.ok() ? w.length() : 0;
+}
+
+// rounds を順に詰める。アリーナが一杯になったら詰め直して続ける（親機が送信後に空ける動きの代わり）
+static bool bench(const char* name, const std::vector<RtcRound>& rounds, size_t arenaBytes) {
+    static uint8_t arena[65536];
+    static uint8_t a[4096], b[4096];
+    RoundPackState st;
+    roundPackClear(st);
+    size_t packed = 0, cborBytes = 0, fills = 0, fillRounds = 0, first = 0;
+    int start = 0;
+    for (size_t i = 0; i < rounds.size(); i++) {
+        uint16_t before = st.bytes;
+        if (!roundPackAppend(arena, arenaBytes, st, rounds[i])) {
+            // 一杯: ここまでを展開して照合し、空にして続ける
+            RoundPackReader rd(arena, st);
+            RtcRound r;
+            for (size_t k = start; k < i; k++) {
+                if (!rd.next(r)) { printf("%s: decode failed at %zu\n", name, k); return false; }
+                size_t n = cborRoundBytes(r, a, sizeof(a));
+                if (n != cborRoundBytes(rounds[k], b, sizeof(b)) || memcmp(a, b, n) != 0) {
+                    printf("%s: round %zu (seq %u) differs after unpack\n", name, k, rounds[k].seq);
+                    return false;
+                }
+            }
+            fills++;
+            fillRounds += st.count;
+            roundPackClear(st);
+            start = (int)i;
+            before = 0;
+            if (!roundPackAppend(arena, arenaBytes, st, rounds[i])) { printf("%s: round too large\n", name); return false; }
+        }
+        size_t n = st.bytes - before;
+        if (st.count == 1) first += n; else packed += n;
+        cborBytes += cborRoundBytes(rounds[i], a, sizeof(a));
+    }
+    size_t keys = fills + 1, deltas = rounds.size() - keys;
+    double perDelta = deltas ? (double)packed / deltas : 0, perKey = (double)first / keys;
+    printf("%s: %zu rounds, %d children (first round)\n", name, rounds.size(), rounds.empty() ? 0 : rounds[0].childCount);
+    printf("  RtcRound %zu B | CBOR %.1f B/round | packed %.1f B/round (first %.1f B) -> %.0fx vs RtcRound, %.1fx vs CBOR\n",
+           sizeof(RtcRound), (double)cborBytes / rounds.size(), perDelta, perKey,
+           sizeof(RtcRound) / perDelta, (double)cborBytes / rounds.size() / perDelta);
+    printf("  arena %zu B + state %zu B: %.1f rounds per fill (%zu fills) vs %zu unpacked in the same RTC bytes\n",
+           arenaBytes, sizeof(RoundPackState), fills ? (double)fillRounds / fills : (double)st.count, fills,
+           (arenaBytes + sizeof(RoundPackState)) / sizeof(RtcRound));
+    return true;
+}
+
+int main(int argc, char** argv) {
+    size_t arenaBytes = DEFAULT_ARENA_BYTES;
+    int opt;
+    while ((opt = getopt(argc, argv, "a:")) != -1) {
+        if (opt == 'a') arenaBytes = (size_t)atoi(optarg);
+        else { fprintf(stderr, "usage: %s [-a arena_bytes] [capture.jsonl ...]\n", argv[0]); return 2; }
+    }
+    if (arenaBytes > 65536) arenaBytes = 65536;
+    bool ok = true;
+    if (optind >= argc) {
+        std::vector<RtcRound> t;
+        synthTrace(t, 72 * 14, 8);
+        ok = bench("synthetic (14 days, 8 children)", t, arenaBytes);
+        return ok ? 0 : 1;
+    }
+    std::map<std::string, std::vector<RtcRound>> byParent;
+    for (int i = optind; i < argc; i++) {
+        FILE* f = strcmp(argv[i], "-") == 0 ? stdin : fopen(argv[i], "r");
+        if (!f) { perror(argv[i]); return 1; }
+        loadCapture(f, byParent);
+        if (f != stdin) fclose(f);
+    }
+    for (auto& kv : byParent) {
+        std::vector<RtcRound>& v = kv.second;
+        std::stable_sort(v.begin(), v.end(), [](const RtcRound& x, const RtcRound& y) { return x.ts < y.ts; });
+        v.erase(std::unique(v.begin(), v.end(), [](const RtcRound& x, const RtcRound& y) {
+            return x.seq == y.seq && x.ts == y.ts; }), v.end());
+        ok = bench(kv.first.c_str(), v, arenaBytes) && ok;
+    }
+    return ok ? 0 : 1;
+}
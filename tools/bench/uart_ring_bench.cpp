@@ -0,0 +1,268 @@
+// =====================================================================
+// モデム受信処理（src/uart_ring.h + src/ac_matcher.h + src/at_engine.h）のベンチマーク/検証  ※ホスト用
+// ---------------------------------------------------------------------
+// 1) 受信スループット: SIM7080G の応答・URC・+CARECV の生データを混ぜた合成ストリームを
+//    UART FIFO 相当の小片で UartRing へ push() し、AcMatcher の1パス照合で行/終端/URC を切り出す。
+//    旧実装相当（1行を文字列に溜めてから各パターンを strstr）と MB/s で比べる。
+// 2) AtEngine の動作: AtPort に擬似モデム（コマンド毎に応答を返す。小片で届く）と仮想時計を渡し、
+//    OK/ERROR/">"・応答に紛れた URC の振分け・購読プレフィクスと同じ応答行・生データ受信・
+//    タイムアウトを確かめる（失敗で終了コード1）。
+//
+//   ビルド: make -C tools/bench
+//   実行:   tools/bench/uart_ring_bench
+// =====================================================================
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <string>
+#include <vector>
+#include "at_engine.h"
+
+#define FIFO_CHUNK 64    // 1回の fill() で届く量（ESP32 の UART FIFO 相当）
+
+// 親機が購読する URC と固定の終端
+static const char* const kPatterns[] = {
+    "OK\r", "ERROR\r", "+CME ERROR", "+CMS ERROR", ">",
+    "+CADATAIND:", "+CASTATE:", "+CEREG:", "+CAURC:", "+APP PDP:", "*PSUTTZ:", "+CTZV:", "+CARECV: ",
+};
+static const int kPatternCount = sizeof(kPatterns) / sizeof(kPatterns[0]);
+
+// ---------------------------------------------------------------------
+// 合成ストリーム（1起床分の受信を模す）
+// ---------------------------------------------------------------------
+static std::string synthStream(int reps) {
+    std::string s;
+    srand(1);
+    for (int i = 0; i < reps; i++) {
+        s += "\r\nOK\r\n";
+        s += "\r\n+CEREG: 0,5\r\n\r\nOK\r\n";
+        s += "\r\n+CPSI: LTE CAT-M1,Online,440-10,0x1234,12345678,123,EUTRAN-BAND1,100,5,5,-10,-95,-65,15\r\n\r\nOK\r\n";
+        s += "\r\n+CADATAIND: 0\r\n";
+        s += "\r\n+CARECV: 1460,";
+        for (int k = 0; k < 1460; k++) s += (char)(rand() % 96 + 32);
+        s += "\r\n\r\nOK\r\n";
+        s += "\r\n+APP PDP: 0,ACTIVE\r\n";
+        s += "\r\n> ";
+        s += "\r\nOK\r\n\r\n+CASEND: 0,0,512\r\n";
+        s += "\r\n+CASTATE: 0,0\r\n";
+    }
+    return s;
+}
+
+// ---------------------------------------------------------------------
+// 1) スループット
+// ---------------------------------------------------------------------
+struct ScanCounts {
+    size_t lines, matches, binBytes;
+};
+
+// UartRing + AcMatcher（at_engine.h と同じ1パス照合。+CARECV の生データは照合せず飛ばす）
+static ScanCounts scanRing(const std::string& in) {
+    static UartRing<AT_RX_RING> rx;
+    static AcMatcher<AT_AC_STATES, AT_AC_PATTERNS> ac;
+    static bool init = false;
+    if (!init) { for (int i = 0; i < kPatternCount; i++) ac.add(kPatterns[i]); init = true; }
+    rx = UartRing<AT_RX_RING>();
+    ScanCounts c = { 0, 0, 0 };
+    uint8_t st = ac.lineStartState();
+    uint32_t scan = rx.begin();
+    size_t off = 0, binRemain = 0, binLen = 0;
+    bool binHdr = false;
+    const int carecv = kPatternCount - 1;
+    while (off < in.size() || scan != rx.end()) {
+        if (off < in.size()) {
+            size_t n = in.size() - off < FIFO_CHUNK ? in.size() - off : FIFO_CHUNK;
+            off += rx.push((const uint8_t*)in.data() + off, n);
+        }
+        while (scan != rx.end()) {
+            if (binRemain) {
+                size_t n = rx.end() - scan;
+                if (n > binRemain) n = binRemain;
+                scan += n; binRemain -= n; c.binBytes += n;
+                rx.release(scan);
+                continue;
+            }
+            uint8_t b = rx.at(scan++);
+            st = ac.step(st, b);
+            int m = ac.match(st);
+            if (m == carecv) { binHdr = true; binLen = 0; continue; }
+            if (m >= 0) c.matches++;
+            if (binHdr) {
+                if (b >= '0' && b <= '9') { binLen = binLen * 10 + (b - '0'); continue; }
+                binHdr = false;
+                if (b == ',') { binRemain = binLen; st = 0; rx.release(scan); continue; }
+            }
+            if (b == '\n') { c.lines++; rx.release(scan); }
+        }
+    }
+    return c;
+}
+
+// 旧実装相当: 行を文字列に溜め、行末で全パターンを strstr（+CARECV の生データ長は同様に扱う）
+static ScanCounts scanStrings(const std::string& in) {
+    ScanCounts c = { 0, 0, 0 };
+    std::string line;
+    size_t i = 0;
+    while (i < in.size()) {
+        char b = in[i++];
+        line += b;
+        if (line.size() > 9 && line.compare(0, 9, "+CARECV: ") == 0 && b == ',') {
+            size_t n = strtoul(line.c_str() + 9, nullptr, 10);
+            i += n; c.binBytes += n; c.matches++;
+            line.clear();
+            continue;
+        }
+        if (b == '>' && line == ">") { c.matches++; continue; }
+        if (b != '\n') continue;
+        c.lines++;
+        for (int k = 0; k < kPatternCount - 2; k++) if (strstr(line.c_str(), kPatterns[k])) { c.matches++; break; }
+        line.clear();
+    }
+    return c;
+}
+
+template <typename F>
+static double mbPerSec(F f, size_t bytes, int iters) {
+    auto t0 = std::chrono::steady_clock::now();
+    volatile size_t sink = 0;
+    for (int i = 0; i < iters; i++) sink = sink + f().lines;
+    double s = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    return bytes * (double)iters / s / 1e6;
+}
+
+// ---------------------------------------------------------------------
+// 2) AtEngine + 擬似モデム
+// ---------------------------------------------------------------------
+struct FakeModem {
+    std::string cmd;                  // 受信中のコマンド行
+    std::string out;                  // 親機へ返す未送信分
+    size_t outPos = 0;
+    std::vector<std::string> sent;    // 受けたコマンド
+    std::string rawData;              // ">" 後に受けた生データ
+    bool raw = false;
+};
+static FakeModem modem;
+static uint32_t clockMs;
+
+// +CARECV の生データ（中に OK 行や URC に見える並びを含む300バイト）
+static std::string binPayload() {
+    std::string p;
+    for (int i = 0; p.size() < 300; i++) p += (i % 40 == 10) ? "\r\nOK\r\n+CEREG: 9\r\n" : std::string(1, (char)('a' + i % 26));
+    p.resize(300);
+    return p;
+}
+
+static void modemReply(const std::string& c) {
+    std::string& o = modem.out;
+    if (c == "AT") o += "\r\nOK\r\n";
+    else if (c == "AT+URC") o += "\r\n+CADATAIND: 0\r\n\r\n+CEREG: 1\r\n\r\nOK\r\n";   // 応答待ち中に URC
+    else if (c == "AT+CEREG?") o += "\r\n+CEREG: 0,5\r\n\r\nOK\r\n";                    // 購読中と同じ応答行
+    else if (c == "AT+BAD") o += "\r\n+CME ERROR: 3\r\n";
+    else if (c == "AT+CASEND=0,5") { o += "\r\n> "; modem.raw = true; }
+    else if (c.compare(0, 11, "AT+CARECV=0") == 0) o += "\r\n+CARECV: 300," + binPayload() + "\r\n\r\nOK\r\n";
+    // "AT+SILENT" は応答しない（タイムアウト）
+}
+
+static size_t fakeRead(uint8_t* buf, size_t cap, void*) {
+    size_t left = modem.out.size() - modem.outPos;
+    size_t n = left < cap ? left : cap;
+    if (n > 17) n = 17;   // 小片で届く（行・生データがチャンク境界をまたぐ）
+    memcpy(buf, modem.out.data() + modem.outPos, n);
+    modem.outPos += n;
+    return n;
+}
+
+static void fakeWrite(const uint8_t* p, size_t n, void*) {
+    for (size_t i = 0; i < n; i++) {
+        char ch = (char)p[i];
+        if (ch == '\n' && modem.cmd.empty()) continue;   // コマンド行末の "\r\n"
+        if (modem.raw) {
+            modem.rawData += ch;
+            if (modem.rawData.size() == 5) { modem.raw = false; modem.out += "\r\nOK\r\n\r\n+CASEND: 0,0,5\r\n"; }
+            continue;
+        }
+        if (ch == '\r') { modem.sent.push_back(modem.cmd); modemReply(modem.cmd); modem.cmd.clear(); continue; }
+        modem.cmd += ch;
+    }
+}
+
+static uint32_t fakeNow() { return clockMs; }
+static void fakeIdle() { clockMs += 2; }
+
+static std::vector<std::string> urcs;
+static void onUrc(const char* line, void*) { urcs.push_back(line); }
+
+static bool checkEngine() {
+    bool ok = true;
+    auto expect = [&](bool cond, const char* what) { if (!cond) { printf("AtEngine: %s\n", what); ok = false; } };
+    static AtEngine at({ fakeRead, fakeWrite, fakeNow, fakeIdle, nullptr });
+    at.subscribe("+CADATAIND:", onUrc);
+    at.subscribe("+CEREG:", onUrc);
+
+    expect(at.exec("AT", 1000) == AT_OK, "AT -> OK");
+
+    urcs.clear();
+    expect(at.exec("AT+URC", 1000) == AT_OK, "AT+URC -> OK");
+    expect(urcs.size() == 2 && urcs[0] == "+CADATAIND: 0" && urcs[1] == "+CEREG: 1", "URCs dispatched while waiting");
+    expect(strstr(at.response(), "+CADATAIND") == nullptr, "URC kept out of the response");
+
+    urcs.clear();
+    expect(at.exec("AT+CEREG?", 1000) == AT_OK, "AT+CEREG? -> OK");
+    expect(urcs.empty() && strstr(at.response(), "+CEREG: 0,5") != nullptr, "+CEREG: line is the response, not a URC");
+
+    expect(at.exec("AT+BAD", 1000) == AT_ERROR, "+CME ERROR -> ERROR");
+
+    expect(at.exec("AT+CASEND=0,5", 1000) == AT_PROMPT, "CASEND -> prompt");
+    at.write((const uint8_t*)"hello", 5);
+    expect(at.waitResult(1000) == AT_OK && modem.rawData == "hello", "raw data after prompt (result already buffered)");
+
+    uint8_t bin[400];
+    size_t got = 0;
+    expect(at.execBinary("AT+CARECV=0,1460", "+CARECV: ", bin, sizeof(bin), got, 1000) == AT_OK, "CARECV -> OK");
+    urcs.clear();
+    expect(got == 300 && memcmp(bin, binPayload().data(), 300) == 0 && urcs.empty(),
+           "CARECV payload (containing OK/URC-like lines) copied intact");
+
+    uint32_t t0 = clockMs;
+    expect(at.exec("AT+SILENT", 500) == AT_TIMEOUT, "no reply -> TIMEOUT");
+    expect(clockMs - t0 >= 500 && clockMs - t0 < 520, "timeout follows the injected clock");
+
+    expect(at.exec("AT", 1000) == AT_OK, "engine usable after timeout");
+
+    // 打ち切り: 応答待ちのコマンドもキュー中のコマンドもすぐ失敗し、以後は送らない
+    AtStatus queued = AT_PENDING;
+    at.submit("AT+SILENT", 5000);
+    at.submit("AT", 1000, nullptr, nullptr, [](AtStatus st, const char*, void* c) { *(AtStatus*)c = st; }, &queued);
+    at.poll();
+    size_t sentBefore = modem.sent.size();
+    t0 = clockMs;
+    at.cancel();
+    expect(at.exec("AT", 1000) == AT_TIMEOUT && queued == AT_TIMEOUT && !at.busy(), "cancel fails pending commands");
+    at.service(1000);
+    expect(clockMs == t0 && modem.sent.size() == sentBefore, "cancelled engine neither waits nor sends");
+    at.resume();
+    expect(at.exec("AT", 1000) == AT_OK, "engine usable after resume");
+    return ok;
+}
+
+int main() {
+    bool ok = checkEngine();
+
+    std::string in = synthStream(64);
+    ScanCounts a = scanRing(in), b = scanStrings(in);
+    if (a.binBytes != b.binBytes || a.binBytes != 64 * 1460) {
+        printf("binary bytes differ: ring %zu, strings %zu\n", a.binBytes, b.binBytes);
+        ok = false;
+    }
+    int iters = 200;
+    double ringMb = mbPerSec([&] { return scanRing(in); }, in.size(), iters);
+    double strMb = mbPerSec([&] { return scanStrings(in); }, in.size(), iters);
+    printf("stream %zu B (%zu lines, %zu binary B), %d patterns\n", in.size(), a.lines, a.binBytes, kPatternCount);
+    printf("  UartRing push + AcMatcher : %8.1f MB/s\n", ringMb);
+    printf("  line String + strstr      : %8.1f MB/s  (%.1fx)\n", strMb, ringMb / strMb);
+    printf("  AT UART 115200 bps        : %8.3f MB/s\n", 115200 / 10 / 1e6);
+    printf(ok ? "OK\n" : "FAILED\n");
+    return ok ? 0 : 1;
+}
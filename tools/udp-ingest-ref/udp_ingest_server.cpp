@@ -0,0 +1,157 @@
+// =====================================================================
+// UDP送信(ingest)の参照サーバ  ※ホスト用（親機ファームの src/udp_ingest.h / round_cbor.h を共用）
+// ---------------------------------------------------------------------
+// 親機の "transport":"udp" 経路を手元で受けるための最小実装（保存はしないので本番の受信には使わない）。
+// データグラムを復号して1件1行のJSONで標準出力へ書き、ACK(8バイト)を返す。HTTP送信との比較用に、受信/送信バイトと
+// 同じ親機からの連続データグラムの間隔を標準エラーへ集計する。
+//
+//   ビルド: g++ -std=c++17 -O2 -I../../src -o udp_ingest_server udp_ingest_server.cpp
+//   実行:   ./udp_ingest_server [-p 5683] [-s SECRET] [-d DROP_PERCENT] [-f ACK_FLAGS]
+//
+// -s を付けると secret 不一致に AUTH を返す。-d は受信データグラムを指定%で捨てて
+// 親機の再送/HTTPフォールバックを確かめる。-f はACKのヒント（既定 0x80=不明）。
+// 重複判定は (parent_id, msgId) の直近 DEDUP_WINDOW 件（再送は保存せず DUPLICATE）。
+// =====================================================================
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "udp_ingest.h"
+#include "round_cbor.h"
+
+#define DEDUP_WINDOW 1024
+#define MAX_ROUNDS_PER_DGRAM 8   // 親機は1データグラム1ラウンド（超過分は読み飛ばす）
+
+struct SeenMsg {
+    char parentId[16];
+    uint16_t msgId;
+};
+
+static SeenMsg seen[DEDUP_WINDOW];
+static int seenNext = 0;
+
+static bool alreadySeen(const char* parentId, uint16_t msgId) {
+    for (int i = 0; i < DEDUP_WINDOW; i++) {
+        if (seen[i].parentId[0] && seen[i].msgId == msgId && strcmp(seen[i].parentId, parentId) == 0) return true;
+    }
+    return false;
+}
+
+static void remember(const char* parentId, uint16_t msgId) {
+    SeenMsg& s = seen[seenNext];
+    snprintf(s.parentId, sizeof(s.parentId), "%s", parentId);
+    s.msgId = msgId;
+    seenNext = (seenNext + 1) % DEDUP_WINDOW;
+}
+
+static double nowMs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+static void printRound(const RtcRound& r) {
+    printf("{\"seq\":%u,\"ts\":%lld,\"parent\":[%.2f,%.2f,%.1f,%d,%d,%d],\"children\":[",
+           r.seq, (long long)r.ts, r.pTemp, r.pHumid, r.pPres, r.pBat, r.pVbus, r.pSignal);
+    for (int j = 0; j < r.childCount; j++) {
+        const RtcChild& c = r.child[j];
+        if (j) printf(",");
+        if (c.received) printf("[\"%08x\",%.2f,%.2f,%.1f,%d,%d]", c.id, c.temp, c.humid, c.pres, c.rssi, c.bat);
+        else printf("[\"%08x\"]", c.id);
+    }
+    printf("]}");
+}
+
+int main(int argc, char** argv) {
+    int port = 5683, dropPct = 0;
+    const char* secret = nullptr;
+    uint8_t ackFlags = UDP_HINT_UNKNOWN;
+    int opt;
+    while ((opt = getopt(argc, argv, "p:s:d:f:")) != -1) {
+        switch (opt) {
+            case 'p': port = atoi(optarg); break;
+            case 's': secret = optarg; break;
+            case 'd': dropPct = atoi(optarg); break;
+            case 'f': ackFlags = (uint8_t)strtoul(optarg, nullptr, 0); break;
+            default:
+                fprintf(stderr, "usage: %s [-p port] [-s secret] [-d drop_percent] [-f ack_flags]\n", argv[0]);
+                return 2;
+        }
+    }
+
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(port);
+    if (fd < 0 || bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        perror("bind");
+        return 1;
+    }
+    fprintf(stderr, "[UDP] listening on :%d (drop %d%%)\n", port, dropPct);
+    srand((unsigned)time(nullptr));
+
+    static uint8_t buf[2048];
+    static RtcRound rounds[MAX_ROUNDS_PER_DGRAM];
+    unsigned long rxBytes = 0, txBytes = 0, datagrams = 0, stored = 0, dups = 0, dropped = 0;
+    double lastMs = 0;
+
+    for (;;) {
+        struct sockaddr_in from;
+        socklen_t fromLen = sizeof(from);
+        ssize_t n = recvfrom(fd, buf, sizeof(buf), 0, (struct sockaddr*)&from, &fromLen);
+        if (n <= 0) continue;
+        double t = nowMs();
+        rxBytes += n;
+        datagrams++;
+        if (dropPct > 0 && rand() % 100 < dropPct) { dropped++; continue; }
+
+        UdpAck ack = { 0, UDP_ACK_BAD, ackFlags };
+        CborBatchHeader hdr;
+        if (!udpParseData(buf, n, ack.msgId)) continue;   // 見出しの読めないものには返さない
+        if (!cborDecodeBatch(buf + UDP_FRAME_HEADER, n - UDP_FRAME_HEADER, hdr, rounds, MAX_ROUNDS_PER_DGRAM)) {
+            // BAD のまま返す
+        } else if (secret && strcmp(hdr.secret, secret) != 0) {
+            ack.status = UDP_ACK_AUTH;
+        } else if (alreadySeen(hdr.parentId, ack.msgId)) {
+            ack.status = UDP_ACK_DUPLICATE;
+            dups++;
+        } else {
+            ack.status = UDP_ACK_STORED;
+            remember(hdr.parentId, ack.msgId);
+            stored++;
+            printf("{\"parent_id\":\"%s\",\"msg_id\":%u,\"boot_count\":%u,\"bytes\":%ld",
+                   hdr.parentId, ack.msgId, hdr.bootCount, (long)n);
+            if (hdr.hasLink) {
+                const LinkStats& l = hdr.link;
+                printf(",\"link\":{\"prep_ms\":%u,\"ttfb_ms\":%u,\"rat\":%u,\"up_transport\":%u,\"up_bytes\":%u,\"up_ms\":%u,\"up_retx\":%u}",
+                       l.prepMs, l.ttfbMs, l.rat, l.upTransport, l.upBytes, l.upMs, l.upRetx);
+            }
+            if (hdr.acAckId) printf(",\"ac_ack\":%u", hdr.acAckId);
+            if (hdr.hasEnergy) printf(",\"energy\":[%u,%u,%d]", hdr.energy.tier, hdr.energy.changes, hdr.energy.charging);
+            if (hdr.seq.epoch) printf(",\"seq_epoch\":%u,\"have_from\":%u", hdr.seq.epoch, hdr.seq.haveFrom);
+            printf(",\"rounds\":[");
+            for (int i = 0; i < hdr.roundCount; i++) {
+                if (i) printf(",");
+                printRound(rounds[i]);
+            }
+            printf("]}\n");
+            fflush(stdout);
+        }
+
+        uint8_t out[UDP_ACK_BYTES];
+        size_t outLen = udpWriteAck(out, ack);
+        sendto(fd, out, outLen, 0, (struct sockaddr*)&from, fromLen);
+        txBytes += outLen;
+        fprintf(stderr, "[UDP] msg %u %s: rx %lu B tx %lu B (%lu dgram, %lu stored, %lu dup, %lu dropped) gap %.0f ms\n",
+                ack.msgId, ack.status == UDP_ACK_STORED ? "stored" : ack.status == UDP_ACK_DUPLICATE ? "dup" :
+                ack.status == UDP_ACK_AUTH ? "auth" : "bad",
+                rxBytes, txBytes, datagrams, stored, dups, dropped, lastMs ? t - lastMs : 0.0);
+        lastMs = t;
+    }
+}